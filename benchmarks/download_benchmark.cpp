@@ -0,0 +1,386 @@
+// Measures model download throughput and CPU cost against a local HTTP server.
+//
+//   download_benchmark [--size-mb N] [--connections N] [--runs N] [--direct] [--dir PATH]
+//
+// A file of pseudo-random bytes is served from 127.0.0.1 by a minimal in-process
+// server (HEAD, byte ranges, one thread per connection). Each run downloads it with
+// DownloadService and reports MB/s and the client's CPU time per MB; the server's own
+// CPU time is measured per thread and left out.
+
+#include "model/download_service.hpp"
+#include "crypto/crypto.hpp"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <Windows.h>
+using SocketHandle = SOCKET;
+#else
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <ctime>
+using SocketHandle = int;
+#endif
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <future>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+namespace
+{
+    struct Options
+    {
+        uint64_t sizeMb = 1024;
+        int connections = Model::DownloadService::DEFAULT_CONNECTIONS;
+        int runs = 3;
+        bool direct = false;
+        std::string dir = (std::filesystem::temp_directory_path() / "kolosal_download_benchmark").string();
+    };
+
+    double processCpuSeconds()
+    {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+        auto toSeconds = [](const FILETIME& t) {
+            return static_cast<double>((static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime) * 1e-7;
+        };
+        return toSeconds(kernel) + toSeconds(user);
+#else
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+            (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+    }
+
+    double threadCpuSeconds()
+    {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+        auto toSeconds = [](const FILETIME& t) {
+            return static_cast<double>((static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime) * 1e-7;
+        };
+        return toSeconds(kernel) + toSeconds(user);
+#else
+        timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+    }
+
+    void closeSocket(SocketHandle socket)
+    {
+#ifdef _WIN32
+        closesocket(socket);
+#else
+        ::close(socket);
+#endif
+    }
+
+    // Writes `size` bytes from a xorshift generator and returns their SHA-256
+    std::string createSourceFile(const std::string& path, uint64_t size)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Cannot create " + path);
+        }
+
+        Crypto::Sha256 hash;
+        std::vector<uint64_t> block(1 << 17);
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        for (uint64_t written = 0; written < size;)
+        {
+            for (auto& word : block)
+            {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                word = state;
+            }
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(block.size() * sizeof(uint64_t), size - written));
+            file.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(chunk));
+            hash.update(block.data(), chunk);
+            written += chunk;
+        }
+        return hash.finalHex();
+    }
+
+    /**
+     * @brief Serves one file over HTTP/1.1 on 127.0.0.1 with byte range support
+     *
+     * Just enough of HTTP for the download path: HEAD and GET, an optional
+     * `Range: bytes=a-b` header, a fixed ETag, and one request per connection.
+     */
+    class LocalFileServer
+    {
+    public:
+        LocalFileServer(const std::string& path, uint64_t size)
+            : m_path(path), m_size(size)
+        {
+            m_listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = 0;
+            if (bind(m_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+                listen(m_listener, 64) != 0)
+            {
+                throw std::runtime_error("Cannot start the local server");
+            }
+
+            socklen_t length = sizeof(address);
+            getsockname(m_listener, reinterpret_cast<sockaddr*>(&address), &length);
+            m_port = ntohs(address.sin_port);
+
+            m_acceptThread = std::thread([this]() { acceptLoop(); });
+        }
+
+        ~LocalFileServer()
+        {
+            m_stopping = true;
+            // Closing alone does not wake a blocked accept() on Linux
+#ifdef _WIN32
+            shutdown(m_listener, SD_BOTH);
+#else
+            shutdown(m_listener, SHUT_RDWR);
+#endif
+            closeSocket(m_listener);
+            m_acceptThread.join();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto& thread : m_connections)
+            {
+                thread.join();
+            }
+        }
+
+        std::string url() const
+        {
+            return "http://127.0.0.1:" + std::to_string(m_port) + "/model.gguf";
+        }
+
+        // CPU time spent serving requests so far, summed over all connection threads
+        double cpuSeconds() const
+        {
+            return m_cpuMicros.load() * 1e-6;
+        }
+
+    private:
+        void acceptLoop()
+        {
+            while (!m_stopping)
+            {
+                SocketHandle client = accept(m_listener, nullptr, nullptr);
+#ifdef _WIN32
+                if (client == INVALID_SOCKET)
+#else
+                if (client < 0)
+#endif
+                    break;
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_connections.emplace_back([this, client]() {
+                    double start = threadCpuSeconds();
+                    serve(client);
+                    closeSocket(client);
+                    m_cpuMicros += static_cast<uint64_t>((threadCpuSeconds() - start) * 1e6);
+                });
+            }
+        }
+
+        void serve(SocketHandle client)
+        {
+            std::string request;
+            char buffer[4096];
+            while (request.find("\r\n\r\n") == std::string::npos)
+            {
+                int received = recv(client, buffer, sizeof(buffer), 0);
+                if (received <= 0)
+                    return;
+                request.append(buffer, static_cast<size_t>(received));
+            }
+
+            bool head = request.rfind("HEAD ", 0) == 0;
+            uint64_t first = 0;
+            uint64_t last = m_size - 1;
+            bool partial = false;
+
+            size_t rangePos = request.find("Range: bytes=");
+            if (rangePos == std::string::npos)
+                rangePos = request.find("range: bytes=");
+            if (rangePos != std::string::npos)
+            {
+                const char* spec = request.c_str() + rangePos + std::strlen("Range: bytes=");
+                char* end = nullptr;
+                first = std::strtoull(spec, &end, 10);
+                if (*end == '-' && end[1] >= '0' && end[1] <= '9')
+                {
+                    last = std::min<uint64_t>(std::strtoull(end + 1, nullptr, 10), m_size - 1);
+                }
+                partial = true;
+            }
+
+            std::string header = partial ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+            header += "Accept-Ranges: bytes\r\nETag: \"benchmark\"\r\nConnection: close\r\n";
+            header += "Content-Length: " + std::to_string(last - first + 1) + "\r\n";
+            if (partial)
+            {
+                header += "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) +
+                    "/" + std::to_string(m_size) + "\r\n";
+            }
+            header += "\r\n";
+            if (!sendAll(client, header.data(), header.size()) || head)
+                return;
+
+            std::ifstream file(m_path, std::ios::binary);
+            file.seekg(static_cast<std::streamoff>(first));
+            std::vector<char> chunk(1 << 20);
+            for (uint64_t remaining = last - first + 1; remaining > 0;)
+            {
+                size_t size = static_cast<size_t>(std::min<uint64_t>(chunk.size(), remaining));
+                file.read(chunk.data(), static_cast<std::streamsize>(size));
+                if (!file || !sendAll(client, chunk.data(), size))
+                    return;
+                remaining -= size;
+            }
+        }
+
+        static bool sendAll(SocketHandle client, const char* data, size_t size)
+        {
+            while (size > 0)
+            {
+                int sent = send(client, data, static_cast<int>(std::min<size_t>(size, 1 << 20)), 0);
+                if (sent <= 0)
+                    return false;
+                data += sent;
+                size -= static_cast<size_t>(sent);
+            }
+            return true;
+        }
+
+        std::string m_path;
+        uint64_t m_size;
+        SocketHandle m_listener;
+        uint16_t m_port = 0;
+        std::atomic<bool> m_stopping{ false };
+        std::atomic<uint64_t> m_cpuMicros{ 0 };
+        std::thread m_acceptThread;
+        std::mutex m_mutex;
+        std::vector<std::thread> m_connections;
+    };
+
+    Options parseOptions(int argc, char** argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc)
+                    throw std::runtime_error("Missing value for " + arg);
+                return argv[++i];
+            };
+
+            if (arg == "--size-mb")
+                options.sizeMb = std::stoull(next());
+            else if (arg == "--connections")
+                options.connections = std::stoi(next());
+            else if (arg == "--runs")
+                options.runs = std::stoi(next());
+            else if (arg == "--direct")
+                options.direct = true;
+            else if (arg == "--dir")
+                options.dir = next();
+            else
+                throw std::runtime_error("Unknown option " + arg);
+        }
+        return options;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        Options options = parseOptions(argc, argv);
+
+#ifdef _WIN32
+        WSADATA wsaData;
+        WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        std::filesystem::create_directories(options.dir);
+
+        const uint64_t size = options.sizeMb * 1024 * 1024;
+        const std::string sourcePath = options.dir + "/source.bin";
+        const std::string targetPath = options.dir + "/target.bin";
+
+        std::cout << "Creating " << options.sizeMb << " MiB source file..." << std::endl;
+        const std::string expected = createSourceFile(sourcePath, size);
+
+        LocalFileServer server(sourcePath, size);
+        std::cout << "Serving " << server.url() << " | connections: " << options.connections
+                  << " | direct I/O: " << (options.direct ? "on" : "off") << std::endl;
+
+        for (int run = 1; run <= options.runs; ++run)
+        {
+            Model::removePartialDownload(targetPath);
+
+            Model::DownloadService service;
+            service.setMaxConnections(options.connections);
+            service.setDirectIO(options.direct);
+
+            std::promise<Model::DownloadResult> done;
+            Model::DownloadRequest request;
+            request.id = targetPath;
+            request.url = server.url();
+            request.partPath = targetPath;
+            request.onComplete = [&done](const Model::DownloadResult& result) { done.set_value(result); };
+
+            double serverCpuStart = server.cpuSeconds();
+            double cpuStart = processCpuSeconds();
+            auto wallStart = std::chrono::steady_clock::now();
+
+            service.enqueue(request);
+            Model::DownloadResult result = done.get_future().get();
+
+            double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+            double clientCpu = (processCpuSeconds() - cpuStart) - (server.cpuSeconds() - serverCpuStart);
+            double megabytes = static_cast<double>(size) / (1024.0 * 1024.0);
+
+            bool verified = result.state == Model::DownloadState::COMPLETED && result.sha256 == expected;
+            std::cout << "Run " << run << ": "
+                      << std::fixed << std::setprecision(1) << megabytes / wall << " MB/s, "
+                      << std::setprecision(3) << clientCpu * 1000.0 / megabytes << " ms CPU/MB, "
+                      << (verified ? "digest OK" : "DIGEST MISMATCH") << std::endl;
+            if (!verified)
+                return 1;
+        }
+
+        Model::removePartialDownload(targetPath);
+        std::filesystem::remove(sourcePath);
+        curl_global_cleanup();
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,136 @@
+// Measures the f16 GEMM used for prompt prefill against the naive path.
+//
+//   gemm_benchmark [--rows N] [--cols N] [--tokens N] [--threads N] [--runs N]
+//
+// Multiplies a rows x cols f16 weight matrix with `tokens` activation vectors, once
+// as one dot product per output (what prefill did before the GEMM) and once with
+// gemmF16(), both on the same thread pool. Reports GFLOP/s of each and the largest
+// difference between their results.
+
+#include "inference/gemm_f16.hpp"
+#include "inference/tensor_ops.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        int64_t rows = 3072;
+        int64_t cols = 3072;
+        size_t tokens = 512;
+        unsigned int threads = 0;
+        int runs = 3;
+    };
+
+    Options parseOptions(int argc, char** argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc)
+                    throw std::runtime_error("Missing value for " + arg);
+                return argv[++i];
+            };
+
+            if (arg == "--rows")
+                options.rows = std::stoll(next());
+            else if (arg == "--cols")
+                options.cols = std::stoll(next());
+            else if (arg == "--tokens")
+                options.tokens = std::stoul(next());
+            else if (arg == "--threads")
+                options.threads = static_cast<unsigned int>(std::stoul(next()));
+            else if (arg == "--runs")
+                options.runs = std::stoi(next());
+            else
+                throw std::runtime_error("Unknown option " + arg);
+        }
+        return options;
+    }
+
+    template <typename Function>
+    double gflops(const Options& options, Function&& function)
+    {
+        function();
+        auto start = std::chrono::steady_clock::now();
+        for (int run = 0; run < options.runs; ++run)
+            function();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / options.runs;
+        return 2.0 * static_cast<double>(options.rows) * static_cast<double>(options.cols) * options.tokens / seconds / 1e9;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        Options options = parseOptions(argc, argv);
+#ifdef KOLOSAL_X86
+        if (!Inference::cpuFeatures().avx2)
+            throw std::runtime_error("The f16 GEMM needs AVX2, FMA and F16C");
+
+        std::mt19937 rng(1234);
+        std::normal_distribution<float> normal(0.0f, 1.0f);
+        std::vector<uint16_t> weights(static_cast<size_t>(options.rows * options.cols));
+        for (auto& weight : weights)
+            weight = Model::fp32ToFp16(normal(rng) * 0.05f);
+        std::vector<float> x(options.tokens * static_cast<size_t>(options.cols));
+        for (auto& value : x)
+            value = normal(rng);
+
+        std::vector<float> naive(options.tokens * static_cast<size_t>(options.rows));
+        std::vector<float> blocked(naive.size());
+        Inference::ThreadPool pool(options.threads);
+
+        std::cout << "f16 " << options.rows << " x " << options.cols << " times " << options.tokens
+                  << " tokens on " << pool.size() << " threads" << std::endl;
+
+        double naiveGflops = gflops(options, [&]() {
+            pool.parallelFor(static_cast<size_t>(options.rows), [&](size_t begin, size_t end) {
+                for (size_t r = begin; r < end; ++r)
+                {
+                    const uint16_t* row = weights.data() + r * options.cols;
+                    for (size_t t = 0; t < options.tokens; ++t)
+                        naive[t * options.rows + r] = Inference::dotF16(row, x.data() + t * options.cols, options.cols);
+                }
+            });
+        });
+
+        double gemmGflops = gflops(options, [&]() {
+            Inference::gemmF16(weights.data(), options.rows, options.cols, x.data(), options.tokens, blocked.data(), pool);
+        });
+
+        double maxDiff = 0.0, maxValue = 0.0;
+        for (size_t i = 0; i < naive.size(); ++i)
+        {
+            maxDiff = std::max(maxDiff, static_cast<double>(std::fabs(naive[i] - blocked[i])));
+            maxValue = std::max(maxValue, static_cast<double>(std::fabs(naive[i])));
+        }
+
+        std::cout << std::fixed << std::setprecision(1)
+                  << "  naive  " << std::setw(8) << naiveGflops << " GFLOP/s" << std::endl
+                  << "  gemm   " << std::setw(8) << gemmGflops << " GFLOP/s ("
+                  << gemmGflops / naiveGflops << "x)" << std::endl
+                  << std::scientific << std::setprecision(2)
+                  << "  max difference " << maxDiff << " (max |y| " << maxValue << ")" << std::endl;
+        return maxDiff <= 1e-4 * std::max(1.0, maxValue) ? 0 : 1;
+#else
+        (void)options;
+        throw std::runtime_error("The f16 GEMM is only built for x86");
+#endif
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,222 @@
+// Measures prompt processing and generation speed of the CPU inference engine.
+//
+//   inference_benchmark --model PATH [--prompt TEXT] [--tokens N] [--threads N] [--pin]
+//                       [--runs N] [--turns N] [--temperature T] [--kv-type f32|f16|q8_0|q4_0]
+//                       [--draft PATH] [--draft-tokens N] [--print]
+//
+// Each run starts from an empty KV cache and holds a conversation of --turns user
+// messages, each answered before the next is sent. Every turn reports how many prompt
+// tokens were prefilled and how many were reused from the cache, prefill and decode
+// throughput in tokens per second, and the KV cache memory in use. The end-of-turn
+// token is suppressed so every reply is exactly --tokens tokens.
+//
+// --draft runs everything twice, without and then with speculative decoding using the
+// draft model (e.g. Llama 3.2 1B for 3B), and reports the share of drafted tokens that
+// were accepted, the decode and end-to-end speedup, and for greedy decoding whether
+// both produced the same replies.
+
+#include "inference/llama_engine.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        std::string model;
+        std::string prompt = "Write a short story about a lighthouse keeper who finds a message in a bottle.";
+        int tokens = 128;
+        unsigned int threads = 0;
+        bool pin = false;
+        int runs = 3;
+        int turns = 1;
+        float temperature = 0.0f;
+        Model::GGMLType kvType = Model::GGMLType::F16;
+        std::string draft;
+        int draftTokens = 8;
+        bool print = false;
+    };
+
+    struct Totals
+    {
+        size_t generatedTokens = 0;
+        size_t draftedTokens = 0;
+        size_t acceptedDraftTokens = 0;
+        double prefillSeconds = 0.0;
+        double decodeSeconds = 0.0;
+        std::string replies; // of the first run
+    };
+
+    Model::GGMLType parseKVType(const std::string& name)
+    {
+        for (Model::GGMLType type : { Model::GGMLType::F32, Model::GGMLType::F16, Model::GGMLType::Q8_0, Model::GGMLType::Q4_0 })
+        {
+            if (name == Model::ggmlTypeName(type))
+                return type;
+        }
+        throw std::runtime_error("Unsupported KV cache type " + name);
+    }
+
+    Options parseOptions(int argc, char** argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc)
+                    throw std::runtime_error("Missing value for " + arg);
+                return argv[++i];
+            };
+
+            if (arg == "--model")
+                options.model = next();
+            else if (arg == "--prompt")
+                options.prompt = next();
+            else if (arg == "--tokens")
+                options.tokens = std::stoi(next());
+            else if (arg == "--threads")
+                options.threads = static_cast<unsigned int>(std::stoul(next()));
+            else if (arg == "--pin")
+                options.pin = true;
+            else if (arg == "--runs")
+                options.runs = std::stoi(next());
+            else if (arg == "--turns")
+                options.turns = std::stoi(next());
+            else if (arg == "--temperature")
+                options.temperature = std::stof(next());
+            else if (arg == "--kv-type")
+                options.kvType = parseKVType(next());
+            else if (arg == "--draft")
+                options.draft = next();
+            else if (arg == "--draft-tokens")
+                options.draftTokens = std::stoi(next());
+            else if (arg == "--print")
+                options.print = true;
+            else
+                throw std::runtime_error("Unknown option " + arg);
+        }
+
+        if (options.model.empty())
+            throw std::runtime_error("--model is required");
+        if (options.draftTokens < 1)
+            throw std::runtime_error("--draft-tokens must be at least 1");
+        return options;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        Options options = parseOptions(argc, argv);
+
+        auto loadStart = std::chrono::steady_clock::now();
+        auto file = std::make_shared<const Model::GGUFFile>(options.model);
+        Inference::ThreadPoolOptions threads;
+        threads.threadCount = options.threads;
+        threads.pinThreads = options.pin;
+        Inference::KVCacheOptions kvCache;
+        kvCache.type = options.kvType;
+        Inference::LlamaEngine engine(threads, Inference::LlamaEngine::DEFAULT_CONTEXT_LENGTH, kvCache);
+        engine.loadModel(file);
+        double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+
+        const auto& hparams = engine.model()->hparams();
+        std::cout << "Model: " << options.model << " | layers: " << hparams.nLayer
+                  << " | embedding: " << hparams.nEmbd << " | vocab: " << hparams.nVocab
+                  << " | threads: " << engine.threadCount() << " | kv: " << Model::ggmlTypeName(options.kvType)
+                  << " | load: " << std::fixed << std::setprecision(1) << loadSeconds * 1000.0 << " ms" << std::endl;
+
+        if (!options.draft.empty())
+        {
+            auto draftStart = std::chrono::steady_clock::now();
+            engine.loadDraftModel(std::make_shared<const Model::GGUFFile>(options.draft));
+            std::cout << "Draft: " << options.draft << " | load: "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - draftStart).count() << " ms" << std::endl;
+        }
+
+        Inference::GenerationParams params;
+        params.sampling.temperature = options.temperature;
+        params.minLength = options.tokens;
+        params.maxNewTokens = options.tokens;
+        params.conversationId = 0;
+
+        auto runAll = [&](int draftTokens) {
+            Totals totals;
+            params.draftTokens = draftTokens;
+            for (int run = 1; run <= options.runs; ++run)
+            {
+                engine.clearCache();
+                std::vector<Inference::ChatMessage> messages = { { "user", options.prompt } };
+                for (int turn = 1; turn <= options.turns; ++turn)
+                {
+                    std::string reply;
+                    Inference::GenerationStats stats = engine.generate(messages, params, [&](const std::string& piece) {
+                        reply += piece;
+                        return true;
+                    });
+
+                    std::cout << "Run " << run;
+                    if (options.turns > 1)
+                        std::cout << " turn " << turn;
+                    std::cout << ": prompt " << stats.promptTokens << " tokens (" << stats.reusedPromptTokens << " cached), "
+                              << std::setprecision(1) << stats.prefillTokensPerSecond() << " tok/s, "
+                              << stats.prefillSeconds * 1000.0 << " ms | generated "
+                              << stats.generatedTokens << " tokens, "
+                              << stats.decodeTokensPerSecond() << " tok/s | kv cache "
+                              << engine.kvCacheBytes() / (1024.0 * 1024.0) << " MiB";
+                    if (stats.draftedTokens > 0)
+                        std::cout << " | draft " << stats.acceptedDraftTokens << "/" << stats.draftedTokens << " accepted";
+                    std::cout << std::endl;
+                    if (options.print && run == 1)
+                        std::cout << reply << std::endl;
+
+                    totals.generatedTokens += stats.generatedTokens;
+                    totals.draftedTokens += stats.draftedTokens;
+                    totals.acceptedDraftTokens += stats.acceptedDraftTokens;
+                    totals.prefillSeconds += stats.prefillSeconds;
+                    totals.decodeSeconds += stats.decodeSeconds;
+                    if (run == 1)
+                        totals.replies += reply + "\n";
+
+                    messages.push_back({ "assistant", reply });
+                    messages.push_back({ "user", "Please continue." });
+                }
+            }
+            return totals;
+        };
+
+        if (options.draft.empty())
+        {
+            runAll(0);
+            return 0;
+        }
+
+        std::cout << "Without draft model:" << std::endl;
+        const Totals plain = runAll(0);
+        std::cout << "With draft model (up to " << options.draftTokens << " tokens per step):" << std::endl;
+        const Totals speculative = runAll(options.draftTokens);
+
+        auto rate = [](const Totals& totals) { return totals.generatedTokens / totals.decodeSeconds; };
+        std::cout << "Speculative decoding: " << std::setprecision(1)
+                  << 100.0 * static_cast<double>(speculative.acceptedDraftTokens) / std::max<size_t>(1, speculative.draftedTokens)
+                  << "% of " << speculative.draftedTokens << " drafted tokens accepted | decode " << rate(plain) << " -> "
+                  << rate(speculative) << " tok/s (" << std::setprecision(2) << rate(speculative) / rate(plain) << "x) | end to end "
+                  << (plain.prefillSeconds + plain.decodeSeconds) / (speculative.prefillSeconds + speculative.decodeSeconds) << "x";
+        if (options.temperature <= 0.0f)
+            std::cout << " | same replies: " << (plain.replies == speculative.replies ? "yes" : "no");
+        std::cout << std::endl;
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,228 @@
+// Checks and times the quantized matrix-vector kernels for every instruction set the
+// CPU supports.
+//
+//   kernel_benchmark [--rows N] [--cols N] [--runs N] [--check]
+//
+// --check compares each SIMD kernel with the scalar one on random q4_K and q6_K rows
+// (and the scalar one with a float reference) and exits non-zero on a mismatch.
+// Timings are single-threaded matrix-vector products over a rows x cols weight matrix,
+// reported as microseconds per product and GB/s of weights read.
+
+#include "inference/quant_kernels.hpp"
+#include "inference/tensor_ops.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        int64_t rows = 3072;
+        int64_t cols = 3072;
+        int runs = 20;
+        bool check = false;
+    };
+
+    Options parseOptions(int argc, char** argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc)
+                    throw std::runtime_error("Missing value for " + arg);
+                return argv[++i];
+            };
+
+            if (arg == "--rows")
+                options.rows = std::stoll(next());
+            else if (arg == "--cols")
+                options.cols = std::stoll(next());
+            else if (arg == "--runs")
+                options.runs = std::stoi(next());
+            else if (arg == "--check")
+                options.check = true;
+            else
+                throw std::runtime_error("Unknown option " + arg);
+        }
+
+        if (options.cols % Model::QK_K != 0)
+            throw std::runtime_error("--cols must be a multiple of 256");
+        return options;
+    }
+
+    std::vector<Inference::KernelIsa> supportedIsas()
+    {
+        std::vector<Inference::KernelIsa> isas;
+        for (auto isa : { Inference::KernelIsa::SCALAR, Inference::KernelIsa::AVX2,
+                 Inference::KernelIsa::AVX512, Inference::KernelIsa::AVX512_VNNI })
+        {
+            if (Inference::isKernelIsaSupported(isa))
+                isas.push_back(isa);
+        }
+        return isas;
+    }
+
+    // Blocks with every byte random, so all scale and quant bit patterns occur
+    template <typename Block>
+    std::vector<Block> randomBlocks(size_t count, std::mt19937& rng)
+    {
+        std::uniform_int_distribution<int> byte(0, 255);
+        std::uniform_real_distribution<float> scale(-0.02f, 0.02f);
+        std::vector<Block> blocks(count);
+        for (auto& block : blocks)
+        {
+            auto* bytes = reinterpret_cast<uint8_t*>(&block);
+            for (size_t i = 0; i < sizeof(Block); ++i)
+                bytes[i] = static_cast<uint8_t>(byte(rng));
+            block.d = Model::fp32ToFp16(scale(rng));
+            if constexpr (std::is_same_v<Block, Model::BlockQ4_K>)
+                block.dmin = Model::fp32ToFp16(scale(rng));
+        }
+        return blocks;
+    }
+
+    std::vector<float> randomFloats(size_t count, std::mt19937& rng)
+    {
+        std::normal_distribution<float> normal(0.0f, 1.0f);
+        std::vector<float> values(count);
+        for (auto& value : values)
+            value = normal(rng);
+        return values;
+    }
+
+    // Runs `trials` random dot products of length n; returns false on a mismatch
+    template <typename Block>
+    bool checkKernels(const char* name, Model::GGMLType type, Inference::DotQ8_KFunction Inference::QuantKernels::*kernel,
+        int64_t n, int trials, std::mt19937& rng)
+    {
+        const size_t blocks = static_cast<size_t>(n / Model::QK_K);
+        std::vector<float> weights(static_cast<size_t>(n));
+        std::vector<Model::BlockQ8_K> quantized(blocks);
+        double worstSimd = 0.0, worstScalar = 0.0;
+
+        for (int trial = 0; trial < trials; ++trial)
+        {
+            std::vector<Block> row = randomBlocks<Block>(blocks, rng);
+            std::vector<float> x = randomFloats(static_cast<size_t>(n), rng);
+            Model::quantizeRowQ8_K(x.data(), quantized.data(), n);
+            Inference::dequantizeRow(type, row.data(), weights.data(), n);
+
+            // Scale for the tolerances: the dot product of the magnitudes
+            double exact = 0.0, magnitude = 0.0;
+            for (int64_t i = 0; i < n; ++i)
+            {
+                exact += static_cast<double>(weights[i]) * x[i];
+                magnitude += std::fabs(static_cast<double>(weights[i]) * x[i]);
+            }
+            magnitude = std::max(magnitude, 1e-30);
+
+            const float scalar = (Inference::quantKernelsFor(Inference::KernelIsa::SCALAR).*kernel)(row.data(), quantized.data(), n);
+            const double scalarError = std::fabs(scalar - exact) / magnitude;
+            worstScalar = std::max(worstScalar, scalarError);
+            if (scalarError > 2e-2)
+            {
+                std::cerr << name << " scalar: " << scalar << " vs float reference " << exact << std::endl;
+                return false;
+            }
+
+            for (auto isa : supportedIsas())
+            {
+                const float value = (Inference::quantKernelsFor(isa).*kernel)(row.data(), quantized.data(), n);
+                const double error = std::fabs(static_cast<double>(value) - scalar) / magnitude;
+                worstSimd = std::max(worstSimd, error);
+                if (error > 1e-5)
+                {
+                    std::cerr << name << " " << Inference::kernelIsaName(isa) << ": " << value
+                              << " vs scalar " << scalar << " (n = " << n << ")" << std::endl;
+                    return false;
+                }
+            }
+        }
+
+        std::cout << name << " n=" << std::setw(5) << n << ": OK | max error vs scalar "
+                  << std::scientific << std::setprecision(2) << worstSimd
+                  << ", scalar vs float " << worstScalar << std::defaultfloat << std::endl;
+        return true;
+    }
+
+    template <typename Block>
+    void benchmarkKernels(const char* name, Model::GGMLType type, Inference::DotQ8_KFunction Inference::QuantKernels::*kernel,
+        const Options& options, std::mt19937& rng)
+    {
+        const size_t blocksPerRow = static_cast<size_t>(options.cols / Model::QK_K);
+        std::vector<Block> matrix = randomBlocks<Block>(blocksPerRow * static_cast<size_t>(options.rows), rng);
+        std::vector<float> x = randomFloats(static_cast<size_t>(options.cols), rng);
+        std::vector<Model::BlockQ8_K> quantized(blocksPerRow);
+        std::vector<float> y(static_cast<size_t>(options.rows));
+        const double bytes = static_cast<double>(matrix.size() * sizeof(Block));
+
+        auto report = [&](const std::string& label, auto&& matVec) {
+            matVec();
+            auto start = std::chrono::steady_clock::now();
+            for (int run = 0; run < options.runs; ++run)
+                matVec();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / options.runs;
+            std::cout << "  " << std::left << std::setw(14) << label << std::right << std::fixed
+                      << std::setprecision(1) << std::setw(10) << seconds * 1e6 << " us"
+                      << std::setw(10) << bytes / seconds / 1e9 << " GB/s" << std::defaultfloat << std::endl;
+        };
+
+        std::cout << name << " " << options.rows << " x " << options.cols << ":" << std::endl;
+
+        // The float kernels dotRow() used before the integer ones existed
+        report("float", [&]() {
+            for (int64_t r = 0; r < options.rows; ++r)
+                y[r] = Inference::dotRow(type, matrix.data() + r * blocksPerRow, x.data(), options.cols);
+        });
+
+        for (auto isa : supportedIsas())
+        {
+            const Inference::DotQ8_KFunction dot = Inference::quantKernelsFor(isa).*kernel;
+            report(Inference::kernelIsaName(isa), [&]() {
+                Model::quantizeRowQ8_K(x.data(), quantized.data(), options.cols);
+                for (int64_t r = 0; r < options.rows; ++r)
+                    y[r] = dot(matrix.data() + r * blocksPerRow, quantized.data(), options.cols);
+            });
+        }
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        Options options = parseOptions(argc, argv);
+        std::mt19937 rng(1234);
+
+        std::cout << "Selected kernels: " << Inference::kernelIsaName(Inference::quantKernels().isa) << std::endl;
+
+        if (options.check)
+        {
+            bool ok = true;
+            for (int64_t n : { 256, 512, 3072, 8192 })
+            {
+                ok = checkKernels<Model::BlockQ4_K>("q4_K", Model::GGMLType::Q4_K, &Inference::QuantKernels::q4_K, n, 200, rng) && ok;
+                ok = checkKernels<Model::BlockQ6_K>("q6_K", Model::GGMLType::Q6_K, &Inference::QuantKernels::q6_K, n, 200, rng) && ok;
+            }
+            if (!ok)
+                return 1;
+        }
+
+        benchmarkKernels<Model::BlockQ4_K>("q4_K", Model::GGMLType::Q4_K, &Inference::QuantKernels::q4_K, options, rng);
+        benchmarkKernels<Model::BlockQ6_K>("q6_K", Model::GGMLType::Q6_K, &Inference::QuantKernels::q6_K, options, rng);
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
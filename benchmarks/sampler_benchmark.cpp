@@ -0,0 +1,320 @@
+// Checks and times the token sampler.
+//
+//   sampler_benchmark [--vocab N] [--runs N] [--check]
+//
+// Times Sampler::sample() on logits shaped like a language model's (a few likely tokens
+// over a long tail) for greedy decoding, the default preset, top-p only, top-k only
+// and no truncation, next to a reference that sorts the whole vocabulary, and reports
+// microseconds per token.
+//
+// --check compares the candidates and probabilities of every configuration with the
+// reference, checks the vectorized exp against std::exp, that a seed reproduces its
+// tokens, that tokens with -inf logits are never picked and that speculative sampling
+// (accept a drafted token or draw from the residual) picks tokens as sample() would.
+
+#include "inference/sampler.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        size_t vocab = 128256;
+        int runs = 200;
+        bool check = false;
+    };
+
+    Options parseOptions(int argc, char** argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc)
+                    throw std::runtime_error("Missing value for " + arg);
+                return argv[++i];
+            };
+
+            if (arg == "--vocab")
+                options.vocab = std::stoul(next());
+            else if (arg == "--runs")
+                options.runs = std::stoi(next());
+            else if (arg == "--check")
+                options.check = true;
+            else
+                throw std::runtime_error("Unknown option " + arg);
+        }
+
+        if (options.vocab < 16)
+            throw std::runtime_error("--vocab must be at least 16");
+        return options;
+    }
+
+    struct Config
+    {
+        const char* name;
+        Inference::SamplingParams params;
+    };
+
+    std::vector<Config> configs()
+    {
+        return {
+            { "greedy", { 0.0f, 1.0f, 0, 42 } },
+            { "preset (T 0.7, k 50, p 0.9)", { 0.7f, 0.9f, 50, 42 } },
+            { "top-p 0.95", { 0.8f, 0.95f, 0, 42 } },
+            { "top-k 1000", { 1.0f, 1.0f, 1000, 42 } },
+            { "no truncation", { 1.0f, 1.0f, 0, 42 } },
+        };
+    }
+
+    // A long normal tail with a handful of tokens well above it, as after a forward pass
+    std::vector<float> modelLikeLogits(size_t vocab, std::mt19937& rng)
+    {
+        std::normal_distribution<float> tail(0.0f, 2.0f);
+        std::uniform_int_distribution<size_t> token(0, vocab - 1);
+        std::vector<float> logits(vocab);
+        for (float& logit : logits)
+        {
+            logit = tail(rng);
+        }
+        for (int i = 0; i < 8; ++i)
+        {
+            logits[token(rng)] = 14.0f - static_cast<float>(i);
+        }
+        return logits;
+    }
+
+    // The specification: sort everything, keep k, softmax with temperature, keep the nucleus
+    std::vector<Inference::TokenCandidate> referenceCandidates(const std::vector<float>& logits, const Inference::SamplingParams& params)
+    {
+        std::vector<Inference::TokenCandidate> candidates;
+        for (size_t i = 0; i < logits.size(); ++i)
+        {
+            candidates.push_back({ logits[i], static_cast<int32_t>(i) });
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+            return a.value > b.value || (a.value == b.value && a.token < b.token);
+        });
+
+        if (params.temperature <= 0.0f)
+            return { { 1.0f, candidates[0].token } };
+        if (params.topK > 0 && static_cast<size_t>(params.topK) < candidates.size())
+            candidates.resize(static_cast<size_t>(params.topK));
+
+        const double maxLogit = candidates[0].value;
+        double sum = 0.0;
+        std::vector<double> weights;
+        for (const auto& candidate : candidates)
+        {
+            weights.push_back(std::exp((candidate.value - maxLogit) / params.temperature));
+            sum += weights.back();
+        }
+
+        double cumulative = 0.0;
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            candidates[i].value = static_cast<float>(weights[i] / sum);
+            cumulative += weights[i] / sum;
+            if (params.topP < 1.0f && cumulative >= params.topP)
+            {
+                candidates.resize(i + 1);
+                break;
+            }
+        }
+        return candidates;
+    }
+
+    int failures = 0;
+
+    void expect(bool condition, const std::string& what)
+    {
+        if (!condition)
+        {
+            std::cout << "  FAIL: " << what << std::endl;
+            ++failures;
+        }
+    }
+
+    void runChecks(const Options& options)
+    {
+        // The vectorized exp against std::exp over the range softmax uses
+        {
+            std::vector<float> x, out(20001);
+            for (int i = 0; i <= 20000; ++i)
+            {
+                x.push_back(-87.0f + 87.0f * static_cast<float>(i) / 20000.0f);
+            }
+            Inference::detail::expSum(x.data(), x.size(), 0.0f, 1.0f, out.data());
+            double worst = 0.0;
+            for (size_t i = 0; i < x.size(); ++i)
+            {
+                worst = std::max(worst, std::abs(out[i] / std::exp(static_cast<double>(x[i])) - 1.0));
+            }
+            expect(worst < 1e-6, "exp relative error " + std::to_string(worst));
+        }
+
+        std::mt19937 rng(7);
+        for (int trial = 0; trial < 5; ++trial)
+        {
+            std::vector<float> logits = modelLikeLogits(options.vocab, rng);
+            if (trial == 1)
+            {
+                // A flat distribution makes top-p take most of the vocabulary
+                for (float& logit : logits)
+                    logit *= 0.01f;
+            }
+            if (trial == 2)
+            {
+                // Ties, decided by token id
+                for (size_t i = 0; i < logits.size(); ++i)
+                    logits[i] = static_cast<float>(static_cast<int>(logits[i]));
+            }
+
+            for (const auto& config : configs())
+            {
+                Inference::Sampler sampler(config.params);
+                std::vector<Inference::TokenCandidate> actual = sampler.candidates(logits.data(), logits.size());
+                std::vector<Inference::TokenCandidate> expected = referenceCandidates(logits, config.params);
+                const std::string what = std::string(config.name) + " (trial " + std::to_string(trial) + ")";
+
+                const bool keepsTopK = config.params.topK == 0 || static_cast<size_t>(config.params.topK) >= logits.size();
+                if (config.params.temperature > 0.0f && keepsTopK && config.params.topP >= 1.0f)
+                {
+                    // Untruncated candidates come in token order
+                    std::sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) { return a.token < b.token; });
+                }
+
+                // Rounding may move the nucleus boundary by one token
+                const size_t common = std::min(actual.size(), expected.size());
+                expect(actual.size() + 1 >= expected.size() && expected.size() + 1 >= actual.size(),
+                    what + ": " + std::to_string(actual.size()) + " candidates instead of " + std::to_string(expected.size()));
+                bool same = true;
+                for (size_t i = 0; i < common; ++i)
+                {
+                    same = same && actual[i].token == expected[i].token &&
+                        std::abs(actual[i].value - expected[i].value) <= 1e-5f * expected[i].value + 1e-9f;
+                }
+                expect(same, what + ": candidates differ from the reference");
+            }
+        }
+
+        // A seed reproduces its tokens, and suppressed tokens are never picked
+        std::vector<float> logits = modelLikeLogits(options.vocab, rng);
+        for (size_t i = 0; i < logits.size(); i += 3)
+        {
+            logits[i] = -std::numeric_limits<float>::infinity();
+        }
+        for (const auto& config : configs())
+        {
+            Inference::Sampler first(config.params), second(config.params);
+            bool reproducible = true, suppressed = true;
+            for (int i = 0; i < 200; ++i)
+            {
+                const int32_t token = first.sample(logits.data(), logits.size());
+                reproducible = reproducible && token == second.sample(logits.data(), logits.size());
+                suppressed = suppressed && token % 3 != 0;
+            }
+            expect(reproducible, std::string(config.name) + ": the same seed gave different tokens");
+            expect(suppressed, std::string(config.name) + ": picked a token with a -inf logit");
+        }
+
+        // Drafting from one distribution and verifying against another gives the other's
+        {
+            // Flat enough that top-p drops a good part of both distributions
+            std::normal_distribution<float> spread(0.0f, 1.0f);
+            std::vector<float> targetLogits(64), draftLogits(64);
+            for (size_t i = 0; i < 64; ++i)
+            {
+                targetLogits[i] = spread(rng);
+                draftLogits[i] = targetLogits[i] + spread(rng);
+            }
+            Inference::Sampler target({ 0.8f, 0.7f, 40, 1 }), draft({ 1.0f, 0.8f, 0, 2 });
+            const std::vector<Inference::TokenCandidate> p = target.candidates(targetLogits.data(), targetLogits.size());
+            const std::vector<Inference::TokenCandidate> q = draft.candidates(draftLogits.data(), draftLogits.size());
+
+            const int trials = 200000;
+            std::vector<int> counts(64, 0);
+            for (int i = 0; i < trials; ++i)
+            {
+                const int32_t drafted = draft.draw(q);
+                ++counts[static_cast<size_t>(target.accept(p, q, drafted) ? drafted : target.sampleResidual(p, q))];
+            }
+
+            // Top-p leaves less than the whole mass; sample() draws in proportion to it
+            double mass = 0.0;
+            for (const auto& candidate : p)
+                mass += candidate.value;
+            std::vector<double> expected(64, 0.0);
+            for (const auto& candidate : p)
+                expected[static_cast<size_t>(candidate.token)] = candidate.value / mass;
+            double worst = 0.0;
+            for (size_t token = 0; token < counts.size(); ++token)
+            {
+                // In standard deviations of the binomial count
+                const double sigma = std::sqrt(trials * expected[token] * (1.0 - expected[token])) + 1.0;
+                worst = std::max(worst, std::abs(counts[token] - trials * expected[token]) / sigma);
+            }
+            expect(worst < 5.0, "speculative sampling is off by " + std::to_string(worst) + " standard deviations");
+        }
+
+        std::cout << "Checks: " << (failures == 0 ? "all passed" : std::to_string(failures) + " failures") << std::endl;
+    }
+
+    template <typename Fn>
+    double microsecondsPerCall(int runs, Fn&& fn)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int run = 0; run < runs; ++run)
+        {
+            fn();
+        }
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / runs;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        Options options = parseOptions(argc, argv);
+        std::cout << "Vocabulary: " << options.vocab << " | AVX2: " << (Inference::cpuFeatures().avx2 ? "yes" : "no") << std::endl;
+
+        if (options.check)
+        {
+            runChecks(options);
+            if (failures > 0)
+                return 1;
+        }
+
+        std::mt19937 rng(1);
+        const std::vector<float> logits = modelLikeLogits(options.vocab, rng);
+        volatile int32_t sink = 0;
+        for (const auto& config : configs())
+        {
+            Inference::Sampler sampler(config.params);
+            const double sampled = microsecondsPerCall(options.runs, [&]() {
+                sink = sampler.sample(logits.data(), logits.size());
+            });
+            const double reference = microsecondsPerCall(std::max(1, options.runs / 10), [&]() {
+                sink = referenceCandidates(logits, config.params)[0].token;
+            });
+            std::cout << std::left << std::setw(30) << config.name << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(9) << sampled << " us/token   (full sort " << std::setw(8) << reference << " us)" << std::endl;
+        }
+        (void)sink;
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
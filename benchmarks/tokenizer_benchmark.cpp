@@ -0,0 +1,303 @@
+// Measures tokenizer throughput and checks its output.
+//
+//   tokenizer_benchmark --model PATH [--input FILE] [--size MB] [--runs N] [--check]
+//
+// Encodes the contents of --input (or --size MB of generated mixed text: prose,
+// code, numbers, non-Latin scripts and long runs of one character) --runs times and
+// reports encode and decode throughput in MB/s.
+//
+// --check compares encode() with a plain rank-ordered merge loop over string pairs,
+// which is how byte-level BPE is specified, on the input and on edge cases; checks
+// that decoding returns the original text and that special tokens are recognized
+// only when asked to; and for the Llama 3 vocabulary checks known token ids.
+
+#include "inference/tokenizer.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        std::string model;
+        std::string input;
+        double sizeMB = 8.0;
+        int runs = 3;
+        bool check = false;
+    };
+
+    Options parseOptions(int argc, char** argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc)
+                    throw std::runtime_error("Missing value for " + arg);
+                return argv[++i];
+            };
+
+            if (arg == "--model")
+                options.model = next();
+            else if (arg == "--input")
+                options.input = next();
+            else if (arg == "--size")
+                options.sizeMB = std::stod(next());
+            else if (arg == "--runs")
+                options.runs = std::stoi(next());
+            else if (arg == "--check")
+                options.check = true;
+            else
+                throw std::runtime_error("Unknown option " + arg);
+        }
+
+        if (options.model.empty())
+            throw std::runtime_error("--model is required");
+        return options;
+    }
+
+    std::string generateText(size_t bytes)
+    {
+        static const char* pieces[] = {
+            "The quick brown fox jumps over the lazy dog. ", "It's what they'll say, isn't it? ",
+            "for (size_t i = 0; i < n; ++i)\n    sum += a[i] * b[i];\n", "    return std::make_pair(x, y);\n",
+            "1234567890 ", "3.14159 ", "$42,000.00 ", "\n\n", "\t\t", "   ",
+            "Héllo wörld, ça va? ", "Привет, мир! ", "你好，世界。", "こんにちは ", "مرحبا بالعالم ", "😀🎉 ",
+            "https://example.com/path?query=1&b=2 ", "<div class=\"x\">text</div> ", "!!!???... ",
+        };
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<size_t> pick(0, sizeof(pieces) / sizeof(pieces[0]) - 1);
+        std::uniform_int_distribution<int> rare(0, 999);
+
+        std::string text;
+        text.reserve(bytes + 1024);
+        while (text.size() < bytes)
+        {
+            if (rare(rng) == 0)
+                text.append(2000, "a=- "[rng() % 4]); // pasted runs that merge into one long word
+            else
+                text += pieces[pick(rng)];
+        }
+        return text;
+    }
+
+    // Byte-level BPE as specified: merge the lowest-ranked adjacent pair until none is left
+    class ReferenceBpe
+    {
+    public:
+        ReferenceBpe(const Model::GGUFFile& file, const Inference::Tokenizer& tokenizer)
+            : m_tokenizer(tokenizer)
+        {
+            if (const Model::GGUFArray* merges = file.getArray("tokenizer.ggml.merges"))
+            {
+                for (size_t i = 0; i < merges->strings.size(); ++i)
+                {
+                    std::string_view merge = merges->strings[i];
+                    size_t space = merge.find(' ', 1);
+                    if (space != std::string_view::npos)
+                        m_ranks.emplace(std::make_pair(std::string(merge.substr(0, space)), std::string(merge.substr(space + 1))), static_cast<int>(i));
+                }
+            }
+
+            int extra = 0;
+            for (int b = 0; b < 256; ++b)
+            {
+                const bool printable = (b >= 33 && b <= 126) || (b >= 161 && b <= 172) || (b >= 174 && b <= 255);
+                Inference::unicode::appendUtf8(m_bytes[static_cast<size_t>(b)], printable ? static_cast<uint32_t>(b) : static_cast<uint32_t>(256 + extra++));
+            }
+        }
+
+        std::vector<int32_t> encode(std::string_view text) const
+        {
+            std::vector<int32_t> ids;
+            for (std::string_view word : Inference::Tokenizer::preTokenize(text))
+            {
+                std::string mapped;
+                std::vector<std::string> symbols;
+                for (char c : word)
+                {
+                    mapped += m_bytes[static_cast<uint8_t>(c)];
+                    symbols.push_back(m_bytes[static_cast<uint8_t>(c)]);
+                }
+                if (auto id = m_tokenizer.tokenId(mapped))
+                {
+                    ids.push_back(*id);
+                    continue;
+                }
+
+                while (symbols.size() > 1)
+                {
+                    int bestRank = std::numeric_limits<int>::max();
+                    size_t best = 0;
+                    for (size_t i = 0; i + 1 < symbols.size(); ++i)
+                    {
+                        auto it = m_ranks.find({ symbols[i], symbols[i + 1] });
+                        if (it != m_ranks.end() && it->second < bestRank && m_tokenizer.tokenId(symbols[i] + symbols[i + 1]))
+                        {
+                            bestRank = it->second;
+                            best = i;
+                        }
+                    }
+                    if (bestRank == std::numeric_limits<int>::max())
+                        break;
+                    symbols[best] += symbols[best + 1];
+                    symbols.erase(symbols.begin() + static_cast<std::ptrdiff_t>(best) + 1);
+                }
+
+                for (const auto& symbol : symbols)
+                {
+                    if (auto id = m_tokenizer.tokenId(symbol))
+                        ids.push_back(*id);
+                }
+            }
+            return ids;
+        }
+
+    private:
+        const Inference::Tokenizer& m_tokenizer;
+        std::map<std::pair<std::string, std::string>, int> m_ranks;
+        std::array<std::string, 256> m_bytes;
+    };
+
+    int failures = 0;
+
+    void expect(bool condition, const std::string& what)
+    {
+        if (!condition)
+        {
+            std::cout << "  FAIL: " << what << std::endl;
+            ++failures;
+        }
+    }
+
+    std::string printable(std::string_view text)
+    {
+        std::string shown(text.substr(0, 40));
+        for (char& c : shown)
+        {
+            if (c == '\n' || c == '\r' || c == '\t')
+                c = ' ';
+        }
+        return "\"" + shown + (text.size() > 40 ? "...\"" : "\"");
+    }
+
+    void runChecks(const Model::GGUFFile& file, const Inference::Tokenizer& tokenizer, const std::string& text)
+    {
+        ReferenceBpe reference(file, tokenizer);
+
+        std::vector<std::string> cases = {
+            "", " ", "a", "Hello world", "Hello  world", "hello\n\nworld\n", "   leading and trailing   ",
+            "It's I'M we'LL they've you'd", "12345678 1,000,000 3.14", "\r\n\r\n\t x", "!!!???", "a.b,c;d:e",
+            "Héllo wörld", "Привет мир", "你好世界", "😀😀😀 x😀", "\xff\xfe invalid \xc3", "snake_case CamelCase",
+            std::string(5000, 'a'), std::string(3000, ' ') + "x", std::string(3000, '='), std::string(1000, '\n'),
+        };
+        // Pieces of the input, so its words are compared too without the quadratic reference taking minutes
+        for (size_t offset = 0; offset < text.size() && cases.size() < 200; offset += text.size() / 100 + 1)
+        {
+            cases.push_back(text.substr(offset, 4096));
+        }
+
+        for (const auto& sample : cases)
+        {
+            const std::vector<int32_t> ids = tokenizer.encode(sample);
+            expect(ids == reference.encode(sample), "encode differs from the reference for " + printable(sample));
+            expect(tokenizer.decode(ids) == sample, "decode(encode()) differs for " + printable(sample));
+        }
+
+        // Special tokens only count as such when parsing them is requested
+        if (auto eot = tokenizer.tokenId("<|eot_id|>"))
+        {
+            const std::string marked = "a<|eot_id|>b<|eot_id|>";
+            const std::vector<int32_t> special = tokenizer.encode(marked, true);
+            const std::vector<int32_t> expected = { tokenizer.encode("a")[0], *eot, tokenizer.encode("b")[0], *eot };
+            expect(special == expected, "special tokens are not parsed in " + printable(marked));
+            expect(tokenizer.encode(marked) == reference.encode(marked), "special token text is not plain text by default");
+        }
+
+        // Known ids of the Llama 3 vocabulary
+        if (tokenizer.vocabSize() == 128256)
+        {
+            expect(tokenizer.encode("Hello world") == std::vector<int32_t>{ 9906, 1917 }, "\"Hello world\" is not [9906, 1917]");
+            expect(tokenizer.encode("<|begin_of_text|>", true) == std::vector<int32_t>{ 128000 }, "<|begin_of_text|> is not 128000");
+            expect(tokenizer.encode("<|eot_id|>", true) == std::vector<int32_t>{ 128009 }, "<|eot_id|> is not 128009");
+        }
+
+        std::cout << "Checked " << cases.size() << " texts: " << (failures == 0 ? "all match" : std::to_string(failures) + " failures") << std::endl;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        Options options = parseOptions(argc, argv);
+
+        Model::GGUFFile file(options.model);
+        auto loadStart = std::chrono::steady_clock::now();
+        Inference::Tokenizer tokenizer(file);
+        double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+
+        std::string text;
+        if (!options.input.empty())
+        {
+            std::ifstream input(options.input, std::ios::binary);
+            if (!input)
+                throw std::runtime_error("Cannot read " + options.input);
+            std::stringstream buffer;
+            buffer << input.rdbuf();
+            text = buffer.str();
+        }
+        else
+        {
+            text = generateText(static_cast<size_t>(options.sizeMB * 1024 * 1024));
+        }
+
+        std::cout << "Vocabulary: " << tokenizer.vocabSize() << " tokens | build: " << std::fixed << std::setprecision(1)
+                  << loadSeconds * 1000.0 << " ms | input: " << text.size() / (1024.0 * 1024.0) << " MiB" << std::endl;
+
+        if (options.check)
+        {
+            runChecks(file, tokenizer, text);
+            if (failures > 0)
+                return 1;
+        }
+
+        std::vector<int32_t> ids;
+        double encodeSeconds = std::numeric_limits<double>::max();
+        double decodeSeconds = std::numeric_limits<double>::max();
+        for (int run = 0; run < options.runs; ++run)
+        {
+            auto start = std::chrono::steady_clock::now();
+            ids = tokenizer.encode(text);
+            encodeSeconds = std::min(encodeSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+            start = std::chrono::steady_clock::now();
+            std::string decoded = tokenizer.decode(ids);
+            decodeSeconds = std::min(decodeSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            if (decoded.size() != text.size())
+                throw std::runtime_error("Decoded text differs in length from the input");
+        }
+
+        const double megabytes = text.size() / 1e6;
+        std::cout << "Tokens: " << ids.size() << " (" << std::setprecision(2) << static_cast<double>(text.size()) / ids.size() << " bytes each)" << std::endl
+                  << std::setprecision(1)
+                  << "  encode " << std::setw(8) << megabytes / encodeSeconds << " MB/s" << std::endl
+                  << "  decode " << std::setw(8) << megabytes / decodeSeconds << " MB/s" << std::endl;
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
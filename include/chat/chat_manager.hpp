@@ -3,6 +3,7 @@
 #pragma once
 
 #include "chat_persistence.hpp"
+#include "inference/llama_engine.hpp"
 
 #include <vector>
 #include <string>
@@ -11,6 +12,8 @@
 #include <optional>
 #include <memory>
 #include <set>
+#include <thread>
+#include <atomic>
 
 namespace Chat
 {
@@ -26,6 +29,21 @@ namespace Chat
             return instance;
         }
 
+        ~ChatManager()
+        {
+            stopGeneration();
+            if (m_generationThread.joinable())
+            {
+                m_generationThread.join();
+            }
+
+            // Keep the last conversation's context for the next start
+            if (m_engine)
+            {
+                saveEngineContext(*m_engine);
+            }
+        }
+
         // Delete copy and move operations
         ChatManager(const ChatManager&) = delete;
         ChatManager& operator=(const ChatManager&) = delete;
@@ -118,6 +136,8 @@ namespace Chat
                 auto saveResult = m_persistence->saveChat(chat).get();
                 if (saveResult) 
                 {
+                    // Deleting the old chat also deletes its context, so that moves first
+                    m_persistence->renameChatContext(oldName, newName);
                     m_persistence->deleteChat(oldName).get();
                 }
 
@@ -155,6 +175,122 @@ namespace Chat
             });
         }
 
+        // Replaces the engine replies are generated with; the default is a LlamaEngine
+        void setInferenceEngine(std::shared_ptr<Inference::IInferenceEngine> engine)
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            m_engine = std::move(engine);
+        }
+
+        /**
+         * @brief Generates the assistant's reply to the current chat on a background thread
+         *
+         * The reply is added as a new assistant message right away and streamed into it
+         * as tokens arrive, so the UI shows it growing; the chat is saved once the reply
+         * is complete. Returns false if a reply is already being generated, there is no
+         * current chat, or no model is loaded (the reply then says so).
+         *
+         * The engine keeps the KV state of one chat. When a reply is for another chat (or
+         * model) than the last one, the previous chat's context is saved next to it and
+         * this chat's saved context, if any, is restored before generating, so switching
+         * back to a long conversation does not prefill it again.
+         */
+        bool generateResponse(std::shared_ptr<const Model::GGUFFile> model, const Model::ModelPreset& preset)
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            if (m_generating || !m_currentChatName || m_currentChatIndex >= m_chats.size())
+            {
+                return false;
+            }
+
+            ChatHistory& chat = m_chats[m_currentChatIndex];
+            std::vector<Inference::ChatMessage> messages;
+            for (const auto& message : chat.messages)
+            {
+                messages.push_back({ message.role, message.content });
+            }
+
+            Message reply(static_cast<int>(chat.messages.size()) + 1, "assistant", model ? "" : NO_MODEL_REPLY);
+            chat.messages.push_back(reply);
+            updateChatTimestamp(m_currentChatIndex, static_cast<int>(std::time(nullptr)));
+            if (!model)
+            {
+                // Saved without holding the lock, which the UI needs every frame
+                ChatHistory saved = chat;
+                lock.unlock();
+                m_persistence->saveChat(saved).get();
+                return false;
+            }
+
+            if (!m_engine)
+            {
+                m_engine = std::make_shared<Inference::LlamaEngine>();
+            }
+
+            // The previous generation has finished, so this join returns immediately
+            if (m_generationThread.joinable())
+            {
+                m_generationThread.join();
+            }
+
+            Inference::GenerationParams params = Inference::GenerationParams::fromPreset(preset);
+            params.conversationId = chat.id;
+
+            // Cleared here rather than in generate(), so stopGeneration() also works while
+            // the thread is still loading the model or the chat's context
+            m_engine->resetCancel();
+            m_generating = true;
+            m_generationThread = std::thread(
+                [this, engine = m_engine, model, messages, chatId = chat.id, replyId = reply.id, params]() {
+                try
+                {
+                    const bool switching = m_context.engine != engine.get() || m_context.model != model || m_context.chatId != chatId;
+                    if (switching)
+                    {
+                        saveEngineContext(*engine);
+                    }
+
+                    engine->loadModel(model);
+                    if (switching)
+                    {
+                        m_context = { engine.get(), model, chatId, false };
+                        if (auto name = chatNameById(chatId))
+                        {
+                            m_persistence->loadChatContext(*name, *engine);
+                        }
+                    }
+
+                    m_context.unsaved = true;
+                    engine->generate(messages, params, [&](const std::string& piece) {
+                        return appendToMessage(chatId, replyId, piece);
+                    });
+                }
+                catch (const std::exception& e)
+                {
+                    appendToMessage(chatId, replyId, std::string("\n\n[Generation failed: ") + e.what() + "]");
+                }
+
+                saveChatById(chatId);
+                m_generating = false;
+            });
+            return true;
+        }
+
+        bool isGenerating() const
+        {
+            return m_generating;
+        }
+
+        // The partial reply is kept
+        void stopGeneration()
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            if (m_generating && m_engine)
+            {
+                m_engine->cancel();
+            }
+        }
+
         // Async operations
         std::future<bool> createNewChat(const std::string& name) 
         {
@@ -172,7 +308,7 @@ namespace Chat
 
                 const int newTimestamp = static_cast<int>(std::time(nullptr));
                 ChatHistory newChat{
-                    static_cast<int>(m_chats.size() + 1),
+                    m_nextChatId++,
                     newTimestamp,
                     name,
                     {}
@@ -379,6 +515,60 @@ namespace Chat
             m_sortedIndices = std::move(newSortedIndices);
         }
 
+        // Returns false once the chat or message is gone, which stops the generation
+        bool appendToMessage(int chatId, int messageId, const std::string& text)
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            auto chat = std::find_if(m_chats.begin(), m_chats.end(),
+                [chatId](const auto& c) { return c.id == chatId; });
+            if (chat == m_chats.end())
+            {
+                return false;
+            }
+
+            auto message = std::find_if(chat->messages.rbegin(), chat->messages.rend(),
+                [messageId](const auto& m) { return m.id == messageId; });
+            if (message == chat->messages.rend())
+            {
+                return false;
+            }
+
+            message->content += text;
+            return true;
+        }
+
+        std::optional<std::string> chatNameById(int chatId) const
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            auto chat = std::find_if(m_chats.begin(), m_chats.end(),
+                [chatId](const auto& c) { return c.id == chatId; });
+            return chat != m_chats.end() ? std::optional<std::string>(chat->name) : std::nullopt;
+        }
+
+        // Saves the context `engine` holds for its chat if it changed since it was restored
+        void saveEngineContext(Inference::IInferenceEngine& engine)
+        {
+            if (m_context.engine == &engine && m_context.unsaved)
+            {
+                if (auto name = chatNameById(m_context.chatId))
+                {
+                    m_persistence->saveChatContext(*name, engine);
+                }
+            }
+            m_context.unsaved = false;
+        }
+
+        void saveChatById(int chatId)
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            auto chat = std::find_if(m_chats.begin(), m_chats.end(),
+                [chatId](const auto& c) { return c.id == chatId; });
+            if (chat != m_chats.end())
+            {
+                m_persistence->saveChat(*chat).get();
+            }
+        }
+
         bool chatExists(const std::string& name) const 
         {
             return std::any_of(m_chats.begin(), m_chats.end(),
@@ -392,6 +582,7 @@ namespace Chat
 
                 std::unique_lock<std::shared_mutex> lock(m_mutex);
                 m_chats = std::move(chats);
+                assignUniqueChatIds();
                 
                 // Initialize indices
                 m_chatNameToIndex.clear();
@@ -422,11 +613,38 @@ namespace Chat
             });
         }
 
+        /**
+         * @brief Makes every chat id unique and sets the id the next new chat gets
+         *
+         * Replies and KV contexts are routed by id, so an id must never be shared, not
+         * even with a deleted chat whose reply may still be streaming. Chats saved by
+         * earlier versions, which numbered them by count, can share one; the later ones
+         * are renumbered.
+         */
+        void assignUniqueChatIds()
+        {
+            m_nextChatId = 1;
+            for (const auto& chat : m_chats)
+            {
+                m_nextChatId = std::max(m_nextChatId, chat.id + 1);
+            }
+
+            std::set<int> seen;
+            for (auto& chat : m_chats)
+            {
+                if (!seen.insert(chat.id).second)
+                {
+                    chat.id = m_nextChatId++;
+                    seen.insert(chat.id);
+                }
+            }
+        }
+
         void createDefaultChat()
         {
             const int currentTime = static_cast<int>(std::time(nullptr));
             ChatHistory defaultChat{
-                1,
+                m_nextChatId++,
                 currentTime,
                 DEFAULT_CHAT_NAME,
                 {}
@@ -442,6 +660,7 @@ namespace Chat
         }
 
         static inline const std::string DEFAULT_CHAT_NAME = "New Chat";
+        static inline const std::string NO_MODEL_REPLY = "Please select a model and wait for it to finish downloading.";
 
         std::unique_ptr<IChatPersistence> m_persistence;
         std::vector<ChatHistory> m_chats;
@@ -449,7 +668,22 @@ namespace Chat
         std::set<ChatIndex> m_sortedIndices;
         std::optional<std::string> m_currentChatName;
         size_t m_currentChatIndex;
+        int m_nextChatId = 1; // ids are never reused, see assignUniqueChatIds()
         mutable std::shared_mutex m_mutex;
+
+        // Whose KV state the engine holds; only used by the generation thread
+        struct EngineContext
+        {
+            const Inference::IInferenceEngine* engine = nullptr;
+            std::shared_ptr<const Model::GGUFFile> model;
+            int chatId = -1;
+            bool unsaved = false;
+        };
+
+        std::shared_ptr<Inference::IInferenceEngine> m_engine;
+        EngineContext m_context;
+        std::thread m_generationThread;
+        std::atomic<bool> m_generating{ false };
     };
 
     inline void initializeChatManager() {
@@ -2,6 +2,7 @@
 
 #include "chat_history.hpp"
 #include "crypto/crypto.hpp"
+#include "inference/inference_engine.hpp"
 
 #include <future>
 #include <shared_mutex>
@@ -21,10 +22,31 @@ namespace Chat
         virtual std::future<bool> saveChat(const ChatHistory& chat) = 0;
         virtual std::future<bool> deleteChat(const std::string& chatName) = 0;
         virtual std::future<std::vector<ChatHistory>> loadAllChats() = 0;
+
+        // Keep an engine's context (its KV cache) for a chat so the chat resumes without a
+        // prefill; both return false where contexts are not stored. Blocking.
+        virtual bool saveChatContext(const std::string& /*chatName*/, Inference::IInferenceEngine& /*engine*/)
+        {
+            return false;
+        }
+
+        virtual bool loadChatContext(const std::string& /*chatName*/, Inference::IInferenceEngine& /*engine*/)
+        {
+            return false;
+        }
+
+        // Moves a chat's saved context to its new name, so a renamed chat keeps it. Blocking.
+        virtual bool renameChatContext(const std::string& /*oldName*/, const std::string& /*newName*/)
+        {
+            return false;
+        }
     };
 
     /**
      * @brief File-based chat persistence implementation using AES-GCM encryption
+     *
+     * Each chat is a `<name>.chat` file; its engine context, if saved, sits next to it
+     * as `<name>.kv`, encrypted with the same key.
      */
     class FileChatPersistence : public IChatPersistence 
     {
@@ -54,6 +76,7 @@ namespace Chat
                 try 
                 {
                     std::filesystem::remove(getChatPath(chatName));
+                    std::filesystem::remove(getContextPath(chatName));
                     return true;
                 }
                 catch (...) 
@@ -71,6 +94,40 @@ namespace Chat
                 });
         }
 
+        bool saveChatContext(const std::string& chatName, Inference::IInferenceEngine& engine) override
+        {
+            std::unique_lock<std::shared_mutex> lock(m_ioMutex);
+            try
+            {
+                return engine.saveContext(getContextPath(chatName), m_key);
+            }
+            catch (const std::exception&)
+            {
+                return false;
+            }
+        }
+
+        bool loadChatContext(const std::string& chatName, Inference::IInferenceEngine& engine) override
+        {
+            std::shared_lock<std::shared_mutex> lock(m_ioMutex);
+            try
+            {
+                return engine.restoreContext(getContextPath(chatName), m_key);
+            }
+            catch (const std::exception&)
+            {
+                return false;
+            }
+        }
+
+        bool renameChatContext(const std::string& oldName, const std::string& newName) override
+        {
+            std::unique_lock<std::shared_mutex> lock(m_ioMutex);
+            std::error_code ec;
+            std::filesystem::rename(getContextPath(oldName), getContextPath(newName), ec);
+            return !ec;
+        }
+
     private:
         const std::string m_basePath;
         const std::array<uint8_t, 32> m_key;
@@ -81,6 +138,11 @@ namespace Chat
             return (std::filesystem::path(m_basePath) / (chatName + ".chat")).string();
         }
 
+        auto getContextPath(const std::string& chatName) const -> std::string
+        {
+            return (std::filesystem::path(m_basePath) / (chatName + ".kv")).string();
+        }
+
         bool saveEncryptedChat(const ChatHistory& chat) 
         {
             try {
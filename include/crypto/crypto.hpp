@@ -9,6 +9,9 @@
 #include <sys/ioctl.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#ifdef __linux__
+#include <linux/if_packet.h>
+#endif
 #endif
 
 #include <openssl/evp.h>
@@ -19,6 +22,7 @@
 #include <vector>
 #include <array>
 #include <string>
+#include <stdexcept>
 
 // TODO: use password-based key derivation function (PBKDF2) to generate key from password
 //       to be more secure.
@@ -30,6 +34,74 @@ public:
     static constexpr size_t TAG_SIZE = 16;
     static constexpr size_t KEY_SIZE = 32;
 
+    /**
+     * @brief Incremental SHA-256, for hashing data as it streams past (e.g. downloads)
+     */
+    class Sha256
+    {
+    public:
+        Sha256()
+            : m_ctx(EVP_MD_CTX_new())
+        {
+            if (m_ctx == nullptr) {
+                throw std::runtime_error("Failed to create EVP_MD_CTX");
+            }
+            if (EVP_DigestInit_ex(m_ctx, EVP_sha256(), nullptr) != 1) {
+                EVP_MD_CTX_free(m_ctx);
+                throw std::runtime_error("Failed to initialize digest");
+            }
+        }
+
+        ~Sha256()
+        {
+            EVP_MD_CTX_free(m_ctx);
+        }
+
+        Sha256(const Sha256&) = delete;
+        Sha256& operator=(const Sha256&) = delete;
+
+        // Discards everything hashed so far
+        void reset()
+        {
+            if (EVP_DigestInit_ex(m_ctx, EVP_sha256(), nullptr) != 1) {
+                throw std::runtime_error("Failed to initialize digest");
+            }
+        }
+
+        void update(const void* data, size_t size)
+        {
+            if (EVP_DigestUpdate(m_ctx, data, size) != 1) {
+                throw std::runtime_error("Failed to update digest");
+            }
+        }
+
+        // Lowercase hex digest; the object cannot be updated afterwards
+        std::string finalHex()
+        {
+            unsigned char hash[SHA256_DIGEST_LENGTH];
+            if (EVP_DigestFinal_ex(m_ctx, hash, nullptr) != 1) {
+                throw std::runtime_error("Failed to finalize digest");
+            }
+            return toHex(hash, SHA256_DIGEST_LENGTH);
+        }
+
+    private:
+        EVP_MD_CTX* m_ctx;
+    };
+
+    static std::string toHex(const unsigned char* data, size_t size)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(size * 2);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hex.push_back(digits[data[i] >> 4]);
+            hex.push_back(digits[data[i] & 0x0F]);
+        }
+        return hex;
+    }
+
     static std::array<uint8_t, KEY_SIZE> generateKey()
     {
         // Get the unique identifier for the device
@@ -175,6 +247,106 @@ public:
         return encrypted;
     }
 
+    /**
+     * @brief Encrypts `size` bytes into `out` as IV || ciphertext || tag
+     *
+     * GCM does not pad, so `out` must hold exactly size + IV_SIZE + TAG_SIZE bytes.
+     * For large payloads written in fixed-size chunks without intermediate copies.
+     */
+    static void encrypt(const uint8_t* plaintext, size_t size,
+        const std::array<uint8_t, KEY_SIZE>& key, uint8_t* out)
+    {
+        if (RAND_bytes(out, IV_SIZE) != 1)
+        {
+            throw std::runtime_error("Failed to generate IV");
+        }
+
+        EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+        if (!ctx)
+        {
+            throw std::runtime_error("Failed to create cipher context");
+        }
+
+        try
+        {
+            if (EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, key.data(), out) != 1)
+            {
+                throw std::runtime_error("Failed to initialize encryption");
+            }
+
+            uint8_t* ciphertext = out + IV_SIZE;
+            int len = 0;
+            if (EVP_EncryptUpdate(ctx, ciphertext, &len, plaintext, static_cast<int>(size)) != 1)
+            {
+                throw std::runtime_error("Failed to encrypt data");
+            }
+            if (EVP_EncryptFinal_ex(ctx, ciphertext + len, &len) != 1)
+            {
+                throw std::runtime_error("Failed to finalize encryption");
+            }
+            if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, TAG_SIZE, ciphertext + size) != 1)
+            {
+                throw std::runtime_error("Failed to get tag");
+            }
+        }
+        catch (...)
+        {
+            EVP_CIPHER_CTX_free(ctx);
+            throw;
+        }
+
+        EVP_CIPHER_CTX_free(ctx);
+    }
+
+    // Decrypts what the pointer overload of encrypt() wrote; `out` receives size - IV_SIZE - TAG_SIZE bytes
+    static void decrypt(const uint8_t* encrypted, size_t size,
+        const std::array<uint8_t, KEY_SIZE>& key, uint8_t* out)
+    {
+        if (size < IV_SIZE + TAG_SIZE)
+        {
+            throw std::runtime_error("Invalid encrypted data size");
+        }
+
+        EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+        if (!ctx)
+        {
+            throw std::runtime_error("Failed to create cipher context");
+        }
+
+        try
+        {
+            if (EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, key.data(), encrypted) != 1)
+            {
+                throw std::runtime_error("Failed to initialize decryption");
+            }
+
+            const size_t ciphertextSize = size - IV_SIZE - TAG_SIZE;
+            int len = 0;
+            if (EVP_DecryptUpdate(ctx, out, &len, encrypted + IV_SIZE, static_cast<int>(ciphertextSize)) != 1)
+            {
+                throw std::runtime_error("Failed to decrypt data");
+            }
+
+            // OpenSSL only reads the tag, the const_cast is for its untyped ctrl interface
+            uint8_t* tag = const_cast<uint8_t*>(encrypted + IV_SIZE + ciphertextSize);
+            if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TAG_SIZE, tag) != 1)
+            {
+                throw std::runtime_error("Failed to set tag");
+            }
+            if (EVP_DecryptFinal_ex(ctx, out + len, &len) != 1)
+            {
+                throw std::runtime_error("Failed to verify tag or finalize decryption");
+            }
+        }
+        catch (...)
+        {
+            EVP_CIPHER_CTX_free(ctx);
+            throw;
+        }
+
+        EVP_CIPHER_CTX_free(ctx);
+    }
+
     static std::vector<uint8_t> decrypt(
         const std::vector<uint8_t>& encrypted,
         const std::array<uint8_t, KEY_SIZE>& key
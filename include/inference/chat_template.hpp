@@ -0,0 +1,322 @@
+#pragma once
+
+#include "inference_engine.hpp"
+#include "tokenizer.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Inference
+{
+    /**
+     * @brief Prompt layout of a chat model, rendered to tokens one message at a time
+     *
+     * The layout family is read from the Jinja template in `tokenizer.chat_template`
+     * (or guessed from the vocabulary when there is none): Llama 3, ChatML or Gemma.
+     * Markup is emitted as special token ids and content is tokenized as plain text,
+     * so a message can never inject control tokens, and a message renders to the same
+     * tokens whatever precedes it. That is what lets ChatPromptCache extend a rendered
+     * conversation instead of rendering it again.
+     */
+    class ChatTemplate
+    {
+    public:
+        enum class Format
+        {
+            Llama3, // <|start_header_id|>role<|end_header_id|>\n\ncontent<|eot_id|>
+            ChatML, // <|im_start|>role\ncontent<|im_end|>\n
+            Gemma,  // <start_of_turn>role\ncontent<end_of_turn>\n, no system role
+        };
+
+        ChatTemplate(const Model::GGUFFile& file, const Tokenizer& tokenizer)
+            : m_tokenizer(tokenizer)
+            , m_format(detectFormat(file.getString("tokenizer.chat_template"), tokenizer))
+        {
+            switch (m_format)
+            {
+            case Format::Llama3:
+                m_startTurn = requireToken("<|start_header_id|>");
+                m_endHeader = requireToken("<|end_header_id|>");
+                m_endTurn = requireToken("<|eot_id|>");
+                break;
+            case Format::ChatML:
+                m_startTurn = requireToken("<|im_start|>");
+                m_endTurn = requireToken("<|im_end|>");
+                break;
+            case Format::Gemma:
+                m_startTurn = requireToken("<start_of_turn>");
+                m_endTurn = requireToken("<end_of_turn>");
+                break;
+            }
+
+            // ChatML models (Qwen and others) usually start without BOS
+            const bool addBos = file.getBool("tokenizer.ggml.add_bos_token", m_format != Format::ChatML);
+            m_bos = addBos ? tokenizer.bos() : -1;
+        }
+
+        Format format() const { return m_format; }
+
+        const char* name() const
+        {
+            switch (m_format)
+            {
+            case Format::Llama3:
+                return "llama3";
+            case Format::ChatML:
+                return "chatml";
+            case Format::Gemma:
+                return "gemma";
+            }
+            return "";
+        }
+
+        // BOS and, where the format has a system role, the system prompt
+        void renderStart(const std::string& systemPrompt, std::vector<int32_t>& tokens) const
+        {
+            if (m_bos >= 0)
+            {
+                tokens.push_back(m_bos);
+            }
+            if (!systemPrompt.empty() && m_format != Format::Gemma)
+            {
+                renderTurn("system", systemPrompt, tokens);
+            }
+        }
+
+        // Message `index` of the chat; Gemma folds the system prompt into the first one
+        void renderMessage(const ChatMessage& message, size_t index, const std::string& systemPrompt,
+            std::vector<int32_t>& tokens) const
+        {
+            if (m_format != Format::Gemma)
+            {
+                renderTurn(message.role, message.content, tokens);
+                return;
+            }
+
+            const std::string role = message.role == "assistant" ? "model" : "user";
+            if (index == 0 && !systemPrompt.empty())
+            {
+                if (role != "user")
+                {
+                    renderTurn("user", systemPrompt, tokens);
+                }
+                else
+                {
+                    renderTurn(role, systemPrompt + "\n\n" + message.content, tokens);
+                    return;
+                }
+            }
+            renderTurn(role, message.content, tokens);
+        }
+
+        // The open assistant turn the reply is generated into
+        void renderGenerationPrompt(std::vector<int32_t>& tokens) const
+        {
+            tokens.push_back(m_startTurn);
+            switch (m_format)
+            {
+            case Format::Llama3:
+                appendText("assistant", tokens);
+                tokens.push_back(m_endHeader);
+                appendText("\n\n", tokens);
+                break;
+            case Format::ChatML:
+                appendText("assistant\n", tokens);
+                break;
+            case Format::Gemma:
+                appendText("model\n", tokens);
+                break;
+            }
+        }
+
+        // The whole prompt for a chat, rendered from scratch
+        std::vector<int32_t> render(const std::vector<ChatMessage>& messages, const std::string& systemPrompt) const
+        {
+            std::vector<int32_t> tokens;
+            renderStart(systemPrompt, tokens);
+            for (size_t i = 0; i < messages.size(); ++i)
+            {
+                renderMessage(messages[i], i, systemPrompt, tokens);
+            }
+            renderGenerationPrompt(tokens);
+            return tokens;
+        }
+
+    private:
+        static Format detectFormat(const std::string& jinja, const Tokenizer& tokenizer)
+        {
+            const std::pair<const char*, Format> markers[] = {
+                { "<|start_header_id|>", Format::Llama3 },
+                { "<|im_start|>", Format::ChatML },
+                { "<start_of_turn>", Format::Gemma },
+            };
+            for (const auto& [marker, format] : markers)
+            {
+                if (jinja.find(marker) != std::string::npos)
+                    return format;
+            }
+            if (!jinja.empty())
+                throw std::runtime_error("Unsupported chat template in model metadata");
+
+            for (const auto& [marker, format] : markers)
+            {
+                if (tokenizer.tokenId(marker))
+                    return format;
+            }
+            throw std::runtime_error("Model has no chat template");
+        }
+
+        int32_t requireToken(const char* text) const
+        {
+            auto id = m_tokenizer.tokenId(text);
+            if (!id)
+                throw std::runtime_error(std::string("Model vocabulary has no ") + text + " token");
+            return *id;
+        }
+
+        void appendText(const std::string& text, std::vector<int32_t>& tokens) const
+        {
+            std::vector<int32_t> encoded = m_tokenizer.encode(text);
+            tokens.insert(tokens.end(), encoded.begin(), encoded.end());
+        }
+
+        void renderTurn(const std::string& role, const std::string& content, std::vector<int32_t>& tokens) const
+        {
+            tokens.push_back(m_startTurn);
+            if (m_format == Format::Llama3)
+            {
+                appendText(role, tokens);
+                tokens.push_back(m_endHeader);
+                appendText("\n\n" + content, tokens);
+                tokens.push_back(m_endTurn);
+                return;
+            }
+
+            appendText(role + "\n" + content, tokens);
+            tokens.push_back(m_endTurn);
+            appendText("\n", tokens);
+        }
+
+        const Tokenizer& m_tokenizer;
+        Format m_format;
+        int32_t m_bos = -1;
+        int32_t m_startTurn = -1;
+        int32_t m_endHeader = -1;
+        int32_t m_endTurn = -1;
+    };
+
+    /**
+     * @brief Rendered prompts of recent conversations, extended by what each request adds
+     *
+     * Keeps the tokens of every message of a conversation, so the next turn only renders
+     * and tokenizes the messages added since. Earlier messages are confirmed unchanged by
+     * a hash of their text, which costs a small fraction of tokenizing them; an edited
+     * message or another system prompt is rendered again from that point on.
+     */
+    class ChatPromptCache
+    {
+    public:
+        explicit ChatPromptCache(size_t maxConversations = 16)
+            : m_maxConversations(std::max<size_t>(1, maxConversations))
+        {
+        }
+
+        /**
+         * @brief The prompt for `messages` of `conversation`, valid until the next call
+         *
+         * A negative conversation id renders from scratch and keeps nothing.
+         */
+        const std::vector<int32_t>& render(const ChatTemplate& chatTemplate, int conversation,
+            const std::string& systemPrompt, const std::vector<ChatMessage>& messages)
+        {
+            if (conversation < 0)
+            {
+                m_scratch = chatTemplate.render(messages, systemPrompt);
+                return m_scratch;
+            }
+
+            Rendered& rendered = find(conversation);
+            const uint64_t systemHash = std::hash<std::string>()(systemPrompt);
+            if (rendered.ends.empty() || rendered.systemHash != systemHash)
+            {
+                rendered.tokens.clear();
+                rendered.hashes.clear();
+                rendered.ends.clear();
+                rendered.systemHash = systemHash;
+                chatTemplate.renderStart(systemPrompt, rendered.tokens);
+                rendered.ends.push_back(rendered.tokens.size());
+            }
+
+            // ends[i] is where message i starts; the start (BOS, system) is entry 0
+            size_t kept = 0;
+            while (kept < messages.size() && kept < rendered.hashes.size() && rendered.hashes[kept] == hashMessage(messages[kept]))
+            {
+                ++kept;
+            }
+            rendered.hashes.resize(kept);
+            rendered.ends.resize(kept + 1);
+            rendered.tokens.resize(rendered.ends.back());
+
+            for (size_t i = kept; i < messages.size(); ++i)
+            {
+                chatTemplate.renderMessage(messages[i], i, systemPrompt, rendered.tokens);
+                rendered.hashes.push_back(hashMessage(messages[i]));
+                rendered.ends.push_back(rendered.tokens.size());
+            }
+
+            chatTemplate.renderGenerationPrompt(rendered.tokens);
+            return rendered.tokens;
+        }
+
+        void clear()
+        {
+            m_conversations.clear();
+            m_scratch.clear();
+        }
+
+    private:
+        struct Rendered
+        {
+            uint64_t systemHash = 0;
+            std::vector<uint64_t> hashes; // per message
+            std::vector<size_t> ends;     // token count after the start and after each message
+            std::vector<int32_t> tokens;  // followed by the generation prompt of the last render
+            uint64_t lastUsed = 0;
+        };
+
+        static uint64_t hashMessage(const ChatMessage& message)
+        {
+            const uint64_t role = std::hash<std::string>()(message.role);
+            return std::hash<std::string>()(message.content) ^ (role * 0x9E3779B97F4A7C15ull);
+        }
+
+        // The entry for `conversation`, making room by dropping the least recently used
+        Rendered& find(int conversation)
+        {
+            auto it = m_conversations.find(conversation);
+            if (it == m_conversations.end())
+            {
+                if (m_conversations.size() >= m_maxConversations)
+                {
+                    auto oldest = std::min_element(m_conversations.begin(), m_conversations.end(),
+                        [](const auto& a, const auto& b) { return a.second.lastUsed < b.second.lastUsed; });
+                    m_conversations.erase(oldest);
+                }
+                it = m_conversations.emplace(conversation, Rendered()).first;
+            }
+            it->second.lastUsed = ++m_clock;
+            return it->second;
+        }
+
+        size_t m_maxConversations;
+        std::unordered_map<int, Rendered> m_conversations;
+        std::vector<int32_t> m_scratch;
+        uint64_t m_clock = 0;
+    };
+} // namespace Inference
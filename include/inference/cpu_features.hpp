@@ -0,0 +1,107 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define KOLOSAL_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+#include <cstdint>
+
+// GCC and Clang only emit AVX instructions in functions compiled for them, which lets
+// one binary carry kernels for several instruction sets; MSVC needs no attribute.
+#if defined(KOLOSAL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define KOLOSAL_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define KOLOSAL_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma,f16c")))
+#define KOLOSAL_TARGET_AVX512_VNNI __attribute__((target("avx512f,avx512bw,avx512vl,avx512vnni,avx2,fma,f16c")))
+#else
+#define KOLOSAL_TARGET_AVX2
+#define KOLOSAL_TARGET_AVX512
+#define KOLOSAL_TARGET_AVX512_VNNI
+#endif
+
+namespace Inference
+{
+    // Instruction sets the running CPU and operating system both support
+    struct CpuFeatures
+    {
+        bool avx2 = false;       // with FMA and F16C
+        bool avx512 = false;     // F, BW and VL
+        bool avx512Vnni = false;
+    };
+
+    namespace detail
+    {
+#ifdef KOLOSAL_X86
+        inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+        {
+#ifdef _MSC_VER
+            int values[4];
+            __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+            for (int i = 0; i < 4; ++i)
+                regs[i] = static_cast<uint32_t>(values[i]);
+#else
+            __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        }
+
+        // Register state the OS saves on context switches (XCR0)
+        inline uint64_t enabledXState()
+        {
+#ifdef _MSC_VER
+            return _xgetbv(0);
+#else
+            uint32_t eax, edx;
+            __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+        }
+#endif
+
+        inline CpuFeatures detectCpuFeatures()
+        {
+            CpuFeatures features;
+#ifdef KOLOSAL_X86
+            uint32_t regs[4];
+            cpuid(0, 0, regs);
+            const uint32_t maxLeaf = regs[0];
+            if (maxLeaf < 7)
+                return features;
+
+            cpuid(1, 0, regs);
+            const bool osxsave = (regs[2] >> 27) & 1;
+            const bool avx = (regs[2] >> 28) & 1;
+            const bool fma = (regs[2] >> 12) & 1;
+            const bool f16c = (regs[2] >> 29) & 1;
+            if (!osxsave || !avx)
+                return features;
+
+            const uint64_t xstate = enabledXState();
+            const bool ymmEnabled = (xstate & 0x6) == 0x6;
+            const bool zmmEnabled = (xstate & 0xE6) == 0xE6;
+
+            cpuid(7, 0, regs);
+            const bool avx2 = (regs[1] >> 5) & 1;
+            const bool avx512f = (regs[1] >> 16) & 1;
+            const bool avx512bw = (regs[1] >> 30) & 1;
+            const bool avx512vl = (regs[1] >> 31) & 1;
+            const bool avx512vnni = (regs[2] >> 11) & 1;
+
+            features.avx2 = ymmEnabled && avx2 && fma && f16c;
+            features.avx512 = features.avx2 && zmmEnabled && avx512f && avx512bw && avx512vl;
+            features.avx512Vnni = features.avx512 && avx512vnni;
+#endif
+            return features;
+        }
+    } // namespace detail
+
+    inline const CpuFeatures& cpuFeatures()
+    {
+        static const CpuFeatures features = detail::detectCpuFeatures();
+        return features;
+    }
+} // namespace Inference
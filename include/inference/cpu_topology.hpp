@@ -0,0 +1,271 @@
+#pragma once
+
+#ifdef _WIN32
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <initializer_list>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Inference
+{
+    struct LogicalCpu
+    {
+        unsigned int id = 0;      // the OS's number, as used for affinity
+        unsigned int core = 0;    // SMT siblings share this
+        bool efficiency = false;  // an E-core (Intel hybrid) or LITTLE core (ARM)
+    };
+
+    /**
+     * @brief The logical CPUs this process may run on, grouped into physical cores
+     *
+     * Read from sysfs on Linux and GetLogicalProcessorInformationEx on Windows. Where
+     * neither is available every hardware thread counts as its own performance core.
+     */
+    class CpuTopology
+    {
+    public:
+        static const CpuTopology& get()
+        {
+            static const CpuTopology topology = detect();
+            return topology;
+        }
+
+        const std::vector<LogicalCpu>& cpus() const { return m_cpus; }
+
+        unsigned int physicalCores(bool includeEfficiency = true) const
+        {
+            std::set<unsigned int> cores;
+            for (const auto& cpu : m_cpus)
+            {
+                if (includeEfficiency || !cpu.efficiency)
+                    cores.insert(cpu.core);
+            }
+            return static_cast<unsigned int>(cores.size());
+        }
+
+        // Compute threads to use by default: one per performance core, since matmuls
+        // gain little from SMT siblings and E-cores hold back the threads waiting on them
+        unsigned int defaultThreadCount() const
+        {
+            unsigned int performance = physicalCores(false);
+            return std::max(1u, performance > 0 ? performance : physicalCores(true));
+        }
+
+        /**
+         * @brief Logical CPUs in the order threads should be placed on them
+         *
+         * First one per performance core, then one per efficiency core, then the
+         * remaining SMT siblings, so the first N entries spread N threads best.
+         */
+        std::vector<unsigned int> placementOrder() const
+        {
+            std::vector<unsigned int> order;
+            std::set<unsigned int> usedCores;
+            std::vector<bool> placed(m_cpus.size(), false);
+            for (bool efficiency : { false, true })
+            {
+                for (size_t i = 0; i < m_cpus.size(); ++i)
+                {
+                    if (m_cpus[i].efficiency == efficiency && usedCores.insert(m_cpus[i].core).second)
+                    {
+                        order.push_back(m_cpus[i].id);
+                        placed[i] = true;
+                    }
+                }
+            }
+            for (size_t i = 0; i < m_cpus.size(); ++i)
+            {
+                if (!placed[i])
+                    order.push_back(m_cpus[i].id);
+            }
+            return order;
+        }
+
+        static CpuTopology detect()
+        {
+            CpuTopology topology;
+#ifdef _WIN32
+            topology.detectWindows();
+#elif defined(__linux__)
+            topology.detectLinux();
+#endif
+            if (topology.m_cpus.empty())
+            {
+                const unsigned int count = std::max(1u, std::thread::hardware_concurrency());
+                for (unsigned int i = 0; i < count; ++i)
+                    topology.m_cpus.push_back({ i, i, false });
+#ifdef __APPLE__
+                // Apple silicon lists its performance cores as perflevel0; they come first
+                int performance = 0;
+                size_t size = sizeof(performance);
+                if (sysctlbyname("hw.perflevel0.logicalcpu", &performance, &size, nullptr, 0) == 0 && performance > 0)
+                {
+                    for (unsigned int i = static_cast<unsigned int>(performance); i < count; ++i)
+                        topology.m_cpus[i].efficiency = true;
+                }
+#endif
+            }
+            return topology;
+        }
+
+    private:
+#ifdef _WIN32
+        void detectWindows()
+        {
+            DWORD length = 0;
+            GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+            if (GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+                return;
+
+            std::vector<char> buffer(length);
+            auto* info = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data());
+            if (!GetLogicalProcessorInformationEx(RelationProcessorCore, info, &length))
+                return;
+
+            // Higher efficiency classes are faster; on non-hybrid CPUs every core is 0
+            std::vector<std::pair<std::vector<unsigned int>, BYTE>> cores;
+            BYTE maxClass = 0;
+            for (DWORD offset = 0; offset < length;)
+            {
+                auto* entry = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+                std::vector<unsigned int> ids;
+                for (WORD g = 0; g < entry->Processor.GroupCount; ++g)
+                {
+                    const GROUP_AFFINITY& mask = entry->Processor.GroupMask[g];
+                    for (unsigned int bit = 0; bit < sizeof(KAFFINITY) * 8; ++bit)
+                    {
+                        if (mask.Mask & (static_cast<KAFFINITY>(1) << bit))
+                            ids.push_back(mask.Group * 64u + bit);
+                    }
+                }
+                maxClass = std::max(maxClass, entry->Processor.EfficiencyClass);
+                cores.emplace_back(std::move(ids), entry->Processor.EfficiencyClass);
+                offset += entry->Size;
+            }
+
+            for (unsigned int core = 0; core < cores.size(); ++core)
+            {
+                for (unsigned int id : cores[core].first)
+                    m_cpus.push_back({ id, core, cores[core].second < maxClass });
+            }
+        }
+#elif defined(__linux__)
+        static bool readNumber(const std::string& path, long& value)
+        {
+            std::ifstream file(path);
+            return static_cast<bool>(file >> value);
+        }
+
+        // "0-3,8,10-11" as used by sysfs cpu lists
+        static std::set<unsigned int> readCpuList(const std::string& path)
+        {
+            std::set<unsigned int> cpus;
+            std::ifstream file(path);
+            std::string list;
+            if (!std::getline(file, list))
+                return cpus;
+
+            size_t position = 0;
+            while (position < list.size())
+            {
+                size_t comma = list.find(',', position);
+                std::string item = list.substr(position, comma == std::string::npos ? std::string::npos : comma - position);
+                size_t dash = item.find('-');
+                try
+                {
+                    unsigned long first = std::stoul(item.substr(0, dash));
+                    unsigned long last = dash == std::string::npos ? first : std::stoul(item.substr(dash + 1));
+                    for (unsigned long cpu = first; cpu <= last; ++cpu)
+                        cpus.insert(static_cast<unsigned int>(cpu));
+                }
+                catch (const std::exception&)
+                {
+                }
+                if (comma == std::string::npos)
+                    break;
+                position = comma + 1;
+            }
+            return cpus;
+        }
+
+        void detectLinux()
+        {
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+                return;
+
+            // Intel hybrid parts expose their E-cores as a separate PMU; ARM big.LITTLE
+            // reports a lower cpu_capacity for LITTLE cores
+            const std::set<unsigned int> atomCpus = readCpuList("/sys/devices/cpu_atom/cpus");
+            std::map<unsigned int, long> capacities;
+            long maxCapacity = 0;
+
+            std::map<std::pair<long, long>, unsigned int> coreIds;
+            for (unsigned int id = 0; id < CPU_SETSIZE; ++id)
+            {
+                if (!CPU_ISSET(id, &allowed))
+                    continue;
+
+                const std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(id);
+                long package = 0, core = static_cast<long>(id);
+                readNumber(base + "/topology/physical_package_id", package);
+                readNumber(base + "/topology/core_id", core);
+                auto key = std::make_pair(package, core);
+                auto it = coreIds.emplace(key, static_cast<unsigned int>(coreIds.size())).first;
+
+                long capacity = 0;
+                if (readNumber(base + "/cpu_capacity", capacity))
+                {
+                    capacities[id] = capacity;
+                    maxCapacity = std::max(maxCapacity, capacity);
+                }
+
+                m_cpus.push_back({ id, it->second, atomCpus.count(id) > 0 });
+            }
+
+            for (auto& cpu : m_cpus)
+            {
+                auto capacity = capacities.find(cpu.id);
+                if (capacity != capacities.end() && capacity->second < maxCapacity)
+                    cpu.efficiency = true;
+            }
+        }
+#endif
+
+        std::vector<LogicalCpu> m_cpus;
+    };
+
+    // Restricts the calling thread to one logical CPU; false where unsupported
+    inline bool pinCurrentThread(unsigned int cpu)
+    {
+#ifdef _WIN32
+        GROUP_AFFINITY affinity{};
+        affinity.Group = static_cast<WORD>(cpu / 64);
+        affinity.Mask = static_cast<KAFFINITY>(1) << (cpu % 64);
+        return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#elif defined(__linux__)
+        if (cpu >= CPU_SETSIZE)
+            return false;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+} // namespace Inference
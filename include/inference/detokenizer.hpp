@@ -0,0 +1,167 @@
+#pragma once
+
+#include "tokenizer.hpp"
+
+#include <array>
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace Inference
+{
+    /**
+     * @brief Turns a stream of generated tokens into text that is safe to display
+     *
+     * Only whole UTF-8 characters are emitted: bytes of a character split across tokens
+     * are held back until it is complete. Stop strings are matched with an Aho-Corasick
+     * automaton advanced once per byte, so a stop string spanning several tokens is found
+     * without rescanning, and text that may still turn out to be the start of one is held
+     * back too. Each token costs work proportional to its length only.
+     */
+    class StreamingDetokenizer
+    {
+    public:
+        explicit StreamingDetokenizer(const Tokenizer& tokenizer, const std::vector<std::string>& stopStrings = {})
+            : m_tokenizer(tokenizer)
+        {
+            buildAutomaton(stopStrings);
+        }
+
+        /**
+         * @brief Adds a token and appends the text that became final to `out`
+         *
+         * Returns false once a stop string is complete; `out` then ends right before it and
+         * later tokens are ignored.
+         */
+        bool push(int32_t token, std::string& out)
+        {
+            if (m_stopped)
+                return false;
+
+            for (char c : m_tokenizer.piece(token))
+            {
+                m_pending += c;
+                m_state = static_cast<size_t>(m_next[m_state][static_cast<uint8_t>(c)]);
+                if (m_match[m_state] > 0)
+                {
+                    out.append(m_pending, 0, m_pending.size() - m_match[m_state]);
+                    m_pending.clear();
+                    m_stopped = true;
+                    return false;
+                }
+            }
+
+            // Keep what could still become a stop string and any unfinished character
+            size_t ready = m_pending.size() - m_depth[m_state];
+            ready = completeUtf8Length(m_pending, ready);
+            out.append(m_pending, 0, ready);
+            m_pending.erase(0, ready);
+            return true;
+        }
+
+        // Text still held back at the end of generation; an unfinished character becomes U+FFFD
+        std::string flush()
+        {
+            std::string text;
+            const size_t complete = completeUtf8Length(m_pending, m_pending.size());
+            text.append(m_pending, 0, complete);
+            if (complete < m_pending.size())
+            {
+                text += "\xEF\xBF\xBD";
+            }
+            m_pending.clear();
+            m_state = 0;
+            return text;
+        }
+
+        bool stopped() const { return m_stopped; }
+
+    private:
+        // Length of the longest prefix of text[0, end) that does not end inside a UTF-8 character
+        static size_t completeUtf8Length(const std::string& text, size_t end)
+        {
+            // Look back at most 3 bytes for the lead byte of the last character
+            for (size_t back = 1; back <= 3 && back <= end; ++back)
+            {
+                const uint8_t c = static_cast<uint8_t>(text[end - back]);
+                if ((c & 0xC0) == 0x80)
+                    continue;
+
+                const size_t length = (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 1;
+                return length > back ? end - back : end;
+            }
+            return end;
+        }
+
+        // A trie of the stop strings with failure links folded into a full transition table
+        void buildAutomaton(const std::vector<std::string>& stopStrings)
+        {
+            m_next.assign(1, {});
+            m_depth.assign(1, 0);
+            m_match.assign(1, 0);
+            for (const std::string& stop : stopStrings)
+            {
+                if (stop.empty())
+                    continue;
+
+                int32_t node = 0;
+                for (char c : stop)
+                {
+                    int32_t& child = m_next[static_cast<size_t>(node)][static_cast<uint8_t>(c)];
+                    if (child == 0)
+                    {
+                        child = static_cast<int32_t>(m_next.size());
+                        m_next.push_back({});
+                        m_depth.push_back(m_depth[static_cast<size_t>(node)] + 1);
+                        m_match.push_back(0);
+                    }
+                    node = m_next[static_cast<size_t>(node)][static_cast<uint8_t>(c)];
+                }
+                m_match[static_cast<size_t>(node)] = stop.size();
+            }
+
+            // Breadth-first, so every node's failure target is finished before its children
+            std::vector<int32_t> fail(m_next.size(), 0);
+            std::queue<int32_t> queue;
+            for (int32_t& child : m_next[0])
+            {
+                if (child != 0)
+                    queue.push(child);
+            }
+            while (!queue.empty())
+            {
+                const int32_t node = queue.front();
+                queue.pop();
+                const size_t n = static_cast<size_t>(node);
+
+                // A stop string that is a suffix of this node's text also matches here
+                if (m_match[n] == 0)
+                    m_match[n] = m_match[static_cast<size_t>(fail[n])];
+
+                for (size_t c = 0; c < 256; ++c)
+                {
+                    int32_t& child = m_next[n][c];
+                    const int32_t fallback = m_next[static_cast<size_t>(fail[n])][c];
+                    if (child != 0)
+                    {
+                        fail[static_cast<size_t>(child)] = fallback;
+                        queue.push(child);
+                    }
+                    else
+                    {
+                        child = fallback;
+                    }
+                }
+            }
+        }
+
+        const Tokenizer& m_tokenizer;
+        std::vector<std::array<int32_t, 256>> m_next;
+        std::vector<size_t> m_depth;  // bytes of stop-string prefix the node stands for
+        std::vector<size_t> m_match;  // length of the stop string that ends at the node, or 0
+        size_t m_state = 0;
+        std::string m_pending;
+        bool m_stopped = false;
+    };
+} // namespace Inference
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "cpu_features.hpp"
+#include "thread_pool.hpp"
+#include "model/ggml_quants.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace Inference
+{
+    /**
+     * Cache-blocked matrix multiply of f16 weights with f32 activations, for prefill.
+     *
+     * Y[t][r] = sum_k W[r][k] * X[t][k], with W nOut rows of nIn halves and X, Y row-major
+     * per token (the layout matMul() uses). Work is split like BLIS:
+     *
+     *  - X is packed once into tiles of GEMM_NR tokens, interleaved per k, so the
+     *    micro-kernel broadcasts one float per token and step.
+     *  - Each thread owns panels of GEMM_MR weight rows. A panel is converted from f16
+     *    with F16C into an f32 block of GEMM_KC x GEMM_MR that stays in L1 while every
+     *    token tile streams past it.
+     *  - The AVX2 micro-kernel holds a GEMM_MR x GEMM_NR block of Y in 12 registers and
+     *    does 12 FMAs per k step.
+     *
+     * Only available where cpuFeatures().avx2 is set; callers fall back to matvecs.
+     */
+    constexpr int GEMM_MR = 16;      // weight rows per micro-tile: two 8-float registers
+    constexpr int GEMM_NR = 6;       // tokens per micro-tile
+    constexpr int64_t GEMM_KC = 256; // k block: a 16 KB packed weight panel
+
+#ifdef KOLOSAL_X86
+    namespace detail
+    {
+        // GEMM_KC x GEMM_MR floats, k-major; rows past `rows` are zero
+        KOLOSAL_TARGET_AVX2 inline void packWeightPanel(const uint16_t* w, int64_t nIn, int rows,
+            int64_t k0, int64_t kc, float* panel)
+        {
+            alignas(32) float converted[8];
+            for (int i = 0; i < GEMM_MR; ++i)
+            {
+                if (i >= rows)
+                {
+                    for (int64_t k = 0; k < kc; ++k)
+                        panel[k * GEMM_MR + i] = 0.0f;
+                    continue;
+                }
+
+                const uint16_t* source = w + i * nIn + k0;
+                int64_t k = 0;
+                for (; k + 8 <= kc; k += 8)
+                {
+                    _mm256_store_ps(converted, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + k))));
+                    for (int l = 0; l < 8; ++l)
+                        panel[(k + l) * GEMM_MR + i] = converted[l];
+                }
+                for (; k < kc; ++k)
+                {
+                    panel[k * GEMM_MR + i] = _cvtsh_ss(source[k]);
+                }
+            }
+        }
+
+        // Adds the product of a packed panel and one packed token tile to Y
+        template <int NR>
+        KOLOSAL_TARGET_AVX2 inline void gemmF16MicroKernel(const float* panel, const float* tile, int64_t kc,
+            float* y, size_t ldy, int rows)
+        {
+            __m256 c[NR][2];
+            for (int j = 0; j < NR; ++j)
+            {
+                c[j][0] = _mm256_setzero_ps();
+                c[j][1] = _mm256_setzero_ps();
+            }
+
+            for (int64_t k = 0; k < kc; ++k, panel += GEMM_MR, tile += GEMM_NR)
+            {
+                const __m256 a0 = _mm256_load_ps(panel);
+                const __m256 a1 = _mm256_load_ps(panel + 8);
+                for (int j = 0; j < NR; ++j)
+                {
+                    const __m256 b = _mm256_broadcast_ss(tile + j);
+                    c[j][0] = _mm256_fmadd_ps(a0, b, c[j][0]);
+                    c[j][1] = _mm256_fmadd_ps(a1, b, c[j][1]);
+                }
+            }
+
+            for (int j = 0; j < NR; ++j)
+            {
+                float* out = y + j * ldy;
+                if (rows == GEMM_MR)
+                {
+                    _mm256_storeu_ps(out, _mm256_add_ps(_mm256_loadu_ps(out), c[j][0]));
+                    _mm256_storeu_ps(out + 8, _mm256_add_ps(_mm256_loadu_ps(out + 8), c[j][1]));
+                }
+                else
+                {
+                    alignas(32) float partial[GEMM_MR];
+                    _mm256_store_ps(partial, c[j][0]);
+                    _mm256_store_ps(partial + 8, c[j][1]);
+                    for (int i = 0; i < rows; ++i)
+                        out[i] += partial[i];
+                }
+            }
+        }
+
+        KOLOSAL_TARGET_AVX2 inline void gemmF16Tile(int tokens, const float* panel, const float* tile, int64_t kc,
+            float* y, size_t ldy, int rows)
+        {
+            switch (tokens)
+            {
+            case 6: gemmF16MicroKernel<6>(panel, tile, kc, y, ldy, rows); break;
+            case 5: gemmF16MicroKernel<5>(panel, tile, kc, y, ldy, rows); break;
+            case 4: gemmF16MicroKernel<4>(panel, tile, kc, y, ldy, rows); break;
+            case 3: gemmF16MicroKernel<3>(panel, tile, kc, y, ldy, rows); break;
+            case 2: gemmF16MicroKernel<2>(panel, tile, kc, y, ldy, rows); break;
+            default: gemmF16MicroKernel<1>(panel, tile, kc, y, ldy, rows); break;
+            }
+        }
+    } // namespace detail
+
+    inline void gemmF16(const uint16_t* w, int64_t nOut, int64_t nIn, const float* x, size_t nTokens, float* y, ThreadPool& pool)
+    {
+        // Token tiles of GEMM_NR, each k-major and zero padded
+        const size_t nTiles = (nTokens + GEMM_NR - 1) / GEMM_NR;
+        thread_local std::vector<float> packedX;
+        packedX.assign(nTiles * static_cast<size_t>(nIn) * GEMM_NR, 0.0f);
+        for (size_t t = 0; t < nTokens; ++t)
+        {
+            float* tile = packedX.data() + (t / GEMM_NR) * static_cast<size_t>(nIn) * GEMM_NR + t % GEMM_NR;
+            const float* row = x + t * nIn;
+            for (int64_t k = 0; k < nIn; ++k)
+                tile[k * GEMM_NR] = row[k];
+        }
+        std::fill(y, y + nTokens * static_cast<size_t>(nOut), 0.0f);
+
+        const size_t nPanels = static_cast<size_t>((nOut + GEMM_MR - 1) / GEMM_MR);
+        const float* tiles = packedX.data();
+        pool.parallelFor(nPanels, [&](size_t begin, size_t end) {
+            alignas(64) float panel[GEMM_KC * GEMM_MR];
+
+            for (size_t p = begin; p < end; ++p)
+            {
+                const int64_t r0 = static_cast<int64_t>(p) * GEMM_MR;
+                const int rows = static_cast<int>(std::min<int64_t>(GEMM_MR, nOut - r0));
+                for (int64_t k0 = 0; k0 < nIn; k0 += GEMM_KC)
+                {
+                    const int64_t kc = std::min(GEMM_KC, nIn - k0);
+                    detail::packWeightPanel(w + r0 * nIn, nIn, rows, k0, kc, panel);
+
+                    for (size_t t = 0; t < nTiles; ++t)
+                    {
+                        const int tokens = static_cast<int>(std::min<size_t>(GEMM_NR, nTokens - t * GEMM_NR));
+                        const float* tile = tiles + t * static_cast<size_t>(nIn) * GEMM_NR + k0 * GEMM_NR;
+                        detail::gemmF16Tile(tokens, panel, tile, kc, y + t * GEMM_NR * nOut + r0,
+                            static_cast<size_t>(nOut), rows);
+                    }
+                }
+            }
+        });
+    }
+#endif
+} // namespace Inference
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "model/gguf_reader.hpp"
+#include "model/preset.hpp"
+#include "sampler.hpp"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Inference
+{
+    struct ChatMessage
+    {
+        std::string role; // "system", "user" or "assistant"
+        std::string content;
+    };
+
+    struct GenerationParams
+    {
+        std::string systemPrompt;
+        SamplingParams sampling;
+        int minLength = 0;       // end-of-turn tokens are suppressed before this many tokens
+        int maxNewTokens = 2048;
+        std::vector<std::string> stopStrings; // the reply ends before the first of these
+        int conversationId = -1; // lets the engine keep the chat's rendered prompt between turns
+        int draftTokens = 8;     // most tokens a draft model proposes at once; 0 turns drafting off
+
+        static GenerationParams fromPreset(const Model::ModelPreset& preset)
+        {
+            GenerationParams params;
+            params.systemPrompt = preset.systemPrompt;
+            params.sampling.temperature = preset.temperature;
+            params.sampling.topP = preset.top_p;
+            params.sampling.topK = static_cast<int>(preset.top_k);
+            params.sampling.seed = static_cast<uint32_t>(preset.random_seed);
+            params.minLength = static_cast<int>(preset.min_length);
+            params.maxNewTokens = static_cast<int>(preset.max_new_tokens);
+            return params;
+        }
+    };
+
+    struct GenerationStats
+    {
+        size_t promptTokens = 0;
+        size_t reusedPromptTokens = 0; // leading prompt tokens still cached from the previous request
+        size_t generatedTokens = 0;
+        size_t draftedTokens = 0;       // proposed by a draft model (speculative decoding)
+        size_t acceptedDraftTokens = 0; // of those, kept in the reply
+        double prefillSeconds = 0.0;
+        double decodeSeconds = 0.0;
+        bool cancelled = false;
+
+        double prefillTokensPerSecond() const
+        {
+            return prefillSeconds > 0.0 ? static_cast<double>(promptTokens - reusedPromptTokens) / prefillSeconds : 0.0;
+        }
+
+        double decodeTokensPerSecond() const
+        {
+            return decodeSeconds > 0.0 ? static_cast<double>(generatedTokens) / decodeSeconds : 0.0;
+        }
+
+        double draftAcceptanceRate() const
+        {
+            return draftedTokens > 0 ? static_cast<double>(acceptedDraftTokens) / draftedTokens : 0.0;
+        }
+    };
+
+    // Receives each piece of generated text; returning false stops the generation
+    using TokenCallback = std::function<bool(const std::string& piece)>;
+
+    /**
+     * @brief Text generation backend driven by ChatManager
+     *
+     * Implementations are free of any UI or platform types so that they also run
+     * headless. generate() blocks the calling thread; cancel() may be called from any
+     * other thread to make it return early. A cancel stays in effect until
+     * resetCancel(), so one that arrives before generate() starts is not lost; callers
+     * reset it when they dispatch a new request.
+     */
+    class IInferenceEngine
+    {
+    public:
+        virtual ~IInferenceEngine() = default;
+
+        // Throws std::runtime_error if the model cannot be run by this engine
+        virtual void loadModel(std::shared_ptr<const Model::GGUFFile> file) = 0;
+        virtual bool isLoaded() const = 0;
+
+        // Generates the assistant's reply to `messages`; throws std::runtime_error on failure
+        virtual GenerationStats generate(const std::vector<ChatMessage>& messages,
+            const GenerationParams& params, const TokenCallback& onToken) = 0;
+
+        virtual void cancel() = 0;
+        virtual void resetCancel() = 0;
+
+        /**
+         * @brief Saves the cached context (the KV state of the last conversation) to `path`
+         *
+         * The file is encrypted with `key`. Returns false if the engine has no context to
+         * save; engines that keep none never do. Throws std::runtime_error on I/O errors.
+         */
+        virtual bool saveContext(const std::string& /*path*/, const std::array<uint8_t, 32>& /*key*/)
+        {
+            return false;
+        }
+
+        // Replaces the cached context with one saveContext() wrote for the loaded model;
+        // false if there is none, so the next generate() prefills as usual
+        virtual bool restoreContext(const std::string& /*path*/, const std::array<uint8_t, 32>& /*key*/)
+        {
+            return false;
+        }
+    };
+} // namespace Inference
@@ -0,0 +1,245 @@
+#pragma once
+
+#include "model/ggml_quants.hpp"
+#include "model/ggml_types.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Inference
+{
+    using Model::GGMLType;
+
+    struct KVCacheOptions
+    {
+        GGMLType type = GGMLType::F16; // F32, F16, Q8_0 or Q4_0
+        size_t blockTokens = 16;       // positions per block
+        size_t maxBytes = 0;           // budget for all sequences together; 0 is unlimited
+    };
+
+    /**
+     * @brief Fixed-size blocks of KV storage shared by any number of sequences
+     *
+     * A block holds the keys and values of `blockTokens` consecutive positions for every
+     * layer, laid out [layer][key/value][position][kvDim] in the cache type. Blocks are
+     * allocated when a sequence grows into them and returned when it shrinks, so memory
+     * follows the tokens actually cached; a few released blocks are kept for reuse.
+     * Thread-safe.
+     */
+    class KVBlockPool
+    {
+    public:
+        KVBlockPool(size_t layers, size_t kvHeads, size_t headDim, const KVCacheOptions& options = KVCacheOptions())
+            : m_type(options.type)
+            , m_layers(layers)
+            , m_kvDim(kvHeads * headDim)
+            , m_headDim(headDim)
+            , m_blockTokens(std::max<size_t>(1, options.blockTokens))
+            , m_maxBytes(options.maxBytes)
+        {
+            if (m_type != GGMLType::F32 && m_type != GGMLType::F16 && m_type != GGMLType::Q8_0 && m_type != GGMLType::Q4_0)
+                throw std::runtime_error(std::string("Unsupported KV cache type: ") + Model::ggmlTypeName(m_type));
+
+            // Quantized rows are read per head, so heads must start on a block boundary
+            m_headBytes = Model::ggmlRowSize(m_type, static_cast<int64_t>(headDim));
+            if (m_headBytes == 0)
+                throw std::runtime_error(std::string("Head size does not fit KV cache type ") + Model::ggmlTypeName(m_type));
+            m_rowBytes = m_headBytes * kvHeads;
+            m_blockBytes = m_layers * 2 * m_blockTokens * m_rowBytes;
+        }
+
+        KVBlockPool(const KVBlockPool&) = delete;
+        KVBlockPool& operator=(const KVBlockPool&) = delete;
+
+        GGMLType type() const { return m_type; }
+        size_t layers() const { return m_layers; }
+        size_t kvDim() const { return m_kvDim; }
+        size_t headDim() const { return m_headDim; }
+        size_t blockTokens() const { return m_blockTokens; }
+        size_t rowBytes() const { return m_rowBytes; }
+        size_t headBytes() const { return m_headBytes; }
+        size_t blockBytes() const { return m_blockBytes; }
+
+        // Bytes held by sequences, not counting spare blocks
+        size_t usedBytes() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_usedBlocks * m_blockBytes;
+        }
+
+        // Throws std::runtime_error once the pool's byte budget is used up
+        uint8_t* allocate()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_maxBytes > 0 && (m_usedBlocks + 1) * m_blockBytes > m_maxBytes)
+                throw std::runtime_error("KV cache memory limit reached");
+
+            ++m_usedBlocks;
+            if (!m_spare.empty())
+            {
+                uint8_t* block = m_spare.back().release();
+                m_spare.pop_back();
+                return block;
+            }
+            return new uint8_t[m_blockBytes];
+        }
+
+        void release(uint8_t* block)
+        {
+            std::unique_ptr<uint8_t[]> owned(block);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_usedBlocks;
+            if (m_spare.size() < SPARE_BLOCKS)
+            {
+                m_spare.push_back(std::move(owned));
+            }
+        }
+
+        // Frees the blocks kept for reuse
+        void trim()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_spare.clear();
+        }
+
+    private:
+        static constexpr size_t SPARE_BLOCKS = 8;
+
+        const GGMLType m_type;
+        const size_t m_layers;
+        const size_t m_kvDim;
+        const size_t m_headDim;
+        const size_t m_blockTokens;
+        const size_t m_maxBytes;
+        size_t m_headBytes = 0;
+        size_t m_rowBytes = 0;
+        size_t m_blockBytes = 0;
+
+        mutable std::mutex m_mutex;
+        size_t m_usedBlocks = 0;
+        std::vector<std::unique_ptr<uint8_t[]>> m_spare;
+    };
+
+    /**
+     * @brief The cached positions of one token sequence, as a table of pool blocks
+     *
+     * Positions 0..size()-1 map to block pos / blockTokens, slot pos % blockTokens.
+     * Keys and values are converted to the pool's type when stored and read back as
+     * raw rows of that type (see rowType()).
+     */
+    class KVSequence
+    {
+    public:
+        KVSequence(std::shared_ptr<KVBlockPool> pool, size_t maxTokens)
+            : m_pool(std::move(pool))
+            , m_maxTokens(maxTokens)
+        {
+        }
+
+        ~KVSequence()
+        {
+            truncate(0);
+        }
+
+        KVSequence(const KVSequence&) = delete;
+        KVSequence& operator=(const KVSequence&) = delete;
+
+        size_t size() const { return m_size; }
+        size_t maxTokens() const { return m_maxTokens; }
+        GGMLType rowType() const { return m_pool->type(); }
+        const KVBlockPool& pool() const { return *m_pool; }
+        size_t blockCount() const { return m_blocks.size(); }
+
+        // Forgets every position from `tokens` on and returns blocks no longer needed
+        void truncate(size_t tokens)
+        {
+            m_size = std::min(m_size, tokens);
+            const size_t needed = (m_size + m_pool->blockTokens() - 1) / m_pool->blockTokens();
+            while (m_blocks.size() > needed)
+            {
+                m_pool->release(m_blocks.back());
+                m_blocks.pop_back();
+            }
+        }
+
+        void clear() { truncate(0); }
+
+        // Makes room for `tokens` more positions; called by the model before a forward pass
+        void reserve(size_t tokens)
+        {
+            const size_t needed = m_size + tokens;
+            if (needed > m_maxTokens)
+                throw std::runtime_error("Context length exceeded");
+
+            while (m_blocks.size() * m_pool->blockTokens() < needed)
+            {
+                m_blocks.push_back(m_pool->allocate());
+            }
+        }
+
+        // Marks `tokens` more positions as filled
+        void commit(size_t tokens)
+        {
+            m_size += tokens;
+        }
+
+        // Converts and stores the kvDim floats of a key and a value at a reserved position
+        void store(size_t layer, size_t pos, const float* key, const float* value)
+        {
+            storeRow(key, row(layer, 0, pos));
+            storeRow(value, row(layer, 1, pos));
+        }
+
+        const uint8_t* key(size_t layer, size_t pos) const { return row(layer, 0, pos); }
+        const uint8_t* value(size_t layer, size_t pos) const { return row(layer, 1, pos); }
+
+        // Raw storage of a block, pool().blockBytes() long; used to save and restore snapshots
+        uint8_t* block(size_t index) { return m_blocks[index]; }
+        const uint8_t* block(size_t index) const { return m_blocks[index]; }
+
+    private:
+        uint8_t* row(size_t layer, size_t kv, size_t pos) const
+        {
+            const size_t blockTokens = m_pool->blockTokens();
+            const size_t slot = ((layer * 2 + kv) * blockTokens + pos % blockTokens);
+            return m_blocks[pos / blockTokens] + slot * m_pool->rowBytes();
+        }
+
+        void storeRow(const float* source, uint8_t* target) const
+        {
+            const size_t n = m_pool->kvDim();
+            switch (m_pool->type())
+            {
+            case GGMLType::F32:
+                std::memcpy(target, source, n * sizeof(float));
+                break;
+            case GGMLType::F16:
+            {
+                auto* halves = reinterpret_cast<uint16_t*>(target);
+                for (size_t i = 0; i < n; ++i)
+                    halves[i] = Model::fp32ToFp16(source[i]);
+                break;
+            }
+            case GGMLType::Q8_0:
+                Model::quantizeRowQ8_0(source, reinterpret_cast<Model::BlockQ8_0*>(target), static_cast<int64_t>(n));
+                break;
+            case GGMLType::Q4_0:
+                Model::quantizeRowQ4_0(source, reinterpret_cast<Model::BlockQ4_0*>(target), static_cast<int64_t>(n));
+                break;
+            default:
+                throw std::runtime_error("Unsupported KV cache type");
+            }
+        }
+
+        std::shared_ptr<KVBlockPool> m_pool;
+        size_t m_maxTokens;
+        size_t m_size = 0;
+        std::vector<uint8_t*> m_blocks;
+    };
+} // namespace Inference
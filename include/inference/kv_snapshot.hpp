@@ -0,0 +1,164 @@
+#pragma once
+
+#include "kv_cache.hpp"
+#include "crypto/crypto.hpp"
+#include "model/mapped_file.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Inference
+{
+    /**
+     * @brief Saves a KV sequence and the tokens it holds to an encrypted file
+     *
+     * The file starts with a plain header (format, the fingerprint of the model and cache
+     * layout the state belongs to, and sizes), followed by the tokens and then every KV
+     * block as separate AES-256-GCM chunks of fixed size. Restoring maps the file and
+     * decrypts each chunk straight into a block of the pool, so resuming a conversation
+     * costs a pass over the file instead of a prefill of its tokens.
+     */
+    class KVSnapshot
+    {
+    public:
+        using Key = std::array<uint8_t, Crypto::KEY_SIZE>;
+
+        // The first `tokens.size()` positions of `sequence`; written to a temporary file and renamed
+        static void save(const std::string& path, const std::string& fingerprint,
+            const std::vector<int32_t>& tokens, const KVSequence& sequence, const Key& key)
+        {
+            if (tokens.size() > sequence.size())
+                throw std::runtime_error("Snapshot tokens exceed the cached positions");
+
+            const KVBlockPool& pool = sequence.pool();
+            Header header = makeHeader(fingerprint, pool);
+            header.tokenCount = tokens.size();
+            header.blockCount = (tokens.size() + pool.blockTokens() - 1) / pool.blockTokens();
+
+            const std::string temporary = path + ".tmp";
+            {
+                std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+                if (!file)
+                    throw std::runtime_error("Failed to create " + temporary);
+
+                file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+                std::vector<uint8_t> chunk(encryptedSize(tokens.size() * sizeof(int32_t)));
+                Crypto::encrypt(reinterpret_cast<const uint8_t*>(tokens.data()), tokens.size() * sizeof(int32_t), key, chunk.data());
+                file.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+
+                chunk.resize(encryptedSize(pool.blockBytes()));
+                for (uint64_t i = 0; i < header.blockCount; ++i)
+                {
+                    Crypto::encrypt(sequence.block(i), pool.blockBytes(), key, chunk.data());
+                    file.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+                }
+
+                if (!file.flush())
+                    throw std::runtime_error("Failed to write " + temporary);
+            }
+            std::filesystem::rename(temporary, path);
+        }
+
+        /**
+         * @brief Replaces the contents of `sequence` with the snapshot at `path`
+         *
+         * Returns false, leaving `sequence` untouched, if there is no snapshot or it was
+         * made for another model or cache layout. Throws std::runtime_error if the file
+         * is damaged or does not decrypt with `key`; `sequence` is then empty.
+         */
+        static bool load(const std::string& path, const std::string& fingerprint, const Key& key,
+            KVSequence& sequence, std::vector<int32_t>& tokens)
+        {
+            std::error_code error;
+            if (!std::filesystem::is_regular_file(path, error))
+                return false;
+
+            Model::MappedFile file(path);
+            const KVBlockPool& pool = sequence.pool();
+            const Header expected = makeHeader(fingerprint, pool);
+            Header header;
+            if (file.size() < sizeof(header))
+                return false;
+            std::memcpy(&header, file.data(), sizeof(header));
+
+            if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version ||
+                std::memcmp(header.fingerprint, expected.fingerprint, sizeof(header.fingerprint)) != 0 ||
+                header.blockBytes != expected.blockBytes || header.blockTokens != expected.blockTokens)
+            {
+                return false;
+            }
+            if (header.tokenCount > sequence.maxTokens())
+                return false;
+
+            const size_t tokensSize = encryptedSize(header.tokenCount * sizeof(int32_t));
+            const size_t blockSize = encryptedSize(pool.blockBytes());
+            if (header.blockCount != (header.tokenCount + pool.blockTokens() - 1) / pool.blockTokens() ||
+                file.size() != sizeof(header) + tokensSize + header.blockCount * blockSize)
+            {
+                throw std::runtime_error("Damaged KV snapshot: " + path);
+            }
+
+            std::vector<int32_t> restored(header.tokenCount);
+            const uint8_t* chunk = file.data() + sizeof(header);
+            Crypto::decrypt(chunk, tokensSize, key, reinterpret_cast<uint8_t*>(restored.data()));
+            chunk += tokensSize;
+
+            sequence.clear();
+            try
+            {
+                sequence.reserve(restored.size());
+                for (uint64_t i = 0; i < header.blockCount; ++i, chunk += blockSize)
+                {
+                    Crypto::decrypt(chunk, blockSize, key, sequence.block(i));
+                }
+                sequence.commit(restored.size());
+            }
+            catch (...)
+            {
+                sequence.clear();
+                throw;
+            }
+
+            tokens = std::move(restored);
+            return true;
+        }
+
+    private:
+        static constexpr uint32_t VERSION = 1;
+
+        struct Header
+        {
+            char magic[4];
+            uint32_t version;
+            char fingerprint[64]; // hex SHA-256 of the model and cache layout
+            uint64_t blockTokens;
+            uint64_t blockBytes;
+            uint64_t tokenCount;
+            uint64_t blockCount;
+        };
+
+        static Header makeHeader(const std::string& fingerprint, const KVBlockPool& pool)
+        {
+            Header header{};
+            std::memcpy(header.magic, "KVSN", sizeof(header.magic));
+            header.version = VERSION;
+            std::memcpy(header.fingerprint, fingerprint.data(), std::min(fingerprint.size(), sizeof(header.fingerprint)));
+            header.blockTokens = pool.blockTokens();
+            header.blockBytes = pool.blockBytes();
+            return header;
+        }
+
+        static size_t encryptedSize(size_t size)
+        {
+            return Crypto::IV_SIZE + size + Crypto::TAG_SIZE;
+        }
+    };
+} // namespace Inference
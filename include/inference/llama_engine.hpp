@@ -0,0 +1,521 @@
+#pragma once
+
+#include "chat_template.hpp"
+#include "detokenizer.hpp"
+#include "inference_engine.hpp"
+#include "kv_snapshot.hpp"
+#include "llama_model.hpp"
+#include "tokenizer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Inference
+{
+    /**
+     * @brief In-process CPU engine for Llama-architecture GGUF models
+     *
+     * Runs the model straight from the mapped file on a ThreadPool and formats chats
+     * with the model's ChatTemplate. The KV cache is limited to `contextLength`
+     * tokens (or the model's training context if smaller) and lives in blocks of a
+     * KVBlockPool, stored as `kvCache.type`.
+     *
+     * The cache is kept between requests together with the tokens it holds. A request
+     * whose prompt starts with those tokens, as the next turn of the same chat does,
+     * only prefills what follows them; anything after the first differing token (an
+     * edited message, another system prompt, another chat) is dropped and recomputed.
+     * saveContext() and restoreContext() move that state to and from a KVSnapshot file.
+     */
+    class LlamaEngine : public IInferenceEngine
+    {
+    public:
+        static constexpr size_t DEFAULT_CONTEXT_LENGTH = 8192;
+
+        // 0 threads means one per performance core
+        explicit LlamaEngine(unsigned int threadCount = 0, size_t contextLength = DEFAULT_CONTEXT_LENGTH)
+            : LlamaEngine(ThreadPoolOptions{ threadCount }, contextLength)
+        {
+        }
+
+        explicit LlamaEngine(const ThreadPoolOptions& threads, size_t contextLength = DEFAULT_CONTEXT_LENGTH,
+            const KVCacheOptions& kvCache = KVCacheOptions())
+            : m_pool(threads)
+            , m_contextLength(contextLength)
+            , m_kvOptions(kvCache)
+        {
+        }
+
+        void loadModel(std::shared_ptr<const Model::GGUFFile> file) override
+        {
+            if (m_model && m_model->fileHandle() == file)
+                return;
+
+            auto model = std::make_unique<LlamaModel>(file);
+            auto tokenizer = std::make_unique<Tokenizer>(*file);
+            if (tokenizer->vocabSize() > static_cast<size_t>(model->hparams().nVocab))
+                throw std::runtime_error("Tokenizer does not match the model");
+            auto chatTemplate = std::make_unique<ChatTemplate>(*file, *tokenizer);
+
+            const LlamaHParams& hp = model->hparams();
+            const size_t context = std::min(m_contextLength, static_cast<size_t>(hp.nCtxTrain));
+            auto kvPool = std::make_shared<KVBlockPool>(static_cast<size_t>(hp.nLayer), static_cast<size_t>(hp.nHeadKv),
+                static_cast<size_t>(hp.headDim), m_kvOptions);
+            m_cache = std::make_unique<KVSequence>(kvPool, context);
+            m_cachedTokens.clear();
+            m_fingerprint = contextFingerprint(*file, *kvPool);
+            m_kvPool = std::move(kvPool);
+            m_prompts.clear();
+            m_template = std::move(chatTemplate);
+            m_tokenizer = std::move(tokenizer);
+            m_model = std::move(model);
+            m_draftMatches = m_draftModel && sameVocabulary(*m_model, *m_tokenizer, *m_draftModel, *m_draftTokenizer);
+        }
+
+        bool isLoaded() const override
+        {
+            return m_model != nullptr;
+        }
+
+        /**
+         * @brief Lets a smaller model of the same family draft tokens (speculative decoding)
+         *
+         * The draft proposes a few tokens at a time and the model checks them all in one
+         * forward pass, keeping its own output distribution, so replies are generated
+         * faster whenever the draft guesses well. Throws std::runtime_error if the draft
+         * cannot be run or its vocabulary differs from the loaded model's; nullptr removes it.
+         */
+        void loadDraftModel(std::shared_ptr<const Model::GGUFFile> file)
+        {
+            if (!file)
+            {
+                m_draftCache.reset();
+                m_draftTokens.clear();
+                m_draftTokenizer.reset();
+                m_draftModel.reset();
+                m_draftMatches = false;
+                return;
+            }
+            if (m_draftModel && m_draftModel->fileHandle() == file)
+                return;
+
+            auto model = std::make_unique<LlamaModel>(file);
+            auto tokenizer = std::make_unique<Tokenizer>(*file);
+            if (m_model && !sameVocabulary(*m_model, *m_tokenizer, *model, *tokenizer))
+                throw std::runtime_error("The draft model's vocabulary differs from the model's");
+
+            const LlamaHParams& hp = model->hparams();
+            const size_t context = std::min(m_contextLength, static_cast<size_t>(hp.nCtxTrain));
+            auto kvPool = std::make_shared<KVBlockPool>(static_cast<size_t>(hp.nLayer), static_cast<size_t>(hp.nHeadKv),
+                static_cast<size_t>(hp.headDim), m_kvOptions);
+            m_draftCache = std::make_unique<KVSequence>(kvPool, context);
+            m_draftTokens.clear();
+            m_draftMatches = m_model != nullptr;
+            m_draftTokenizer = std::move(tokenizer);
+            m_draftModel = std::move(model);
+        }
+
+        bool hasDraftModel() const
+        {
+            return m_draftModel != nullptr;
+        }
+
+        // Forgets the cached prompts so the next request renders and prefills from scratch
+        void clearCache()
+        {
+            if (m_cache)
+                m_cache->clear();
+            m_cachedTokens.clear();
+            if (m_draftCache)
+                m_draftCache->clear();
+            m_draftTokens.clear();
+            m_prompts.clear();
+        }
+
+        bool saveContext(const std::string& path, const KVSnapshot::Key& key) override
+        {
+            if (!m_model || m_cachedTokens.empty())
+                return false;
+
+            KVSnapshot::save(path, m_fingerprint, m_cachedTokens, *m_cache, key);
+            return true;
+        }
+
+        bool restoreContext(const std::string& path, const KVSnapshot::Key& key) override
+        {
+            if (!m_model)
+                return false;
+
+            std::vector<int32_t> tokens;
+            try
+            {
+                if (!KVSnapshot::load(path, m_fingerprint, key, *m_cache, tokens))
+                    return false;
+            }
+            catch (...)
+            {
+                clearCache();
+                throw;
+            }
+            m_cachedTokens = std::move(tokens);
+            return true;
+        }
+
+        // Bytes of KV cache blocks currently holding positions
+        size_t kvCacheBytes() const
+        {
+            return m_kvPool ? m_kvPool->usedBytes() : 0;
+        }
+
+        GenerationStats generate(const std::vector<ChatMessage>& messages,
+            const GenerationParams& params, const TokenCallback& onToken) override
+        {
+            if (!m_model)
+                throw std::runtime_error("No model loaded");
+
+            GenerationStats stats;
+            if (m_cancelled)
+            {
+                stats.cancelled = true;
+                return stats;
+            }
+
+            const std::vector<int32_t>& prompt = m_prompts.render(*m_template, params.conversationId, params.systemPrompt, messages);
+            if (prompt.size() >= m_cache->maxTokens())
+                throw std::runtime_error("The conversation is longer than the context window");
+
+            const size_t nVocab = static_cast<size_t>(m_model->hparams().nVocab);
+            std::vector<float> logits(nVocab);
+            Sampler sampler(params.sampling);
+            StreamingDetokenizer text(*m_tokenizer, params.stopStrings);
+            std::string piece;
+
+            using Clock = std::chrono::steady_clock;
+            auto start = Clock::now();
+            // The last prompt token always runs again since its logits start the reply
+            const size_t reused = std::min(commonPrefixLength(m_cachedTokens, prompt), prompt.size() - 1);
+            m_cache->truncate(reused);
+            m_cachedTokens.resize(reused);
+            m_model->forward(prompt.data() + reused, prompt.size() - reused, *m_cache, m_pool, logits.data());
+            m_cachedTokens.insert(m_cachedTokens.end(), prompt.begin() + reused, prompt.end());
+            stats.promptTokens = prompt.size();
+            stats.reusedPromptTokens = reused;
+            stats.prefillSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            // Adds a sampled token to the reply; false once the reply is complete
+            const std::function<bool(int32_t)> emit = [&](int32_t token) {
+                if (m_tokenizer->isEndOfGeneration(token))
+                    return false;
+
+                ++stats.generatedTokens;
+                piece.clear();
+                const bool more = text.push(token, piece);
+                if (onToken && !piece.empty() && !onToken(piece))
+                {
+                    stats.cancelled = true;
+                    return false;
+                }
+                return more;
+            };
+
+            start = Clock::now();
+            const size_t maxNewTokens = static_cast<size_t>(std::max(0, params.maxNewTokens));
+            while (stats.generatedTokens < maxNewTokens && m_cache->size() < m_cache->maxTokens())
+            {
+                if (m_cancelled)
+                {
+                    stats.cancelled = true;
+                    break;
+                }
+
+                if (stats.generatedTokens < static_cast<size_t>(std::max(0, params.minLength)))
+                {
+                    suppressEndOfGeneration(logits.data());
+                }
+
+                int32_t token = sampler.sample(logits.data(), nVocab);
+                if (!emit(token))
+                    break;
+
+                if (m_draftModel && m_draftMatches && params.draftTokens > 0)
+                {
+                    decodeSpeculatively(token, params, sampler, emit, stats);
+                    break;
+                }
+
+                m_model->forward(&token, 1, *m_cache, m_pool, logits.data());
+                m_cachedTokens.push_back(token);
+            }
+
+            // Text held back for an unfinished character or a possible stop string
+            piece = text.flush();
+            if (onToken && !piece.empty() && !stats.cancelled)
+                onToken(piece);
+            stats.decodeSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+            return stats;
+        }
+
+        void cancel() override
+        {
+            m_cancelled = true;
+        }
+
+        void resetCancel() override
+        {
+            m_cancelled = false;
+        }
+
+        const LlamaModel* model() const { return m_model.get(); }
+        const Tokenizer* tokenizer() const { return m_tokenizer.get(); }
+        const ChatTemplate* chatTemplate() const { return m_template.get(); }
+        unsigned int threadCount() const { return m_pool.size(); }
+
+    private:
+        // Versions the prompt layouts of ChatTemplate; change it when one of them changes
+        // so saved contexts made with the old layout are not restored
+        static constexpr const char* PROMPT_FORMAT = "chat-template-v1";
+
+        // Plain tokens before drafting is tried again, doubling while tries fail, and the
+        // weight of one round in m_draftGain
+        static constexpr size_t DRAFT_PROBE_INTERVAL = 32;
+        static constexpr size_t MAX_DRAFT_PROBE_INTERVAL = 1024;
+        static constexpr double DRAFT_GAIN_SMOOTHING = 0.25;
+
+        /**
+         * @brief Identifies the model and cache layout a saved context is valid for
+         *
+         * Hashes the GGUF header and metadata, which cover the architecture, quantization,
+         * tokenizer, chat template and every tensor's shape and offset, together with the
+         * prompt format and the KV block layout.
+         */
+        static std::string contextFingerprint(const Model::GGUFFile& file, const KVBlockPool& pool)
+        {
+            Crypto::Sha256 hash;
+            hash.update(file.mapping().data(), file.dataOffset());
+            hash.update(PROMPT_FORMAT, std::strlen(PROMPT_FORMAT));
+            const uint64_t layout[] = { static_cast<uint64_t>(pool.type()), pool.blockTokens(), pool.blockBytes() };
+            hash.update(layout, sizeof(layout));
+            return hash.finalHex();
+        }
+
+        // Whether a draft model's tokens and logits mean the same as the model's
+        static bool sameVocabulary(const LlamaModel& model, const Tokenizer& a, const LlamaModel& draft, const Tokenizer& b)
+        {
+            if (model.hparams().nVocab != draft.hparams().nVocab || a.vocabSize() != b.vocabSize())
+                return false;
+            for (size_t i = 0; i < a.vocabSize(); ++i)
+            {
+                if (a.piece(static_cast<int32_t>(i)) != b.piece(static_cast<int32_t>(i)))
+                    return false;
+            }
+            return true;
+        }
+
+        static size_t commonPrefixLength(const std::vector<int32_t>& a, const std::vector<int32_t>& b)
+        {
+            const size_t limit = std::min(a.size(), b.size());
+            size_t length = 0;
+            while (length < limit && a[length] == b[length])
+            {
+                ++length;
+            }
+            return length;
+        }
+
+        void suppressEndOfGeneration(float* logits) const
+        {
+            const size_t nVocab = static_cast<size_t>(m_model->hparams().nVocab);
+            for (int32_t token : m_tokenizer->endOfGenerationTokens())
+            {
+                if (token >= 0 && static_cast<size_t>(token) < nVocab)
+                {
+                    logits[static_cast<size_t>(token)] = -std::numeric_limits<float>::infinity();
+                }
+            }
+        }
+
+        /**
+         * @brief Generates the rest of the reply in rounds of draft and verification
+         *
+         * `pending` is the last token of the reply so far, sampled but not yet run. Each
+         * round the draft model catches up on the tokens it has not seen and proposes up
+         * to m_draftLength more; the model then runs `pending` and the drafts in one batch,
+         * giving its logits at every drafted position. Drafts are accepted in order by
+         * Sampler::accept() and the first rejected one is replaced from the residual
+         * distribution, so the reply is distributed exactly as without a draft. When all
+         * are accepted the last row of logits yields one more token for free.
+         *
+         * The draft length grows while whole drafts are accepted and shrinks when fewer
+         * than half are. It drops to 0, plain decoding, once drafting stops paying for
+         * itself: m_draftGain tracks the tokens each round saved, net of the time spent
+         * drafting them in units of a model step. Since acceptance depends on the text,
+         * a single draft is tried again after DRAFT_PROBE_INTERVAL tokens, backing off
+         * while those tries keep failing.
+         */
+        void decodeSpeculatively(int32_t pending, const GenerationParams& params, Sampler& sampler,
+            const std::function<bool(int32_t)>& emit, GenerationStats& stats)
+        {
+            const size_t nVocab = static_cast<size_t>(m_model->hparams().nVocab);
+            const size_t maxNewTokens = static_cast<size_t>(std::max(0, params.maxNewTokens));
+            const size_t minLength = static_cast<size_t>(std::max(0, params.minLength));
+            const size_t maxDraft = static_cast<size_t>(params.draftTokens);
+
+            SamplingParams draftSampling = params.sampling;
+            draftSampling.seed ^= 0x9E3779B9u;
+            Sampler draftSampler(draftSampling);
+
+            std::vector<float> draftLogits(nVocab);
+            std::vector<float> targetLogits;
+            std::vector<std::vector<TokenCandidate>> proposals(maxDraft);
+            std::vector<int32_t> batch;
+
+            while (true)
+            {
+                if (m_cancelled)
+                {
+                    stats.cancelled = true;
+                    return;
+                }
+
+                const size_t generated = stats.generatedTokens;
+                const size_t position = m_cachedTokens.size();
+                if (generated >= maxNewTokens || position >= m_cache->maxTokens())
+                    return;
+
+                // Room for pending plus the drafts in the reply and in both caches
+                const size_t room = std::min({ maxNewTokens - generated, m_cache->maxTokens() - position,
+                    position < m_draftCache->maxTokens() ? m_draftCache->maxTokens() - position : 0 });
+                if (m_draftLength == 0 && ++m_tokensWithoutDraft >= m_draftProbeInterval)
+                {
+                    m_draftLength = 1;
+                    m_draftGain = 0.0;
+                    m_tokensWithoutDraft = 0;
+                }
+                const size_t draftLength = std::min({ m_draftLength, maxDraft, room > 0 ? room - 1 : 0 });
+
+                const auto draftStart = std::chrono::steady_clock::now();
+                batch.assign(1, pending);
+                if (draftLength > 0)
+                {
+                    // The draft follows the model's tokens; run what it has not seen yet
+                    const size_t common = commonPrefixLength(m_draftTokens, m_cachedTokens);
+                    m_draftCache->truncate(common);
+                    m_draftTokens.resize(common);
+                    m_draftTokens.insert(m_draftTokens.end(), m_cachedTokens.begin() + static_cast<std::ptrdiff_t>(common), m_cachedTokens.end());
+                    m_draftTokens.push_back(pending);
+                    m_draftModel->forward(m_draftTokens.data() + common, m_draftTokens.size() - common, *m_draftCache, m_pool, draftLogits.data());
+
+                    for (size_t i = 0; i < draftLength; ++i)
+                    {
+                        if (generated + i < minLength)
+                        {
+                            suppressEndOfGeneration(draftLogits.data());
+                        }
+                        proposals[i] = draftSampler.candidates(draftLogits.data(), nVocab);
+                        const int32_t draft = draftSampler.draw(proposals[i]);
+                        batch.push_back(draft);
+                        if (m_tokenizer->isEndOfGeneration(draft) || i + 1 == draftLength)
+                            break;
+
+                        m_draftModel->forward(&draft, 1, *m_draftCache, m_pool, draftLogits.data());
+                        m_draftTokens.push_back(draft);
+                    }
+                }
+
+                const size_t drafted = batch.size() - 1;
+                const auto targetStart = std::chrono::steady_clock::now();
+                targetLogits.resize(batch.size() * nVocab);
+                m_model->forward(batch.data(), batch.size(), *m_cache, m_pool, targetLogits.data(), batch.size());
+                const double draftSeconds = std::chrono::duration<double>(targetStart - draftStart).count();
+                const double targetSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - targetStart).count();
+                m_cachedTokens.insert(m_cachedTokens.end(), batch.begin(), batch.end());
+
+                size_t accepted = 0;
+                int32_t next = -1;
+                while (next < 0)
+                {
+                    float* row = &targetLogits[accepted * nVocab];
+                    if (generated + accepted < minLength)
+                    {
+                        suppressEndOfGeneration(row);
+                    }
+                    const std::vector<TokenCandidate>& target = sampler.candidates(row, nVocab);
+                    if (accepted == drafted)
+                        next = sampler.draw(target);
+                    else if (sampler.accept(target, proposals[accepted], batch[accepted + 1]))
+                        ++accepted;
+                    else
+                        next = sampler.sampleResidual(target, proposals[accepted]);
+                }
+
+                // Forget the positions of rejected drafts
+                m_cache->truncate(position + 1 + accepted);
+                m_cachedTokens.resize(position + 1 + accepted);
+
+                stats.draftedTokens += drafted;
+                stats.acceptedDraftTokens += accepted;
+                if (drafted > 0)
+                {
+                    // The verification batch costs about one plain step, so drafting took
+                    // draftSeconds / targetSeconds steps extra
+                    const double gain = static_cast<double>(accepted) - draftSeconds / std::max(targetSeconds, 1e-9);
+                    m_draftGain += (gain - m_draftGain) * DRAFT_GAIN_SMOOTHING;
+
+                    if (accepted == drafted)
+                    {
+                        m_draftLength = std::min(m_draftLength + 1, maxDraft);
+                        m_draftProbeInterval = DRAFT_PROBE_INTERVAL;
+                    }
+                    else if (accepted * 2 < drafted)
+                    {
+                        m_draftLength = std::max<size_t>(m_draftLength - 1, 1);
+                    }
+
+                    if (m_draftLength == 1 && m_draftGain < 0.0)
+                    {
+                        m_draftLength = 0;
+                        m_draftProbeInterval = std::min(m_draftProbeInterval * 2, MAX_DRAFT_PROBE_INTERVAL);
+                    }
+                }
+
+                for (size_t i = 1; i <= accepted; ++i)
+                {
+                    if (!emit(batch[i]))
+                        return;
+                }
+                if (!emit(next))
+                    return;
+                pending = next;
+            }
+        }
+
+        ThreadPool m_pool;
+        size_t m_contextLength;
+        KVCacheOptions m_kvOptions;
+        std::unique_ptr<LlamaModel> m_model;
+        std::unique_ptr<Tokenizer> m_tokenizer;
+        std::unique_ptr<ChatTemplate> m_template;
+        ChatPromptCache m_prompts;
+        std::shared_ptr<KVBlockPool> m_kvPool;
+        std::unique_ptr<KVSequence> m_cache;
+        std::vector<int32_t> m_cachedTokens; // the tokens m_cache holds positions for
+
+        std::unique_ptr<LlamaModel> m_draftModel;
+        std::unique_ptr<Tokenizer> m_draftTokenizer;
+        std::unique_ptr<KVSequence> m_draftCache;
+        std::vector<int32_t> m_draftTokens;  // the tokens m_draftCache holds positions for
+        bool m_draftMatches = false;         // the draft shares the model's vocabulary
+        size_t m_draftLength = 4;            // 0 while drafting does not pay off
+        double m_draftGain = 0.0;            // smoothed tokens saved per drafting round
+        size_t m_tokensWithoutDraft = 0;
+        size_t m_draftProbeInterval = DRAFT_PROBE_INTERVAL;
+        std::string m_fingerprint;
+        std::atomic<bool> m_cancelled{ false };
+    };
+} // namespace Inference
@@ -0,0 +1,371 @@
+#pragma once
+
+#include "kv_cache.hpp"
+#include "tensor_ops.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Inference
+{
+    using Model::GGUFFile;
+
+    struct LlamaHParams
+    {
+        int64_t nVocab = 0;
+        int64_t nEmbd = 0;
+        int64_t nLayer = 0;
+        int64_t nHead = 0;
+        int64_t nHeadKv = 0;
+        int64_t headDim = 0;
+        int64_t nFF = 0;
+        int64_t nCtxTrain = 0;
+        float normEps = 1e-5f;
+        float ropeBase = 10000.0f;
+
+        int64_t qDim() const { return nHead * headDim; }
+        int64_t kvDim() const { return nHeadKv * headDim; }
+    };
+
+    /**
+     * @brief Llama-architecture transformer running straight from a mapped GGUF file
+     *
+     * Weights are used in place in whatever type the file stores them (f16, bf16, f32,
+     * q8_0, q4_K, q6_K), so loading costs no more than mapping the file. Llama 3 rope
+     * scaling is applied through the file's `rope_freqs.weight` factors when present.
+     * Throws std::runtime_error if the file is not a supported llama model.
+     */
+    class LlamaModel
+    {
+    public:
+        explicit LlamaModel(std::shared_ptr<const GGUFFile> file)
+            : m_file(std::move(file))
+        {
+            if (!m_file)
+                throw std::runtime_error("No model file");
+            if (m_file->architecture() != "llama")
+                throw std::runtime_error("Unsupported model architecture: " + m_file->architecture());
+
+            m_tokenEmbedding = &requireTensor("token_embd.weight");
+            m_outputNorm = &requireNorm("output_norm.weight");
+            m_output = m_file->findTensor("output.weight");
+            if (!m_output)
+            {
+                m_output = m_tokenEmbedding; // tied embeddings
+            }
+
+            m_hparams.nVocab = m_tokenEmbedding->ne[1];
+            m_hparams.nEmbd = static_cast<int64_t>(m_file->getArchUInt("embedding_length"));
+            m_hparams.nLayer = static_cast<int64_t>(m_file->getArchUInt("block_count"));
+            m_hparams.nHead = static_cast<int64_t>(m_file->getArchUInt("attention.head_count"));
+            m_hparams.nHeadKv = static_cast<int64_t>(m_file->getArchUInt("attention.head_count_kv", m_hparams.nHead));
+            m_hparams.nFF = static_cast<int64_t>(m_file->getArchUInt("feed_forward_length"));
+            m_hparams.nCtxTrain = static_cast<int64_t>(m_file->getArchUInt("context_length", 2048));
+            m_hparams.normEps = static_cast<float>(m_file->getArchFloat("attention.layer_norm_rms_epsilon", 1e-5));
+            m_hparams.ropeBase = static_cast<float>(m_file->getArchFloat("rope.freq_base", 10000.0));
+            if (m_hparams.nEmbd <= 0 || m_hparams.nLayer <= 0 || m_hparams.nHead <= 0 ||
+                m_hparams.nHeadKv <= 0 || m_hparams.nHead % m_hparams.nHeadKv != 0)
+            {
+                throw std::runtime_error("Invalid llama hyperparameters");
+            }
+            m_hparams.headDim = static_cast<int64_t>(m_file->getArchUInt("attention.key_length",
+                static_cast<uint64_t>(m_hparams.nEmbd / m_hparams.nHead)));
+
+            const int64_t ropeDim = static_cast<int64_t>(m_file->getArchUInt("rope.dimension_count",
+                static_cast<uint64_t>(m_hparams.headDim)));
+            if (ropeDim != m_hparams.headDim)
+                throw std::runtime_error("Partial rotary embeddings are not supported");
+
+            const GGUFTensorView* ropeFreqs = m_file->findTensor("rope_freqs.weight");
+            if (ropeFreqs && (ropeFreqs->type != GGMLType::F32 || ropeFreqs->ne[0] != ropeDim / 2))
+                throw std::runtime_error("Invalid rope_freqs.weight");
+
+            m_invFreq.resize(static_cast<size_t>(ropeDim / 2));
+            for (int64_t i = 0; i < ropeDim / 2; ++i)
+            {
+                float freq = std::pow(m_hparams.ropeBase, -2.0f * static_cast<float>(i) / static_cast<float>(ropeDim));
+                if (ropeFreqs)
+                {
+                    freq /= static_cast<const float*>(ropeFreqs->data)[i];
+                }
+                m_invFreq[static_cast<size_t>(i)] = freq;
+            }
+
+            const LlamaHParams& hp = m_hparams;
+            checkShape(*m_tokenEmbedding, hp.nEmbd, hp.nVocab);
+            checkShape(*m_output, hp.nEmbd, hp.nVocab);
+            for (int64_t i = 0; i < hp.nLayer; ++i)
+            {
+                const std::string prefix = "blk." + std::to_string(i) + ".";
+                Layer layer;
+                layer.attnNorm = &requireNorm(prefix + "attn_norm.weight");
+                layer.wq = &requireTensor(prefix + "attn_q.weight");
+                layer.wk = &requireTensor(prefix + "attn_k.weight");
+                layer.wv = &requireTensor(prefix + "attn_v.weight");
+                layer.wo = &requireTensor(prefix + "attn_output.weight");
+                layer.ffnNorm = &requireNorm(prefix + "ffn_norm.weight");
+                layer.wGate = &requireTensor(prefix + "ffn_gate.weight");
+                layer.wUp = &requireTensor(prefix + "ffn_up.weight");
+                layer.wDown = &requireTensor(prefix + "ffn_down.weight");
+
+                checkShape(*layer.wq, hp.nEmbd, hp.qDim());
+                checkShape(*layer.wk, hp.nEmbd, hp.kvDim());
+                checkShape(*layer.wv, hp.nEmbd, hp.kvDim());
+                checkShape(*layer.wo, hp.qDim(), hp.nEmbd);
+                checkShape(*layer.wGate, hp.nEmbd, hp.nFF);
+                checkShape(*layer.wUp, hp.nEmbd, hp.nFF);
+                checkShape(*layer.wDown, hp.nFF, hp.nEmbd);
+                m_layers.push_back(layer);
+            }
+        }
+
+        const LlamaHParams& hparams() const { return m_hparams; }
+        const GGUFFile& file() const { return *m_file; }
+        const std::shared_ptr<const GGUFFile>& fileHandle() const { return m_file; }
+
+        // Tokens per forward batch; a long prompt runs in batches of this size
+        static constexpr size_t MAX_BATCH = 512;
+
+        /**
+         * @brief Runs `count` tokens following the cached positions
+         *
+         * Their keys and values are appended to `cache`. If `logits` is not null it
+         * receives the nVocab next-token logits after each of the last `logitRows`
+         * tokens, one row after another; verifying drafted tokens needs all of them.
+         *
+         * Long prompts run in batches of MAX_BATCH tokens, which still make full use of
+         * the GEMM kernels while keeping activations at a fixed size rather than growing
+         * with the prompt.
+         */
+        void forward(const int32_t* tokens, size_t count, KVSequence& cache, ThreadPool& pool, float* logits,
+            size_t logitRows = 1) const
+        {
+            if (count == 0)
+                return;
+            if (logitRows > count)
+                throw std::runtime_error("More logit rows than tokens");
+
+            // Checked up front so a bad token fails the call before any batch is cached
+            for (size_t t = 0; t < count; ++t)
+            {
+                if (tokens[t] < 0 || tokens[t] >= m_hparams.nVocab)
+                    throw std::runtime_error("Token id out of range");
+            }
+            cache.reserve(count);
+
+            const size_t firstLogitToken = count - (logits ? logitRows : 0);
+            const size_t nVocab = static_cast<size_t>(m_hparams.nVocab);
+            Activations activations;
+            for (size_t begin = 0; begin < count; begin += MAX_BATCH)
+            {
+                const size_t end = std::min(begin + MAX_BATCH, count);
+                const size_t rows = end > firstLogitToken ? end - std::max(begin, firstLogitToken) : 0;
+                float* batchLogits = rows > 0 ? logits + (end - rows - firstLogitToken) * nVocab : nullptr;
+                forwardBatch(tokens + begin, end - begin, cache, pool, activations, batchLogits, rows);
+            }
+        }
+
+    private:
+        struct Layer
+        {
+            const GGUFTensorView* attnNorm = nullptr;
+            const GGUFTensorView* wq = nullptr;
+            const GGUFTensorView* wk = nullptr;
+            const GGUFTensorView* wv = nullptr;
+            const GGUFTensorView* wo = nullptr;
+            const GGUFTensorView* ffnNorm = nullptr;
+            const GGUFTensorView* wGate = nullptr;
+            const GGUFTensorView* wUp = nullptr;
+            const GGUFTensorView* wDown = nullptr;
+        };
+
+        // Per-token activations of one batch, reused across the batches of a forward pass
+        struct Activations
+        {
+            std::vector<float> x, xb, q, k, v, attn, gate, up;
+        };
+
+        // Runs one batch of at most MAX_BATCH tokens; `logits` gets rows for the last `logitRows`
+        void forwardBatch(const int32_t* tokens, size_t n, KVSequence& cache, ThreadPool& pool,
+            Activations& a, float* logits, size_t logitRows) const
+        {
+            const LlamaHParams& hp = m_hparams;
+            const size_t nEmbd = static_cast<size_t>(hp.nEmbd);
+            const size_t qDim = static_cast<size_t>(hp.qDim());
+            const size_t kvDim = static_cast<size_t>(hp.kvDim());
+            const size_t nFF = static_cast<size_t>(hp.nFF);
+            const size_t pos0 = cache.size();
+            cache.reserve(n);
+
+            a.x.resize(n * nEmbd);
+            a.xb.resize(n * nEmbd);
+            a.q.resize(n * qDim);
+            a.k.resize(n * kvDim);
+            a.v.resize(n * kvDim);
+            a.attn.resize(n * qDim);
+            a.gate.resize(n * nFF);
+            a.up.resize(n * nFF);
+            float* x = a.x.data();
+            float* xb = a.xb.data();
+            float* q = a.q.data();
+            float* k = a.k.data();
+            float* v = a.v.data();
+            float* attn = a.attn.data();
+            float* gate = a.gate.data();
+            float* up = a.up.data();
+
+            for (size_t t = 0; t < n; ++t)
+            {
+                dequantizeRow(m_tokenEmbedding->type, tensorRow(*m_tokenEmbedding, tokens[t]), &x[t * nEmbd], hp.nEmbd);
+            }
+
+            for (size_t l = 0; l < m_layers.size(); ++l)
+            {
+                const Layer& layer = m_layers[l];
+
+                for (size_t t = 0; t < n; ++t)
+                {
+                    rmsNorm(&x[t * nEmbd], normWeights(*layer.attnNorm), &xb[t * nEmbd], hp.nEmbd, hp.normEps);
+                }
+                matMul(*layer.wq, xb, n, q, pool);
+                matMul(*layer.wk, xb, n, k, pool);
+                matMul(*layer.wv, xb, n, v, pool);
+
+                for (size_t t = 0; t < n; ++t)
+                {
+                    const int64_t pos = static_cast<int64_t>(pos0 + t);
+                    applyRope(&q[t * qDim], hp.nHead, hp.headDim, pos, m_invFreq);
+                    applyRope(&k[t * kvDim], hp.nHeadKv, hp.headDim, pos, m_invFreq);
+                    cache.store(l, pos0 + t, &k[t * kvDim], &v[t * kvDim]);
+                }
+
+                attention(l, cache, pos0, n, q, attn, pool);
+
+                matMul(*layer.wo, attn, n, xb, pool);
+                for (size_t i = 0; i < n * nEmbd; ++i)
+                {
+                    x[i] += xb[i];
+                }
+
+                for (size_t t = 0; t < n; ++t)
+                {
+                    rmsNorm(&x[t * nEmbd], normWeights(*layer.ffnNorm), &xb[t * nEmbd], hp.nEmbd, hp.normEps);
+                }
+                matMul(*layer.wGate, xb, n, gate, pool);
+                matMul(*layer.wUp, xb, n, up, pool);
+                for (size_t i = 0; i < n * nFF; ++i)
+                {
+                    gate[i] = silu(gate[i]) * up[i];
+                }
+                matMul(*layer.wDown, gate, n, xb, pool);
+                for (size_t i = 0; i < n * nEmbd; ++i)
+                {
+                    x[i] += xb[i];
+                }
+            }
+
+            cache.commit(n);
+
+            if (logits && logitRows > 0)
+            {
+                const size_t first = n - logitRows;
+                for (size_t t = 0; t < logitRows; ++t)
+                {
+                    rmsNorm(&x[(first + t) * nEmbd], normWeights(*m_outputNorm), &xb[t * nEmbd], hp.nEmbd, hp.normEps);
+                }
+                matMul(*m_output, xb, logitRows, logits, pool);
+            }
+        }
+
+        const GGUFTensorView& requireTensor(const std::string& name) const
+        {
+            const GGUFTensorView* tensor = m_file->findTensor(name);
+            if (!tensor)
+                throw std::runtime_error("Missing tensor " + name);
+            if (!isSupportedWeightType(tensor->type))
+                throw std::runtime_error("Unsupported type for tensor " + name);
+            return *tensor;
+        }
+
+        const GGUFTensorView& requireNorm(const std::string& name) const
+        {
+            const GGUFTensorView& tensor = requireTensor(name);
+            if (tensor.type != GGMLType::F32)
+                throw std::runtime_error("Norm weights must be f32: " + name);
+            return tensor;
+        }
+
+        static void checkShape(const GGUFTensorView& tensor, int64_t ne0, int64_t ne1)
+        {
+            if (tensor.ne[0] != ne0 || tensor.ne[1] != ne1 || tensor.ne[2] != 1 || tensor.ne[3] != 1)
+                throw std::runtime_error("Unexpected shape for tensor " + std::string(tensor.name));
+        }
+
+        static const float* normWeights(const GGUFTensorView& tensor)
+        {
+            return static_cast<const float*>(tensor.data);
+        }
+
+        // Causal grouped-query attention of the new tokens over every cached position.
+        // Cached rows are read in the cache's own type; values are expanded one head at a time.
+        void attention(size_t layer, const KVSequence& cache, size_t pos0, size_t n,
+            const float* q, float* out, ThreadPool& pool) const
+        {
+            const LlamaHParams& hp = m_hparams;
+            const size_t headDim = static_cast<size_t>(hp.headDim);
+            const size_t qDim = static_cast<size_t>(hp.qDim());
+            const size_t groupSize = static_cast<size_t>(hp.nHead / hp.nHeadKv);
+            const size_t headBytes = cache.pool().headBytes();
+            const GGMLType kvType = cache.rowType();
+            const float scale = 1.0f / std::sqrt(static_cast<float>(headDim));
+
+            pool.parallelFor(n * static_cast<size_t>(hp.nHead), [&](size_t begin, size_t end) {
+                std::vector<float> scores(pos0 + n);
+                std::vector<float> valueRow(headDim);
+                for (size_t item = begin; item < end; ++item)
+                {
+                    const size_t t = item / static_cast<size_t>(hp.nHead);
+                    const size_t h = item % static_cast<size_t>(hp.nHead);
+                    const size_t kvOffset = (h / groupSize) * headBytes;
+                    const float* qh = q + t * qDim + h * headDim;
+                    const size_t positions = pos0 + t + 1;
+
+                    for (size_t p = 0; p < positions; ++p)
+                    {
+                        scores[p] = dotRow(kvType, cache.key(layer, p) + kvOffset, qh, static_cast<int64_t>(headDim)) * scale;
+                    }
+                    softmax(scores.data(), static_cast<int64_t>(positions));
+
+                    float* oh = out + t * qDim + h * headDim;
+                    std::fill(oh, oh + headDim, 0.0f);
+                    for (size_t p = 0; p < positions; ++p)
+                    {
+                        const uint8_t* row = cache.value(layer, p) + kvOffset;
+                        const float* vh = reinterpret_cast<const float*>(row);
+                        if (kvType != GGMLType::F32)
+                        {
+                            dequantizeRow(kvType, row, valueRow.data(), static_cast<int64_t>(headDim));
+                            vh = valueRow.data();
+                        }
+                        for (size_t d = 0; d < headDim; ++d)
+                        {
+                            oh[d] += scores[p] * vh[d];
+                        }
+                    }
+                }
+            });
+        }
+
+        std::shared_ptr<const GGUFFile> m_file;
+        LlamaHParams m_hparams;
+        std::vector<float> m_invFreq;
+        const GGUFTensorView* m_tokenEmbedding = nullptr;
+        const GGUFTensorView* m_outputNorm = nullptr;
+        const GGUFTensorView* m_output = nullptr;
+        std::vector<Layer> m_layers;
+    };
+} // namespace Inference
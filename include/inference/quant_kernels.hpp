@@ -0,0 +1,393 @@
+#pragma once
+
+#include "cpu_features.hpp"
+#include "model/ggml_quants.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+
+namespace Inference
+{
+    /**
+     * Integer dot products of k-quant weight rows with Q8_K activations.
+     *
+     * Weights are unpacked to bytes in registers and multiplied with the 8-bit
+     * activations in integer arithmetic; only the per-block scales are applied in
+     * float. Each kernel exists as portable scalar code and, on x86, for AVX2 and
+     * AVX-512 (using VNNI when present). quantKernels() picks the best set for the
+     * running CPU once, via CPUID.
+     */
+    enum class KernelIsa
+    {
+        SCALAR,
+        AVX2,
+        AVX512,
+        AVX512_VNNI
+    };
+
+    inline const char* kernelIsaName(KernelIsa isa)
+    {
+        switch (isa)
+        {
+        case KernelIsa::AVX2: return "avx2";
+        case KernelIsa::AVX512: return "avx512";
+        case KernelIsa::AVX512_VNNI: return "avx512-vnni";
+        default: return "scalar";
+        }
+    }
+
+    // Dot product of one weight row of n values with n values of activations
+    using DotQ8_KFunction = float (*)(const void* row, const Model::BlockQ8_K* x, int64_t n);
+
+    struct QuantKernels
+    {
+        KernelIsa isa = KernelIsa::SCALAR;
+        DotQ8_KFunction q4_K = nullptr;
+        DotQ8_KFunction q6_K = nullptr;
+    };
+
+    namespace detail
+    {
+        // The eight 6-bit scales and mins of a q4_K block, unpacked branch-free
+        inline void unpackScalesMinsK4(const uint8_t* packed, uint8_t scales[8], uint8_t mins[8])
+        {
+            constexpr uint32_t kmask1 = 0x3f3f3f3f;
+            constexpr uint32_t kmask2 = 0x0f0f0f0f;
+            constexpr uint32_t kmask3 = 0x03030303;
+
+            uint32_t utmp[4];
+            std::memcpy(utmp, packed, 12);
+            utmp[3] = ((utmp[2] >> 4) & kmask2) | (((utmp[1] >> 6) & kmask3) << 4);
+            const uint32_t uaux = utmp[1] & kmask1;
+            utmp[1] = (utmp[2] & kmask2) | (((utmp[0] >> 6) & kmask3) << 4);
+            utmp[2] = uaux;
+            utmp[0] &= kmask1;
+
+            std::memcpy(scales, &utmp[0], 8);
+            std::memcpy(mins, &utmp[2], 8);
+        }
+
+        inline float dotQ4_KQ8_KScalar(const void* row, const Model::BlockQ8_K* y, int64_t n)
+        {
+            const auto* x = static_cast<const Model::BlockQ4_K*>(row);
+            float sum = 0.0f;
+            for (int64_t i = 0; i < n / Model::QK_K; ++i)
+            {
+                uint8_t scales[8], mins[8];
+                unpackScalesMinsK4(x[i].scales, scales, mins);
+
+                const uint8_t* q4 = x[i].qs;
+                const int8_t* q8 = y[i].qs;
+                int32_t sumi = 0;
+                for (int j = 0; j < Model::QK_K / 64; ++j, q4 += 32, q8 += 64)
+                {
+                    int32_t low = 0, high = 0;
+                    for (int l = 0; l < 32; ++l)
+                    {
+                        low += (q4[l] & 0xF) * q8[l];
+                        high += (q4[l] >> 4) * q8[l + 32];
+                    }
+                    sumi += scales[2 * j] * low + scales[2 * j + 1] * high;
+                }
+
+                int32_t summ = 0;
+                for (int j = 0; j < Model::QK_K / 16; ++j)
+                {
+                    summ += y[i].bsums[j] * mins[j / 2];
+                }
+
+                sum += y[i].d * (Model::fp16ToFp32(x[i].d) * sumi - Model::fp16ToFp32(x[i].dmin) * summ);
+            }
+            return sum;
+        }
+
+        inline float dotQ6_KQ8_KScalar(const void* row, const Model::BlockQ8_K* y, int64_t n)
+        {
+            const auto* x = static_cast<const Model::BlockQ6_K*>(row);
+            float sum = 0.0f;
+            for (int64_t i = 0; i < n / Model::QK_K; ++i)
+            {
+                const uint8_t* ql = x[i].ql;
+                const uint8_t* qh = x[i].qh;
+                const int8_t* sc = x[i].scales;
+                const int8_t* q8 = y[i].qs;
+                int32_t sumi = 0;
+                for (int j = 0; j < Model::QK_K; j += 128, ql += 64, qh += 32, sc += 8, q8 += 128)
+                {
+                    int32_t groups[8] = {};
+                    for (int l = 0; l < 32; ++l)
+                    {
+                        const int is = l / 16;
+                        const int q1 = ((ql[l] & 0xF) | (((qh[l] >> 0) & 3) << 4)) - 32;
+                        const int q2 = ((ql[l + 32] & 0xF) | (((qh[l] >> 2) & 3) << 4)) - 32;
+                        const int q3 = ((ql[l] >> 4) | (((qh[l] >> 4) & 3) << 4)) - 32;
+                        const int q4 = ((ql[l + 32] >> 4) | (((qh[l] >> 6) & 3) << 4)) - 32;
+                        groups[is] += q1 * q8[l];
+                        groups[is + 2] += q2 * q8[l + 32];
+                        groups[is + 4] += q3 * q8[l + 64];
+                        groups[is + 6] += q4 * q8[l + 96];
+                    }
+                    for (int g = 0; g < 8; ++g)
+                    {
+                        sumi += sc[g] * groups[g];
+                    }
+                }
+                sum += Model::fp16ToFp32(x[i].d) * y[i].d * sumi;
+            }
+            return sum;
+        }
+
+#ifdef KOLOSAL_X86
+        KOLOSAL_TARGET_AVX2 inline float horizontalSum(__m256 v)
+        {
+            __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+            sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+            return _mm_cvtss_f32(sum);
+        }
+
+        // Two 16-bit broadcasts, one per 128-bit half
+        KOLOSAL_TARGET_AVX2 inline __m256i broadcastPair16(int low, int high)
+        {
+            return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi16(static_cast<short>(low))),
+                _mm_set1_epi16(static_cast<short>(high)), 1);
+        }
+
+        // sum(bsums * mins) of a q4_K block as four int32 lanes
+        KOLOSAL_TARGET_AVX2 inline __m128i q4_KMinProducts(const uint8_t mins[8], const int16_t* bsums)
+        {
+            const __m256i sums16 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bsums));
+            const __m128i sums32 = _mm_hadd_epi16(_mm256_castsi256_si128(sums16), _mm256_extracti128_si256(sums16, 1));
+            const __m128i mins16 = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(mins)));
+            return _mm_madd_epi16(mins16, sums32);
+        }
+
+        KOLOSAL_TARGET_AVX2 inline float dotQ4_KQ8_KAvx2(const void* row, const Model::BlockQ8_K* y, int64_t n)
+        {
+            const auto* x = static_cast<const Model::BlockQ4_K*>(row);
+            const __m256i lowMask = _mm256_set1_epi8(0xF);
+            __m256 acc = _mm256_setzero_ps();
+            __m128 accMins = _mm_setzero_ps();
+
+            for (int64_t i = 0; i < n / Model::QK_K; ++i)
+            {
+                uint8_t scales[8], mins[8];
+                unpackScalesMinsK4(x[i].scales, scales, mins);
+
+                const float d = y[i].d * _cvtsh_ss(x[i].d);
+                const float dmin = -y[i].d * _cvtsh_ss(x[i].dmin);
+                accMins = _mm_fmadd_ps(_mm_set1_ps(dmin), _mm_cvtepi32_ps(q4_KMinProducts(mins, y[i].bsums)), accMins);
+
+                const uint8_t* q4 = x[i].qs;
+                const int8_t* q8 = y[i].qs;
+                __m256i sumi = _mm256_setzero_si256();
+                for (int j = 0; j < Model::QK_K / 64; ++j, q4 += 32, q8 += 64)
+                {
+                    const __m256i bits = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q4));
+                    const __m256i low = _mm256_and_si256(bits, lowMask);
+                    const __m256i high = _mm256_and_si256(_mm256_srli_epi16(bits, 4), lowMask);
+
+                    // u8 x s8 pairs into s16 cannot saturate: 2 * 15 * 128 < 32768
+                    __m256i p16Low = _mm256_maddubs_epi16(low, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q8)));
+                    __m256i p16High = _mm256_maddubs_epi16(high, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q8 + 32)));
+                    p16Low = _mm256_madd_epi16(_mm256_set1_epi16(scales[2 * j]), p16Low);
+                    p16High = _mm256_madd_epi16(_mm256_set1_epi16(scales[2 * j + 1]), p16High);
+                    sumi = _mm256_add_epi32(sumi, _mm256_add_epi32(p16Low, p16High));
+                }
+                acc = _mm256_fmadd_ps(_mm256_set1_ps(d), _mm256_cvtepi32_ps(sumi), acc);
+            }
+
+            accMins = _mm_add_ps(accMins, _mm_movehl_ps(accMins, accMins));
+            accMins = _mm_add_ss(accMins, _mm_movehdup_ps(accMins));
+            return horizontalSum(acc) + _mm_cvtss_f32(accMins);
+        }
+
+        KOLOSAL_TARGET_AVX2 inline float dotQ6_KQ8_KAvx2(const void* row, const Model::BlockQ8_K* y, int64_t n)
+        {
+            const auto* x = static_cast<const Model::BlockQ6_K*>(row);
+            const __m256i lowMask = _mm256_set1_epi8(0xF);
+            const __m256i highMask = _mm256_set1_epi8(3);
+            const __m256i offset = _mm256_set1_epi8(32);
+            __m256 acc = _mm256_setzero_ps();
+
+            for (int64_t i = 0; i < n / Model::QK_K; ++i)
+            {
+                const float d = y[i].d * _cvtsh_ss(x[i].d);
+                const uint8_t* ql = x[i].ql;
+                const uint8_t* qh = x[i].qh;
+                const int8_t* sc = x[i].scales;
+                const int8_t* q8 = y[i].qs;
+
+                __m256i sumi = _mm256_setzero_si256();
+                for (int j = 0; j < Model::QK_K / 128; ++j, ql += 64, qh += 32, sc += 8, q8 += 128)
+                {
+                    const __m256i highBits = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(qh));
+                    const __m256i lowBits1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ql));
+                    const __m256i lowBits2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ql + 32));
+
+                    // Unsigned 6-bit quants; the -32 offset is applied as 32 * sum(q8) below
+                    __m256i q6[4];
+                    q6[0] = _mm256_or_si256(_mm256_and_si256(lowBits1, lowMask),
+                        _mm256_slli_epi16(_mm256_and_si256(highBits, highMask), 4));
+                    q6[1] = _mm256_or_si256(_mm256_and_si256(lowBits2, lowMask),
+                        _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(highBits, 2), highMask), 4));
+                    q6[2] = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(lowBits1, 4), lowMask),
+                        _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(highBits, 4), highMask), 4));
+                    q6[3] = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(lowBits2, 4), lowMask),
+                        _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(highBits, 6), highMask), 4));
+
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        const __m256i q8v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q8 + 32 * k));
+                        const __m256i p16 = _mm256_sub_epi16(_mm256_maddubs_epi16(q6[k], q8v), _mm256_maddubs_epi16(offset, q8v));
+                        sumi = _mm256_add_epi32(sumi, _mm256_madd_epi16(broadcastPair16(sc[2 * k], sc[2 * k + 1]), p16));
+                    }
+                }
+                acc = _mm256_fmadd_ps(_mm256_set1_ps(d), _mm256_cvtepi32_ps(sumi), acc);
+            }
+            return horizontalSum(acc);
+        }
+
+        // The 32 quant bytes of a 64-value group, low nibbles in the lower half of the
+        // register and high nibbles in the upper half: two 32-value sub-blocks
+        KOLOSAL_TARGET_AVX512 inline __m512i unpackNibbles512(const uint8_t* q4)
+        {
+            const __m512i shifts = _mm512_inserti64x4(_mm512_setzero_si512(), _mm256_set1_epi16(4), 1);
+            const __m512i bits = _mm512_broadcast_i64x4(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(q4)));
+            return _mm512_and_si512(_mm512_srlv_epi16(bits, shifts), _mm512_set1_epi8(0xF));
+        }
+
+        // Scales of sub-blocks 2j and 2j + 1 as 16-bit lanes matching unpackNibbles512
+        KOLOSAL_TARGET_AVX512 inline void q4_KScalePairs512(const uint8_t scales[8], __m512i pairs[4])
+        {
+            const __m512i scales16 = _mm512_castsi128_si512(
+                _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(scales))));
+            for (int j = 0; j < 4; ++j)
+            {
+                const __m512i index = _mm512_inserti64x4(_mm512_set1_epi16(static_cast<short>(2 * j)),
+                    _mm256_set1_epi16(static_cast<short>(2 * j + 1)), 1);
+                pairs[j] = _mm512_permutexvar_epi16(index, scales16);
+            }
+        }
+
+        KOLOSAL_TARGET_AVX512 inline float dotQ4_KQ8_KAvx512(const void* row, const Model::BlockQ8_K* y, int64_t n)
+        {
+            const auto* x = static_cast<const Model::BlockQ4_K*>(row);
+            __m512 acc = _mm512_setzero_ps();
+            __m128 accMins = _mm_setzero_ps();
+
+            for (int64_t i = 0; i < n / Model::QK_K; ++i)
+            {
+                uint8_t scales[8], mins[8];
+                unpackScalesMinsK4(x[i].scales, scales, mins);
+                __m512i scalePairs[4];
+                q4_KScalePairs512(scales, scalePairs);
+
+                const float d = y[i].d * _cvtsh_ss(x[i].d);
+                const float dmin = -y[i].d * _cvtsh_ss(x[i].dmin);
+                accMins = _mm_fmadd_ps(_mm_set1_ps(dmin), _mm_cvtepi32_ps(q4_KMinProducts(mins, y[i].bsums)), accMins);
+
+                __m512i sums[4];
+                for (int j = 0; j < 4; ++j)
+                {
+                    const __m512i p16 = _mm512_maddubs_epi16(unpackNibbles512(x[i].qs + 32 * j), _mm512_loadu_si512(y[i].qs + 64 * j));
+                    sums[j] = _mm512_madd_epi16(p16, scalePairs[j]);
+                }
+                const __m512i sumi = _mm512_add_epi32(_mm512_add_epi32(sums[0], sums[1]), _mm512_add_epi32(sums[2], sums[3]));
+                acc = _mm512_fmadd_ps(_mm512_set1_ps(d), _mm512_cvtepi32_ps(sumi), acc);
+            }
+
+            accMins = _mm_add_ps(accMins, _mm_movehl_ps(accMins, accMins));
+            accMins = _mm_add_ss(accMins, _mm_movehdup_ps(accMins));
+            return _mm512_reduce_add_ps(acc) + _mm_cvtss_f32(accMins);
+        }
+
+        // As above with the scale multiply and accumulate fused into VPDPWSSD, in two
+        // independent chains so its latency overlaps
+        KOLOSAL_TARGET_AVX512_VNNI inline float dotQ4_KQ8_KAvx512Vnni(const void* row, const Model::BlockQ8_K* y, int64_t n)
+        {
+            const auto* x = static_cast<const Model::BlockQ4_K*>(row);
+            __m512 acc = _mm512_setzero_ps();
+            __m128 accMins = _mm_setzero_ps();
+
+            for (int64_t i = 0; i < n / Model::QK_K; ++i)
+            {
+                uint8_t scales[8], mins[8];
+                unpackScalesMinsK4(x[i].scales, scales, mins);
+                __m512i scalePairs[4];
+                q4_KScalePairs512(scales, scalePairs);
+
+                const float d = y[i].d * _cvtsh_ss(x[i].d);
+                const float dmin = -y[i].d * _cvtsh_ss(x[i].dmin);
+                accMins = _mm_fmadd_ps(_mm_set1_ps(dmin), _mm_cvtepi32_ps(q4_KMinProducts(mins, y[i].bsums)), accMins);
+
+                __m512i sums[2] = { _mm512_setzero_si512(), _mm512_setzero_si512() };
+                for (int j = 0; j < 4; ++j)
+                {
+                    const __m512i p16 = _mm512_maddubs_epi16(unpackNibbles512(x[i].qs + 32 * j), _mm512_loadu_si512(y[i].qs + 64 * j));
+                    sums[j & 1] = _mm512_dpwssd_epi32(sums[j & 1], p16, scalePairs[j]);
+                }
+                acc = _mm512_fmadd_ps(_mm512_set1_ps(d), _mm512_cvtepi32_ps(_mm512_add_epi32(sums[0], sums[1])), acc);
+            }
+
+            accMins = _mm_add_ps(accMins, _mm_movehl_ps(accMins, accMins));
+            accMins = _mm_add_ss(accMins, _mm_movehdup_ps(accMins));
+            return _mm512_reduce_add_ps(acc) + _mm_cvtss_f32(accMins);
+        }
+#endif
+    } // namespace detail
+
+    inline bool isKernelIsaSupported(KernelIsa isa)
+    {
+        const CpuFeatures& features = cpuFeatures();
+        switch (isa)
+        {
+        case KernelIsa::AVX2: return features.avx2;
+        case KernelIsa::AVX512: return features.avx512;
+        case KernelIsa::AVX512_VNNI: return features.avx512Vnni;
+        default: return true;
+        }
+    }
+
+    // Kernels for one instruction set; the caller must check isKernelIsaSupported()
+    inline QuantKernels quantKernelsFor(KernelIsa isa)
+    {
+        QuantKernels kernels;
+        kernels.q4_K = detail::dotQ4_KQ8_KScalar;
+        kernels.q6_K = detail::dotQ6_KQ8_KScalar;
+#ifdef KOLOSAL_X86
+        switch (isa)
+        {
+        case KernelIsa::AVX2:
+            kernels = { isa, detail::dotQ4_KQ8_KAvx2, detail::dotQ6_KQ8_KAvx2 };
+            break;
+        case KernelIsa::AVX512:
+            kernels = { isa, detail::dotQ4_KQ8_KAvx512, detail::dotQ6_KQ8_KAvx2 };
+            break;
+        case KernelIsa::AVX512_VNNI:
+            kernels = { isa, detail::dotQ4_KQ8_KAvx512Vnni, detail::dotQ6_KQ8_KAvx2 };
+            break;
+        default:
+            break;
+        }
+#endif
+        return kernels;
+    }
+
+    inline KernelIsa bestKernelIsa()
+    {
+        for (KernelIsa isa : { KernelIsa::AVX512_VNNI, KernelIsa::AVX512, KernelIsa::AVX2 })
+        {
+            if (isKernelIsaSupported(isa))
+                return isa;
+        }
+        return KernelIsa::SCALAR;
+    }
+
+    inline const QuantKernels& quantKernels()
+    {
+        static const QuantKernels kernels = quantKernelsFor(bestKernelIsa());
+        return kernels;
+    }
+} // namespace Inference
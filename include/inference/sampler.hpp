@@ -0,0 +1,421 @@
+#pragma once
+
+#include "cpu_features.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace Inference
+{
+    struct SamplingParams
+    {
+        float temperature = 0.7f; // 0 picks the most likely token every time
+        float topP = 0.9f;
+        int topK = 50;            // 0 keeps every token
+        uint32_t seed = 42;
+    };
+
+    struct TokenCandidate
+    {
+        float value;   // the logit while candidates are selected, then the probability
+        int32_t token;
+    };
+
+    namespace detail
+    {
+        // Smallest exponent whose e^x is still a normal float; anything below counts as 0
+        constexpr float EXP_MIN_ARGUMENT = -87.33f;
+
+#ifdef KOLOSAL_X86
+        // e^x per lane with the Cephes polynomial (relative error about 2e-7), 0 below EXP_MIN_ARGUMENT
+        KOLOSAL_TARGET_AVX2 inline __m256 expAvx2(__m256 x)
+        {
+            const __m256 valid = _mm256_cmp_ps(x, _mm256_set1_ps(EXP_MIN_ARGUMENT), _CMP_GE_OQ);
+            x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(EXP_MIN_ARGUMENT)), _mm256_set1_ps(88.37f));
+
+            // e^x = 2^n * e^r with |r| <= ln(2)/2; ln(2) is split in two for precision
+            const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+            r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+
+            __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+            y = _mm256_fmadd_ps(y, r, _mm256_set1_ps(1.3981999507e-3f));
+            y = _mm256_fmadd_ps(y, r, _mm256_set1_ps(8.3334519073e-3f));
+            y = _mm256_fmadd_ps(y, r, _mm256_set1_ps(4.1665795894e-2f));
+            y = _mm256_fmadd_ps(y, r, _mm256_set1_ps(1.6666665459e-1f));
+            y = _mm256_fmadd_ps(y, r, _mm256_set1_ps(5.0000001201e-1f));
+            y = _mm256_fmadd_ps(y, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+            const __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+            return _mm256_and_ps(_mm256_mul_ps(y, _mm256_castsi256_ps(exponent)), valid);
+        }
+
+        KOLOSAL_TARGET_AVX2 inline float maxValueAvx2(const float* x, size_t n)
+        {
+            __m256 best = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                best = _mm256_max_ps(best, _mm256_loadu_ps(x + i));
+            }
+            alignas(32) float lanes[8];
+            _mm256_store_ps(lanes, best);
+            float result = *std::max_element(lanes, lanes + 8);
+            for (; i < n; ++i)
+            {
+                result = std::max(result, x[i]);
+            }
+            return result;
+        }
+
+        KOLOSAL_TARGET_AVX2 inline double expSumAvx2(const float* x, size_t n, float offset, float scale, float* out)
+        {
+            const __m256 offsetV = _mm256_set1_ps(offset);
+            const __m256 scaleV = _mm256_set1_ps(scale);
+            __m256d sumLow = _mm256_setzero_pd();
+            __m256d sumHigh = _mm256_setzero_pd();
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                const __m256 e = expAvx2(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + i), offsetV), scaleV));
+                _mm256_storeu_ps(out + i, e);
+                sumLow = _mm256_add_pd(sumLow, _mm256_cvtps_pd(_mm256_castps256_ps128(e)));
+                sumHigh = _mm256_add_pd(sumHigh, _mm256_cvtps_pd(_mm256_extractf128_ps(e, 1)));
+            }
+            alignas(32) double lanes[4];
+            _mm256_store_pd(lanes, _mm256_add_pd(sumLow, sumHigh));
+            double result = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            for (; i < n; ++i)
+            {
+                const float e = (x[i] - offset) * scale;
+                out[i] = e >= EXP_MIN_ARGUMENT ? std::exp(e) : 0.0f;
+                result += out[i];
+            }
+            return result;
+        }
+
+        // Index of the first block of 8 at or after `i` holding a value above `threshold`
+        KOLOSAL_TARGET_AVX2 inline size_t skipBelowAvx2(const float* x, size_t i, size_t n, float threshold)
+        {
+            const __m256 limit = _mm256_set1_ps(threshold);
+            while (i + 8 <= n && _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(x + i), limit, _CMP_GT_OQ)) == 0)
+            {
+                i += 8;
+            }
+            return i;
+        }
+#endif
+
+        inline float maxValue(const float* x, size_t n)
+        {
+#ifdef KOLOSAL_X86
+            if (cpuFeatures().avx2)
+                return maxValueAvx2(x, n);
+#endif
+            return *std::max_element(x, x + n);
+        }
+
+        // Writes e^((x - offset) * scale) to `out` and returns the sum, added up in double
+        // since a vocabulary has enough terms for float rounding to shift the nucleus
+        inline double expSum(const float* x, size_t n, float offset, float scale, float* out)
+        {
+#ifdef KOLOSAL_X86
+            if (cpuFeatures().avx2)
+                return expSumAvx2(x, n, offset, scale, out);
+#endif
+            double sum = 0.0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                const float e = (x[i] - offset) * scale;
+                out[i] = e >= EXP_MIN_ARGUMENT ? std::exp(e) : 0.0f;
+                sum += out[i];
+            }
+            return sum;
+        }
+
+        inline size_t skipBelow(const float* x, size_t i, size_t n, float threshold)
+        {
+#ifdef KOLOSAL_X86
+            if (cpuFeatures().avx2)
+                return skipBelowAvx2(x, i, n, threshold);
+#endif
+            (void)x;
+            (void)threshold;
+            (void)n;
+            return i;
+        }
+    } // namespace detail
+
+    /**
+     * @brief Picks the next token from a row of logits
+     *
+     * Applies top-k, temperature and top-p (nucleus) truncation in that order and draws
+     * from what is left with a seeded generator, so a given seed reproduces a run.
+     *
+     * Nothing sorts the vocabulary: top-k keeps a heap of the best k logits while a SIMD
+     * scan skips every block of 8 below the worst of them, which after the first few
+     * thousand tokens is nearly all of them. Top-p without top-k normalizes over the
+     * whole vocabulary with a vectorized exp and then only looks at a candidate set that
+     * grows until it holds the requested probability mass.
+     */
+    class Sampler
+    {
+    public:
+        explicit Sampler(const SamplingParams& params = SamplingParams())
+            : m_params(params)
+            , m_rng(params.seed)
+        {
+        }
+
+        const SamplingParams& params() const { return m_params; }
+
+        /**
+         * @brief The tokens sample() chooses from and their probabilities
+         *
+         * Most likely first, except when nothing is truncated: then every token, in
+         * token order. Valid until the next call.
+         */
+        const std::vector<TokenCandidate>& candidates(const float* logits, size_t nVocab)
+        {
+            m_candidates.clear();
+            if (nVocab == 0)
+                return m_candidates;
+
+            if (m_params.temperature <= 0.0f)
+            {
+                const float best = detail::maxValue(logits, nVocab);
+                m_candidates.push_back({ 1.0f, static_cast<int32_t>(std::find(logits, logits + nVocab, best) - logits) });
+                return m_candidates;
+            }
+
+            const float scale = 1.0f / m_params.temperature;
+            const bool topK = m_params.topK > 0 && static_cast<size_t>(m_params.topK) < nVocab;
+            if (topK)
+            {
+                // Softmax over the k best only
+                selectTop(logits, nVocab, static_cast<size_t>(m_params.topK));
+                if (m_candidates.empty())
+                {
+                    // Every logit is -inf or NaN; there is nothing to weigh
+                    m_candidates.push_back({ 1.0f, 0 });
+                    return m_candidates;
+                }
+                const float maxLogit = m_candidates[0].value;
+                double sum = 0.0;
+                for (auto& candidate : m_candidates)
+                {
+                    candidate.value = std::exp((candidate.value - maxLogit) * scale);
+                    sum += candidate.value;
+                }
+                for (auto& candidate : m_candidates)
+                {
+                    candidate.value = static_cast<float>(candidate.value / sum);
+                }
+            }
+            else
+            {
+                const float maxLogit = detail::maxValue(logits, nVocab);
+                m_exps.resize(nVocab);
+                const double sum = detail::expSum(logits, nVocab, maxLogit, scale, m_exps.data());
+                if (m_params.topP >= 1.0f)
+                {
+                    m_candidates.resize(nVocab);
+                    for (size_t i = 0; i < nVocab; ++i)
+                    {
+                        m_candidates[i] = { static_cast<float>(m_exps[i] / sum), static_cast<int32_t>(i) };
+                    }
+                    return m_candidates;
+                }
+
+                // Grow the candidate set until it holds the requested mass
+                for (size_t k = std::min<size_t>(INITIAL_TOP_P_CANDIDATES, nVocab);; k = std::min(k * 8, nVocab))
+                {
+                    selectTop(logits, nVocab, k);
+                    double mass = 0.0;
+                    for (auto& candidate : m_candidates)
+                    {
+                        candidate.value = static_cast<float>(m_exps[static_cast<size_t>(candidate.token)] / sum);
+                        mass += candidate.value;
+                    }
+                    if (mass >= m_params.topP || k == nVocab)
+                        break;
+                }
+            }
+
+            if (m_params.topP < 1.0f)
+            {
+                double cumulative = 0.0;
+                for (size_t i = 0; i < m_candidates.size(); ++i)
+                {
+                    cumulative += m_candidates[i].value;
+                    if (cumulative >= m_params.topP)
+                    {
+                        m_candidates.resize(i + 1);
+                        break;
+                    }
+                }
+            }
+            return m_candidates;
+        }
+
+        int32_t sample(const float* logits, size_t nVocab)
+        {
+            return draw(candidates(logits, nVocab));
+        }
+
+        // Draws a token from candidates weighted by their values, which need not add up to 1
+        int32_t draw(const std::vector<TokenCandidate>& weighted)
+        {
+            if (weighted.empty())
+                return 0;
+            if (weighted.size() == 1)
+                return weighted[0].token;
+
+            float total = 0.0f;
+            for (const auto& candidate : weighted)
+            {
+                total += candidate.value;
+            }
+
+            std::uniform_real_distribution<float> distribution(0.0f, total);
+            float target = distribution(m_rng);
+            for (const auto& candidate : weighted)
+            {
+                target -= candidate.value;
+                if (target <= 0.0f)
+                    return candidate.token;
+            }
+            return weighted.back().token;
+        }
+
+        /**
+         * @brief Speculative sampling: keeps a drafted token with probability min(1, p/q)
+         *
+         * `target` (p) and `draft` (q) are candidates() of the target and draft models at
+         * the same position, and `token` was drawn from `draft`. A rejected token is
+         * replaced by sampleResidual(), which together make the result distributed
+         * exactly as if it had been sampled from `target`. Both are renormalized, as
+         * top-p leaves candidates whose probabilities add up to less than 1.
+         */
+        bool accept(const std::vector<TokenCandidate>& target, const std::vector<TokenCandidate>& draft, int32_t token)
+        {
+            const double p = probabilityOf(target, token) / totalOf(target);
+            const double q = probabilityOf(draft, token) / totalOf(draft);
+            if (p >= q)
+                return true;
+            return std::uniform_real_distribution<double>(0.0, 1.0)(m_rng) * q < p;
+        }
+
+        // Draws from max(0, p - q), the mass the draft model under-proposed
+        int32_t sampleResidual(const std::vector<TokenCandidate>& target, const std::vector<TokenCandidate>& draft)
+        {
+            int32_t maxToken = 0;
+            for (const auto& candidate : draft)
+            {
+                maxToken = std::max(maxToken, candidate.token);
+            }
+            if (m_dense.size() <= static_cast<size_t>(maxToken))
+                m_dense.resize(static_cast<size_t>(maxToken) + 1, 0.0f);
+
+            const float draftScale = static_cast<float>(1.0 / totalOf(draft));
+            const float targetScale = static_cast<float>(1.0 / totalOf(target));
+            for (const auto& candidate : draft)
+            {
+                m_dense[static_cast<size_t>(candidate.token)] = candidate.value * draftScale;
+            }
+            m_residual.clear();
+            for (const auto& candidate : target)
+            {
+                const size_t token = static_cast<size_t>(candidate.token);
+                const float p = candidate.value * targetScale;
+                const float q = token < m_dense.size() ? m_dense[token] : 0.0f;
+                if (p > q)
+                    m_residual.push_back({ p - q, candidate.token });
+            }
+            for (const auto& candidate : draft)
+            {
+                m_dense[static_cast<size_t>(candidate.token)] = 0.0f;
+            }
+
+            // p == q up to rounding leaves nothing; p itself is then the right distribution
+            return m_residual.empty() ? draw(target) : draw(m_residual);
+        }
+
+    private:
+        static constexpr size_t INITIAL_TOP_P_CANDIDATES = 64;
+
+        static float probabilityOf(const std::vector<TokenCandidate>& candidates, int32_t token)
+        {
+            for (const auto& candidate : candidates)
+            {
+                if (candidate.token == token)
+                    return candidate.value;
+            }
+            return 0.0f;
+        }
+
+        static double totalOf(const std::vector<TokenCandidate>& candidates)
+        {
+            double total = 0.0;
+            for (const auto& candidate : candidates)
+            {
+                total += candidate.value;
+            }
+            return total > 0.0 ? total : 1.0;
+        }
+
+        // Higher logit first, lower token id on ties, so results do not depend on the scan
+        static bool better(const TokenCandidate& a, const TokenCandidate& b)
+        {
+            return a.value > b.value || (a.value == b.value && a.token < b.token);
+        }
+
+        // The k highest logits into m_candidates, best first
+        void selectTop(const float* logits, size_t nVocab, size_t k)
+        {
+            m_candidates.clear();
+            m_candidates.reserve(k);
+
+            // A heap with the worst kept candidate on top; a later token only gets in by
+            // beating it, so whole blocks below it are skipped
+            float threshold = -std::numeric_limits<float>::infinity();
+            for (size_t i = 0; i < nVocab;)
+            {
+                i = detail::skipBelow(logits, i, nVocab, threshold);
+                const size_t end = std::min(nVocab, i + 8);
+                for (; i < end; ++i)
+                {
+                    if (!(logits[i] > threshold))
+                        continue;
+
+                    const TokenCandidate candidate{ logits[i], static_cast<int32_t>(i) };
+                    if (m_candidates.size() < k)
+                    {
+                        m_candidates.push_back(candidate);
+                        std::push_heap(m_candidates.begin(), m_candidates.end(), better);
+                    }
+                    else
+                    {
+                        std::pop_heap(m_candidates.begin(), m_candidates.end(), better);
+                        m_candidates.back() = candidate;
+                        std::push_heap(m_candidates.begin(), m_candidates.end(), better);
+                    }
+                    if (m_candidates.size() == k)
+                        threshold = m_candidates.front().value;
+                }
+            }
+            std::sort_heap(m_candidates.begin(), m_candidates.end(), better);
+        }
+
+        SamplingParams m_params;
+        std::mt19937 m_rng;
+        std::vector<TokenCandidate> m_candidates;
+        std::vector<float> m_exps;
+        std::vector<float> m_dense;                // draft probabilities by token, zero between calls
+        std::vector<TokenCandidate> m_residual;
+    };
+} // namespace Inference
@@ -0,0 +1,366 @@
+#pragma once
+
+#include "model/gguf_reader.hpp"
+#include "model/ggml_quants.hpp"
+#include "gemm_f16.hpp"
+#include "quant_kernels.hpp"
+#include "thread_pool.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Inference
+{
+    using Model::GGMLType;
+    using Model::GGUFTensorView;
+
+    // Every half value converted once, so f16 weights cost a table lookup per element
+    inline const float* fp16Table()
+    {
+        static const std::vector<float> table = []() {
+            std::vector<float> values(65536);
+            for (uint32_t i = 0; i < 65536; ++i)
+            {
+                values[i] = Model::fp16ToFp32(static_cast<uint16_t>(i));
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    // Weight types the kernels below can multiply with
+    inline bool isSupportedWeightType(GGMLType type)
+    {
+        switch (type)
+        {
+        case GGMLType::F32:
+        case GGMLType::F16:
+        case GGMLType::BF16:
+        case GGMLType::Q4_0:
+        case GGMLType::Q8_0:
+        case GGMLType::Q4_K:
+        case GGMLType::Q6_K:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    inline float dotF32(const float* a, const float* x, int64_t n)
+    {
+        float sum = 0.0f;
+        for (int64_t i = 0; i < n; ++i)
+        {
+            sum += a[i] * x[i];
+        }
+        return sum;
+    }
+
+    inline float dotF16(const uint16_t* a, const float* x, int64_t n)
+    {
+        const float* table = fp16Table();
+        float sum = 0.0f;
+        for (int64_t i = 0; i < n; ++i)
+        {
+            sum += table[a[i]] * x[i];
+        }
+        return sum;
+    }
+
+    inline float dotBF16(const uint16_t* a, const float* x, int64_t n)
+    {
+        float sum = 0.0f;
+        for (int64_t i = 0; i < n; ++i)
+        {
+            sum += Model::bf16ToFp32(a[i]) * x[i];
+        }
+        return sum;
+    }
+
+    inline float dotQ4_0(const Model::BlockQ4_0* blocks, const float* x, int64_t n)
+    {
+        const float* table = fp16Table();
+        float sum = 0.0f;
+        for (int64_t i = 0; i < n / Model::QK4_0; ++i, x += Model::QK4_0)
+        {
+            float blockSum = 0.0f;
+            for (int j = 0; j < Model::QK4_0 / 2; ++j)
+            {
+                blockSum += ((blocks[i].qs[j] & 0xF) - 8) * x[j] + ((blocks[i].qs[j] >> 4) - 8) * x[j + Model::QK4_0 / 2];
+            }
+            sum += table[blocks[i].d] * blockSum;
+        }
+        return sum;
+    }
+
+    inline float dotQ8_0(const Model::BlockQ8_0* blocks, const float* x, int64_t n)
+    {
+        const float* table = fp16Table();
+        float sum = 0.0f;
+        for (int64_t i = 0; i < n / Model::QK8_0; ++i, x += Model::QK8_0)
+        {
+            float blockSum = 0.0f;
+            for (int j = 0; j < Model::QK8_0; ++j)
+            {
+                blockSum += blocks[i].qs[j] * x[j];
+            }
+            sum += table[blocks[i].d] * blockSum;
+        }
+        return sum;
+    }
+
+    // Dequantizes on the fly: each 32-value group is sum(q * x) * scale - sum(x) * min
+    inline float dotQ4_K(const Model::BlockQ4_K* blocks, const float* x, int64_t n)
+    {
+        const float* table = fp16Table();
+        float sum = 0.0f;
+        for (int64_t i = 0; i < n / Model::QK_K; ++i)
+        {
+            const uint8_t* q = blocks[i].qs;
+            const float d = table[blocks[i].d];
+            const float min = table[blocks[i].dmin];
+
+            for (int j = 0, is = 0; j < Model::QK_K; j += 64, is += 2, q += 32, x += 64)
+            {
+                uint8_t sc1, m1, sc2, m2;
+                Model::detail::getScaleMinK4(is, blocks[i].scales, &sc1, &m1);
+                Model::detail::getScaleMinK4(is + 1, blocks[i].scales, &sc2, &m2);
+
+                float qx1 = 0.0f, sx1 = 0.0f, qx2 = 0.0f, sx2 = 0.0f;
+                for (int l = 0; l < 32; ++l)
+                {
+                    qx1 += static_cast<float>(q[l] & 0xF) * x[l];
+                    sx1 += x[l];
+                    qx2 += static_cast<float>(q[l] >> 4) * x[l + 32];
+                    sx2 += x[l + 32];
+                }
+                sum += d * (sc1 * qx1 + sc2 * qx2) - min * (m1 * sx1 + m2 * sx2);
+            }
+        }
+        return sum;
+    }
+
+    inline float dotQ6_K(const Model::BlockQ6_K* blocks, const float* x, int64_t n)
+    {
+        const float* table = fp16Table();
+        float sum = 0.0f;
+        for (int64_t i = 0; i < n / Model::QK_K; ++i)
+        {
+            const float d = table[blocks[i].d];
+            const uint8_t* ql = blocks[i].ql;
+            const uint8_t* qh = blocks[i].qh;
+            const int8_t* sc = blocks[i].scales;
+
+            for (int j = 0; j < Model::QK_K; j += 128, ql += 64, qh += 32, sc += 8, x += 128)
+            {
+                // Sixteen values share a scale; accumulate per scale, then apply it once
+                float groups[8] = {};
+                for (int l = 0; l < 32; ++l)
+                {
+                    const int is = l / 16;
+                    const int q1 = ((ql[l] & 0xF) | (((qh[l] >> 0) & 3) << 4)) - 32;
+                    const int q2 = ((ql[l + 32] & 0xF) | (((qh[l] >> 2) & 3) << 4)) - 32;
+                    const int q3 = ((ql[l] >> 4) | (((qh[l] >> 4) & 3) << 4)) - 32;
+                    const int q4 = ((ql[l + 32] >> 4) | (((qh[l] >> 6) & 3) << 4)) - 32;
+                    groups[is] += q1 * x[l];
+                    groups[is + 2] += q2 * x[l + 32];
+                    groups[is + 4] += q3 * x[l + 64];
+                    groups[is + 6] += q4 * x[l + 96];
+                }
+                for (int g = 0; g < 8; ++g)
+                {
+                    sum += d * sc[g] * groups[g];
+                }
+            }
+        }
+        return sum;
+    }
+
+    // Dot product of one weight row of `type` with `n` floats
+    inline float dotRow(GGMLType type, const void* row, const float* x, int64_t n)
+    {
+        switch (type)
+        {
+        case GGMLType::F32:  return dotF32(static_cast<const float*>(row), x, n);
+        case GGMLType::F16:  return dotF16(static_cast<const uint16_t*>(row), x, n);
+        case GGMLType::BF16: return dotBF16(static_cast<const uint16_t*>(row), x, n);
+        case GGMLType::Q4_0: return dotQ4_0(static_cast<const Model::BlockQ4_0*>(row), x, n);
+        case GGMLType::Q8_0: return dotQ8_0(static_cast<const Model::BlockQ8_0*>(row), x, n);
+        case GGMLType::Q4_K: return dotQ4_K(static_cast<const Model::BlockQ4_K*>(row), x, n);
+        case GGMLType::Q6_K: return dotQ6_K(static_cast<const Model::BlockQ6_K*>(row), x, n);
+        default:
+            throw std::runtime_error("Unsupported weight type");
+        }
+    }
+
+    inline void dequantizeRow(GGMLType type, const void* row, float* y, int64_t n)
+    {
+        switch (type)
+        {
+        case GGMLType::F32:
+            std::memcpy(y, row, static_cast<size_t>(n) * sizeof(float));
+            break;
+        case GGMLType::F16:
+        {
+            const float* table = fp16Table();
+            const uint16_t* values = static_cast<const uint16_t*>(row);
+            for (int64_t i = 0; i < n; ++i)
+            {
+                y[i] = table[values[i]];
+            }
+            break;
+        }
+        case GGMLType::BF16:
+        {
+            const uint16_t* values = static_cast<const uint16_t*>(row);
+            for (int64_t i = 0; i < n; ++i)
+            {
+                y[i] = Model::bf16ToFp32(values[i]);
+            }
+            break;
+        }
+        case GGMLType::Q4_0: Model::dequantizeRowQ4_0(static_cast<const Model::BlockQ4_0*>(row), y, n); break;
+        case GGMLType::Q8_0: Model::dequantizeRowQ8_0(static_cast<const Model::BlockQ8_0*>(row), y, n); break;
+        case GGMLType::Q4_K: Model::dequantizeRowQ4_K(static_cast<const Model::BlockQ4_K*>(row), y, n); break;
+        case GGMLType::Q6_K: Model::dequantizeRowQ6_K(static_cast<const Model::BlockQ6_K*>(row), y, n); break;
+        default:
+            throw std::runtime_error("Unsupported weight type");
+        }
+    }
+
+    inline const uint8_t* tensorRow(const GGUFTensorView& tensor, int64_t row)
+    {
+        return static_cast<const uint8_t*>(tensor.data) + static_cast<size_t>(row) * tensor.rowSize();
+    }
+
+    // Fewer tokens than this gain nothing from packing for the f16 GEMM
+    constexpr size_t GEMM_MIN_TOKENS = 4;
+
+    /**
+     * @brief y = W x for `nTokens` activation vectors at once
+     *
+     * `x` holds nTokens rows of ne[0] floats and `y` receives nTokens rows of ne[1].
+     * Output rows are split across the pool; every weight row is read once and applied
+     * to all tokens while it is in cache.
+     */
+    inline void matMul(const GGUFTensorView& weight, const float* x, size_t nTokens, float* y, ThreadPool& pool)
+    {
+        const int64_t nIn = weight.ne[0];
+        const int64_t nOut = weight.ne[1];
+
+        // k-quant weights take integer kernels: quantize the activations to Q8_K once
+        // per call, then every row is a dispatched Q8_K dot product
+        const QuantKernels& kernels = quantKernels();
+        const DotQ8_KFunction dotQ8_K = weight.type == GGMLType::Q4_K ? kernels.q4_K
+            : weight.type == GGMLType::Q6_K ? kernels.q6_K : nullptr;
+        if (dotQ8_K && nIn % Model::QK_K == 0)
+        {
+            const size_t blocksPerToken = static_cast<size_t>(nIn / Model::QK_K);
+            thread_local std::vector<Model::BlockQ8_K> quantized;
+            quantized.resize(nTokens * blocksPerToken);
+            for (size_t t = 0; t < nTokens; ++t)
+            {
+                Model::quantizeRowQ8_K(x + t * nIn, quantized.data() + t * blocksPerToken, nIn);
+            }
+
+            const Model::BlockQ8_K* xq = quantized.data();
+            pool.parallelFor(static_cast<size_t>(nOut), [&](size_t begin, size_t end) {
+                for (size_t r = begin; r < end; ++r)
+                {
+                    const uint8_t* row = tensorRow(weight, static_cast<int64_t>(r));
+                    for (size_t t = 0; t < nTokens; ++t)
+                    {
+                        y[t * nOut + r] = dotQ8_K(row, xq + t * blocksPerToken, nIn);
+                    }
+                }
+            });
+            return;
+        }
+
+#ifdef KOLOSAL_X86
+        // Prefill with f16 weights is matrix-matrix work
+        if (weight.type == GGMLType::F16 && nTokens >= GEMM_MIN_TOKENS && cpuFeatures().avx2)
+        {
+            gemmF16(static_cast<const uint16_t*>(weight.data), nOut, nIn, x, nTokens, y, pool);
+            return;
+        }
+#endif
+
+        pool.parallelFor(static_cast<size_t>(nOut), [&](size_t begin, size_t end) {
+            for (size_t r = begin; r < end; ++r)
+            {
+                const uint8_t* row = tensorRow(weight, static_cast<int64_t>(r));
+                for (size_t t = 0; t < nTokens; ++t)
+                {
+                    y[t * nOut + r] = dotRow(weight.type, row, x + t * nIn, nIn);
+                }
+            }
+        });
+    }
+
+    inline void rmsNorm(const float* x, const float* weight, float* y, int64_t n, float eps)
+    {
+        float sum = 0.0f;
+        for (int64_t i = 0; i < n; ++i)
+        {
+            sum += x[i] * x[i];
+        }
+        const float scale = 1.0f / std::sqrt(sum / static_cast<float>(n) + eps);
+        for (int64_t i = 0; i < n; ++i)
+        {
+            y[i] = x[i] * scale * weight[i];
+        }
+    }
+
+    inline void softmax(float* x, int64_t n)
+    {
+        float max = x[0];
+        for (int64_t i = 1; i < n; ++i)
+        {
+            max = std::max(max, x[i]);
+        }
+        float sum = 0.0f;
+        for (int64_t i = 0; i < n; ++i)
+        {
+            x[i] = std::exp(x[i] - max);
+            sum += x[i];
+        }
+        for (int64_t i = 0; i < n; ++i)
+        {
+            x[i] /= sum;
+        }
+    }
+
+    inline float silu(float x)
+    {
+        return x / (1.0f + std::exp(-x));
+    }
+
+    /**
+     * @brief Rotary position embedding in place, for `heads` vectors of `headDim`
+     *
+     * Rotates adjacent pairs (x[2i], x[2i+1]) by pos * invFreq[i], which is the layout
+     * GGUF llama models are converted to.
+     */
+    inline void applyRope(float* x, int64_t heads, int64_t headDim, int64_t pos, const std::vector<float>& invFreq)
+    {
+        for (int64_t i = 0; i < headDim / 2; ++i)
+        {
+            const float angle = static_cast<float>(pos) * invFreq[static_cast<size_t>(i)];
+            const float c = std::cos(angle);
+            const float s = std::sin(angle);
+            for (int64_t h = 0; h < heads; ++h)
+            {
+                float* v = x + h * headDim + 2 * i;
+                const float v0 = v[0];
+                const float v1 = v[1];
+                v[0] = v0 * c - v1 * s;
+                v[1] = v0 * s + v1 * c;
+            }
+        }
+    }
+} // namespace Inference
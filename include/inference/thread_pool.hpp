@@ -0,0 +1,347 @@
+#pragma once
+
+#include "cpu_features.hpp"
+#include "cpu_topology.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace Inference
+{
+    // Tells the core a thread is busy-waiting (PAUSE on x86)
+    inline void cpuRelax()
+    {
+#ifdef KOLOSAL_X86
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    /**
+     * @brief Reusable barrier for a fixed number of threads that busy-waits
+     *
+     * Arriving costs one atomic add, and the last thread releases everyone by bumping
+     * the phase, so the barrier can sit between the matmuls of every layer. Waiters
+     * spin briefly and then yield, so an unbalanced phase doesn't burn a whole core.
+     */
+    class SpinBarrier
+    {
+    public:
+        static constexpr unsigned int DEFAULT_SPIN_LIMIT = 1 << 14;
+
+        explicit SpinBarrier(unsigned int count, unsigned int spinLimit = DEFAULT_SPIN_LIMIT)
+            : m_count(count)
+            , m_spinLimit(spinLimit)
+        {
+        }
+
+        void arriveAndWait()
+        {
+            const uint32_t phase = m_phase.load(std::memory_order_acquire);
+            if (m_arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == m_count)
+            {
+                m_arrived.store(0, std::memory_order_relaxed);
+                m_phase.store(phase + 1, std::memory_order_release);
+                return;
+            }
+
+            for (unsigned int spins = 0; m_phase.load(std::memory_order_acquire) == phase; ++spins)
+            {
+                if (spins < m_spinLimit)
+                    cpuRelax();
+                else
+                    std::this_thread::yield();
+            }
+        }
+
+    private:
+        const unsigned int m_count;
+        const unsigned int m_spinLimit;
+        alignas(64) std::atomic<unsigned int> m_arrived{ 0 };
+        alignas(64) std::atomic<uint32_t> m_phase{ 0 };
+    };
+
+    struct ThreadPoolOptions
+    {
+        unsigned int threadCount = 0;  // 0: one per performance core (CpuTopology)
+        bool pinThreads = false;       // pin workers to CPUs in CpuTopology::placementOrder()
+
+        // How long idle workers keep spinning for the next job before they sleep
+        std::chrono::microseconds spinTime{ 200 };
+    };
+
+    /**
+     * @brief Persistent compute threads for splitting operations across cores
+     *
+     * parallelFor() splits the work evenly into per-thread ranges. Each thread takes
+     * chunks from the front of its own range; a thread whose range runs dry steals the
+     * back half of another's, so threads slowed by an E-core, an SMT sibling or the OS
+     * do not hold up the call. The calling thread works as thread 0.
+     *
+     * Between jobs workers spin for `spinTime`, so a forward pass that issues several
+     * jobs per layer never pays for a wake-up; after that they park on a condition
+     * variable and cost nothing while the model is idle.
+     */
+    class ThreadPool
+    {
+    public:
+        using RangeFunction = std::function<void(size_t begin, size_t end)>;
+        using ThreadFunction = std::function<void(unsigned int thread, unsigned int threads)>;
+
+        explicit ThreadPool(unsigned int threadCount = 0)
+            : ThreadPool(ThreadPoolOptions{ threadCount })
+        {
+        }
+
+        explicit ThreadPool(const ThreadPoolOptions& options)
+            : m_threadCount(options.threadCount > 0 ? options.threadCount : CpuTopology::get().defaultThreadCount())
+            , m_spinTime(isOversubscribed(m_threadCount) ? std::chrono::microseconds(0) : options.spinTime)
+            , m_barrier(m_threadCount, isOversubscribed(m_threadCount) ? 0 : SpinBarrier::DEFAULT_SPIN_LIMIT)
+            , m_ranges(new WorkRange[m_threadCount])
+        {
+            std::vector<unsigned int> placement;
+            if (options.pinThreads)
+            {
+                placement = CpuTopology::get().placementOrder();
+            }
+
+            // The caller is thread 0 and is never pinned, so workers start at the second CPU
+            for (unsigned int i = 1; i < m_threadCount; ++i)
+            {
+                const int cpu = placement.empty() ? -1 : static_cast<int>(placement[i % placement.size()]);
+                m_workers.emplace_back([this, i, cpu]() {
+                    if (cpu >= 0)
+                        pinCurrentThread(static_cast<unsigned int>(cpu));
+                    workerLoop(i);
+                });
+            }
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopping.store(true, std::memory_order_release);
+                m_generation.fetch_add(1, std::memory_order_seq_cst);
+            }
+            m_wake.notify_all();
+            for (auto& worker : m_workers)
+            {
+                worker.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Threads working on each job, including the caller
+        unsigned int size() const
+        {
+            return m_threadCount;
+        }
+
+        /**
+         * @brief Runs fn(thread, threads) once on every thread of the pool
+         *
+         * Returns when all threads have finished. `fn` may call barrier() to separate
+         * phases that depend on each other's results. Not reentrant.
+         */
+        void run(const ThreadFunction& fn)
+        {
+            if (m_workers.empty())
+            {
+                fn(0, 1);
+                return;
+            }
+
+            m_job = &fn;
+            m_generation.fetch_add(1, std::memory_order_seq_cst);
+            if (m_sleepers.load(std::memory_order_seq_cst) > 0)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_wake.notify_all();
+            }
+
+            fn(0, m_threadCount);
+            m_barrier.arriveAndWait();
+            m_job = nullptr;
+        }
+
+        // Synchronizes all threads inside run()
+        SpinBarrier& barrier()
+        {
+            return m_barrier;
+        }
+
+        // Calls fn on disjoint ranges covering [0, count) across the pool; not reentrant
+        void parallelFor(size_t count, const RangeFunction& fn)
+        {
+            if (count == 0)
+                return;
+            if (m_workers.empty() || count == 1)
+            {
+                fn(0, count);
+                return;
+            }
+
+            // Several chunks per thread leave something to steal
+            const size_t chunkSize = std::max<size_t>(1, count / (static_cast<size_t>(m_threadCount) * CHUNKS_PER_THREAD));
+            const size_t chunks = (count + chunkSize - 1) / chunkSize;
+            if (chunks > UINT32_MAX)
+            {
+                throw std::runtime_error("Too much work for one parallelFor");
+            }
+
+            for (unsigned int t = 0; t < m_threadCount; ++t)
+            {
+                const uint64_t begin = chunks * t / m_threadCount;
+                const uint64_t end = chunks * (t + 1) / m_threadCount;
+                m_ranges[t].bounds.store(pack(begin, end), std::memory_order_relaxed);
+            }
+
+            run([&](unsigned int thread, unsigned int threads) {
+                auto runChunk = [&](uint64_t chunk) {
+                    const size_t begin = static_cast<size_t>(chunk) * chunkSize;
+                    fn(begin, std::min(count, begin + chunkSize));
+                };
+
+                uint64_t chunk;
+                while (true)
+                {
+                    while (popFront(thread, chunk))
+                    {
+                        runChunk(chunk);
+                    }
+                    if (!steal(thread, threads, chunk))
+                        break;
+                    runChunk(chunk);
+                }
+            });
+        }
+
+    private:
+        static constexpr size_t CHUNKS_PER_THREAD = 4;
+
+        // [begin, end) of chunk indices, packed so owner and thieves update it with one CAS
+        struct alignas(64) WorkRange
+        {
+            std::atomic<uint64_t> bounds{ 0 };
+        };
+
+        // Spinning threads only steal time from each other when there are more than CPUs
+        static bool isOversubscribed(unsigned int threads)
+        {
+            return threads > std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        static uint64_t pack(uint64_t begin, uint64_t end)
+        {
+            return (begin << 32) | end;
+        }
+
+        bool popFront(unsigned int thread, uint64_t& chunk)
+        {
+            std::atomic<uint64_t>& bounds = m_ranges[thread].bounds;
+            uint64_t current = bounds.load(std::memory_order_acquire);
+            while (true)
+            {
+                const uint64_t begin = current >> 32;
+                const uint64_t end = current & 0xFFFFFFFFu;
+                if (begin >= end)
+                    return false;
+                if (bounds.compare_exchange_weak(current, pack(begin + 1, end), std::memory_order_acq_rel))
+                {
+                    chunk = begin;
+                    return true;
+                }
+            }
+        }
+
+        // Takes the back half of another thread's range, runs its first chunk now (returned
+        // in `chunk`) and keeps the rest as this thread's own range
+        bool steal(unsigned int thread, unsigned int threads, uint64_t& chunk)
+        {
+            for (unsigned int offset = 1; offset < threads; ++offset)
+            {
+                std::atomic<uint64_t>& victim = m_ranges[(thread + offset) % threads].bounds;
+                uint64_t current = victim.load(std::memory_order_acquire);
+                while (true)
+                {
+                    const uint64_t begin = current >> 32;
+                    const uint64_t end = current & 0xFFFFFFFFu;
+                    if (begin >= end)
+                        break;
+
+                    const uint64_t middle = begin + (end - begin) / 2;
+                    if (victim.compare_exchange_weak(current, pack(begin, middle), std::memory_order_acq_rel))
+                    {
+                        chunk = middle;
+                        m_ranges[thread].bounds.store(pack(middle + 1, end), std::memory_order_release);
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        void waitForJob(uint64_t seen)
+        {
+            const auto spinUntil = std::chrono::steady_clock::now() + m_spinTime;
+            for (unsigned int spins = 0; m_generation.load(std::memory_order_acquire) == seen; ++spins)
+            {
+                cpuRelax();
+                if ((spins & 63) == 0 && std::chrono::steady_clock::now() >= spinUntil)
+                    break;
+            }
+
+            if (m_generation.load(std::memory_order_acquire) != seen)
+                return;
+
+            // run() bumps the generation before it reads m_sleepers and this thread
+            // counts itself before it checks the generation, so one of them sees the other
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+            m_wake.wait(lock, [&]() { return m_generation.load(std::memory_order_seq_cst) != seen; });
+            m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        void workerLoop(unsigned int index)
+        {
+            uint64_t seen = 0;
+            while (true)
+            {
+                waitForJob(seen);
+                seen = m_generation.load(std::memory_order_acquire);
+                if (m_stopping.load(std::memory_order_acquire))
+                    return;
+
+                (*m_job)(index, m_threadCount);
+                m_barrier.arriveAndWait();
+            }
+        }
+
+        const unsigned int m_threadCount;
+        std::chrono::microseconds m_spinTime;
+        SpinBarrier m_barrier;
+        std::unique_ptr<WorkRange[]> m_ranges;
+        std::vector<std::thread> m_workers;
+
+        const ThreadFunction* m_job = nullptr;
+        alignas(64) std::atomic<uint64_t> m_generation{ 0 };
+        std::atomic<unsigned int> m_sleepers{ 0 };
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::atomic<bool> m_stopping{ false };
+    };
+} // namespace Inference
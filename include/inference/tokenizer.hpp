@@ -0,0 +1,646 @@
+#pragma once
+
+#include "model/gguf_reader.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Inference
+{
+    // GGUF tokenizer.ggml.token_type values
+    enum class TokenType : int32_t
+    {
+        UNDEFINED = 0,
+        NORMAL = 1,
+        UNKNOWN = 2,
+        CONTROL = 3,
+        USER_DEFINED = 4,
+        UNUSED = 5,
+        BYTE = 6
+    };
+
+    namespace unicode
+    {
+        // Decodes one code point at `pos` and advances it; invalid bytes decode as themselves
+        inline uint32_t decodeUtf8(std::string_view text, size_t& pos)
+        {
+            const uint8_t c = static_cast<uint8_t>(text[pos]);
+            size_t length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+            if (length == 0 || pos + length > text.size())
+            {
+                ++pos;
+                return c;
+            }
+
+            uint32_t cp = length == 1 ? c : length == 2 ? (c & 0x1F) : length == 3 ? (c & 0x0F) : (c & 0x07);
+            for (size_t i = 1; i < length; ++i)
+            {
+                const uint8_t next = static_cast<uint8_t>(text[pos + i]);
+                if ((next & 0xC0) != 0x80)
+                {
+                    ++pos;
+                    return c;
+                }
+                cp = (cp << 6) | (next & 0x3F);
+            }
+            pos += length;
+            return cp;
+        }
+
+        inline void appendUtf8(std::string& out, uint32_t cp)
+        {
+            if (cp < 0x80)
+            {
+                out += static_cast<char>(cp);
+            }
+            else if (cp < 0x800)
+            {
+                out += static_cast<char>(0xC0 | (cp >> 6));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000)
+            {
+                out += static_cast<char>(0xE0 | (cp >> 12));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else
+            {
+                out += static_cast<char>(0xF0 | (cp >> 18));
+                out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+        }
+
+        inline bool isSpace(uint32_t cp)
+        {
+            return (cp >= 0x09 && cp <= 0x0D) || cp == 0x20 || cp == 0x85 || cp == 0xA0 || cp == 0x1680 ||
+                (cp >= 0x2000 && cp <= 0x200A) || cp == 0x2028 || cp == 0x2029 || cp == 0x202F ||
+                cp == 0x205F || cp == 0x3000;
+        }
+
+        inline bool isNumber(uint32_t cp)
+        {
+            return (cp >= '0' && cp <= '9') || cp == 0xB2 || cp == 0xB3 || cp == 0xB9 || (cp >= 0xBC && cp <= 0xBE) ||
+                (cp >= 0x660 && cp <= 0x669) || (cp >= 0x6F0 && cp <= 0x6F9) || (cp >= 0x966 && cp <= 0x96F) ||
+                (cp >= 0x2070 && cp <= 0x2079) || (cp >= 0x2080 && cp <= 0x2089) || (cp >= 0x2150 && cp <= 0x2189) ||
+                (cp >= 0x2460 && cp <= 0x249B) || (cp >= 0xFF10 && cp <= 0xFF19);
+        }
+
+        /**
+         * @brief Approximation of \p{L} without the Unicode tables
+         *
+         * ASCII is exact. Above it, every code point counts as a letter except spaces,
+         * numbers, combining marks and the main punctuation, symbol and emoji blocks,
+         * which covers the scripts chat text is written in.
+         */
+        inline bool isLetter(uint32_t cp)
+        {
+            if (cp < 0x80)
+                return (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z');
+            if (cp < 0xC0)
+                return cp == 0xAA || cp == 0xB5 || cp == 0xBA;
+            if (cp == 0xD7 || cp == 0xF7 || isSpace(cp) || isNumber(cp))
+                return false;
+            return !((cp >= 0x300 && cp <= 0x36F) ||   // combining diacritics
+                (cp >= 0x2000 && cp <= 0x2BFF) ||       // punctuation, symbols, arrows, math, shapes
+                (cp >= 0x3000 && cp <= 0x3004) || (cp >= 0x3008 && cp <= 0x3020) ||
+                (cp >= 0xE000 && cp <= 0xF8FF) ||       // private use
+                (cp >= 0xFE00 && cp <= 0xFE4F) ||       // variation selectors, CJK compatibility forms
+                (cp >= 0xFF01 && cp <= 0xFF20) || (cp >= 0xFF3B && cp <= 0xFF40) || (cp >= 0xFF5B && cp <= 0xFF65) ||
+                (cp >= 0x1F000 && cp <= 0x1FAFF));      // emoji and pictographs
+        }
+    } // namespace unicode
+
+    /**
+     * @brief Byte-level BPE tokenizer built from a GGUF file's `tokenizer.ggml.*` metadata
+     *
+     * Supports the "gpt2" tokenizer model with the Llama 3 pre-tokenizer, as used by the
+     * Llama 3.x GGUF files. Text is split by a hand-written equivalent of the Llama 3
+     * pre-tokenizer regex; words found in the vocabulary as a whole are emitted directly
+     * and the rest are merged pair by pair in merge-rank order.
+     *
+     * Merges work on token ids: the merge table is hashed by the (left, right) id pair and
+     * a word's candidate pairs sit in a priority queue over a linked list of symbols, so
+     * a word of n bytes costs O(n log n) however long it is.
+     */
+    class Tokenizer
+    {
+    public:
+        explicit Tokenizer(const Model::GGUFFile& file)
+        {
+            const std::string model = file.getString("tokenizer.ggml.model");
+            if (model != "gpt2")
+                throw std::runtime_error("Unsupported tokenizer model: " + model);
+
+            const Model::GGUFArray* tokens = file.getArray("tokenizer.ggml.tokens");
+            if (!tokens || tokens->type != Model::GGUFValueType::STRING || tokens->strings.empty())
+                throw std::runtime_error("Missing tokenizer.ggml.tokens");
+
+            m_tokens.reserve(tokens->strings.size());
+            for (size_t i = 0; i < tokens->strings.size(); ++i)
+            {
+                m_tokens.emplace_back(tokens->strings[i]);
+                m_tokenIds.emplace(m_tokens.back(), static_cast<int32_t>(i));
+            }
+
+            m_types.assign(m_tokens.size(), TokenType::NORMAL);
+            if (const Model::GGUFArray* types = file.getArray("tokenizer.ggml.token_type"))
+            {
+                if (types->type == Model::GGUFValueType::INT32)
+                {
+                    for (size_t i = 0; i < std::min<size_t>(types->count, m_types.size()); ++i)
+                    {
+                        m_types[i] = static_cast<TokenType>(types->at<int32_t>(i));
+                    }
+                }
+            }
+
+            if (const Model::GGUFArray* merges = file.getArray("tokenizer.ggml.merges"))
+            {
+                m_merges.reserve(merges->strings.size());
+                for (size_t i = 0; i < merges->strings.size(); ++i)
+                {
+                    std::string_view merge = merges->strings[i];
+                    size_t space = merge.find(' ', 1);
+                    if (space == std::string_view::npos)
+                        continue;
+
+                    auto left = tokenId(merge.substr(0, space));
+                    auto right = tokenId(merge.substr(space + 1));
+                    auto result = tokenId(std::string(merge.substr(0, space)).append(merge.substr(space + 1)));
+                    if (left && right && result)
+                    {
+                        m_merges.emplace(pairKey(*left, *right), Merge{ static_cast<int32_t>(i), *result });
+                    }
+                }
+            }
+
+            m_bos = findSpecial(file, "tokenizer.ggml.bos_token_id", "<|begin_of_text|>");
+            m_eos = findSpecial(file, "tokenizer.ggml.eos_token_id", "<|end_of_text|>");
+            for (const char* name : { "<|eot_id|>", "<|eom_id|>", "<|end_of_text|>", "<|im_end|>", "<end_of_turn>" })
+            {
+                if (auto id = tokenId(name))
+                {
+                    m_endOfGeneration.push_back(*id);
+                }
+            }
+            if (m_eos >= 0)
+            {
+                m_endOfGeneration.push_back(m_eos);
+            }
+            if (auto eot = file.findMetadata("tokenizer.ggml.eot_token_id"))
+            {
+                if (auto id = eot->asUInt())
+                    m_endOfGeneration.push_back(static_cast<int32_t>(*id));
+            }
+
+            buildByteMap();
+            buildPieces();
+            buildSpecialTokens();
+        }
+
+        size_t vocabSize() const { return m_tokens.size(); }
+        int32_t bos() const { return m_bos; }
+        int32_t eos() const { return m_eos; }
+
+        // End-of-turn, end-of-message and end-of-text tokens
+        bool isEndOfGeneration(int32_t token) const
+        {
+            return std::find(m_endOfGeneration.begin(), m_endOfGeneration.end(), token) != m_endOfGeneration.end();
+        }
+
+        const std::vector<int32_t>& endOfGenerationTokens() const { return m_endOfGeneration; }
+
+        std::optional<int32_t> tokenId(std::string_view text) const
+        {
+            auto it = m_tokenIds.find(std::string(text));
+            if (it == m_tokenIds.end())
+                return std::nullopt;
+            return it->second;
+        }
+
+        /**
+         * @brief Token ids of `text`
+         *
+         * With `parseSpecial` the text of control and user-defined tokens (such as
+         * "<|eot_id|>") becomes that token; otherwise it is tokenized as plain text, which
+         * is what user-supplied content needs.
+         */
+        std::vector<int32_t> encode(std::string_view text, bool parseSpecial = false) const
+        {
+            std::vector<int32_t> ids;
+            ids.reserve(text.size() / 3);
+            if (!parseSpecial)
+            {
+                encodeText(text, ids);
+                return ids;
+            }
+
+            size_t start = 0;
+            for (size_t pos = 0; pos < text.size(); ++pos)
+            {
+                const int32_t special = matchSpecial(text, pos);
+                if (special < 0)
+                    continue;
+
+                encodeText(text.substr(start, pos - start), ids);
+                ids.push_back(special);
+                pos += m_tokens[static_cast<size_t>(special)].size() - 1;
+                start = pos + 1;
+            }
+            encodeText(text.substr(start), ids);
+            return ids;
+        }
+
+        // UTF-8 bytes of a token; control tokens decode to nothing
+        const std::string& piece(int32_t token) const
+        {
+            static const std::string empty;
+            if (token < 0 || static_cast<size_t>(token) >= m_pieces.size())
+                return empty;
+            return m_pieces[static_cast<size_t>(token)];
+        }
+
+        std::string decode(int32_t token) const
+        {
+            return piece(token);
+        }
+
+        std::string decode(const std::vector<int32_t>& tokens) const
+        {
+            std::string text;
+            for (int32_t token : tokens)
+            {
+                text += piece(token);
+            }
+            return text;
+        }
+
+        /**
+         * @brief Splits text like the Llama 3 pre-tokenizer regex
+         *
+         *   (?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}{1,3}|
+         *    ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+
+         */
+        static std::vector<std::string_view> preTokenize(std::string_view text)
+        {
+            // Code points with their byte offsets; offsets has one extra entry for the end
+            std::vector<uint32_t> cps;
+            std::vector<size_t> offsets;
+            for (size_t pos = 0; pos < text.size();)
+            {
+                offsets.push_back(pos);
+                cps.push_back(unicode::decodeUtf8(text, pos));
+            }
+            offsets.push_back(text.size());
+
+            const size_t n = cps.size();
+            auto at = [&](size_t i) -> uint32_t { return i < n ? cps[i] : 0xFFFFFFFF; };
+            auto isLetter = [&](size_t i) { return i < n && unicode::isLetter(cps[i]); };
+            auto isNumber = [&](size_t i) { return i < n && unicode::isNumber(cps[i]); };
+            auto isSpace = [&](size_t i) { return i < n && unicode::isSpace(cps[i]); };
+            auto isNewline = [&](size_t i) { return at(i) == '\r' || at(i) == '\n'; };
+            auto lower = [&](size_t i) { uint32_t c = at(i); return c >= 'A' && c <= 'Z' ? c + 32 : c; };
+
+            std::vector<std::string_view> words;
+            size_t i = 0;
+            while (i < n)
+            {
+                size_t end = i;
+
+                if (at(i) == '\'')
+                {
+                    const uint32_t c1 = lower(i + 1);
+                    const uint32_t c2 = lower(i + 2);
+                    if (c1 == 's' || c1 == 't' || c1 == 'm' || c1 == 'd')
+                        end = i + 2;
+                    else if ((c1 == 'r' && c2 == 'e') || (c1 == 'v' && c2 == 'e') || (c1 == 'l' && c2 == 'l'))
+                        end = i + 3;
+                }
+
+                if (end == i)
+                {
+                    // [^\r\n\p{L}\p{N}]?\p{L}+
+                    size_t j = i;
+                    if (!isLetter(j) && !isNewline(j) && !isNumber(j))
+                        ++j;
+                    if (isLetter(j))
+                    {
+                        while (isLetter(j))
+                            ++j;
+                        end = j;
+                    }
+                }
+
+                if (end == i && isNumber(i))
+                {
+                    end = i + 1;
+                    while (end < n && end < i + 3 && isNumber(end))
+                        ++end;
+                }
+
+                if (end == i)
+                {
+                    //  ?[^\s\p{L}\p{N}]+[\r\n]*
+                    size_t j = at(i) == ' ' ? i + 1 : i;
+                    size_t k = j;
+                    while (k < n && !isSpace(k) && !isLetter(k) && !isNumber(k))
+                        ++k;
+                    if (k > j)
+                    {
+                        while (isNewline(k))
+                            ++k;
+                        end = k;
+                    }
+                }
+
+                if (end == i && isSpace(i))
+                {
+                    size_t runEnd = i;
+                    while (isSpace(runEnd))
+                        ++runEnd;
+
+                    // \s*[\r\n]+ ends at the last newline of the whitespace run
+                    size_t lastNewline = n;
+                    for (size_t k = i; k < runEnd; ++k)
+                    {
+                        if (isNewline(k))
+                            lastNewline = k;
+                    }
+
+                    if (lastNewline != n)
+                        end = lastNewline + 1;
+                    else if (runEnd == n || runEnd - i == 1)
+                        end = runEnd;           // \s+(?!\S) at the end, or \s+ for a single space
+                    else
+                        end = runEnd - 1;       // \s+(?!\S): leave the last space for the next word
+                }
+
+                if (end == i)
+                    end = i + 1;
+
+                words.push_back(text.substr(offsets[i], offsets[end] - offsets[i]));
+                i = end;
+            }
+            return words;
+        }
+
+    private:
+        int32_t findSpecial(const Model::GGUFFile& file, const char* key, const char* fallback) const
+        {
+            if (const Model::GGUFValue* value = file.findMetadata(key))
+            {
+                if (auto id = value->asUInt())
+                    return static_cast<int32_t>(*id);
+            }
+            return tokenId(fallback).value_or(-1);
+        }
+
+        // GPT-2's reversible mapping of bytes to printable code points
+        void buildByteMap()
+        {
+            int extra = 0;
+            for (int b = 0; b < 256; ++b)
+            {
+                const bool printable = (b >= 33 && b <= 126) || (b >= 161 && b <= 172) || (b >= 174 && b <= 255);
+                const uint32_t cp = printable ? static_cast<uint32_t>(b) : static_cast<uint32_t>(256 + extra++);
+                m_byteToUnicode[static_cast<size_t>(b)].clear();
+                unicode::appendUtf8(m_byteToUnicode[static_cast<size_t>(b)], cp);
+                m_unicodeToByte[cp] = static_cast<uint8_t>(b);
+            }
+        }
+
+        struct Merge
+        {
+            int32_t rank;
+            int32_t result;
+        };
+
+        static uint64_t pairKey(int32_t left, int32_t right)
+        {
+            return (static_cast<uint64_t>(static_cast<uint32_t>(left)) << 32) | static_cast<uint32_t>(right);
+        }
+
+        // Bytes each token stands for, so decoding is a lookup
+        void buildPieces()
+        {
+            m_pieces.resize(m_tokens.size());
+            for (size_t token = 0; token < m_tokens.size(); ++token)
+            {
+                const TokenType type = m_types[token];
+                if (type == TokenType::CONTROL || type == TokenType::UNUSED)
+                    continue;
+
+                const std::string& text = m_tokens[token];
+                if (type == TokenType::USER_DEFINED)
+                {
+                    m_pieces[token] = text;
+                    continue;
+                }
+
+                std::string& bytes = m_pieces[token];
+                for (size_t pos = 0; pos < text.size();)
+                {
+                    uint32_t cp = unicode::decodeUtf8(text, pos);
+                    auto it = m_unicodeToByte.find(cp);
+                    if (it != m_unicodeToByte.end())
+                    {
+                        bytes += static_cast<char>(it->second);
+                    }
+                    else
+                    {
+                        unicode::appendUtf8(bytes, cp);
+                    }
+                }
+            }
+
+            for (int b = 0; b < 256; ++b)
+            {
+                m_byteTokens[static_cast<size_t>(b)] = tokenId(m_byteToUnicode[static_cast<size_t>(b)]).value_or(-1);
+            }
+        }
+
+        // Control and user-defined tokens by first byte, longest first so the longest match wins
+        void buildSpecialTokens()
+        {
+            for (size_t token = 0; token < m_tokens.size(); ++token)
+            {
+                if ((m_types[token] == TokenType::CONTROL || m_types[token] == TokenType::USER_DEFINED) && !m_tokens[token].empty())
+                {
+                    m_specials[static_cast<uint8_t>(m_tokens[token][0])].push_back(static_cast<int32_t>(token));
+                }
+            }
+            for (auto& bucket : m_specials)
+            {
+                std::stable_sort(bucket.begin(), bucket.end(), [&](int32_t a, int32_t b) {
+                    return m_tokens[static_cast<size_t>(a)].size() > m_tokens[static_cast<size_t>(b)].size();
+                });
+            }
+        }
+
+        // The special token whose text starts at `pos`, or -1
+        int32_t matchSpecial(std::string_view text, size_t pos) const
+        {
+            for (int32_t token : m_specials[static_cast<uint8_t>(text[pos])])
+            {
+                const std::string& special = m_tokens[static_cast<size_t>(token)];
+                if (special.size() <= text.size() - pos && std::memcmp(text.data() + pos, special.data(), special.size()) == 0)
+                    return token;
+            }
+            return -1;
+        }
+
+        // One symbol per byte of a word, linked so a merge unlinks its right-hand symbol in O(1)
+        struct Symbol
+        {
+            int32_t id;
+            int32_t prev;
+            int32_t next;
+        };
+
+        // A possible merge, ordered by rank and then position as the rank-ordered merge loop applies them
+        struct Candidate
+        {
+            int32_t rank;
+            int32_t left;
+            int32_t right;
+            int32_t result;
+
+            bool operator>(const Candidate& other) const
+            {
+                return rank != other.rank ? rank > other.rank : left > other.left;
+            }
+        };
+
+        // Buffers reused across the words of one encode() call
+        struct WordScratch
+        {
+            std::string mapped;
+            std::vector<Symbol> symbols;
+            std::vector<Candidate> queue;
+        };
+
+        void encodeText(std::string_view text, std::vector<int32_t>& ids) const
+        {
+            if (text.empty())
+                return;
+
+            WordScratch scratch;
+            for (std::string_view word : preTokenize(text))
+            {
+                encodeWord(word, scratch, ids);
+            }
+        }
+
+        void encodeWord(std::string_view word, WordScratch& scratch, std::vector<int32_t>& ids) const
+        {
+            std::string& mapped = scratch.mapped;
+            mapped.clear();
+            for (char c : word)
+            {
+                mapped += m_byteToUnicode[static_cast<uint8_t>(c)];
+            }
+
+            // Llama 3 emits whole words that are in the vocabulary without merging
+            auto whole = m_tokenIds.find(mapped);
+            if (whole != m_tokenIds.end())
+            {
+                ids.push_back(whole->second);
+                return;
+            }
+
+            std::vector<Symbol>& symbols = scratch.symbols;
+            symbols.clear();
+            for (char c : word)
+            {
+                const int32_t id = m_byteTokens[static_cast<uint8_t>(c)];
+                if (id < 0)
+                    continue;
+                const int32_t index = static_cast<int32_t>(symbols.size());
+                symbols.push_back({ id, index - 1, index + 1 });
+            }
+            if (symbols.empty())
+                return;
+            symbols.back().next = -1;
+
+            std::vector<Candidate>& queue = scratch.queue;
+            queue.clear();
+            const std::greater<Candidate> later;
+            auto addCandidate = [&](int32_t left, int32_t right) {
+                if (left < 0 || right < 0)
+                    return;
+                auto merge = m_merges.find(pairKey(symbols[static_cast<size_t>(left)].id, symbols[static_cast<size_t>(right)].id));
+                if (merge != m_merges.end())
+                {
+                    queue.push_back({ merge->second.rank, left, right, merge->second.result });
+                    std::push_heap(queue.begin(), queue.end(), later);
+                }
+            };
+
+            for (int32_t i = 0; i + 1 < static_cast<int32_t>(symbols.size()); ++i)
+            {
+                addCandidate(i, i + 1);
+            }
+
+            while (!queue.empty())
+            {
+                std::pop_heap(queue.begin(), queue.end(), later);
+                const Candidate candidate = queue.back();
+                queue.pop_back();
+
+                // Skip candidates made stale by an earlier merge of either symbol
+                Symbol& left = symbols[static_cast<size_t>(candidate.left)];
+                if (left.id < 0 || left.next != candidate.right)
+                    continue;
+                Symbol& right = symbols[static_cast<size_t>(candidate.right)];
+                if (right.id < 0)
+                    continue;
+                auto merge = m_merges.find(pairKey(left.id, right.id));
+                if (merge == m_merges.end() || merge->second.rank != candidate.rank)
+                    continue;
+
+                left.id = candidate.result;
+                left.next = right.next;
+                if (right.next >= 0)
+                {
+                    symbols[static_cast<size_t>(right.next)].prev = candidate.left;
+                }
+                right.id = -1;
+
+                addCandidate(left.prev, candidate.left);
+                addCandidate(candidate.left, left.next);
+            }
+
+            for (int32_t i = 0; i >= 0; i = symbols[static_cast<size_t>(i)].next)
+            {
+                ids.push_back(symbols[static_cast<size_t>(i)].id);
+            }
+        }
+
+        std::vector<std::string> m_tokens;
+        std::vector<TokenType> m_types;
+        std::vector<std::string> m_pieces;
+        std::unordered_map<std::string, int32_t> m_tokenIds;
+        std::unordered_map<uint64_t, Merge> m_merges;
+        std::array<std::string, 256> m_byteToUnicode;
+        std::array<int32_t, 256> m_byteTokens{};
+        std::unordered_map<uint32_t, uint8_t> m_unicodeToByte;
+        std::array<std::vector<int32_t>, 256> m_specials;
+        std::vector<int32_t> m_endOfGeneration;
+        int32_t m_bos = -1;
+        int32_t m_eos = -1;
+    };
+} // namespace Inference
@@ -0,0 +1,483 @@
+#pragma once
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/fs.h>
+#elif defined(__APPLE__)
+#include <sys/clonefile.h>
+#endif
+#endif
+
+#include <json.hpp>
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <fstream>
+#include <filesystem>
+#include <optional>
+#include <cstdint>
+#include <cctype>
+#include <algorithm>
+
+namespace Model
+{
+    enum class MaterializeMethod
+    {
+        HARDLINK,
+        REFLINK,
+        COPY
+    };
+
+    /**
+     * @brief Content-addressed store for model files, shared by every catalog entry
+     *
+     * Each distinct file is kept once as `<root>/sha256/<digest>`. Model paths in the
+     * catalog are materialized from these blobs as hardlinks, so a renamed catalog
+     * entry, a re-download, or a second copy of the same weights costs no extra disk
+     * space. Where hardlinks are not allowed (e.g. fs.protected_hardlinks on a store
+     * shared between users), a reflink (copy-on-write clone) is tried before falling
+     * back to a full copy.
+     *
+     * `<root>/manifest.json` maps each digest to the model paths that reference it; a
+     * blob with no remaining references is deleted by collectGarbage(). The manifest is
+     * re-read and rewritten under an exclusive lock on `<root>/manifest.lock` for every
+     * change, so several processes (or users) can share one store.
+     *
+     * Digests are trusted as given: only files whose SHA-256 was verified should be
+     * added.
+     */
+    class BlobStore
+    {
+    public:
+        explicit BlobStore(const std::string& rootPath)
+            : m_rootPath(rootPath)
+        {
+        }
+
+        BlobStore(const BlobStore&) = delete;
+        BlobStore& operator=(const BlobStore&) = delete;
+
+        const std::string& rootPath() const { return m_rootPath; }
+
+        std::string getBlobPath(const std::string& sha256) const
+        {
+            return m_rootPath + "/sha256/" + toLower(sha256);
+        }
+
+        bool contains(const std::string& sha256) const
+        {
+            std::error_code ec;
+            return isDigest(sha256) && std::filesystem::is_regular_file(getBlobPath(sha256), ec);
+        }
+
+        /**
+         * @brief Moves a verified file into the store and links it back in place
+         *
+         * If the store already holds the same content, the file is replaced by a link
+         * to the existing blob, freeing its space. Afterwards `path` is a reference of
+         * the blob. Returns std::nullopt (leaving `path` as it was) on failure.
+         */
+        std::optional<MaterializeMethod> add(const std::string& path, const std::string& digest)
+        {
+            const std::string sha256 = toLower(digest);
+            if (!isDigest(sha256))
+                return std::nullopt;
+
+            std::lock_guard<std::mutex> guard(m_mutex);
+            ManifestLock lock(m_rootPath);
+            if (!lock.isLocked())
+                return std::nullopt;
+
+            Manifest manifest = loadManifest();
+            const std::string blobPath = getBlobPath(sha256);
+            std::error_code ec;
+
+            if (std::filesystem::equivalent(path, blobPath, ec))
+            {
+                addReference(manifest, sha256, path);
+                return saveManifest(manifest) ? std::optional<MaterializeMethod>(MaterializeMethod::HARDLINK) : std::nullopt;
+            }
+
+            bool movedIn = false;
+            if (!std::filesystem::is_regular_file(blobPath, ec))
+            {
+                // Moving keeps the file's inode, so a same-filesystem add costs no I/O
+                if (!moveFile(path, blobPath))
+                    return std::nullopt;
+                movedIn = true;
+            }
+
+            std::optional<MaterializeMethod> method = link(blobPath, path);
+            if (!method)
+            {
+                // Put the original back rather than leave the model missing. A blob that was
+                // already stored may be shared, so it stays put and `path` gets a copy instead.
+                if (!std::filesystem::exists(path, ec))
+                {
+                    if (movedIn)
+                        moveFile(blobPath, path);
+                    else
+                        std::filesystem::copy_file(blobPath, path, ec);
+                }
+                return std::nullopt;
+            }
+
+            addReference(manifest, sha256, path);
+            manifest.blobs[sha256].size = std::filesystem::file_size(blobPath, ec);
+            if (!saveManifest(manifest))
+                return std::nullopt;
+            return method;
+        }
+
+        // Creates `path` from a stored blob and records it as a reference
+        std::optional<MaterializeMethod> materialize(const std::string& digest, const std::string& path)
+        {
+            const std::string sha256 = toLower(digest);
+            if (!contains(sha256))
+                return std::nullopt;
+
+            std::lock_guard<std::mutex> guard(m_mutex);
+            ManifestLock lock(m_rootPath);
+            if (!lock.isLocked())
+                return std::nullopt;
+
+            std::error_code ec;
+            std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+            std::optional<MaterializeMethod> method = link(getBlobPath(sha256), path);
+            if (!method)
+                return std::nullopt;
+
+            Manifest manifest = loadManifest();
+            addReference(manifest, sha256, path);
+            manifest.blobs[sha256].size = std::filesystem::file_size(getBlobPath(sha256), ec);
+            if (!saveManifest(manifest))
+                return std::nullopt;
+            return method;
+        }
+
+        /**
+         * @brief Drops references whose file is gone, then deletes unreferenced blobs
+         *
+         * Files in the blob directory that the manifest does not know (left behind by
+         * a crash between moving a file in and saving the manifest) are deleted too.
+         * Returns the number of bytes freed.
+         */
+        uint64_t collectGarbage()
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            ManifestLock lock(m_rootPath);
+            if (!lock.isLocked())
+                return 0;
+
+            Manifest manifest = loadManifest();
+            uint64_t freed = 0;
+            std::error_code ec;
+
+            for (auto it = manifest.blobs.begin(); it != manifest.blobs.end();)
+            {
+                auto& refs = it->second.refs;
+                for (auto ref = refs.begin(); ref != refs.end();)
+                {
+                    ref = std::filesystem::exists(*ref, ec) ? std::next(ref) : refs.erase(ref);
+                }
+
+                if (refs.empty())
+                {
+                    freed += removeBlob(getBlobPath(it->first));
+                    it = manifest.blobs.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+
+            for (const auto& entry : std::filesystem::directory_iterator(m_rootPath + "/sha256", ec))
+            {
+                const std::string name = entry.path().filename().string();
+                if (manifest.blobs.find(name) == manifest.blobs.end())
+                {
+                    freed += removeBlob(entry.path().string());
+                }
+            }
+
+            saveManifest(manifest);
+            return freed;
+        }
+
+        // Total size of all stored blobs, each counted once
+        uint64_t getStoredBytes() const
+        {
+            uint64_t total = 0;
+            std::error_code ec;
+            for (const auto& entry : std::filesystem::directory_iterator(m_rootPath + "/sha256", ec))
+            {
+                total += entry.file_size(ec);
+            }
+            return total;
+        }
+
+    private:
+        struct BlobEntry
+        {
+            uint64_t size = 0;
+            std::set<std::string> refs; // absolute model paths
+        };
+
+        struct Manifest
+        {
+            std::map<std::string, BlobEntry> blobs;
+        };
+
+        // Exclusive advisory lock on the manifest, held across processes
+        class ManifestLock
+        {
+        public:
+            explicit ManifestLock(const std::string& rootPath)
+            {
+                std::error_code ec;
+                std::filesystem::create_directories(rootPath + "/sha256", ec);
+                const std::string lockPath = rootPath + "/manifest.lock";
+#ifdef _WIN32
+                m_handle = CreateFileA(lockPath.c_str(), GENERIC_READ | GENERIC_WRITE,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+                OVERLAPPED overlapped = {};
+                m_locked = m_handle != INVALID_HANDLE_VALUE &&
+                    LockFileEx(m_handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+#else
+                m_fd = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+                m_locked = m_fd >= 0 && flock(m_fd, LOCK_EX) == 0;
+#endif
+            }
+
+            ~ManifestLock()
+            {
+#ifdef _WIN32
+                if (m_handle != INVALID_HANDLE_VALUE)
+                {
+                    CloseHandle(m_handle); // also releases the lock
+                }
+#else
+                if (m_fd >= 0)
+                {
+                    ::close(m_fd); // also releases the lock
+                }
+#endif
+            }
+
+            ManifestLock(const ManifestLock&) = delete;
+            ManifestLock& operator=(const ManifestLock&) = delete;
+
+            bool isLocked() const { return m_locked; }
+
+        private:
+#ifdef _WIN32
+            HANDLE m_handle = INVALID_HANDLE_VALUE;
+#else
+            int m_fd = -1;
+#endif
+            bool m_locked = false;
+        };
+
+        static std::string toLower(std::string str)
+        {
+            std::transform(str.begin(), str.end(), str.begin(),
+                [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            return str;
+        }
+
+        static bool isDigest(const std::string& sha256)
+        {
+            return sha256.size() == 64 &&
+                toLower(sha256).find_first_not_of("0123456789abcdef") == std::string::npos;
+        }
+
+        static std::string normalize(const std::string& path)
+        {
+            std::error_code ec;
+            std::filesystem::path absolute = std::filesystem::absolute(path, ec);
+            return (ec ? std::filesystem::path(path) : absolute).lexically_normal().string();
+        }
+
+        static void addReference(Manifest& manifest, const std::string& sha256, const std::string& path)
+        {
+            const std::string ref = normalize(path);
+
+            // A path references one blob at a time; re-adding it moves the reference
+            for (auto& [digest, entry] : manifest.blobs)
+            {
+                if (digest != sha256)
+                {
+                    entry.refs.erase(ref);
+                }
+            }
+            manifest.blobs[sha256].refs.insert(ref);
+        }
+
+        // Renames, or copies and deletes when `from` and `to` are on different filesystems
+        static bool moveFile(const std::string& from, const std::string& to)
+        {
+            std::error_code ec;
+            std::filesystem::rename(from, to, ec);
+            if (!ec)
+                return true;
+
+            const std::string tmpPath = to + ".tmp";
+            if (!std::filesystem::copy_file(from, tmpPath, std::filesystem::copy_options::overwrite_existing, ec))
+                return false;
+            std::filesystem::rename(tmpPath, to, ec);
+            if (ec)
+            {
+                std::filesystem::remove(tmpPath, ec);
+                return false;
+            }
+            std::filesystem::remove(from, ec);
+            return true;
+        }
+
+        // Replaces `target` with a hardlink, reflink or copy of `blobPath`, in that order of preference
+        static std::optional<MaterializeMethod> link(const std::string& blobPath, const std::string& target)
+        {
+            std::error_code ec;
+            std::filesystem::remove(target, ec);
+
+            std::filesystem::create_hard_link(blobPath, target, ec);
+            if (!ec)
+                return MaterializeMethod::HARDLINK;
+
+            const std::string tmpPath = target + ".tmp";
+            std::optional<MaterializeMethod> method;
+            if (reflink(blobPath, tmpPath))
+            {
+                method = MaterializeMethod::REFLINK;
+            }
+            else if (std::filesystem::copy_file(blobPath, tmpPath, std::filesystem::copy_options::overwrite_existing, ec))
+            {
+                method = MaterializeMethod::COPY;
+            }
+
+            if (method)
+            {
+                std::filesystem::rename(tmpPath, target, ec);
+                if (!ec)
+                    return method;
+            }
+            std::filesystem::remove(tmpPath, ec);
+            return std::nullopt;
+        }
+
+        // Copy-on-write clone; only some filesystems (btrfs, XFS, APFS, ...) support it
+        static bool reflink(const std::string& from, const std::string& to)
+        {
+#if defined(__linux__) && defined(FICLONE)
+            int src = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+            if (src < 0)
+                return false;
+            int dst = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            bool ok = dst >= 0 && ioctl(dst, FICLONE, src) == 0;
+            if (dst >= 0)
+            {
+                ::close(dst);
+            }
+            ::close(src);
+            if (!ok)
+            {
+                std::error_code ec;
+                std::filesystem::remove(to, ec);
+            }
+            return ok;
+#elif defined(__APPLE__)
+            return clonefile(from.c_str(), to.c_str(), 0) == 0;
+#else
+            (void)from;
+            (void)to;
+            return false;
+#endif
+        }
+
+        static uint64_t removeBlob(const std::string& path)
+        {
+            std::error_code ec;
+            uint64_t size = std::filesystem::file_size(path, ec);
+            if (ec)
+            {
+                size = 0;
+            }
+            return std::filesystem::remove(path, ec) ? size : 0;
+        }
+
+        std::string manifestPath() const
+        {
+            return m_rootPath + "/manifest.json";
+        }
+
+        // Expects the manifest lock to be held
+        Manifest loadManifest() const
+        {
+            Manifest manifest;
+            std::ifstream file(manifestPath());
+            if (!file.is_open())
+                return manifest;
+
+            try
+            {
+                nlohmann::json j;
+                file >> j;
+                for (const auto& [digest, value] : j.at("blobs").items())
+                {
+                    BlobEntry entry;
+                    value.at("size").get_to(entry.size);
+                    for (const auto& ref : value.at("refs"))
+                    {
+                        entry.refs.insert(ref.get<std::string>());
+                    }
+                    manifest.blobs[digest] = std::move(entry);
+                }
+            }
+            catch (const std::exception&)
+            {
+                // Unreadable: blobs become unreferenced and are re-added as models are used
+                manifest.blobs.clear();
+            }
+            return manifest;
+        }
+
+        // Expects the manifest lock to be held
+        bool saveManifest(const Manifest& manifest) const
+        {
+            nlohmann::json blobs = nlohmann::json::object();
+            for (const auto& [digest, entry] : manifest.blobs)
+            {
+                blobs[digest] = nlohmann::json{ {"size", entry.size}, {"refs", entry.refs} };
+            }
+
+            // Write to a temporary file first so a crash never leaves a torn manifest
+            const std::string tmpPath = manifestPath() + ".tmp";
+            {
+                std::ofstream file(tmpPath);
+                if (!file.is_open())
+                    return false;
+                file << nlohmann::json{ {"version", 1}, {"blobs", blobs} }.dump(4);
+                if (!file)
+                    return false;
+            }
+
+            std::error_code ec;
+            std::filesystem::rename(tmpPath, manifestPath(), ec);
+            return !ec;
+        }
+
+        const std::string m_rootPath;
+        std::mutex m_mutex; // the file lock does not exclude threads of the same process
+    };
+} // namespace Model
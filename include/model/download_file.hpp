@@ -0,0 +1,205 @@
+#pragma once
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+
+namespace Model
+{
+    /**
+     * @brief Download destination supporting positional reads/writes and preallocation
+     *
+     * Positional I/O lets several connections write their byte ranges into the same
+     * file concurrently without sharing a file pointer.
+     */
+    class DownloadFile
+    {
+    public:
+        static constexpr size_t DIRECT_ALIGNMENT = 4096;
+
+        DownloadFile() = default;
+
+        ~DownloadFile()
+        {
+            close();
+        }
+
+        DownloadFile(const DownloadFile&) = delete;
+        DownloadFile& operator=(const DownloadFile&) = delete;
+
+        /**
+         * @brief Opens (creating if needed) `path` for positional reads and writes
+         *
+         * With `direct`, writes whose offset, size and buffer address are all multiples
+         * of DIRECT_ALIGNMENT bypass the page cache (O_DIRECT). Other writes, and all
+         * writes on systems or filesystems without direct I/O, stay buffered.
+         */
+        bool open(const std::string& path, bool truncate, bool direct = false)
+        {
+            close();
+#ifdef _WIN32
+            (void)direct;
+            m_handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+            return m_handle != INVALID_HANDLE_VALUE;
+#else
+            m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+#ifdef O_DIRECT
+            if (m_fd >= 0 && direct)
+            {
+                // Fails on filesystems such as tmpfs; buffered writes still work then
+                m_directFd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC | O_DIRECT);
+            }
+#else
+            (void)direct;
+#endif
+            return m_fd >= 0;
+#endif
+        }
+
+        bool isOpen() const
+        {
+#ifdef _WIN32
+            return m_handle != INVALID_HANDLE_VALUE;
+#else
+            return m_fd >= 0;
+#endif
+        }
+
+        // Reserves `size` bytes on disk up front so that out-of-order writes do not fragment the file
+        bool preallocate(uint64_t size)
+        {
+#ifdef _WIN32
+            LARGE_INTEGER position;
+            position.QuadPart = static_cast<LONGLONG>(size);
+            return SetFilePointerEx(m_handle, position, nullptr, FILE_BEGIN) && SetEndOfFile(m_handle);
+#else
+#if defined(__linux__)
+            int rc = posix_fallocate(m_fd, 0, static_cast<off_t>(size));
+            if (rc == 0)
+                return true;
+            // Filesystems without fallocate support still get a file of the right length
+            if (rc != EOPNOTSUPP && rc != EINVAL)
+                return false;
+#endif
+            return ftruncate(m_fd, static_cast<off_t>(size)) == 0;
+#endif
+        }
+
+        bool writeAt(uint64_t offset, const void* data, size_t size)
+        {
+            const char* bytes = static_cast<const char*>(data);
+            while (size > 0)
+            {
+#ifdef _WIN32
+                OVERLAPPED overlapped = {};
+                overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFFULL);
+                overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+                DWORD written = 0;
+                DWORD chunk = static_cast<DWORD>(size > 0x40000000 ? 0x40000000 : size);
+                if (!WriteFile(m_handle, bytes, chunk, &written, &overlapped) || written == 0)
+                    return false;
+#else
+                int fd = isDirectWrite(offset, bytes, size) ? m_directFd : m_fd;
+                ssize_t written = pwrite(fd, bytes, size, static_cast<off_t>(offset));
+                if (written < 0 && errno == EINTR)
+                    continue;
+                if (written <= 0)
+                    return false;
+#endif
+                bytes += written;
+                offset += static_cast<uint64_t>(written);
+                size -= static_cast<size_t>(written);
+            }
+            return true;
+        }
+
+        bool readAt(uint64_t offset, void* data, size_t size) const
+        {
+            char* bytes = static_cast<char*>(data);
+            while (size > 0)
+            {
+#ifdef _WIN32
+                OVERLAPPED overlapped = {};
+                overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFFULL);
+                overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+                DWORD read = 0;
+                DWORD chunk = static_cast<DWORD>(size > 0x40000000 ? 0x40000000 : size);
+                if (!ReadFile(m_handle, bytes, chunk, &read, &overlapped) || read == 0)
+                    return false;
+#else
+                ssize_t read = pread(m_fd, bytes, size, static_cast<off_t>(offset));
+                if (read < 0 && errno == EINTR)
+                    continue;
+                if (read <= 0)
+                    return false;
+#endif
+                bytes += read;
+                offset += static_cast<uint64_t>(read);
+                size -= static_cast<size_t>(read);
+            }
+            return true;
+        }
+
+        // Flushes written data (not necessarily metadata) to the device
+        bool sync()
+        {
+#ifdef _WIN32
+            return FlushFileBuffers(m_handle) != 0;
+#elif defined(__linux__)
+            return fdatasync(m_fd) == 0;
+#else
+            return fsync(m_fd) == 0;
+#endif
+        }
+
+        void close()
+        {
+#ifdef _WIN32
+            if (m_handle != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(m_handle);
+                m_handle = INVALID_HANDLE_VALUE;
+            }
+#else
+            if (m_fd >= 0)
+            {
+                ::close(m_fd);
+                m_fd = -1;
+            }
+            if (m_directFd >= 0)
+            {
+                ::close(m_directFd);
+                m_directFd = -1;
+            }
+#endif
+        }
+
+    private:
+#ifndef _WIN32
+        bool isDirectWrite(uint64_t offset, const void* data, size_t size) const
+        {
+            return m_directFd >= 0 &&
+                offset % DIRECT_ALIGNMENT == 0 &&
+                size % DIRECT_ALIGNMENT == 0 &&
+                reinterpret_cast<uintptr_t>(data) % DIRECT_ALIGNMENT == 0;
+        }
+#endif
+
+#ifdef _WIN32
+        HANDLE m_handle = INVALID_HANDLE_VALUE;
+#else
+        int m_fd = -1;
+        int m_directFd = -1;
+#endif
+    };
+} // namespace Model
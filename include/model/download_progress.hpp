@@ -0,0 +1,175 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <cmath>
+#include <cstdint>
+
+namespace Model
+{
+    enum class DownloadState
+    {
+        QUEUED,
+        ACTIVE,
+        PAUSED,
+        COMPLETED,
+        FAILED,
+        CANCELLED
+    };
+
+    // Plain copy of a DownloadProgress at one point in time
+    struct DownloadProgressSnapshot
+    {
+        std::optional<DownloadState> state; // std::nullopt until the download is queued
+        uint64_t doneBytes = 0;
+        uint64_t totalBytes = 0;         // 0 while unknown
+        double bytesPerSecond = 0.0;     // over the last sample interval
+        double smoothedBytesPerSecond = 0.0;
+        double etaSeconds = -1.0;        // -1 while unknown
+
+        // 0.0 to 100.0, matching ModelVariant::downloadProgress
+        double percent() const
+        {
+            if (totalBytes == 0)
+                return 0.0;
+            return static_cast<double>(doneBytes) / static_cast<double>(totalBytes) * 100.0;
+        }
+
+        bool isInProgress() const
+        {
+            return state == DownloadState::QUEUED || state == DownloadState::ACTIVE || state == DownloadState::PAUSED;
+        }
+    };
+
+    /**
+     * @brief Live progress of one download, shared between the download thread and readers
+     *
+     * Every field is a lock-free atomic, so the UI can read progress every frame without
+     * taking a lock or racing the download thread. Only one thread at a time may call the
+     * update methods (the download thread, or whoever queues the download before handing
+     * it over); reads are wait-free from any thread.
+     *
+     * Throughput is sampled at most every SAMPLE_INTERVAL. The smoothed rate is an
+     * exponential moving average with a time constant of SMOOTHING_TIME, which keeps the
+     * ETA from jumping around on bursty connections. Fields are read individually, so a
+     * snapshot may mix values from two consecutive updates.
+     */
+    class DownloadProgress
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        static constexpr std::chrono::milliseconds SAMPLE_INTERVAL{ 250 };
+        static constexpr double SMOOTHING_TIME = 5.0; // seconds
+
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "progress counters must be lock-free");
+        static_assert(std::atomic<double>::is_always_lock_free, "progress rates must be lock-free");
+
+        DownloadProgress() = default;
+
+        DownloadProgress(const DownloadProgress&) = delete;
+        DownloadProgress& operator=(const DownloadProgress&) = delete;
+
+        void setState(DownloadState state)
+        {
+            if (state != DownloadState::ACTIVE)
+            {
+                // Time spent queued or paused must not drag the average down later
+                m_bytesPerSecond.store(0.0, std::memory_order_relaxed);
+                m_smoothedBytesPerSecond.store(0.0, std::memory_order_relaxed);
+                m_etaSeconds.store(-1.0, std::memory_order_relaxed);
+                m_hasSample = false;
+            }
+            m_state.store(static_cast<int>(state), std::memory_order_release);
+        }
+
+        void update(uint64_t doneBytes, uint64_t totalBytes, Clock::time_point now = Clock::now())
+        {
+            m_totalBytes.store(totalBytes, std::memory_order_relaxed);
+            m_doneBytes.store(doneBytes, std::memory_order_relaxed);
+
+            // A restart moves progress backwards; measure from there
+            if (!m_hasSample || doneBytes < m_sampleBytes)
+            {
+                m_hasSample = true;
+                m_sampleBytes = doneBytes;
+                m_sampleTime = now;
+                return;
+            }
+
+            if (totalBytes > 0 && doneBytes >= totalBytes)
+            {
+                m_etaSeconds.store(0.0, std::memory_order_relaxed);
+            }
+            if (now - m_sampleTime < SAMPLE_INTERVAL)
+                return;
+
+            double elapsed = std::chrono::duration<double>(now - m_sampleTime).count();
+            double rate = static_cast<double>(doneBytes - m_sampleBytes) / elapsed;
+            double smoothed = m_smoothedBytesPerSecond.load(std::memory_order_relaxed);
+            smoothed = smoothed == 0.0 ? rate : smoothed + (rate - smoothed) * (1.0 - std::exp(-elapsed / SMOOTHING_TIME));
+
+            double eta = -1.0;
+            if (totalBytes > 0 && doneBytes >= totalBytes)
+            {
+                eta = 0.0;
+            }
+            else if (totalBytes > 0 && smoothed > 0.0)
+            {
+                eta = static_cast<double>(totalBytes - doneBytes) / smoothed;
+            }
+
+            m_bytesPerSecond.store(rate, std::memory_order_relaxed);
+            m_smoothedBytesPerSecond.store(smoothed, std::memory_order_relaxed);
+            m_etaSeconds.store(eta, std::memory_order_relaxed);
+
+            m_sampleBytes = doneBytes;
+            m_sampleTime = now;
+        }
+
+        std::optional<DownloadState> getState() const
+        {
+            int state = m_state.load(std::memory_order_acquire);
+            if (state == NO_STATE)
+                return std::nullopt;
+            return static_cast<DownloadState>(state);
+        }
+
+        // 0.0 to 100.0
+        double getPercent() const
+        {
+            uint64_t total = m_totalBytes.load(std::memory_order_relaxed);
+            if (total == 0)
+                return 0.0;
+            return static_cast<double>(m_doneBytes.load(std::memory_order_relaxed)) / static_cast<double>(total) * 100.0;
+        }
+
+        DownloadProgressSnapshot snapshot() const
+        {
+            DownloadProgressSnapshot snapshot;
+            snapshot.state = getState();
+            snapshot.totalBytes = m_totalBytes.load(std::memory_order_relaxed);
+            snapshot.doneBytes = m_doneBytes.load(std::memory_order_relaxed);
+            snapshot.bytesPerSecond = m_bytesPerSecond.load(std::memory_order_relaxed);
+            snapshot.smoothedBytesPerSecond = m_smoothedBytesPerSecond.load(std::memory_order_relaxed);
+            snapshot.etaSeconds = m_etaSeconds.load(std::memory_order_relaxed);
+            return snapshot;
+        }
+
+    private:
+        static constexpr int NO_STATE = -1;
+
+        std::atomic<int> m_state{ NO_STATE };
+        std::atomic<uint64_t> m_doneBytes{ 0 };
+        std::atomic<uint64_t> m_totalBytes{ 0 };
+        std::atomic<double> m_bytesPerSecond{ 0.0 };
+        std::atomic<double> m_smoothedBytesPerSecond{ 0.0 };
+        std::atomic<double> m_etaSeconds{ -1.0 };
+
+        // Owned by the updating thread
+        bool m_hasSample = false;
+        uint64_t m_sampleBytes = 0;
+        Clock::time_point m_sampleTime{};
+    };
+} // namespace Model
@@ -0,0 +1,1248 @@
+#pragma once
+
+#include "partial_download.hpp"
+#include "download_file.hpp"
+#include "download_writer.hpp"
+#include "download_progress.hpp"
+#include "crypto/crypto.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <curl/curl.h>
+
+namespace Model
+{
+    struct DownloadResult
+    {
+        DownloadState state = DownloadState::FAILED;
+        std::string sha256; // digest of the downloaded bytes, set when COMPLETED
+        uint64_t size = 0;
+
+        // Digest and size the server published for the file, if it did (see sha256FromLinkedETag)
+        std::string publishedSha256;
+        uint64_t publishedSize = 0;
+
+        // A download that ended without data (FAILED or CANCELLED)
+        static DownloadResult ended(DownloadState state)
+        {
+            DownloadResult result;
+            result.state = state;
+            return result;
+        }
+
+        static DownloadResult completed(std::string sha256, uint64_t size)
+        {
+            DownloadResult result;
+            result.state = DownloadState::COMPLETED;
+            result.sha256 = std::move(sha256);
+            result.size = size;
+            return result;
+        }
+    };
+
+    struct DownloadRequest
+    {
+        std::string id; // identifies the download in pause/resume/cancel calls
+        std::string url;
+        std::string partPath;
+        int priority = 0; // higher starts first
+        std::shared_ptr<DownloadProgress> progress; // updated live if set
+        std::function<void(const DownloadProgressSnapshot&)> onProgress; // at most every PROGRESS_INTERVAL
+        std::function<void(const DownloadResult&)> onComplete;
+    };
+
+    /**
+     * @brief Runs every download on a single thread driving one curl multi handle
+     *
+     * Requests wait in a priority queue and at most `maxActive` of them transfer at a
+     * time; a queued request with a higher priority than a running one takes its slot,
+     * and the preempted download goes back to the queue with its `.part` file kept.
+     *
+     * Each download first probes the server with a HEAD request. Large files from
+     * servers that accept byte ranges are split into segments fetched over several
+     * connections, written in place into a preallocated `.part` file. Everything else
+     * is a single resumable stream. Either way the SHA-256 is computed as contiguous
+     * data arrives, reading back from the page cache only for bytes that were written
+     * out of order or by an earlier session. Resume state lives in `<part>.meta`; it is
+     * checkpointed each time the writer has synced the file, so it never counts bytes
+     * that a crash could still lose, and a killed download resumes from the last sync.
+     *
+     * Received data goes through a DownloadWriter, so disk writes happen in large
+     * buffers on a second thread. Only bytes that reached the file count as done for
+     * hashing and resuming. When the size is known up front the file is preallocated.
+     *
+     * Live progress goes into the request's DownloadProgress record on every received
+     * chunk, so readers never need a lock; `onProgress` only gets periodic snapshots.
+     * The callbacks of a request run on the service thread. All public methods only
+     * queue a command and return, so they are safe to call from those callbacks.
+     */
+    class DownloadService
+    {
+    public:
+        static constexpr int DEFAULT_MAX_ACTIVE = 2;
+        static constexpr int DEFAULT_CONNECTIONS = 4;
+        static constexpr int MAX_ATTEMPTS = 5;
+
+        // Below this, connection setup costs more than parallel transfer saves
+        static constexpr uint64_t MIN_SEGMENTED_SIZE = 32ULL * 1024 * 1024;
+        static constexpr uint64_t MIN_SEGMENT_SIZE = 16ULL * 1024 * 1024;
+        static constexpr int SEGMENTS_PER_CONNECTION = 4;
+
+        // Segment boundaries are multiples of this, so segment writes can use direct I/O
+        static constexpr uint64_t SEGMENT_ALIGNMENT = 1024 * 1024;
+
+        // Most bytes read back for hashing per loop turn, so catching up on a resumed
+        // file never stalls the other transfers
+        static constexpr size_t HASH_SLICE = 8 * 1024 * 1024;
+
+        static constexpr std::chrono::seconds PROGRESS_INTERVAL{ 1 };
+
+        DownloadService()
+            : m_multi(curl_multi_init())
+        {
+            if (!m_multi)
+            {
+                throw std::runtime_error("Failed to create curl multi handle");
+            }
+
+            // Segments should use separate connections rather than share one HTTP/2 stream
+            curl_multi_setopt(m_multi, CURLMOPT_PIPELINING, CURLPIPE_NOTHING);
+
+            m_thread = std::thread([this]() { run(); });
+        }
+
+        // Stops all transfers; unfinished downloads keep their .part files for resuming
+        ~DownloadService()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopping = true;
+            }
+            curl_multi_wakeup(m_multi);
+            m_thread.join();
+
+            // The writer wakes m_multi after every write, so it must be gone before the handle
+            m_writer.stop();
+            curl_multi_cleanup(m_multi);
+        }
+
+        DownloadService(const DownloadService&) = delete;
+        DownloadService& operator=(const DownloadService&) = delete;
+
+        // A request whose id is already queued or running only updates its priority
+        void enqueue(DownloadRequest request)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_states.emplace(request.id, DownloadState::QUEUED);
+            }
+            post([this, request]() { addJob(request); });
+        }
+
+        bool pause(const std::string& id)
+        {
+            return postIfKnown(id, [this, id]() {
+                Job* job = findJob(id);
+                if (!job || job->state == DownloadState::PAUSED)
+                    return;
+                if (job->state == DownloadState::ACTIVE)
+                {
+                    stopJob(*job);
+                }
+                setState(*job, DownloadState::PAUSED);
+            });
+        }
+
+        bool resume(const std::string& id)
+        {
+            return postIfKnown(id, [this, id]() {
+                Job* job = findJob(id);
+                if (job && job->state == DownloadState::PAUSED)
+                {
+                    setState(*job, DownloadState::QUEUED);
+                }
+            });
+        }
+
+        // Stops the download and deletes its partial data
+        bool cancel(const std::string& id)
+        {
+            return postIfKnown(id, [this, id]() {
+                Job* job = findJob(id);
+                if (job)
+                {
+                    finishJob(*job, DownloadResult::ended(DownloadState::CANCELLED));
+                }
+            });
+        }
+
+        void setPriority(const std::string& id, int priority)
+        {
+            postIfKnown(id, [this, id, priority]() {
+                Job* job = findJob(id);
+                if (job)
+                {
+                    job->request.priority = priority;
+                }
+            });
+        }
+
+        // Number of downloads transferring at once; the rest wait in the queue
+        void setMaxActive(int maxActive)
+        {
+            post([this, maxActive]() { m_maxActive = std::max(1, maxActive); });
+        }
+
+        // Writes download data with O_DIRECT where supported, keeping it out of the page cache
+        void setDirectIO(bool enabled)
+        {
+            post([this, enabled]() { m_directIO = enabled; });
+        }
+
+        // Connections per download for segmented transfers; 1 disables segmenting
+        void setMaxConnections(int connections)
+        {
+            post([this, connections]() { m_maxConnections = std::max(1, connections); });
+        }
+
+        // std::nullopt once the download has finished or if it was never queued
+        std::optional<DownloadState> getState(const std::string& id) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_states.find(id);
+            if (it == m_states.end())
+                return std::nullopt;
+            return it->second;
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        enum class Mode
+        {
+            PROBING,
+            STREAM,
+            SEGMENTED
+        };
+
+        struct Job;
+
+        // One easy handle in the multi handle
+        struct Transfer
+        {
+            enum class Kind
+            {
+                PROBE,
+                STREAM,
+                SEGMENT
+            };
+
+            DownloadService* service = nullptr;
+            Job* job = nullptr;
+            Kind kind = Kind::STREAM;
+            size_t segment = 0;
+            CURL* curl = nullptr;
+            struct curl_slist* headers = nullptr;
+            std::string range;
+            uint64_t resumeOffset = 0;
+            uint64_t cursor = 0; // file offset of the next received byte
+            DownloadWriter::Pending pending;
+            bool responseChecked = false;
+            bool acceptsRanges = false;
+            std::string etag;
+            std::string lastModified;
+
+            // Sent on a redirect, so kept across the responses of one transfer
+            std::string publishedSha256;
+            uint64_t publishedSize = 0;
+        };
+
+        struct SegmentState
+        {
+            uint64_t received = 0; // may run ahead of DownloadSegment::done while writes are queued
+            bool active = false;
+            int attempts = 0;
+            Clock::time_point retryAt{};
+        };
+
+        struct Job
+        {
+            DownloadRequest request;
+            std::shared_ptr<DownloadProgress> progress;
+            Clock::time_point lastProgressReport{};
+            uint64_t sequence = 0;
+            uint64_t epoch = 0; // bumped on restart, so stale writes are not credited
+            DownloadState state = DownloadState::QUEUED;
+            bool finished = false;
+
+            // Everything below is reset whenever the job (re)starts
+            Mode mode = Mode::PROBING;
+            std::string etag;
+            std::string lastModified;
+            std::string publishedSha256;
+            uint64_t publishedSize = 0;
+            uint64_t totalSize = 0; // 0 while unknown
+            DownloadFile file;
+            Crypto::Sha256 hash;
+            uint64_t hashedBytes = 0; // length of the prefix covered by `hash`
+            uint64_t receivedBytes = 0;
+            std::vector<std::unique_ptr<Transfer>> transfers;
+
+            // Single stream: bytes written to the .part file, and received so far
+            uint64_t streamBytes = 0;
+            uint64_t streamReceived = 0;
+            bool streamDone = false;
+            int attempts = 0;
+            Clock::time_point retryAt{};
+
+            // Segmented
+            std::vector<DownloadSegment> segments;
+            std::vector<SegmentState> segmentStates;
+            bool rangesRejected = false;
+        };
+
+        void post(std::function<void()> command)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_commands.push_back(std::move(command));
+            }
+            curl_multi_wakeup(m_multi);
+        }
+
+        bool postIfKnown(const std::string& id, std::function<void()> command)
+        {
+            if (!getState(id))
+                return false;
+            post(std::move(command));
+            return true;
+        }
+
+        void run()
+        {
+            while (true)
+            {
+                std::vector<std::function<void()>> commands;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (m_stopping)
+                        break;
+                    commands.swap(m_commands);
+                }
+
+                for (auto& command : commands)
+                {
+                    command();
+                }
+
+                schedule();
+
+                int running = 0;
+                curl_multi_perform(m_multi, &running);
+                processMessages();
+                applyWrites();
+
+                bool hashPending = false;
+                bool retryPending = false;
+                for (auto& job : m_jobs)
+                {
+                    if (job->finished || job->state != DownloadState::ACTIVE)
+                        continue;
+
+                    startTransfers(*job);
+                    if (!job->finished)
+                        hashPending |= advanceHash(*job);
+                    if (!job->finished)
+                        finishIfComplete(*job);
+                    retryPending |= !job->finished && job->transfers.empty();
+                }
+
+                removeFinishedJobs();
+
+                int timeoutMs = hashPending ? 0 : (retryPending ? 100 : 1000);
+                curl_multi_poll(m_multi, nullptr, 0, timeoutMs, nullptr);
+            }
+
+            for (auto& job : m_jobs)
+            {
+                if (job->state == DownloadState::ACTIVE)
+                {
+                    stopJob(*job);
+                }
+            }
+            m_jobs.clear();
+        }
+
+        Job* findJob(const std::string& id)
+        {
+            for (auto& job : m_jobs)
+            {
+                if (!job->finished && job->request.id == id)
+                    return job.get();
+            }
+            return nullptr;
+        }
+
+        Job* findJob(uint64_t sequence)
+        {
+            for (auto& job : m_jobs)
+            {
+                if (!job->finished && job->sequence == sequence)
+                    return job.get();
+            }
+            return nullptr;
+        }
+
+        void setState(Job& job, DownloadState state)
+        {
+            job.state = state;
+            job.progress->setState(state);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_states[job.request.id] = state;
+        }
+
+        void addJob(const DownloadRequest& request)
+        {
+            if (Job* existing = findJob(request.id))
+            {
+                existing->request.priority = std::max(existing->request.priority, request.priority);
+                return;
+            }
+
+            auto job = std::make_unique<Job>();
+            job->request = request;
+            job->progress = request.progress ? request.progress : std::make_shared<DownloadProgress>();
+            job->sequence = m_nextSequence++;
+            m_jobs.push_back(std::move(job));
+            setState(*m_jobs.back(), DownloadState::QUEUED);
+        }
+
+        // Fills free slots from the queue, preempting lower priority downloads if needed
+        void schedule()
+        {
+            while (true)
+            {
+                Job* next = nullptr;
+                Job* lowestActive = nullptr;
+                int active = 0;
+                for (auto& job : m_jobs)
+                {
+                    if (job->finished)
+                        continue;
+
+                    if (job->state == DownloadState::QUEUED &&
+                        (!next || job->request.priority > next->request.priority ||
+                            (job->request.priority == next->request.priority && job->sequence < next->sequence)))
+                    {
+                        next = job.get();
+                    }
+                    else if (job->state == DownloadState::ACTIVE)
+                    {
+                        ++active;
+                        if (!lowestActive || job->request.priority < lowestActive->request.priority ||
+                            (job->request.priority == lowestActive->request.priority && job->sequence > lowestActive->sequence))
+                        {
+                            lowestActive = job.get();
+                        }
+                    }
+                }
+
+                if (!next)
+                    return;
+
+                if (active >= m_maxActive)
+                {
+                    if (!lowestActive || lowestActive->request.priority >= next->request.priority)
+                        return;
+
+                    stopJob(*lowestActive);
+                    setState(*lowestActive, DownloadState::QUEUED);
+                }
+
+                startJob(*next);
+            }
+        }
+
+        // Expects the job's transfers to be released already
+        void resetJob(Job& job)
+        {
+            m_writer.waitIdle(job.file);
+            ++job.epoch;
+
+            job.mode = Mode::PROBING;
+            job.etag.clear();
+            job.lastModified.clear();
+            job.publishedSha256.clear();
+            job.publishedSize = 0;
+            job.totalSize = 0;
+            job.file.close();
+            job.hash.reset();
+            job.hashedBytes = 0;
+            job.receivedBytes = 0;
+            job.streamBytes = 0;
+            job.streamReceived = 0;
+            job.streamDone = false;
+            job.attempts = 0;
+            job.retryAt = Clock::time_point{};
+            job.segments.clear();
+            job.segmentStates.clear();
+            job.rangesRejected = false;
+        }
+
+        void startJob(Job& job)
+        {
+            resetJob(job);
+            setState(job, DownloadState::ACTIVE);
+
+            if (m_maxConnections > 1)
+            {
+                addTransfer(job, Transfer::Kind::PROBE);
+            }
+            else
+            {
+                startStream(job);
+            }
+        }
+
+        // Aborts the job's transfers and records its progress so it can resume later
+        void stopJob(Job& job)
+        {
+            for (auto& transfer : job.transfers)
+            {
+                releaseTransfer(*transfer);
+            }
+            job.transfers.clear();
+
+            // Received data is kept, so everything queued must reach the file first
+            m_writer.waitIdle(job.file);
+            applyWrites();
+
+            if (job.mode != Mode::PROBING)
+            {
+                job.file.sync();
+                saveState(job);
+            }
+            job.file.close();
+        }
+
+        void finishJob(Job& job, DownloadResult result)
+        {
+            if (job.state == DownloadState::ACTIVE)
+            {
+                stopJob(job);
+            }
+            if (result.state == DownloadState::CANCELLED)
+            {
+                removePartialDownload(job.request.partPath);
+            }
+
+            job.state = result.state;
+            job.finished = true;
+            reportProgress(job, true);
+            job.progress->setState(result.state);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_states.erase(job.request.id);
+            }
+
+            if (job.request.onComplete)
+            {
+                job.request.onComplete(result);
+            }
+        }
+
+        void removeFinishedJobs()
+        {
+            m_jobs.erase(std::remove_if(m_jobs.begin(), m_jobs.end(),
+                [](const std::unique_ptr<Job>& job) { return job->finished; }), m_jobs.end());
+        }
+
+        void saveState(const Job& job)
+        {
+            PartialDownloadInfo info;
+            info.url = job.request.url;
+            info.etag = job.etag;
+            info.lastModified = job.lastModified;
+            info.totalSize = job.totalSize;
+            if (job.mode == Mode::SEGMENTED)
+            {
+                info.segments = job.segments;
+            }
+            else if (job.totalSize > 0)
+            {
+                // The file is preallocated, so its size no longer tells how far the stream got
+                info.segments.push_back({ 0, job.totalSize, job.streamBytes });
+            }
+            savePartialDownloadInfo(job.request.partPath, info);
+        }
+
+        // Single stream, resuming from whatever is already in the .part file
+        void startStream(Job& job)
+        {
+            const std::string& partPath = job.request.partPath;
+            job.mode = Mode::STREAM;
+
+            std::error_code ec;
+            uint64_t partSize = std::filesystem::exists(partPath, ec) ? std::filesystem::file_size(partPath, ec) : 0;
+            if (ec)
+                partSize = 0;
+
+            // Only resume a .part file that belongs to this URL. A preallocated file records
+            // its progress as a single segment; a multi-segment one cannot continue as a stream.
+            auto info = loadPartialDownloadInfo(partPath);
+            bool resumable = info && info->url == job.request.url &&
+                (info->segments.empty() || (info->segments.size() == 1 && info->segments[0].start == 0));
+            if (!resumable)
+            {
+                removePartialDownload(partPath);
+                partSize = 0;
+                info.reset();
+            }
+            else if (!info->segments.empty())
+            {
+                partSize = std::min(partSize, info->segments[0].done);
+            }
+
+            if (info)
+            {
+                job.etag = info->etag;
+                job.lastModified = info->lastModified;
+                job.totalSize = info->totalSize;
+
+                // Already complete from an earlier attempt that died before the rename
+                job.streamDone = info->totalSize > 0 && partSize == info->totalSize;
+            }
+
+            if (!job.file.open(partPath, partSize == 0, m_directIO))
+            {
+                finishJob(job, DownloadResult::ended(DownloadState::FAILED));
+                return;
+            }
+
+            // The existing prefix is hashed by advanceHash before new bytes are hashed inline
+            job.streamBytes = partSize;
+            job.streamReceived = partSize;
+            job.receivedBytes = partSize;
+            reportProgress(job);
+        }
+
+        // Splits the file into segments, reusing the recorded progress of a matching .part file
+        void startSegmented(Job& job, const Transfer& probe, uint64_t size)
+        {
+            const std::string& partPath = job.request.partPath;
+            job.mode = Mode::SEGMENTED;
+            job.etag = probe.etag;
+            job.lastModified = probe.lastModified;
+            job.totalSize = size;
+
+            auto info = loadPartialDownloadInfo(partPath);
+            bool resumable = info &&
+                info->url == job.request.url &&
+                info->totalSize == size &&
+                info->etag == job.etag &&
+                info->lastModified == job.lastModified &&
+                !info->segments.empty();
+
+            std::error_code ec;
+            if (resumable && std::filesystem::file_size(partPath, ec) != size)
+            {
+                resumable = false;
+            }
+
+            bool opened = false;
+            if (resumable)
+            {
+                job.segments = info->segments;
+                for (auto& segment : job.segments)
+                {
+                    segment.done = std::min(segment.done, segment.length());
+                    job.receivedBytes += segment.done;
+                }
+                opened = job.file.open(partPath, false, m_directIO);
+            }
+            else
+            {
+                removePartialDownload(partPath);
+
+                uint64_t segmentSize = std::max<uint64_t>(MIN_SEGMENT_SIZE,
+                    size / static_cast<uint64_t>(m_maxConnections * SEGMENTS_PER_CONNECTION) + 1);
+                segmentSize = (segmentSize + SEGMENT_ALIGNMENT - 1) / SEGMENT_ALIGNMENT * SEGMENT_ALIGNMENT;
+                for (uint64_t start = 0; start < size; start += segmentSize)
+                {
+                    job.segments.push_back({ start, std::min(size, start + segmentSize), 0 });
+                }
+                opened = job.file.open(partPath, true, m_directIO) && job.file.preallocate(size);
+            }
+
+            if (!opened)
+            {
+                finishJob(job, DownloadResult::ended(DownloadState::FAILED));
+                return;
+            }
+
+            job.segmentStates.assign(job.segments.size(), SegmentState{});
+            for (size_t i = 0; i < job.segments.size(); ++i)
+            {
+                job.segmentStates[i].received = job.segments[i].done;
+            }
+            saveState(job);
+            reportProgress(job);
+        }
+
+        // Falls back to a single stream after a server answered a range request with 200
+        void switchToStream(Job& job)
+        {
+            for (auto& transfer : job.transfers)
+            {
+                releaseTransfer(*transfer, false);
+            }
+            job.transfers.clear();
+
+            resetJob(job);
+            removePartialDownload(job.request.partPath);
+            startStream(job);
+        }
+
+        void startTransfers(Job& job)
+        {
+            Clock::time_point now = Clock::now();
+
+            if (job.mode == Mode::STREAM)
+            {
+                if (!job.streamDone && job.transfers.empty() && now >= job.retryAt)
+                {
+                    addTransfer(job, Transfer::Kind::STREAM);
+                }
+                return;
+            }
+
+            if (job.mode != Mode::SEGMENTED)
+                return;
+
+            // Lowest offsets first, so the hash can follow right behind the download
+            for (size_t i = 0; i < job.segments.size() &&
+                static_cast<int>(job.transfers.size()) < m_maxConnections; ++i)
+            {
+                SegmentState& state = job.segmentStates[i];
+                if (state.received < job.segments[i].length() && !state.active && now >= state.retryAt)
+                {
+                    addTransfer(job, Transfer::Kind::SEGMENT, i);
+                }
+            }
+        }
+
+        void addTransfer(Job& job, Transfer::Kind kind, size_t segment = 0)
+        {
+            CURL* curl = curl_easy_init();
+            if (!curl)
+            {
+                finishJob(job, DownloadResult::ended(DownloadState::FAILED));
+                return;
+            }
+
+            auto transfer = std::make_unique<Transfer>();
+            transfer->service = this;
+            transfer->job = &job;
+            transfer->kind = kind;
+            transfer->segment = segment;
+            transfer->curl = curl;
+
+            std::string validator = !job.etag.empty() ? job.etag : job.lastModified;
+            if (kind == Transfer::Kind::PROBE)
+            {
+                curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+            }
+            else if (kind == Transfer::Kind::STREAM)
+            {
+                transfer->resumeOffset = job.streamReceived;
+                transfer->cursor = job.streamReceived;
+                m_writer.begin(transfer->pending, transfer->cursor);
+                if (job.streamReceived > 0)
+                {
+                    // Not CURLOPT_RESUME_FROM_LARGE: curl fails that on a 200, which is the
+                    // expected answer when If-Range finds the file changed
+                    transfer->range = std::to_string(job.streamReceived) + "-";
+                    curl_easy_setopt(curl, CURLOPT_RANGE, transfer->range.c_str());
+                }
+                else
+                {
+                    validator.clear();
+                }
+            }
+            else
+            {
+                const DownloadSegment& range = job.segments[segment];
+                transfer->cursor = range.start + job.segmentStates[segment].received;
+                transfer->range = std::to_string(transfer->cursor) + "-" + std::to_string(range.end - 1);
+                m_writer.begin(transfer->pending, transfer->cursor);
+                curl_easy_setopt(curl, CURLOPT_RANGE, transfer->range.c_str());
+                job.segmentStates[segment].active = true;
+            }
+
+            // Without a validator the server would splice a changed file onto the old bytes
+            if (kind != Transfer::Kind::PROBE && !validator.empty())
+            {
+                transfer->headers = curl_slist_append(transfer->headers, ("If-Range: " + validator).c_str());
+                curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->headers);
+            }
+
+            curl_easy_setopt(curl, CURLOPT_URL, job.request.url.c_str());
+            curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer.get());
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfer.get());
+            curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+            curl_easy_setopt(curl, CURLOPT_HEADERDATA, transfer.get());
+            curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+            curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+            curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+
+            // Treat a stalled connection like a dropped one so it gets resumed
+            curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+            curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 60L);
+
+            curl_multi_add_handle(m_multi, curl);
+            job.transfers.push_back(std::move(transfer));
+        }
+
+        // Writes out what the transfer buffered unless `keepData` is false
+        void releaseTransfer(Transfer& transfer, bool keepData = true)
+        {
+            if (keepData)
+            {
+                m_writer.flush(transfer.pending, transfer.job->file, writeTag(transfer));
+            }
+            m_writer.discard(transfer.pending);
+
+            if (transfer.kind == Transfer::Kind::SEGMENT && transfer.segment < transfer.job->segmentStates.size())
+            {
+                transfer.job->segmentStates[transfer.segment].active = false;
+            }
+
+            curl_multi_remove_handle(m_multi, transfer.curl);
+            curl_easy_cleanup(transfer.curl);
+            curl_slist_free_all(transfer.headers);
+            transfer.curl = nullptr;
+            transfer.headers = nullptr;
+        }
+
+        static DownloadWriter::Tag writeTag(const Transfer& transfer)
+        {
+            return { transfer.job->sequence, transfer.job->epoch, transfer.segment };
+        }
+
+        // Credits bytes that reached the file to their segment or stream
+        void applyWrites()
+        {
+            for (const auto& write : m_writer.takeCompleted())
+            {
+                Job* job = findJob(write.tag.job);
+                if (!job || job->epoch != write.tag.epoch)
+                    continue;
+
+                if (!write.ok)
+                {
+                    finishJob(*job, DownloadResult::ended(DownloadState::FAILED));
+                    continue;
+                }
+
+                if (job->mode == Mode::SEGMENTED)
+                {
+                    job->segments[write.tag.segment].done += write.size;
+                }
+                else
+                {
+                    job->streamBytes += write.size;
+                }
+
+                // Writes to a file complete in order, so everything credited so far is durable
+                if (write.synced)
+                {
+                    saveState(*job);
+                }
+            }
+        }
+
+        static bool isTransientError(CURLcode code, long status)
+        {
+            switch (code)
+            {
+            case CURLE_COULDNT_CONNECT:
+            case CURLE_PARTIAL_FILE:
+            case CURLE_RECV_ERROR:
+            case CURLE_SEND_ERROR:
+            case CURLE_OPERATION_TIMEDOUT:
+            case CURLE_GOT_NOTHING:
+            case CURLE_SSL_CONNECT_ERROR:
+            case CURLE_HTTP2:
+            case CURLE_HTTP2_STREAM:
+                return true;
+            case CURLE_HTTP_RETURNED_ERROR:
+                // Other client errors will not go away by retrying
+                return status >= 500 || status == 429;
+            default:
+                return false;
+            }
+        }
+
+        void processMessages()
+        {
+            int remaining = 0;
+            while (CURLMsg* message = curl_multi_info_read(m_multi, &remaining))
+            {
+                if (message->msg != CURLMSG_DONE)
+                    continue;
+
+                Transfer* transfer = nullptr;
+                curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, reinterpret_cast<char**>(&transfer));
+                CURLcode result = message->data.result;
+
+                long status = 0;
+                curl_easy_getinfo(message->easy_handle, CURLINFO_RESPONSE_CODE, &status);
+                curl_off_t contentLength = -1;
+                curl_easy_getinfo(message->easy_handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+
+                Job& job = *transfer->job;
+                releaseTransfer(*transfer);
+
+                // Keep the transfer alive until its handler is done with it
+                std::unique_ptr<Transfer> owned;
+                auto it = std::find_if(job.transfers.begin(), job.transfers.end(),
+                    [transfer](const std::unique_ptr<Transfer>& t) { return t.get() == transfer; });
+                if (it != job.transfers.end())
+                {
+                    owned = std::move(*it);
+                    job.transfers.erase(it);
+                }
+
+                if (job.finished || job.state != DownloadState::ACTIVE)
+                    continue;
+
+                switch (transfer->kind)
+                {
+                case Transfer::Kind::PROBE:
+                    onProbeDone(job, *transfer, result, contentLength);
+                    break;
+                case Transfer::Kind::STREAM:
+                    onStreamDone(job, result, status);
+                    break;
+                case Transfer::Kind::SEGMENT:
+                    onSegmentDone(job, transfer->segment, result, status);
+                    break;
+                }
+            }
+        }
+
+        void onProbeDone(Job& job, const Transfer& probe, CURLcode result, curl_off_t contentLength)
+        {
+            notePublishedDigest(job, probe);
+
+            bool segmented = result == CURLE_OK &&
+                probe.acceptsRanges &&
+                m_maxConnections > 1 &&
+                contentLength >= static_cast<curl_off_t>(MIN_SEGMENTED_SIZE);
+
+            // A failed probe (some servers reject HEAD) still gets a GET, which reports the real error
+            if (segmented)
+            {
+                startSegmented(job, probe, static_cast<uint64_t>(contentLength));
+            }
+            else
+            {
+                startStream(job);
+            }
+        }
+
+        void onStreamDone(Job& job, CURLcode result, long status)
+        {
+            if (result == CURLE_OK)
+            {
+                job.streamDone = true;
+                if (job.totalSize == 0)
+                {
+                    job.totalSize = job.streamReceived;
+                }
+                return;
+            }
+
+            // Range not satisfiable: the .part file does not fit the remote file any more
+            if (result == CURLE_HTTP_RETURNED_ERROR && status == 416)
+            {
+                resetJob(job);
+                removePartialDownload(job.request.partPath);
+                startStream(job);
+                return;
+            }
+
+            saveState(job);
+            if (!isTransientError(result, status) || ++job.attempts >= MAX_ATTEMPTS)
+            {
+                // Keep the .part file so a later attempt resumes where this one stopped
+                finishJob(job, DownloadResult::ended(DownloadState::FAILED));
+                return;
+            }
+            job.retryAt = Clock::now() + std::chrono::seconds(job.attempts);
+        }
+
+        void onSegmentDone(Job& job, size_t index, CURLcode result, long status)
+        {
+            if (job.rangesRejected)
+            {
+                switchToStream(job);
+                return;
+            }
+
+            const DownloadSegment& segment = job.segments[index];
+            if (result == CURLE_OK && job.segmentStates[index].received == segment.length())
+                return;
+
+            // Keep what arrived; the retry continues after the received bytes
+            SegmentState& state = job.segmentStates[index];
+            if ((result != CURLE_OK && !isTransientError(result, status)) || ++state.attempts >= MAX_ATTEMPTS)
+            {
+                finishJob(job, DownloadResult::ended(DownloadState::FAILED));
+                return;
+            }
+            state.retryAt = Clock::now() + std::chrono::seconds(state.attempts);
+        }
+
+        // End of the data that has been written without gaps from the start of the file
+        static uint64_t contiguousBytes(const Job& job)
+        {
+            if (job.mode == Mode::STREAM)
+                return job.streamBytes;
+
+            for (const auto& segment : job.segments)
+            {
+                if (!segment.isComplete())
+                    return segment.start + segment.done;
+            }
+            return job.totalSize;
+        }
+
+        // Hashes up to HASH_SLICE bytes that were written before the hash reached them
+        // Returns true if more are waiting
+        bool advanceHash(Job& job)
+        {
+            if (job.mode == Mode::PROBING)
+                return false;
+
+            uint64_t target = contiguousBytes(job);
+            size_t budget = HASH_SLICE;
+            while (job.hashedBytes < target && budget > 0)
+            {
+                size_t chunk = static_cast<size_t>(std::min<uint64_t>(
+                    std::min<uint64_t>(m_hashBuffer.size(), budget), target - job.hashedBytes));
+                if (!job.file.readAt(job.hashedBytes, m_hashBuffer.data(), chunk))
+                {
+                    finishJob(job, DownloadResult::ended(DownloadState::FAILED));
+                    return false;
+                }
+                job.hash.update(m_hashBuffer.data(), chunk);
+                job.hashedBytes += chunk;
+                budget -= chunk;
+            }
+            return job.hashedBytes < target;
+        }
+
+        void finishIfComplete(Job& job)
+        {
+            if (job.finished || job.state != DownloadState::ACTIVE || job.mode == Mode::PROBING || !job.transfers.empty())
+                return;
+
+            bool complete = job.mode == Mode::STREAM
+                ? job.streamDone && job.streamBytes == job.streamReceived
+                : std::all_of(job.segments.begin(), job.segments.end(),
+                    [](const DownloadSegment& segment) { return segment.isComplete(); });
+            if (!complete || job.hashedBytes != contiguousBytes(job))
+                return;
+
+            DownloadResult result = DownloadResult::completed(job.hash.finalHex(), job.hashedBytes);
+            result.publishedSha256 = job.publishedSha256;
+            result.publishedSize = job.publishedSize;
+            finishJob(job, std::move(result));
+        }
+
+        static void notePublishedDigest(Job& job, const Transfer& transfer)
+        {
+            if (!transfer.publishedSha256.empty())
+            {
+                job.publishedSha256 = transfer.publishedSha256;
+            }
+            if (transfer.publishedSize > 0)
+            {
+                job.publishedSize = transfer.publishedSize;
+            }
+        }
+
+        // Cheap enough for every chunk; the callback only fires every PROGRESS_INTERVAL
+        void reportProgress(Job& job, bool force = false)
+        {
+            Clock::time_point now = Clock::now();
+            job.progress->update(job.receivedBytes, job.totalSize, now);
+
+            if (job.request.onProgress && (force || now - job.lastProgressReport >= PROGRESS_INTERVAL))
+            {
+                job.lastProgressReport = now;
+                job.request.onProgress(job.progress->snapshot());
+            }
+        }
+
+        // Called before the first body byte of a response is written
+        bool onResponseStarted(Transfer& transfer)
+        {
+            transfer.responseChecked = true;
+            Job& job = *transfer.job;
+
+            long status = 0;
+            curl_easy_getinfo(transfer.curl, CURLINFO_RESPONSE_CODE, &status);
+
+            notePublishedDigest(job, transfer);
+
+            if (transfer.kind == Transfer::Kind::SEGMENT)
+            {
+                // A 200 means the range was ignored or If-Range found the file changed
+                if (status != 206)
+                {
+                    job.rangesRejected = true;
+                    return false;
+                }
+                return true;
+            }
+
+            if (transfer.resumeOffset > 0 && status != 206)
+            {
+                // The body is the whole file: start over, dropping writes still queued
+                m_writer.waitIdle(job.file);
+                ++job.epoch;
+                if (!job.file.open(job.request.partPath, true, m_directIO))
+                    return false;
+                job.hash.reset();
+                job.hashedBytes = 0;
+                job.streamBytes = 0;
+                job.streamReceived = 0;
+                job.receivedBytes = 0;
+                transfer.resumeOffset = 0;
+                transfer.cursor = 0;
+                m_writer.begin(transfer.pending, 0);
+            }
+
+            curl_off_t contentLength = -1;
+            curl_easy_getinfo(transfer.curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+
+            job.etag = transfer.etag;
+            job.lastModified = transfer.lastModified;
+            job.totalSize = contentLength >= 0 ? transfer.resumeOffset + static_cast<uint64_t>(contentLength) : 0;
+
+            // Reserves the space up front: no fragmentation, and a full disk fails right away
+            if (job.totalSize > 0 && !job.file.preallocate(job.totalSize))
+                return false;
+
+            saveState(job);
+            return true;
+        }
+
+        static size_t write_data(void* ptr, size_t size, size_t nmemb, void* userdata)
+        {
+            Transfer* transfer = static_cast<Transfer*>(userdata);
+            Job& job = *transfer->job;
+            size_t bytes = size * nmemb;
+
+            if (!transfer->responseChecked && !transfer->service->onResponseStarted(*transfer))
+            {
+                return 0; // Aborts the transfer
+            }
+
+            uint64_t offset = transfer->cursor;
+            if (transfer->kind == Transfer::Kind::SEGMENT &&
+                offset + bytes > job.segments[transfer->segment].end)
+            {
+                return 0;
+            }
+
+            transfer->service->m_writer.append(transfer->pending, job.file, writeTag(*transfer), ptr, bytes);
+
+            // In-order bytes are hashed straight from the network buffer
+            if (job.hashedBytes == offset)
+            {
+                job.hash.update(ptr, bytes);
+                job.hashedBytes += bytes;
+            }
+
+            transfer->cursor += bytes;
+            if (transfer->kind == Transfer::Kind::SEGMENT)
+            {
+                job.segmentStates[transfer->segment].received += bytes;
+            }
+            else
+            {
+                job.streamReceived += bytes;
+            }
+            job.receivedBytes += bytes;
+
+            transfer->service->reportProgress(job);
+            return bytes;
+        }
+
+        static size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata)
+        {
+            Transfer* transfer = static_cast<Transfer*>(userdata);
+            std::string line(buffer, size * nitems);
+
+            // A new status line starts a new response (e.g. after a redirect)
+            if (line.rfind("HTTP/", 0) == 0)
+            {
+                transfer->acceptsRanges = false;
+                transfer->etag.clear();
+                transfer->lastModified.clear();
+            }
+            else if (auto value = httpHeaderValue(line, "accept-ranges"))
+            {
+                transfer->acceptsRanges = value->find("bytes") != std::string::npos;
+            }
+            else if (auto value = httpHeaderValue(line, "x-linked-etag"))
+            {
+                transfer->publishedSha256 = sha256FromLinkedETag(*value);
+            }
+            else if (auto value = httpHeaderValue(line, "x-linked-size"))
+            {
+                transfer->publishedSize = std::strtoull(value->c_str(), nullptr, 10);
+            }
+            else if (auto value = httpHeaderValue(line, "etag"))
+            {
+                transfer->etag = *value;
+            }
+            else if (auto value = httpHeaderValue(line, "last-modified"))
+            {
+                transfer->lastModified = *value;
+            }
+            return size * nitems;
+        }
+
+        CURLM* m_multi;
+        std::thread m_thread;
+        DownloadWriter m_writer{ [this]() { curl_multi_wakeup(m_multi); } };
+
+        mutable std::mutex m_mutex; // guards m_commands, m_states and m_stopping
+        std::vector<std::function<void()>> m_commands;
+        std::unordered_map<std::string, DownloadState> m_states;
+        bool m_stopping = false;
+
+        // Owned by the service thread
+        std::vector<std::unique_ptr<Job>> m_jobs;
+        uint64_t m_nextSequence = 0;
+        int m_maxActive = DEFAULT_MAX_ACTIVE;
+        int m_maxConnections = DEFAULT_CONNECTIONS;
+        bool m_directIO = false;
+        std::vector<char> m_hashBuffer = std::vector<char>(1 << 20);
+    };
+} // namespace Model
@@ -0,0 +1,317 @@
+#pragma once
+
+#include "download_file.hpp"
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <new>
+#include <cstring>
+#include <algorithm>
+
+namespace Model
+{
+    /**
+     * @brief Write-behind stage between the network and the download files
+     *
+     * curl hands over data in small pieces (often 16 KB). Writing each piece directly
+     * costs a syscall per piece and keeps the page cache churning on multi-GB files.
+     * Instead, callers copy into large aligned buffers and submit whole buffers to a
+     * single writer thread, which issues one positional write per buffer (eligible
+     * for O_DIRECT when the file was opened for it) and runs fdatasync every
+     * SYNC_INTERVAL bytes or SYNC_PERIOD per file, so dirty memory stays bounded and
+     * resume state can be checkpointed often.
+     *
+     * submit() blocks while MAX_QUEUED buffers are waiting, throttling the network to
+     * the disk. Finished writes are reported through takeCompleted(), and `onWritten`
+     * is called on the writer thread whenever new results are available.
+     */
+    class DownloadWriter
+    {
+    public:
+        static constexpr size_t BUFFER_SIZE = 4 * 1024 * 1024;
+        static constexpr size_t MAX_QUEUED = 8;
+        static constexpr uint64_t SYNC_INTERVAL = 256ULL * 1024 * 1024;
+        static constexpr std::chrono::seconds SYNC_PERIOD{ 10 };
+
+        class Buffer
+        {
+        public:
+            Buffer()
+                : m_data(static_cast<char*>(::operator new(BUFFER_SIZE, std::align_val_t(DownloadFile::DIRECT_ALIGNMENT)))) {}
+
+            ~Buffer()
+            {
+                ::operator delete(m_data, std::align_val_t(DownloadFile::DIRECT_ALIGNMENT));
+            }
+
+            Buffer(const Buffer&) = delete;
+            Buffer& operator=(const Buffer&) = delete;
+
+            char* data() { return m_data; }
+            const char* data() const { return m_data; }
+
+        private:
+            char* m_data;
+        };
+
+        // A buffer being filled for one contiguous run of a file
+        struct Pending
+        {
+            std::unique_ptr<Buffer> buffer;
+            uint64_t offset = 0;   // file offset of the first buffered byte
+            size_t size = 0;
+            size_t capacity = 0;   // ends on an aligned file offset when possible
+
+            bool empty() const { return size == 0; }
+            bool full() const { return size == capacity; }
+        };
+
+        // Identifies what a write belongs to, so the caller can credit the bytes
+        struct Tag
+        {
+            uint64_t job = 0;
+            uint64_t epoch = 0;
+            size_t segment = 0;
+        };
+
+        struct Completed
+        {
+            Tag tag;
+            uint64_t offset;
+            size_t size;
+            bool ok;
+            bool synced; // this and every write to the file completed before it are on disk
+        };
+
+        explicit DownloadWriter(std::function<void()> onWritten)
+            : m_onWritten(std::move(onWritten))
+        {
+            m_thread = std::thread([this]() { run(); });
+        }
+
+        ~DownloadWriter()
+        {
+            stop();
+        }
+
+        DownloadWriter(const DownloadWriter&) = delete;
+        DownloadWriter& operator=(const DownloadWriter&) = delete;
+
+        // Starts a run at `offset`; the first buffer is shortened so later ones start aligned
+        void begin(Pending& pending, uint64_t offset)
+        {
+            if (!pending.buffer)
+            {
+                pending.buffer = acquire();
+            }
+            pending.offset = offset;
+            pending.size = 0;
+            pending.capacity = BUFFER_SIZE - static_cast<size_t>(offset % DownloadFile::DIRECT_ALIGNMENT);
+        }
+
+        // Copies `size` bytes, submitting each buffer as it fills up
+        void append(Pending& pending, DownloadFile& file, const Tag& tag, const void* data, size_t size)
+        {
+            const char* bytes = static_cast<const char*>(data);
+            while (size > 0)
+            {
+                size_t chunk = std::min(size, pending.capacity - pending.size);
+                std::memcpy(pending.buffer->data() + pending.size, bytes, chunk);
+                pending.size += chunk;
+                bytes += chunk;
+                size -= chunk;
+
+                if (pending.full())
+                {
+                    uint64_t next = pending.offset + pending.size;
+                    flush(pending, file, tag);
+                    begin(pending, next);
+                }
+            }
+        }
+
+        // Hands whatever is buffered to the writer thread; begin() starts the next buffer
+        void flush(Pending& pending, DownloadFile& file, const Tag& tag)
+        {
+            if (pending.empty())
+                return;
+
+            Request request{ &file, tag, pending.offset, pending.size, std::move(pending.buffer) };
+            pending.offset += pending.size;
+            pending.size = 0;
+            submit(std::move(request));
+        }
+
+        // Drops buffered bytes without writing them
+        void discard(Pending& pending)
+        {
+            if (pending.buffer)
+            {
+                release(std::move(pending.buffer));
+            }
+            pending.size = 0;
+        }
+
+        // Blocks until every submitted write to `file` has finished
+        void waitIdle(const DownloadFile& file)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_idleCondition.wait(lock, [&]() {
+                auto it = m_inFlight.find(&file);
+                return it == m_inFlight.end() || it->second == 0;
+            });
+            m_inFlight.erase(&file);
+            m_sync.erase(&file);
+        }
+
+        /**
+         * @brief Writes everything still queued, then stops the writer thread
+         *
+         * No write may be submitted afterwards. Once this returns `onWritten` is never
+         * called again, so the owner can release whatever it touches.
+         */
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopping = true;
+            }
+            m_queueCondition.notify_all();
+            if (m_thread.joinable())
+            {
+                m_thread.join();
+            }
+        }
+
+        std::vector<Completed> takeCompleted()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<Completed> completed;
+            completed.swap(m_completed);
+            return completed;
+        }
+
+    private:
+        struct Request
+        {
+            DownloadFile* file;
+            Tag tag;
+            uint64_t offset;
+            size_t size;
+            std::unique_ptr<Buffer> buffer;
+        };
+
+        struct SyncState
+        {
+            uint64_t unsyncedBytes = 0;
+            std::chrono::steady_clock::time_point lastSync = std::chrono::steady_clock::now();
+        };
+
+        std::unique_ptr<Buffer> acquire()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_free.empty())
+            {
+                return std::make_unique<Buffer>();
+            }
+            std::unique_ptr<Buffer> buffer = std::move(m_free.back());
+            m_free.pop_back();
+            return buffer;
+        }
+
+        void release(std::unique_ptr<Buffer> buffer)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            releaseLocked(std::move(buffer));
+        }
+
+        // Keeps a few buffers around for reuse and frees the rest
+        void releaseLocked(std::unique_ptr<Buffer> buffer)
+        {
+            if (m_free.size() < MAX_QUEUED)
+            {
+                m_free.push_back(std::move(buffer));
+            }
+        }
+
+        void submit(Request request)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_spaceCondition.wait(lock, [this]() { return m_queue.size() < MAX_QUEUED; });
+            ++m_inFlight[request.file];
+            m_queue.push_back(std::move(request));
+            m_queueCondition.notify_one();
+        }
+
+        void run()
+        {
+            while (true)
+            {
+                Request request;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_queueCondition.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+                    if (m_queue.empty())
+                        return;
+                    request = std::move(m_queue.front());
+                    m_queue.pop_front();
+                }
+                m_spaceCondition.notify_one();
+
+                bool ok = request.file->writeAt(request.offset, request.buffer->data(), request.size);
+
+                bool sync = false;
+                const auto now = std::chrono::steady_clock::now();
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    SyncState& state = m_sync[request.file];
+                    state.unsyncedBytes += request.size;
+                    if (state.unsyncedBytes >= SYNC_INTERVAL || now - state.lastSync >= SYNC_PERIOD)
+                    {
+                        state.unsyncedBytes = 0;
+                        state.lastSync = now;
+                        sync = true;
+                    }
+                }
+
+                // Bounds the dirty pages a multi-GB download can pile up, and tells the
+                // caller which progress would survive a crash
+                bool synced = ok && sync && request.file->sync();
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_completed.push_back({ request.tag, request.offset, request.size, ok, synced });
+                    releaseLocked(std::move(request.buffer));
+                    --m_inFlight[request.file];
+                }
+                m_idleCondition.notify_all();
+
+                if (m_onWritten)
+                {
+                    m_onWritten();
+                }
+            }
+        }
+
+        std::function<void()> m_onWritten;
+        std::thread m_thread;
+
+        std::mutex m_mutex;
+        std::condition_variable m_queueCondition;
+        std::condition_variable m_spaceCondition;
+        std::condition_variable m_idleCondition;
+        std::deque<Request> m_queue;
+        std::vector<std::unique_ptr<Buffer>> m_free;
+        std::vector<Completed> m_completed;
+        std::unordered_map<const DownloadFile*, size_t> m_inFlight;
+        std::unordered_map<const DownloadFile*, SyncState> m_sync;
+        bool m_stopping = false;
+    };
+} // namespace Model
@@ -0,0 +1,611 @@
+#pragma once
+
+#include "ggml_types.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+namespace Model
+{
+    // Elements per super-block of the k-quant formats
+    constexpr int QK_K = 256;
+    constexpr int QK4_0 = 32;
+    constexpr int QK8_0 = 32;
+
+    inline uint32_t floatToBits(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    inline float floatFromBits(uint32_t bits)
+    {
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // IEEE half to float without F16C; handles subnormals, infinities and NaN
+    inline float fp16ToFp32(uint16_t h)
+    {
+        const uint32_t w = static_cast<uint32_t>(h) << 16;
+        const uint32_t sign = w & 0x80000000u;
+        const uint32_t twoW = w + w;
+
+        const float normalized = floatFromBits((twoW >> 4) + (0xE0u << 23)) * 0x1.0p-112f;
+        const float denormalized = floatFromBits((twoW >> 17) | (126u << 23)) - 0.5f;
+
+        const uint32_t result = sign | (twoW < (1u << 27) ? floatToBits(denormalized) : floatToBits(normalized));
+        return floatFromBits(result);
+    }
+
+    // Float to IEEE half, rounding to nearest even
+    inline uint16_t fp32ToFp16(float f)
+    {
+        float base = (std::fabs(f) * 0x1.0p+112f) * 0x1.0p-110f;
+
+        const uint32_t w = floatToBits(f);
+        const uint32_t shl1W = w + w;
+        const uint32_t sign = w & 0x80000000u;
+        uint32_t bias = shl1W & 0xFF000000u;
+        if (bias < 0x71000000u)
+            bias = 0x71000000u;
+
+        base = floatFromBits((bias >> 1) + 0x07800000u) + base;
+        const uint32_t bits = floatToBits(base);
+        const uint32_t expBits = (bits >> 13) & 0x00007C00u;
+        const uint32_t mantissaBits = bits & 0x00000FFFu;
+        const uint32_t nonSign = expBits + mantissaBits;
+        return static_cast<uint16_t>((sign >> 16) | (shl1W > 0xFF000000u ? 0x7E00u : nonSign));
+    }
+
+    inline float bf16ToFp32(uint16_t h)
+    {
+        return floatFromBits(static_cast<uint32_t>(h) << 16);
+    }
+
+    // Block layouts, byte for byte as in ggml
+    struct BlockQ4_0
+    {
+        uint16_t d;            // scale (f16)
+        uint8_t qs[QK4_0 / 2]; // value j in the low nibble of byte j, value j + 16 in the high one
+    };
+
+    struct BlockQ8_0
+    {
+        uint16_t d;         // scale (f16)
+        int8_t qs[QK8_0];
+    };
+
+    struct BlockQ4_K
+    {
+        uint16_t d;         // super-block scale for the sub-block scales (f16)
+        uint16_t dmin;      // super-block scale for the sub-block mins (f16)
+        uint8_t scales[12]; // 8 scales and 8 mins, 6 bits each
+        uint8_t qs[QK_K / 2];
+    };
+
+    struct BlockQ6_K
+    {
+        uint8_t ql[QK_K / 2]; // low 4 bits
+        uint8_t qh[QK_K / 4]; // high 2 bits
+        int8_t scales[QK_K / 16];
+        uint16_t d;
+    };
+
+    // Activations quantized for k-quant dot products; never stored in a file
+    struct BlockQ8_K
+    {
+        float d;
+        int8_t qs[QK_K];
+        int16_t bsums[QK_K / 16]; // sum of each group of 16 quants
+    };
+
+    static_assert(sizeof(BlockQ4_0) == 18, "unexpected q4_0 block size");
+    static_assert(sizeof(BlockQ8_0) == 34, "unexpected q8_0 block size");
+    static_assert(sizeof(BlockQ4_K) == 144, "unexpected q4_K block size");
+    static_assert(sizeof(BlockQ6_K) == 210, "unexpected q6_K block size");
+    static_assert(sizeof(BlockQ8_K) == 292, "unexpected q8_K block size");
+
+    namespace detail
+    {
+        constexpr float GROUP_MAX_EPS = 1e-15f;
+
+        // Round half to even, like ggml's nearest_int
+        inline int nearestInt(float value)
+        {
+            return static_cast<int>(std::nearbyint(value));
+        }
+
+        // Weighted asymmetric fit of x to scale * L + min with L in [0, nmax]; searches a few
+        // candidate scales around max - min. Returns the scale and stores -min in `theMin`.
+        inline float makeQkx2Quants(int n, int nmax, const float* x, const float* weights,
+            uint8_t* L, float* theMin, uint8_t* Laux, float rmin, float rdelta, int nstep)
+        {
+            float min = x[0];
+            float max = x[0];
+            float sumW = weights[0];
+            float sumX = sumW * x[0];
+            for (int i = 1; i < n; ++i)
+            {
+                min = std::min(min, x[i]);
+                max = std::max(max, x[i]);
+                sumW += weights[i];
+                sumX += weights[i] * x[i];
+            }
+            if (min > 0)
+                min = 0;
+            if (max == min)
+            {
+                std::fill(L, L + n, 0);
+                *theMin = -min;
+                return 0.0f;
+            }
+
+            float iscale = nmax / (max - min);
+            float scale = 1 / iscale;
+            float bestError = 0;
+            for (int i = 0; i < n; ++i)
+            {
+                int l = nearestInt(iscale * (x[i] - min));
+                L[i] = static_cast<uint8_t>(std::max(0, std::min(nmax, l)));
+                float diff = scale * L[i] + min - x[i];
+                bestError += weights[i] * diff * diff;
+            }
+
+            for (int is = 0; is <= nstep; ++is)
+            {
+                iscale = (rmin + rdelta * is + nmax) / (max - min);
+                float sumL = 0, sumL2 = 0, sumXL = 0;
+                for (int i = 0; i < n; ++i)
+                {
+                    int l = std::max(0, std::min(nmax, nearestInt(iscale * (x[i] - min))));
+                    Laux[i] = static_cast<uint8_t>(l);
+                    float w = weights[i];
+                    sumL += w * l;
+                    sumL2 += w * l * l;
+                    sumXL += w * l * x[i];
+                }
+
+                float D = sumW * sumL2 - sumL * sumL;
+                if (D <= 0)
+                    continue;
+
+                float thisScale = (sumW * sumXL - sumX * sumL) / D;
+                float thisMin = (sumL2 * sumX - sumL * sumXL) / D;
+                if (thisMin > 0)
+                {
+                    thisMin = 0;
+                    thisScale = sumXL / sumL2;
+                }
+
+                float error = 0;
+                for (int i = 0; i < n; ++i)
+                {
+                    float diff = thisScale * Laux[i] + thisMin - x[i];
+                    error += weights[i] * diff * diff;
+                }
+                if (error < bestError)
+                {
+                    std::copy(Laux, Laux + n, L);
+                    bestError = error;
+                    scale = thisScale;
+                    min = thisMin;
+                }
+            }
+
+            *theMin = -min;
+            return scale;
+        }
+
+        // Symmetric fit of x to scale * (L - nmax) weighted by x^2, trying scales around amax
+        inline float makeQxQuants(int n, int nmax, const float* x, int8_t* L)
+        {
+            float max = 0;
+            float amax = 0;
+            for (int i = 0; i < n; ++i)
+            {
+                float ax = std::fabs(x[i]);
+                if (ax > amax)
+                {
+                    amax = ax;
+                    max = x[i];
+                }
+            }
+            if (amax < GROUP_MAX_EPS)
+            {
+                std::fill(L, L + n, 0);
+                return 0.0f;
+            }
+
+            float iscale = -nmax / max;
+            float sumLX = 0;
+            float sumL2 = 0;
+            for (int i = 0; i < n; ++i)
+            {
+                int l = std::max(-nmax, std::min(nmax - 1, nearestInt(iscale * x[i])));
+                L[i] = static_cast<int8_t>(l + nmax);
+                float w = x[i] * x[i];
+                sumLX += w * x[i] * l;
+                sumL2 += w * l * l;
+            }
+            float scale = sumL2 != 0 ? sumLX / sumL2 : 0.0f;
+            float best = scale * sumLX;
+
+            for (int is = -9; is <= 9; ++is)
+            {
+                if (is == 0)
+                    continue;
+                iscale = -(nmax + 0.1f * is) / max;
+                sumLX = 0;
+                sumL2 = 0;
+                for (int i = 0; i < n; ++i)
+                {
+                    int l = std::max(-nmax, std::min(nmax - 1, nearestInt(iscale * x[i])));
+                    float w = x[i] * x[i];
+                    sumLX += w * x[i] * l;
+                    sumL2 += w * l * l;
+                }
+                if (sumL2 > 0 && sumLX * sumLX > best * sumL2)
+                {
+                    for (int i = 0; i < n; ++i)
+                    {
+                        int l = std::max(-nmax, std::min(nmax - 1, nearestInt(iscale * x[i])));
+                        L[i] = static_cast<int8_t>(l + nmax);
+                    }
+                    scale = sumLX / sumL2;
+                    best = scale * sumLX;
+                }
+            }
+            return scale;
+        }
+
+        inline void getScaleMinK4(int j, const uint8_t* q, uint8_t* d, uint8_t* m)
+        {
+            if (j < 4)
+            {
+                *d = q[j] & 63;
+                *m = q[j + 4] & 63;
+            }
+            else
+            {
+                *d = static_cast<uint8_t>((q[j + 4] & 0xF) | ((q[j - 4] >> 6) << 4));
+                *m = static_cast<uint8_t>((q[j + 4] >> 4) | ((q[j] >> 6) << 4));
+            }
+        }
+    } // namespace detail
+
+    /**
+     * @brief Reference quantizers producing ggml-compatible blocks
+     *
+     * These follow ggml's `quantize_row_*_ref` algorithms (without an importance
+     * matrix), so files written with them load in llama.cpp and dequantize to the
+     * same values. `n` must be a multiple of the format's block size.
+     */
+    inline void quantizeRowQ8_0(const float* x, BlockQ8_0* y, int64_t n)
+    {
+        for (int64_t i = 0; i < n / QK8_0; ++i, x += QK8_0)
+        {
+            float amax = 0.0f;
+            for (int j = 0; j < QK8_0; ++j)
+            {
+                amax = std::max(amax, std::fabs(x[j]));
+            }
+
+            const float d = amax / 127.0f;
+            const float id = d != 0.0f ? 1.0f / d : 0.0f;
+            y[i].d = fp32ToFp16(d);
+            for (int j = 0; j < QK8_0; ++j)
+            {
+                y[i].qs[j] = static_cast<int8_t>(std::round(x[j] * id));
+            }
+        }
+    }
+
+    // Symmetric 4-bit with the largest magnitude mapped to -8, as ggml's quantize_row_q4_0_ref
+    inline void quantizeRowQ4_0(const float* x, BlockQ4_0* y, int64_t n)
+    {
+        for (int64_t i = 0; i < n / QK4_0; ++i, x += QK4_0)
+        {
+            float amax = 0.0f;
+            float max = 0.0f;
+            for (int j = 0; j < QK4_0; ++j)
+            {
+                if (std::fabs(x[j]) > amax)
+                {
+                    amax = std::fabs(x[j]);
+                    max = x[j];
+                }
+            }
+
+            const float d = max / -8.0f;
+            const float id = d != 0.0f ? 1.0f / d : 0.0f;
+            y[i].d = fp32ToFp16(d);
+            for (int j = 0; j < QK4_0 / 2; ++j)
+            {
+                const int low = std::min(15, static_cast<int>(static_cast<int8_t>(x[j] * id + 8.5f)));
+                const int high = std::min(15, static_cast<int>(static_cast<int8_t>(x[j + QK4_0 / 2] * id + 8.5f)));
+                y[i].qs[j] = static_cast<uint8_t>(low | (high << 4));
+            }
+        }
+    }
+
+    inline void quantizeRowQ4_K(const float* x, BlockQ4_K* y, int64_t n)
+    {
+        uint8_t L[QK_K];
+        uint8_t Laux[32];
+        float weights[32];
+        float mins[QK_K / 32];
+        float scales[QK_K / 32];
+
+        for (int64_t i = 0; i < n / QK_K; ++i, x += QK_K)
+        {
+            float maxScale = 0;
+            float maxMin = 0;
+            for (int j = 0; j < QK_K / 32; ++j)
+            {
+                float sumX2 = 0;
+                for (int l = 0; l < 32; ++l)
+                {
+                    sumX2 += x[32 * j + l] * x[32 * j + l];
+                }
+                float avX = std::sqrt(sumX2 / 32);
+                for (int l = 0; l < 32; ++l)
+                {
+                    weights[l] = avX + std::fabs(x[32 * j + l]);
+                }
+                scales[j] = detail::makeQkx2Quants(32, 15, x + 32 * j, weights, L + 32 * j, &mins[j], Laux, -1.0f, 0.1f, 20);
+                maxScale = std::max(maxScale, scales[j]);
+                maxMin = std::max(maxMin, mins[j]);
+            }
+
+            // Sub-block scales and mins are themselves quantized to 6 bits
+            float invScale = maxScale > 0 ? 63.0f / maxScale : 0.0f;
+            float invMin = maxMin > 0 ? 63.0f / maxMin : 0.0f;
+            for (int j = 0; j < QK_K / 32; ++j)
+            {
+                uint8_t ls = static_cast<uint8_t>(std::min(63, detail::nearestInt(invScale * scales[j])));
+                uint8_t lm = static_cast<uint8_t>(std::min(63, detail::nearestInt(invMin * mins[j])));
+                if (j < 4)
+                {
+                    y[i].scales[j] = ls;
+                    y[i].scales[j + 4] = lm;
+                }
+                else
+                {
+                    y[i].scales[j + 4] = static_cast<uint8_t>((ls & 0xF) | ((lm & 0xF) << 4));
+                    y[i].scales[j - 4] |= static_cast<uint8_t>((ls >> 4) << 6);
+                    y[i].scales[j] |= static_cast<uint8_t>((lm >> 4) << 6);
+                }
+            }
+            y[i].d = fp32ToFp16(maxScale / 63.0f);
+            y[i].dmin = fp32ToFp16(maxMin / 63.0f);
+
+            // Requantize against the rounded scales that will actually be stored
+            for (int j = 0; j < QK_K / 32; ++j)
+            {
+                uint8_t sc, m;
+                detail::getScaleMinK4(j, y[i].scales, &sc, &m);
+                const float d = fp16ToFp32(y[i].d) * sc;
+                if (d == 0.0f)
+                    continue;
+                const float dm = fp16ToFp32(y[i].dmin) * m;
+                for (int ii = 0; ii < 32; ++ii)
+                {
+                    int l = detail::nearestInt((x[32 * j + ii] + dm) / d);
+                    L[32 * j + ii] = static_cast<uint8_t>(std::max(0, std::min(15, l)));
+                }
+            }
+
+            uint8_t* q = y[i].qs;
+            for (int j = 0; j < QK_K; j += 64)
+            {
+                for (int l = 0; l < 32; ++l)
+                {
+                    q[l] = static_cast<uint8_t>(L[j + l] | (L[j + l + 32] << 4));
+                }
+                q += 32;
+            }
+        }
+    }
+
+    inline void quantizeRowQ6_K(const float* x, BlockQ6_K* y, int64_t n)
+    {
+        int8_t L[QK_K];
+        float scales[QK_K / 16];
+
+        for (int64_t i = 0; i < n / QK_K; ++i, x += QK_K)
+        {
+            float maxScale = 0;
+            float maxAbsScale = 0;
+            for (int ib = 0; ib < QK_K / 16; ++ib)
+            {
+                scales[ib] = detail::makeQxQuants(16, 32, x + 16 * ib, L + 16 * ib);
+                if (std::fabs(scales[ib]) > maxAbsScale)
+                {
+                    maxAbsScale = std::fabs(scales[ib]);
+                    maxScale = scales[ib];
+                }
+            }
+
+            if (maxAbsScale < detail::GROUP_MAX_EPS)
+            {
+                std::memset(&y[i], 0, sizeof(BlockQ6_K));
+                y[i].d = fp32ToFp16(0.0f);
+                continue;
+            }
+
+            float iscale = -128.0f / maxScale;
+            y[i].d = fp32ToFp16(1 / iscale);
+            for (int ib = 0; ib < QK_K / 16; ++ib)
+            {
+                y[i].scales[ib] = static_cast<int8_t>(std::min(127, detail::nearestInt(iscale * scales[ib])));
+            }
+
+            for (int j = 0; j < QK_K / 16; ++j)
+            {
+                const float d = fp16ToFp32(y[i].d) * y[i].scales[j];
+                if (d == 0.0f)
+                    continue;
+                for (int ii = 0; ii < 16; ++ii)
+                {
+                    int l = std::max(-32, std::min(31, detail::nearestInt(x[16 * j + ii] / d)));
+                    L[16 * j + ii] = static_cast<int8_t>(l + 32);
+                }
+            }
+
+            uint8_t* ql = y[i].ql;
+            uint8_t* qh = y[i].qh;
+            for (int j = 0; j < QK_K; j += 128)
+            {
+                for (int l = 0; l < 32; ++l)
+                {
+                    const uint8_t q1 = L[j + l] & 0xF;
+                    const uint8_t q2 = L[j + l + 32] & 0xF;
+                    const uint8_t q3 = L[j + l + 64] & 0xF;
+                    const uint8_t q4 = L[j + l + 96] & 0xF;
+                    ql[l] = static_cast<uint8_t>(q1 | (q3 << 4));
+                    ql[l + 32] = static_cast<uint8_t>(q2 | (q4 << 4));
+                    qh[l] = static_cast<uint8_t>((L[j + l] >> 4) | ((L[j + l + 32] >> 4) << 2) |
+                        ((L[j + l + 64] >> 4) << 4) | ((L[j + l + 96] >> 4) << 6));
+                }
+                ql += 64;
+                qh += 32;
+            }
+        }
+    }
+
+    /**
+     * @brief Reference dequantizers, matching ggml's `dequantize_row_*`
+     *
+     * `n` must be a multiple of the format's block size.
+     */
+    // Symmetric 8-bit with the largest magnitude mapped to -128, as ggml's quantize_row_q8_K
+    inline void quantizeRowQ8_K(const float* x, BlockQ8_K* y, int64_t n)
+    {
+        for (int64_t i = 0; i < n / QK_K; ++i, x += QK_K)
+        {
+            float max = 0.0f;
+            float amax = 0.0f;
+            for (int j = 0; j < QK_K; ++j)
+            {
+                const float ax = std::fabs(x[j]);
+                if (ax > amax)
+                {
+                    amax = ax;
+                    max = x[j];
+                }
+            }
+
+            if (amax == 0.0f)
+            {
+                std::memset(&y[i], 0, sizeof(BlockQ8_K));
+                continue;
+            }
+
+            const float iscale = -128.0f / max;
+            for (int j = 0; j < QK_K; ++j)
+            {
+                y[i].qs[j] = static_cast<int8_t>(std::min(127, detail::nearestInt(iscale * x[j])));
+            }
+            for (int j = 0; j < QK_K / 16; ++j)
+            {
+                int sum = 0;
+                for (int l = 0; l < 16; ++l)
+                {
+                    sum += y[i].qs[j * 16 + l];
+                }
+                y[i].bsums[j] = static_cast<int16_t>(sum);
+            }
+            y[i].d = 1.0f / iscale;
+        }
+    }
+
+    inline void dequantizeRowQ4_0(const BlockQ4_0* x, float* y, int64_t n)
+    {
+        for (int64_t i = 0; i < n / QK4_0; ++i, y += QK4_0)
+        {
+            const float d = fp16ToFp32(x[i].d);
+            for (int j = 0; j < QK4_0 / 2; ++j)
+            {
+                y[j] = d * ((x[i].qs[j] & 0xF) - 8);
+                y[j + QK4_0 / 2] = d * ((x[i].qs[j] >> 4) - 8);
+            }
+        }
+    }
+
+    inline void dequantizeRowQ8_0(const BlockQ8_0* x, float* y, int64_t n)
+    {
+        for (int64_t i = 0; i < n / QK8_0; ++i, y += QK8_0)
+        {
+            const float d = fp16ToFp32(x[i].d);
+            for (int j = 0; j < QK8_0; ++j)
+            {
+                y[j] = d * x[i].qs[j];
+            }
+        }
+    }
+
+    inline void dequantizeRowQ4_K(const BlockQ4_K* x, float* y, int64_t n)
+    {
+        for (int64_t i = 0; i < n / QK_K; ++i)
+        {
+            const uint8_t* q = x[i].qs;
+            const float d = fp16ToFp32(x[i].d);
+            const float min = fp16ToFp32(x[i].dmin);
+
+            for (int j = 0, is = 0; j < QK_K; j += 64, is += 2)
+            {
+                uint8_t sc, m;
+                detail::getScaleMinK4(is, x[i].scales, &sc, &m);
+                const float d1 = d * sc, m1 = min * m;
+                detail::getScaleMinK4(is + 1, x[i].scales, &sc, &m);
+                const float d2 = d * sc, m2 = min * m;
+
+                for (int l = 0; l < 32; ++l)
+                {
+                    *y++ = d1 * (q[l] & 0xF) - m1;
+                }
+                for (int l = 0; l < 32; ++l)
+                {
+                    *y++ = d2 * (q[l] >> 4) - m2;
+                }
+                q += 32;
+            }
+        }
+    }
+
+    inline void dequantizeRowQ6_K(const BlockQ6_K* x, float* y, int64_t n)
+    {
+        for (int64_t i = 0; i < n / QK_K; ++i)
+        {
+            const float d = fp16ToFp32(x[i].d);
+            const uint8_t* ql = x[i].ql;
+            const uint8_t* qh = x[i].qh;
+            const int8_t* sc = x[i].scales;
+
+            for (int j = 0; j < QK_K; j += 128)
+            {
+                for (int l = 0; l < 32; ++l)
+                {
+                    const int is = l / 16;
+                    const int q1 = static_cast<int8_t>((ql[l] & 0xF) | (((qh[l] >> 0) & 3) << 4)) - 32;
+                    const int q2 = static_cast<int8_t>((ql[l + 32] & 0xF) | (((qh[l] >> 2) & 3) << 4)) - 32;
+                    const int q3 = static_cast<int8_t>((ql[l] >> 4) | (((qh[l] >> 4) & 3) << 4)) - 32;
+                    const int q4 = static_cast<int8_t>((ql[l + 32] >> 4) | (((qh[l] >> 6) & 3) << 4)) - 32;
+                    y[l] = d * sc[is] * q1;
+                    y[l + 32] = d * sc[is + 2] * q2;
+                    y[l + 64] = d * sc[is + 4] * q3;
+                    y[l + 96] = d * sc[is + 6] * q4;
+                }
+                y += 128;
+                ql += 64;
+                qh += 32;
+                sc += 8;
+            }
+        }
+    }
+} // namespace Model
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Model
+{
+    // Tensor element types as stored in GGUF files (values match ggml's enum)
+    enum class GGMLType : uint32_t
+    {
+        F32 = 0,
+        F16 = 1,
+        Q4_0 = 2,
+        Q4_1 = 3,
+        Q5_0 = 6,
+        Q5_1 = 7,
+        Q8_0 = 8,
+        Q8_1 = 9,
+        Q2_K = 10,
+        Q3_K = 11,
+        Q4_K = 12,
+        Q5_K = 13,
+        Q6_K = 14,
+        Q8_K = 15,
+        I8 = 24,
+        I16 = 25,
+        I32 = 26,
+        I64 = 27,
+        F64 = 28,
+        BF16 = 30,
+    };
+
+    struct GGMLTypeTraits
+    {
+        const char* name;
+        size_t blockSize; // elements per block
+        size_t typeSize;  // bytes per block
+    };
+
+    // Returns nullptr for types this reader does not know how to size
+    inline const GGMLTypeTraits* getGGMLTypeTraits(GGMLType type)
+    {
+        static const GGMLTypeTraits F32_TRAITS{ "f32", 1, 4 };
+        static const GGMLTypeTraits F16_TRAITS{ "f16", 1, 2 };
+        static const GGMLTypeTraits Q4_0_TRAITS{ "q4_0", 32, 18 };
+        static const GGMLTypeTraits Q4_1_TRAITS{ "q4_1", 32, 20 };
+        static const GGMLTypeTraits Q5_0_TRAITS{ "q5_0", 32, 22 };
+        static const GGMLTypeTraits Q5_1_TRAITS{ "q5_1", 32, 24 };
+        static const GGMLTypeTraits Q8_0_TRAITS{ "q8_0", 32, 34 };
+        static const GGMLTypeTraits Q8_1_TRAITS{ "q8_1", 32, 36 };
+        static const GGMLTypeTraits Q2_K_TRAITS{ "q2_K", 256, 84 };
+        static const GGMLTypeTraits Q3_K_TRAITS{ "q3_K", 256, 110 };
+        static const GGMLTypeTraits Q4_K_TRAITS{ "q4_K", 256, 144 };
+        static const GGMLTypeTraits Q5_K_TRAITS{ "q5_K", 256, 176 };
+        static const GGMLTypeTraits Q6_K_TRAITS{ "q6_K", 256, 210 };
+        static const GGMLTypeTraits Q8_K_TRAITS{ "q8_K", 256, 292 };
+        static const GGMLTypeTraits I8_TRAITS{ "i8", 1, 1 };
+        static const GGMLTypeTraits I16_TRAITS{ "i16", 1, 2 };
+        static const GGMLTypeTraits I32_TRAITS{ "i32", 1, 4 };
+        static const GGMLTypeTraits I64_TRAITS{ "i64", 1, 8 };
+        static const GGMLTypeTraits F64_TRAITS{ "f64", 1, 8 };
+        static const GGMLTypeTraits BF16_TRAITS{ "bf16", 1, 2 };
+
+        switch (type)
+        {
+        case GGMLType::F32:  return &F32_TRAITS;
+        case GGMLType::F16:  return &F16_TRAITS;
+        case GGMLType::Q4_0: return &Q4_0_TRAITS;
+        case GGMLType::Q4_1: return &Q4_1_TRAITS;
+        case GGMLType::Q5_0: return &Q5_0_TRAITS;
+        case GGMLType::Q5_1: return &Q5_1_TRAITS;
+        case GGMLType::Q8_0: return &Q8_0_TRAITS;
+        case GGMLType::Q8_1: return &Q8_1_TRAITS;
+        case GGMLType::Q2_K: return &Q2_K_TRAITS;
+        case GGMLType::Q3_K: return &Q3_K_TRAITS;
+        case GGMLType::Q4_K: return &Q4_K_TRAITS;
+        case GGMLType::Q5_K: return &Q5_K_TRAITS;
+        case GGMLType::Q6_K: return &Q6_K_TRAITS;
+        case GGMLType::Q8_K: return &Q8_K_TRAITS;
+        case GGMLType::I8:   return &I8_TRAITS;
+        case GGMLType::I16:  return &I16_TRAITS;
+        case GGMLType::I32:  return &I32_TRAITS;
+        case GGMLType::I64:  return &I64_TRAITS;
+        case GGMLType::F64:  return &F64_TRAITS;
+        case GGMLType::BF16: return &BF16_TRAITS;
+        default:             return nullptr;
+        }
+    }
+
+    inline const char* ggmlTypeName(GGMLType type)
+    {
+        const GGMLTypeTraits* traits = getGGMLTypeTraits(type);
+        return traits ? traits->name : "unknown";
+    }
+
+    // Byte size of a row of `nElements` elements, or 0 if the row is not block aligned
+    inline size_t ggmlRowSize(GGMLType type, int64_t nElements)
+    {
+        const GGMLTypeTraits* traits = getGGMLTypeTraits(type);
+        if (!traits || nElements < 0 || nElements % static_cast<int64_t>(traits->blockSize) != 0)
+            return 0;
+        return static_cast<size_t>(nElements) / traits->blockSize * traits->typeSize;
+    }
+
+    // Maps general.file_type (llama_ftype) to a human readable quantization label
+    inline const char* ggufFileTypeName(uint32_t fileType)
+    {
+        switch (fileType)
+        {
+        case 0:  return "F32";
+        case 1:  return "F16";
+        case 2:  return "Q4_0";
+        case 3:  return "Q4_1";
+        case 7:  return "Q8_0";
+        case 8:  return "Q5_0";
+        case 9:  return "Q5_1";
+        case 10: return "Q2_K";
+        case 11: return "Q3_K_S";
+        case 12: return "Q3_K_M";
+        case 13: return "Q3_K_L";
+        case 14: return "Q4_K_S";
+        case 15: return "Q4_K_M";
+        case 16: return "Q5_K_S";
+        case 17: return "Q5_K_M";
+        case 18: return "Q6_K";
+        case 32: return "BF16";
+        default: return "unknown";
+        }
+    }
+} // namespace Model
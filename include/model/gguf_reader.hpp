@@ -0,0 +1,531 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "ggml_types.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <memory>
+#include <variant>
+#include <optional>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+
+namespace Model
+{
+    constexpr uint32_t GGUF_MAGIC = 0x46554747; // "GGUF" little-endian
+    constexpr uint32_t GGUF_DEFAULT_ALIGNMENT = 32;
+    constexpr uint32_t GGUF_MAX_DIMS = 4;
+
+    enum class GGUFValueType : uint32_t
+    {
+        UINT8 = 0,
+        INT8 = 1,
+        UINT16 = 2,
+        INT16 = 3,
+        UINT32 = 4,
+        INT32 = 5,
+        FLOAT32 = 6,
+        BOOL = 7,
+        STRING = 8,
+        ARRAY = 9,
+        UINT64 = 10,
+        INT64 = 11,
+        FLOAT64 = 12,
+    };
+
+    // Byte size of a fixed-size metadata value, or 0 for strings and arrays
+    inline size_t ggufScalarSize(GGUFValueType type)
+    {
+        switch (type)
+        {
+        case GGUFValueType::UINT8:
+        case GGUFValueType::INT8:
+        case GGUFValueType::BOOL:
+            return 1;
+        case GGUFValueType::UINT16:
+        case GGUFValueType::INT16:
+            return 2;
+        case GGUFValueType::UINT32:
+        case GGUFValueType::INT32:
+        case GGUFValueType::FLOAT32:
+            return 4;
+        case GGUFValueType::UINT64:
+        case GGUFValueType::INT64:
+        case GGUFValueType::FLOAT64:
+            return 8;
+        default:
+            return 0;
+        }
+    }
+
+    /**
+     * @brief Non-owning view of a metadata array inside the mapping
+     *
+     * Numeric elements are read straight from the mapping; string elements are indexed
+     * once as views so that e.g. a 128k-entry vocabulary is never copied.
+     */
+    struct GGUFArray
+    {
+        GGUFValueType type = GGUFValueType::UINT8;
+        uint64_t count = 0;
+        const uint8_t* data = nullptr;
+        std::vector<std::string_view> strings;
+
+        template <typename T>
+        T at(size_t index) const
+        {
+            T value;
+            std::memcpy(&value, data + index * sizeof(T), sizeof(T));
+            return value;
+        }
+    };
+
+    struct GGUFValue
+    {
+        GGUFValueType type = GGUFValueType::UINT8;
+        std::variant<uint64_t, int64_t, double, bool, std::string_view, GGUFArray> value;
+
+        bool isString() const { return type == GGUFValueType::STRING; }
+        bool isArray() const { return type == GGUFValueType::ARRAY; }
+
+        std::optional<uint64_t> asUInt() const
+        {
+            if (auto v = std::get_if<uint64_t>(&value))
+                return *v;
+            if (auto v = std::get_if<int64_t>(&value))
+                return *v >= 0 ? std::optional<uint64_t>(static_cast<uint64_t>(*v)) : std::nullopt;
+            return std::nullopt;
+        }
+
+        std::optional<double> asFloat() const
+        {
+            if (auto v = std::get_if<double>(&value))
+                return *v;
+            if (auto v = std::get_if<uint64_t>(&value))
+                return static_cast<double>(*v);
+            if (auto v = std::get_if<int64_t>(&value))
+                return static_cast<double>(*v);
+            return std::nullopt;
+        }
+
+        std::optional<std::string_view> asString() const
+        {
+            if (auto v = std::get_if<std::string_view>(&value))
+                return *v;
+            return std::nullopt;
+        }
+
+        const GGUFArray* asArray() const
+        {
+            return std::get_if<GGUFArray>(&value);
+        }
+    };
+
+    /**
+     * @brief Non-owning view of a tensor's weights inside the mapping
+     *
+     * ne[] follows ggml's convention: ne[0] is the contiguous (row) dimension.
+     */
+    struct GGUFTensorView
+    {
+        std::string_view name;
+        GGMLType type = GGMLType::F32;
+        uint32_t nDims = 0;
+        std::array<int64_t, GGUF_MAX_DIMS> ne{ 1, 1, 1, 1 };
+        uint64_t offset = 0; // relative to the start of the data section
+        const void* data = nullptr;
+        size_t nbytes = 0;
+
+        int64_t nElements() const
+        {
+            return ne[0] * ne[1] * ne[2] * ne[3];
+        }
+
+        int64_t nRows() const
+        {
+            return ne[1] * ne[2] * ne[3];
+        }
+
+        size_t rowSize() const
+        {
+            return ggmlRowSize(type, ne[0]);
+        }
+    };
+
+    /**
+     * @brief Zero-copy GGUF reader
+     *
+     * Maps the file read-only and parses the header, metadata key/values and tensor-info
+     * table. Tensor data is never copied: every GGUFTensorView points into the mapping,
+     * which stays alive for as long as the GGUFFile does. Throws std::runtime_error on
+     * malformed or truncated files.
+     */
+    class GGUFFile
+    {
+    public:
+        explicit GGUFFile(const std::string& path)
+            : m_file(std::make_unique<MappedFile>(path))
+        {
+            parse();
+        }
+
+        GGUFFile(const GGUFFile&) = delete;
+        GGUFFile& operator=(const GGUFFile&) = delete;
+
+        // Cheap check of the magic number without mapping the whole file
+        static bool isGGUF(const std::string& path)
+        {
+            std::FILE* file = std::fopen(path.c_str(), "rb");
+            if (!file)
+                return false;
+
+            uint32_t magic = 0;
+            bool ok = std::fread(&magic, sizeof(magic), 1, file) == 1 && magic == GGUF_MAGIC;
+            std::fclose(file);
+            return ok;
+        }
+
+        const std::string& path() const { return m_file->path(); }
+        const MappedFile& mapping() const { return *m_file; }
+        uint32_t version() const { return m_version; }
+        uint32_t alignment() const { return m_alignment; }
+        size_t fileSize() const { return m_file->size(); }
+        size_t dataOffset() const { return m_dataOffset; }
+
+        const std::vector<std::string_view>& metadataKeys() const { return m_metadataKeys; }
+        const std::vector<GGUFTensorView>& tensors() const { return m_tensors; }
+
+        const GGUFValue* findMetadata(std::string_view key) const
+        {
+            auto it = m_metadata.find(key);
+            return it != m_metadata.end() ? &it->second : nullptr;
+        }
+
+        std::string getString(std::string_view key, const std::string& defaultValue = "") const
+        {
+            const GGUFValue* value = findMetadata(key);
+            if (!value)
+                return defaultValue;
+            auto str = value->asString();
+            return str ? std::string(*str) : defaultValue;
+        }
+
+        uint64_t getUInt(std::string_view key, uint64_t defaultValue = 0) const
+        {
+            const GGUFValue* value = findMetadata(key);
+            if (!value)
+                return defaultValue;
+            return value->asUInt().value_or(defaultValue);
+        }
+
+        double getFloat(std::string_view key, double defaultValue = 0.0) const
+        {
+            const GGUFValue* value = findMetadata(key);
+            if (!value)
+                return defaultValue;
+            return value->asFloat().value_or(defaultValue);
+        }
+
+        bool getBool(std::string_view key, bool defaultValue = false) const
+        {
+            const GGUFValue* value = findMetadata(key);
+            if (!value)
+                return defaultValue;
+            auto flag = std::get_if<bool>(&value->value);
+            return flag ? *flag : defaultValue;
+        }
+
+        const GGUFArray* getArray(std::string_view key) const
+        {
+            const GGUFValue* value = findMetadata(key);
+            return value ? value->asArray() : nullptr;
+        }
+
+        // Architecture-scoped key lookup, e.g. getArchUInt("context_length") -> llama.context_length
+        uint64_t getArchUInt(const std::string& suffix, uint64_t defaultValue = 0) const
+        {
+            return getUInt(architecture() + "." + suffix, defaultValue);
+        }
+
+        double getArchFloat(const std::string& suffix, double defaultValue = 0.0) const
+        {
+            return getFloat(architecture() + "." + suffix, defaultValue);
+        }
+
+        std::string architecture() const
+        {
+            return getString("general.architecture");
+        }
+
+        const GGUFTensorView* findTensor(std::string_view name) const
+        {
+            auto it = m_tensorIndex.find(name);
+            return it != m_tensorIndex.end() ? &m_tensors[it->second] : nullptr;
+        }
+
+        // Total element count over all tensors
+        uint64_t parameterCount() const
+        {
+            uint64_t count = 0;
+            for (const auto& tensor : m_tensors)
+            {
+                count += static_cast<uint64_t>(tensor.nElements());
+            }
+            return count;
+        }
+
+        // Size of the tensor data section in bytes
+        size_t tensorDataSize() const
+        {
+            return m_file->size() - m_dataOffset;
+        }
+
+    private:
+        class Cursor
+        {
+        public:
+            Cursor(const uint8_t* data, size_t size)
+                : m_data(data), m_size(size) {}
+
+            template <typename T>
+            T read()
+            {
+                require(sizeof(T));
+                T value;
+                std::memcpy(&value, m_data + m_pos, sizeof(T));
+                m_pos += sizeof(T);
+                return value;
+            }
+
+            std::string_view readString()
+            {
+                uint64_t length = read<uint64_t>();
+                require(length);
+                std::string_view str(reinterpret_cast<const char*>(m_data + m_pos), static_cast<size_t>(length));
+                m_pos += static_cast<size_t>(length);
+                return str;
+            }
+
+            const uint8_t* skip(uint64_t bytes)
+            {
+                require(bytes);
+                const uint8_t* start = m_data + m_pos;
+                m_pos += static_cast<size_t>(bytes);
+                return start;
+            }
+
+            size_t position() const { return m_pos; }
+            size_t remaining() const { return m_size - m_pos; }
+
+        private:
+            void require(uint64_t bytes) const
+            {
+                if (bytes > m_size - m_pos)
+                {
+                    throw std::runtime_error("Unexpected end of GGUF file");
+                }
+            }
+
+            const uint8_t* m_data;
+            size_t m_size;
+            size_t m_pos = 0;
+        };
+
+        static GGUFValue readScalar(Cursor& cursor, GGUFValueType type)
+        {
+            GGUFValue value;
+            value.type = type;
+            switch (type)
+            {
+            case GGUFValueType::UINT8:   value.value = static_cast<uint64_t>(cursor.read<uint8_t>()); break;
+            case GGUFValueType::INT8:    value.value = static_cast<int64_t>(cursor.read<int8_t>()); break;
+            case GGUFValueType::UINT16:  value.value = static_cast<uint64_t>(cursor.read<uint16_t>()); break;
+            case GGUFValueType::INT16:   value.value = static_cast<int64_t>(cursor.read<int16_t>()); break;
+            case GGUFValueType::UINT32:  value.value = static_cast<uint64_t>(cursor.read<uint32_t>()); break;
+            case GGUFValueType::INT32:   value.value = static_cast<int64_t>(cursor.read<int32_t>()); break;
+            case GGUFValueType::UINT64:  value.value = cursor.read<uint64_t>(); break;
+            case GGUFValueType::INT64:   value.value = cursor.read<int64_t>(); break;
+            case GGUFValueType::FLOAT32: value.value = static_cast<double>(cursor.read<float>()); break;
+            case GGUFValueType::FLOAT64: value.value = cursor.read<double>(); break;
+            case GGUFValueType::BOOL:    value.value = cursor.read<uint8_t>() != 0; break;
+            case GGUFValueType::STRING:  value.value = cursor.readString(); break;
+            default:
+                throw std::runtime_error("Invalid GGUF metadata value type");
+            }
+            return value;
+        }
+
+        static GGUFValue readValue(Cursor& cursor, GGUFValueType type)
+        {
+            if (type != GGUFValueType::ARRAY)
+            {
+                return readScalar(cursor, type);
+            }
+
+            GGUFArray array;
+            array.type = static_cast<GGUFValueType>(cursor.read<uint32_t>());
+            array.count = cursor.read<uint64_t>();
+
+            if (array.type == GGUFValueType::STRING)
+            {
+                // Each string takes at least its length field, which bounds the reservation
+                if (array.count > cursor.remaining() / sizeof(uint64_t))
+                {
+                    throw std::runtime_error("GGUF array is too large");
+                }
+                array.strings.reserve(static_cast<size_t>(array.count));
+                for (uint64_t i = 0; i < array.count; ++i)
+                {
+                    array.strings.push_back(cursor.readString());
+                }
+            }
+            else
+            {
+                size_t elementSize = ggufScalarSize(array.type);
+                if (elementSize == 0)
+                {
+                    throw std::runtime_error("Unsupported GGUF array element type");
+                }
+                if (array.count > UINT64_MAX / elementSize)
+                {
+                    throw std::runtime_error("GGUF array is too large");
+                }
+                array.data = cursor.skip(array.count * elementSize);
+            }
+
+            GGUFValue value;
+            value.type = GGUFValueType::ARRAY;
+            value.value = std::move(array);
+            return value;
+        }
+
+        void parse()
+        {
+            Cursor cursor(m_file->data(), m_file->size());
+
+            if (cursor.read<uint32_t>() != GGUF_MAGIC)
+            {
+                throw std::runtime_error("Not a GGUF file: " + m_file->path());
+            }
+
+            m_version = cursor.read<uint32_t>();
+            if (m_version < 2 || m_version > 3)
+            {
+                throw std::runtime_error("Unsupported GGUF version " + std::to_string(m_version));
+            }
+
+            uint64_t tensorCount = cursor.read<uint64_t>();
+            uint64_t metadataCount = cursor.read<uint64_t>();
+
+            // Every entry takes at least a few bytes, so this rejects absurd counts up front
+            if (tensorCount > m_file->size() || metadataCount > m_file->size())
+            {
+                throw std::runtime_error("Corrupt GGUF header");
+            }
+
+            m_metadataKeys.reserve(static_cast<size_t>(metadataCount));
+            for (uint64_t i = 0; i < metadataCount; ++i)
+            {
+                std::string_view key = cursor.readString();
+                auto type = static_cast<GGUFValueType>(cursor.read<uint32_t>());
+                m_metadata[key] = readValue(cursor, type);
+                m_metadataKeys.push_back(key);
+            }
+
+            m_alignment = static_cast<uint32_t>(getUInt("general.alignment", GGUF_DEFAULT_ALIGNMENT));
+            if (m_alignment == 0 || (m_alignment & (m_alignment - 1)) != 0)
+            {
+                throw std::runtime_error("Invalid GGUF alignment");
+            }
+
+            m_tensors.reserve(static_cast<size_t>(tensorCount));
+            for (uint64_t i = 0; i < tensorCount; ++i)
+            {
+                GGUFTensorView tensor;
+                tensor.name = cursor.readString();
+                tensor.nDims = cursor.read<uint32_t>();
+                if (tensor.nDims > GGUF_MAX_DIMS)
+                {
+                    throw std::runtime_error("Too many dimensions in tensor " + std::string(tensor.name));
+                }
+                for (uint32_t d = 0; d < tensor.nDims; ++d)
+                {
+                    uint64_t dim = cursor.read<uint64_t>();
+                    if (dim > static_cast<uint64_t>(INT64_MAX))
+                    {
+                        throw std::runtime_error("Invalid dimension in tensor " + std::string(tensor.name));
+                    }
+                    tensor.ne[d] = static_cast<int64_t>(dim);
+                }
+                tensor.type = static_cast<GGMLType>(cursor.read<uint32_t>());
+                tensor.offset = cursor.read<uint64_t>();
+
+                // nElements(), nRows() and the byte size must not overflow before the bounds check below
+                int64_t rows = 1;
+                for (uint32_t d = 1; d < GGUF_MAX_DIMS; ++d)
+                {
+                    if (tensor.ne[d] != 0 && rows > INT64_MAX / tensor.ne[d])
+                    {
+                        throw std::runtime_error("Tensor is too large: " + std::string(tensor.name));
+                    }
+                    rows *= tensor.ne[d];
+                }
+                if (tensor.ne[0] != 0 && rows > INT64_MAX / tensor.ne[0])
+                {
+                    throw std::runtime_error("Tensor is too large: " + std::string(tensor.name));
+                }
+
+                size_t rowSize = tensor.rowSize();
+                if (rowSize == 0 && tensor.ne[0] != 0)
+                {
+                    throw std::runtime_error("Unsupported type or shape for tensor " + std::string(tensor.name));
+                }
+                if (rowSize != 0 && static_cast<uint64_t>(rows) > SIZE_MAX / rowSize)
+                {
+                    throw std::runtime_error("Tensor is too large: " + std::string(tensor.name));
+                }
+                tensor.nbytes = rowSize * static_cast<size_t>(rows);
+
+                m_tensorIndex[tensor.name] = m_tensors.size();
+                m_tensors.push_back(tensor);
+            }
+
+            size_t position = cursor.position();
+            m_dataOffset = (position + m_alignment - 1) / m_alignment * m_alignment;
+
+            if (!m_tensors.empty() && m_dataOffset > m_file->size())
+            {
+                throw std::runtime_error("GGUF tensor data section is missing");
+            }
+
+            const uint8_t* base = m_file->data();
+            const size_t available = m_file->size() - std::min(m_dataOffset, m_file->size());
+            for (auto& tensor : m_tensors)
+            {
+                if (tensor.offset % m_alignment != 0 ||
+                    tensor.offset > available ||
+                    tensor.nbytes > available - tensor.offset)
+                {
+                    throw std::runtime_error("Tensor data out of bounds: " + std::string(tensor.name));
+                }
+                tensor.data = base + m_dataOffset + tensor.offset;
+            }
+        }
+
+        std::unique_ptr<MappedFile> m_file;
+        uint32_t m_version = 0;
+        uint32_t m_alignment = GGUF_DEFAULT_ALIGNMENT;
+        size_t m_dataOffset = 0;
+        std::unordered_map<std::string_view, GGUFValue> m_metadata;
+        std::vector<std::string_view> m_metadataKeys;
+        std::vector<GGUFTensorView> m_tensors;
+        std::unordered_map<std::string_view, size_t> m_tensorIndex;
+    };
+} // namespace Model
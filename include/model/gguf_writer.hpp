@@ -0,0 +1,213 @@
+#pragma once
+
+#include "gguf_reader.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace Model
+{
+    /**
+     * @brief Builds the header of a GGUF v3 file and lays out its tensor data
+     *
+     * Metadata can be copied from an existing GGUFFile and then overridden key by key.
+     * Tensors are laid out in the order they are added, each at an aligned offset, so
+     * callers know where every tensor goes before any data exists and can write the
+     * data section out of order (e.g. from several threads). Gaps between tensors are
+     * expected to read as zeros, which a preallocated file guarantees.
+     */
+    class GGUFWriter
+    {
+    public:
+        struct TensorInfo
+        {
+            std::string name;
+            GGMLType type = GGMLType::F32;
+            uint32_t nDims = 0;
+            std::array<int64_t, GGUF_MAX_DIMS> ne{ 1, 1, 1, 1 };
+            uint64_t offset = 0; // relative to the start of the data section
+            size_t nbytes = 0;
+        };
+
+        explicit GGUFWriter(uint32_t alignment = GGUF_DEFAULT_ALIGNMENT)
+            : m_alignment(alignment) {}
+
+        // Copies every metadata entry of `source`, keeping its order
+        void copyMetadata(const GGUFFile& source)
+        {
+            for (std::string_view key : source.metadataKeys())
+            {
+                std::vector<uint8_t> bytes;
+                appendValue(bytes, *source.findMetadata(key));
+                setRaw(std::string(key), std::move(bytes));
+            }
+        }
+
+        void setUInt32(const std::string& key, uint32_t value)
+        {
+            std::vector<uint8_t> bytes;
+            append<uint32_t>(bytes, static_cast<uint32_t>(GGUFValueType::UINT32));
+            append<uint32_t>(bytes, value);
+            setRaw(key, std::move(bytes));
+        }
+
+        void setString(const std::string& key, std::string_view value)
+        {
+            std::vector<uint8_t> bytes;
+            append<uint32_t>(bytes, static_cast<uint32_t>(GGUFValueType::STRING));
+            appendString(bytes, value);
+            setRaw(key, std::move(bytes));
+        }
+
+        // Returns the tensor's index in tensors(); throws if a row is not a whole number of blocks
+        size_t addTensor(std::string_view name, GGMLType type, uint32_t nDims,
+            const std::array<int64_t, GGUF_MAX_DIMS>& ne)
+        {
+            TensorInfo info;
+            info.name = std::string(name);
+            info.type = type;
+            info.nDims = nDims;
+            info.ne = ne;
+
+            size_t rowSize = ggmlRowSize(type, ne[0]);
+            if (rowSize == 0 && ne[0] != 0)
+            {
+                throw std::runtime_error("Unsupported type or shape for tensor " + info.name);
+            }
+            info.nbytes = rowSize * static_cast<size_t>(ne[1] * ne[2] * ne[3]);
+            info.offset = m_dataSize;
+            m_dataSize = alignUp(m_dataSize + info.nbytes);
+
+            m_tensors.push_back(std::move(info));
+            return m_tensors.size() - 1;
+        }
+
+        const std::vector<TensorInfo>& tensors() const { return m_tensors; }
+
+        // Header, metadata and tensor table, padded so the data section starts aligned
+        std::vector<uint8_t> serializeHeader() const
+        {
+            std::vector<uint8_t> bytes;
+            append<uint32_t>(bytes, GGUF_MAGIC);
+            append<uint32_t>(bytes, 3);
+            append<uint64_t>(bytes, m_tensors.size());
+            append<uint64_t>(bytes, m_metadata.size());
+
+            for (const auto& [key, value] : m_metadata)
+            {
+                appendString(bytes, key);
+                bytes.insert(bytes.end(), value.begin(), value.end());
+            }
+
+            for (const auto& tensor : m_tensors)
+            {
+                appendString(bytes, tensor.name);
+                append<uint32_t>(bytes, tensor.nDims);
+                for (uint32_t d = 0; d < tensor.nDims; ++d)
+                {
+                    append<uint64_t>(bytes, static_cast<uint64_t>(tensor.ne[d]));
+                }
+                append<uint32_t>(bytes, static_cast<uint32_t>(tensor.type));
+                append<uint64_t>(bytes, tensor.offset);
+            }
+
+            bytes.resize(static_cast<size_t>(alignUp(bytes.size())), 0);
+            return bytes;
+        }
+
+        // Size of the finished file for a header of `headerSize` bytes
+        uint64_t fileSize(size_t headerSize) const
+        {
+            return headerSize + m_dataSize;
+        }
+
+    private:
+        template <typename T>
+        static void append(std::vector<uint8_t>& bytes, T value)
+        {
+            const uint8_t* raw = reinterpret_cast<const uint8_t*>(&value);
+            bytes.insert(bytes.end(), raw, raw + sizeof(T));
+        }
+
+        static void appendString(std::vector<uint8_t>& bytes, std::string_view str)
+        {
+            append<uint64_t>(bytes, str.size());
+            bytes.insert(bytes.end(), str.begin(), str.end());
+        }
+
+        static void appendScalar(std::vector<uint8_t>& bytes, const GGUFValue& value)
+        {
+            switch (value.type)
+            {
+            case GGUFValueType::UINT8:   append<uint8_t>(bytes, static_cast<uint8_t>(*value.asUInt())); break;
+            case GGUFValueType::UINT16:  append<uint16_t>(bytes, static_cast<uint16_t>(*value.asUInt())); break;
+            case GGUFValueType::UINT32:  append<uint32_t>(bytes, static_cast<uint32_t>(*value.asUInt())); break;
+            case GGUFValueType::UINT64:  append<uint64_t>(bytes, std::get<uint64_t>(value.value)); break;
+            case GGUFValueType::INT8:    append<int8_t>(bytes, static_cast<int8_t>(std::get<int64_t>(value.value))); break;
+            case GGUFValueType::INT16:   append<int16_t>(bytes, static_cast<int16_t>(std::get<int64_t>(value.value))); break;
+            case GGUFValueType::INT32:   append<int32_t>(bytes, static_cast<int32_t>(std::get<int64_t>(value.value))); break;
+            case GGUFValueType::INT64:   append<int64_t>(bytes, std::get<int64_t>(value.value)); break;
+            case GGUFValueType::FLOAT32: append<float>(bytes, static_cast<float>(std::get<double>(value.value))); break;
+            case GGUFValueType::FLOAT64: append<double>(bytes, std::get<double>(value.value)); break;
+            case GGUFValueType::BOOL:    append<uint8_t>(bytes, std::get<bool>(value.value) ? 1 : 0); break;
+            case GGUFValueType::STRING:  appendString(bytes, *value.asString()); break;
+            default:
+                throw std::runtime_error("Invalid GGUF metadata value type");
+            }
+        }
+
+        static void appendValue(std::vector<uint8_t>& bytes, const GGUFValue& value)
+        {
+            append<uint32_t>(bytes, static_cast<uint32_t>(value.type));
+            if (!value.isArray())
+            {
+                appendScalar(bytes, value);
+                return;
+            }
+
+            const GGUFArray& array = *value.asArray();
+            append<uint32_t>(bytes, static_cast<uint32_t>(array.type));
+            append<uint64_t>(bytes, array.count);
+            if (array.type == GGUFValueType::STRING)
+            {
+                for (std::string_view str : array.strings)
+                {
+                    appendString(bytes, str);
+                }
+            }
+            else
+            {
+                // Numeric arrays are stored little-endian in the mapping already
+                const size_t size = static_cast<size_t>(array.count) * ggufScalarSize(array.type);
+                bytes.insert(bytes.end(), array.data, array.data + size);
+            }
+        }
+
+        void setRaw(const std::string& key, std::vector<uint8_t> value)
+        {
+            for (auto& entry : m_metadata)
+            {
+                if (entry.first == key)
+                {
+                    entry.second = std::move(value);
+                    return;
+                }
+            }
+            m_metadata.emplace_back(key, std::move(value));
+        }
+
+        uint64_t alignUp(uint64_t value) const
+        {
+            return (value + m_alignment - 1) / m_alignment * m_alignment;
+        }
+
+        uint32_t m_alignment;
+        std::vector<std::pair<std::string, std::vector<uint8_t>>> m_metadata;
+        std::vector<TensorInfo> m_tensors;
+        uint64_t m_dataSize = 0;
+    };
+} // namespace Model
@@ -0,0 +1,133 @@
+#pragma once
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+namespace Model
+{
+    /**
+     * @brief Read-only memory mapping of a whole file
+     *
+     * The mapping is shared with the OS page cache, so several processes mapping the
+     * same model file share the physical pages and nothing is copied onto the heap.
+     */
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string& path)
+            : m_path(path)
+        {
+#ifdef _WIN32
+            m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (m_file == INVALID_HANDLE_VALUE)
+            {
+                throw std::runtime_error("Failed to open file: " + path);
+            }
+
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(m_file, &size))
+            {
+                CloseHandle(m_file);
+                throw std::runtime_error("Failed to get file size: " + path);
+            }
+            m_size = static_cast<size_t>(size.QuadPart);
+
+            if (m_size > 0)
+            {
+                m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (m_mapping == nullptr)
+                {
+                    CloseHandle(m_file);
+                    throw std::runtime_error("Failed to create file mapping: " + path);
+                }
+
+                m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+                if (m_data == nullptr)
+                {
+                    CloseHandle(m_mapping);
+                    CloseHandle(m_file);
+                    throw std::runtime_error("Failed to map view of file: " + path);
+                }
+            }
+#else
+            m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (m_fd < 0)
+            {
+                throw std::runtime_error("Failed to open file: " + path);
+            }
+
+            struct stat st;
+            if (fstat(m_fd, &st) != 0)
+            {
+                ::close(m_fd);
+                throw std::runtime_error("Failed to stat file: " + path);
+            }
+            m_size = static_cast<size_t>(st.st_size);
+
+            if (m_size > 0)
+            {
+                void* addr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+                if (addr == MAP_FAILED)
+                {
+                    ::close(m_fd);
+                    throw std::runtime_error("Failed to map file: " + path);
+                }
+                m_data = static_cast<const uint8_t*>(addr);
+            }
+#endif
+        }
+
+        ~MappedFile()
+        {
+#ifdef _WIN32
+            if (m_data)
+                UnmapViewOfFile(m_data);
+            if (m_mapping)
+                CloseHandle(m_mapping);
+            if (m_file != INVALID_HANDLE_VALUE)
+                CloseHandle(m_file);
+#else
+            if (m_data)
+                munmap(const_cast<uint8_t*>(m_data), m_size);
+            if (m_fd >= 0)
+                ::close(m_fd);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&&) = delete;
+        MappedFile& operator=(MappedFile&&) = delete;
+
+        const uint8_t* data() const { return m_data; }
+        size_t size() const { return m_size; }
+        const std::string& path() const { return m_path; }
+
+#ifndef _WIN32
+        int fd() const { return m_fd; }
+#endif
+
+    private:
+        std::string m_path;
+        const uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+#ifdef _WIN32
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+        HANDLE m_mapping = nullptr;
+#else
+        int m_fd = -1;
+#endif
+    };
+} // namespace Model
@@ -2,33 +2,110 @@
 
 #include <string>
 #include <json.hpp>
+#include "download_progress.hpp"
 #include <filesystem>
+#include <optional>
+#include <memory>
+#include <vector>
+#include <cstdint>
 
 using json = nlohmann::json;
 
 namespace Model
 {
+    // Capabilities read from a variant's GGUF header, filled from the metadata cache
+    struct ModelMetadata
+    {
+        std::string architecture;
+        std::string quantization; // e.g. "F16", "Q4_K_M"
+        uint64_t contextLength = 0;
+        uint64_t parameterCount = 0;
+        uint64_t tensorCount = 0;
+        uint64_t fileSize = 0;
+        uint64_t tensorDataSize = 0;
+        uint64_t blockCount = 0;
+        uint64_t embeddingLength = 0;
+        uint64_t headCount = 0;
+        uint64_t headCountKv = 0;
+
+        // Weights plus an f16 KV cache sized for `contextSize` tokens
+        uint64_t estimateMemoryBytes(uint64_t contextSize) const
+        {
+            uint64_t kvCache = 0;
+            if (headCount > 0)
+            {
+                uint64_t headDim = embeddingLength / headCount;
+                kvCache = 2 * blockCount * contextSize * headCountKv * headDim * sizeof(uint16_t);
+            }
+            return tensorDataSize + kvCache;
+        }
+    };
+
+    inline void to_json(nlohmann::json &j, const ModelMetadata &m)
+    {
+        j = nlohmann::json{
+            {"architecture", m.architecture},
+            {"quantization", m.quantization},
+            {"contextLength", m.contextLength},
+            {"parameterCount", m.parameterCount},
+            {"tensorCount", m.tensorCount},
+            {"fileSize", m.fileSize},
+            {"tensorDataSize", m.tensorDataSize},
+            {"blockCount", m.blockCount},
+            {"embeddingLength", m.embeddingLength},
+            {"headCount", m.headCount},
+            {"headCountKv", m.headCountKv}};
+    }
+
+    inline void from_json(const nlohmann::json &j, ModelMetadata &m)
+    {
+        j.at("architecture").get_to(m.architecture);
+        j.at("quantization").get_to(m.quantization);
+        j.at("contextLength").get_to(m.contextLength);
+        j.at("parameterCount").get_to(m.parameterCount);
+        j.at("tensorCount").get_to(m.tensorCount);
+        j.at("fileSize").get_to(m.fileSize);
+        j.at("tensorDataSize").get_to(m.tensorDataSize);
+        j.at("blockCount").get_to(m.blockCount);
+        j.at("embeddingLength").get_to(m.embeddingLength);
+        j.at("headCount").get_to(m.headCount);
+        j.at("headCountKv").get_to(m.headCountKv);
+    }
+
     struct ModelVariant
     {
         std::string type; // "Full Precision" or "4-bit Quantized"
         std::string path;
         std::string downloadLink;
         bool isDownloaded;
-        double downloadProgress; // 0.0 to 100.0
+        double downloadProgress; // 0.0 to 100.0, a periodic snapshot of `progress`
         int lastSelected;
+        std::string sha256; // expected lowercase hex digest, empty if unknown
+        uint64_t size;      // expected size in bytes, 0 if unknown
+
+        // Runtime only: filled from the metadata cache, not stored in the catalog
+        std::optional<ModelMetadata> metadata;
+
+        // Runtime only: live download progress, shared by every copy of the variant so a
+        // copy from ModelManager::getModels() keeps showing the current state
+        std::shared_ptr<DownloadProgress> progress = std::make_shared<DownloadProgress>();
 
         ModelVariant(const std::string &type = "",
                      const std::string &path = "",
                      const std::string &downloadLink = "",
                      bool isDownloaded = false,
                      double downloadProgress = 0.0,
-                     int lastSelected = 0)
+                     int lastSelected = 0,
+                     const std::string &sha256 = "",
+                     uint64_t size = 0)
             : type(type)
             , path(path)
             , downloadLink(downloadLink)
             , isDownloaded(isDownloaded)
             , downloadProgress(downloadProgress)
-            , lastSelected(lastSelected) {}
+            , lastSelected(lastSelected)
+            , sha256(sha256)
+            , size(size) {}
     };
 
     inline void to_json(nlohmann::json &j, const ModelVariant &v)
@@ -39,7 +116,9 @@ namespace Model
             {"downloadLink", v.downloadLink},
             {"isDownloaded", v.isDownloaded},
             {"downloadProgress", v.downloadProgress},
-            {"lastSelected", v.lastSelected}};
+            {"lastSelected", v.lastSelected},
+            {"sha256", v.sha256},
+            {"size", v.size}};
     }
 
     inline void from_json(const nlohmann::json &j, ModelVariant &v)
@@ -50,6 +129,10 @@ namespace Model
         j.at("isDownloaded").get_to(v.isDownloaded);
         j.at("downloadProgress").get_to(v.downloadProgress);
         j.at("lastSelected").get_to(v.lastSelected);
+
+        // Optional so that catalogs written before verification existed still load
+        v.sha256 = j.value("sha256", "");
+        v.size = j.value("size", static_cast<uint64_t>(0));
     }
 
     struct ModelData
@@ -58,12 +141,48 @@ namespace Model
         ModelVariant fullPrecision;
         ModelVariant quantized4Bit;
 
+        // Variants produced on this machine (see ModelQuantizer) rather than downloaded
+        std::vector<ModelVariant> localVariants;
+
         ModelData(const std::string &name = "",
                   const ModelVariant &fullPrecision = ModelVariant(),
                   const ModelVariant &quantized4Bit = ModelVariant())
             : name(name)
             , fullPrecision(fullPrecision)
             , quantized4Bit(quantized4Bit) {}
+
+        /**
+         * @brief Resolves a variant type to the variant that serves it
+         *
+         * A downloaded local variant of the requested type stands in for a catalog
+         * variant that has not been downloaded, so a locally quantized 4-bit model
+         * satisfies "4-bit Quantized" without a second download. Returns nullptr for a
+         * type the model has no variant of.
+         */
+        ModelVariant *getVariant(const std::string &variantType)
+        {
+            if (variantType == "Full Precision")
+                return &fullPrecision;
+
+            ModelVariant *local = nullptr;
+            for (auto &candidate : localVariants)
+            {
+                if (candidate.type == variantType && candidate.isDownloaded)
+                {
+                    local = &candidate;
+                    break;
+                }
+            }
+
+            if (variantType == quantized4Bit.type)
+                return local && !quantized4Bit.isDownloaded ? local : &quantized4Bit;
+            return local;
+        }
+
+        const ModelVariant *getVariant(const std::string &variantType) const
+        {
+            return const_cast<ModelData *>(this)->getVariant(variantType);
+        }
     };
 
     inline void to_json(nlohmann::json &j, const ModelData &m)
@@ -72,6 +191,10 @@ namespace Model
             {"name", m.name},
             {"fullPrecision", m.fullPrecision},
             {"quantized4Bit", m.quantized4Bit}};
+        if (!m.localVariants.empty())
+        {
+            j["localVariants"] = m.localVariants;
+        }
     }
 
     inline void from_json(const nlohmann::json &j, ModelData &m)
@@ -79,5 +202,9 @@ namespace Model
         j.at("name").get_to(m.name);
         j.at("fullPrecision").get_to(m.fullPrecision);
         j.at("quantized4Bit").get_to(m.quantized4Bit);
+        if (j.contains("localVariants"))
+        {
+            j.at("localVariants").get_to(m.localVariants);
+        }
     }
 } // namespace Model
\ No newline at end of file
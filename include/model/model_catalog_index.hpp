@@ -0,0 +1,446 @@
+#pragma once
+
+#include "model.hpp"
+
+#include <json.hpp>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <optional>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+
+namespace Model
+{
+    // A catalog file that could not be read; the other files still load
+    struct CatalogError
+    {
+        std::string path;
+        std::string message;
+    };
+
+    struct CatalogLoadResult
+    {
+        std::vector<ModelData> models; // in source file name order
+        std::vector<CatalogError> errors;
+    };
+
+    /**
+     * @brief Compiled index of the model catalog in `<basePath>/*.json`
+     *
+     * The index is a JSON-lines file with one entry per catalog file, recording the
+     * file's size and mtime next to the parsed model. Loading the catalog stats every
+     * catalog file but only opens the ones that changed since they were indexed, and
+     * both the index and changed files are parsed on all cores.
+     *
+     * The index is also where model state is saved: update() appends the model's new
+     * entry instead of rewriting its catalog file, and the last entry for a file wins.
+     * A torn last line after a crash is skipped, leaving the previous entry in effect.
+     * The log is compacted once superseded lines outnumber live entries. When a catalog
+     * file itself changes (e.g. an updated catalog is shipped), its model is re-read and
+     * the saved state (selection times, local variants) carried over.
+     */
+    class ModelCatalogIndex
+    {
+    public:
+        static constexpr int VERSION = 1;
+        static constexpr const char *INDEX_FILE_NAME = ".catalog.index";
+
+        explicit ModelCatalogIndex(const std::string &basePath)
+            : m_basePath(basePath)
+            , m_indexPath(basePath + "/" + INDEX_FILE_NAME)
+        {
+        }
+
+        ModelCatalogIndex(const ModelCatalogIndex &) = delete;
+        ModelCatalogIndex &operator=(const ModelCatalogIndex &) = delete;
+
+        // Brings the index up to date with the catalog files and returns every model
+        CatalogLoadResult load()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            readIndexLocked();
+
+            std::vector<SourceStat> sources = listSources();
+            std::vector<const SourceStat *> stale;
+            for (const auto &source : sources)
+            {
+                auto it = m_entries.find(source.name);
+                if (it == m_entries.end() || it->second.size != source.size || it->second.mtime != source.mtime)
+                {
+                    stale.push_back(&source);
+                }
+            }
+
+            std::vector<std::optional<ModelData>> parsed(stale.size());
+            std::vector<std::string> messages(stale.size());
+            parallelFor(stale.size(), [&](size_t i) {
+                try
+                {
+                    std::ifstream file(m_basePath + "/" + stale[i]->name);
+                    if (!file.is_open())
+                        throw std::runtime_error("cannot open file");
+
+                    nlohmann::json j;
+                    file >> j;
+                    parsed[i] = j.get<ModelData>();
+                }
+                catch (const std::exception &e)
+                {
+                    messages[i] = e.what();
+                }
+            });
+
+            CatalogLoadResult result;
+            bool changed = false;
+            for (size_t i = 0; i < stale.size(); ++i)
+            {
+                if (!parsed[i])
+                {
+                    // A previously indexed model stays available until its file is fixed
+                    result.errors.push_back({ m_basePath + "/" + stale[i]->name, messages[i] });
+                    continue;
+                }
+
+                Entry &entry = m_entries[stale[i]->name];
+                if (!entry.model.name.empty())
+                {
+                    carryOverState(*parsed[i], entry.model);
+                }
+                entry = Entry{ stale[i]->size, stale[i]->mtime, std::move(*parsed[i]) };
+                changed = true;
+            }
+
+            // Catalog files that were deleted take their models with them
+            for (auto it = m_entries.begin(); it != m_entries.end();)
+            {
+                bool exists = std::any_of(sources.begin(), sources.end(),
+                    [&](const SourceStat &source) { return source.name == it->first; });
+                if (exists)
+                {
+                    ++it;
+                }
+                else
+                {
+                    it = m_entries.erase(it);
+                    changed = true;
+                }
+            }
+
+            if (changed || m_lineCount > 2 * m_entries.size() + 16)
+            {
+                writeIndexLocked();
+            }
+
+            rebuildNamesLocked();
+            for (const auto &[name, entry] : m_entries)
+            {
+                result.models.push_back(entry.model);
+            }
+            return result;
+        }
+
+        // Reads only the index, so catalog files are neither stat'ed nor opened
+        std::vector<std::string> listModelNames()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_loaded)
+            {
+                readIndexLocked();
+                rebuildNamesLocked();
+            }
+
+            std::vector<std::string> names;
+            for (const auto &[name, entry] : m_entries)
+            {
+                names.push_back(entry.model.name);
+            }
+            return names;
+        }
+
+        /**
+         * @brief Saves a model's state by appending one index entry
+         *
+         * A model without a catalog file (e.g. one added at runtime) gets a new
+         * `<name>.json` written first, so it is found again on the next load.
+         */
+        bool update(const ModelData &modelData)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_loaded)
+            {
+                readIndexLocked();
+                rebuildNamesLocked();
+            }
+
+            auto it = m_sourceByName.find(modelData.name);
+            if (it == m_sourceByName.end())
+            {
+                std::string source = getSourceFileName(modelData.name);
+                std::ofstream file(m_basePath + "/" + source);
+                if (!file.is_open())
+                    return false;
+                file << nlohmann::json(modelData).dump(4);
+                file.close();
+
+                std::optional<SourceStat> stat = statSource(source);
+                if (!stat)
+                    return false;
+                m_entries[source] = Entry{ stat->size, stat->mtime, modelData };
+                it = m_sourceByName.emplace(modelData.name, source).first;
+            }
+
+            Entry &entry = m_entries[it->second];
+            entry.model = modelData;
+
+            // Appending needs the version header in place
+            std::error_code ec;
+            if (!std::filesystem::exists(m_indexPath, ec))
+                return writeIndexLocked();
+
+            std::ofstream index(m_indexPath, std::ios::app);
+            if (!index.is_open())
+                return false;
+            index << serializeEntry(it->second, entry) << '\n';
+            ++m_lineCount;
+            return static_cast<bool>(index);
+        }
+
+        // Catalog file name the original persistence used for a model name
+        static std::string getSourceFileName(const std::string &modelName)
+        {
+            std::string fileName = modelName;
+            std::replace(fileName.begin(), fileName.end(), ' ', '-');
+            std::transform(fileName.begin(), fileName.end(), fileName.begin(), ::tolower);
+            return fileName + ".json";
+        }
+
+    private:
+        struct Entry
+        {
+            uint64_t size = 0;
+            int64_t mtime = 0;
+            ModelData model;
+        };
+
+        struct SourceStat
+        {
+            std::string name; // file name within the base path
+            uint64_t size = 0;
+            int64_t mtime = 0;
+        };
+
+        std::optional<SourceStat> statSource(const std::string &name) const
+        {
+            std::error_code ec;
+            const std::string path = m_basePath + "/" + name;
+            SourceStat stat;
+            stat.name = name;
+            stat.size = std::filesystem::file_size(path, ec);
+            if (ec)
+                return std::nullopt;
+            auto mtime = std::filesystem::last_write_time(path, ec);
+            if (ec)
+                return std::nullopt;
+            stat.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+            return stat;
+        }
+
+        std::vector<SourceStat> listSources() const
+        {
+            std::vector<SourceStat> sources;
+            std::error_code ec;
+            for (const auto &entry : std::filesystem::directory_iterator(m_basePath, ec))
+            {
+                if (entry.path().extension() != ".json")
+                    continue;
+                if (auto stat = statSource(entry.path().filename().string()))
+                {
+                    sources.push_back(std::move(*stat));
+                }
+            }
+            std::sort(sources.begin(), sources.end(),
+                [](const SourceStat &a, const SourceStat &b) { return a.name < b.name; });
+            return sources;
+        }
+
+        // State the user built up that a re-read catalog file must not wipe out
+        static void carryOverState(ModelData &fresh, const ModelData &previous)
+        {
+            if (fresh.fullPrecision.type == previous.fullPrecision.type)
+            {
+                fresh.fullPrecision.lastSelected = previous.fullPrecision.lastSelected;
+            }
+            if (fresh.quantized4Bit.type == previous.quantized4Bit.type)
+            {
+                fresh.quantized4Bit.lastSelected = previous.quantized4Bit.lastSelected;
+            }
+            if (fresh.localVariants.empty())
+            {
+                fresh.localVariants = previous.localVariants;
+            }
+        }
+
+        static std::string serializeEntry(const std::string &source, const Entry &entry)
+        {
+            return nlohmann::json{
+                {"source", source},
+                {"size", entry.size},
+                {"mtime", entry.mtime},
+                {"model", entry.model} }.dump();
+        }
+
+        // Runs fn(0) .. fn(count - 1) on up to one thread per core
+        static void parallelFor(size_t count, const std::function<void(size_t)> &fn)
+        {
+            size_t threadCount = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+            if (threadCount <= 1)
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    fn(i);
+                }
+                return;
+            }
+
+            std::atomic<size_t> next{ 0 };
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < threadCount; ++t)
+            {
+                workers.emplace_back([&]() {
+                    for (size_t i = next++; i < count; i = next++)
+                    {
+                        fn(i);
+                    }
+                });
+            }
+            for (auto &worker : workers)
+            {
+                worker.join();
+            }
+        }
+
+        void readIndexLocked()
+        {
+            m_loaded = true;
+            m_entries.clear();
+            m_lineCount = 0;
+
+            std::ifstream file(m_indexPath, std::ios::binary);
+            if (!file.is_open())
+                return;
+
+            std::stringstream buffer;
+            buffer << file.rdbuf();
+            const std::string content = buffer.str();
+
+            std::vector<std::string_view> lines;
+            for (size_t start = 0; start < content.size();)
+            {
+                size_t end = content.find('\n', start);
+                if (end == std::string::npos)
+                {
+                    end = content.size();
+                }
+                if (end > start)
+                {
+                    lines.emplace_back(content.data() + start, end - start);
+                }
+                start = end + 1;
+            }
+
+            // The first line is the version header; an index from another version is rebuilt
+            try
+            {
+                if (lines.empty() || nlohmann::json::parse(lines[0]).at("version").get<int>() != VERSION)
+                    return;
+            }
+            catch (const std::exception &)
+            {
+                return;
+            }
+
+            std::vector<std::optional<std::pair<std::string, Entry>>> parsed(lines.size());
+            parallelFor(lines.size() - 1, [&](size_t i) {
+                try
+                {
+                    nlohmann::json j = nlohmann::json::parse(lines[i + 1]);
+                    Entry entry;
+                    j.at("size").get_to(entry.size);
+                    j.at("mtime").get_to(entry.mtime);
+                    j.at("model").get_to(entry.model);
+                    parsed[i] = std::make_pair(j.at("source").get<std::string>(), std::move(entry));
+                }
+                catch (const std::exception &)
+                {
+                    // Torn or corrupt line; an earlier entry for the same file stays in effect
+                }
+            });
+
+            // Applied in file order so that the last entry for a catalog file wins
+            for (auto &line : parsed)
+            {
+                if (line)
+                {
+                    m_entries[line->first] = std::move(line->second);
+                }
+            }
+            m_lineCount = lines.size() - 1;
+        }
+
+        bool writeIndexLocked()
+        {
+            // Write to a temporary file first so a crash never leaves a torn index
+            const std::string tmpPath = m_indexPath + ".tmp";
+            {
+                std::ofstream file(tmpPath, std::ios::binary);
+                if (!file.is_open())
+                    return false;
+
+                file << nlohmann::json{ {"version", VERSION} }.dump() << '\n';
+                for (const auto &[source, entry] : m_entries)
+                {
+                    file << serializeEntry(source, entry) << '\n';
+                }
+                if (!file)
+                    return false;
+            }
+
+            std::error_code ec;
+            std::filesystem::rename(tmpPath, m_indexPath, ec);
+            if (ec)
+                return false;
+
+            m_lineCount = m_entries.size();
+            return true;
+        }
+
+        void rebuildNamesLocked()
+        {
+            m_sourceByName.clear();
+            for (const auto &[source, entry] : m_entries)
+            {
+                m_sourceByName.emplace(entry.model.name, source);
+            }
+        }
+
+        const std::string m_basePath;
+        const std::string m_indexPath;
+
+        std::mutex m_mutex;
+        bool m_loaded = false;
+        std::map<std::string, Entry> m_entries; // keyed by catalog file name
+        std::unordered_map<std::string, std::string> m_sourceByName;
+        size_t m_lineCount = 0; // entry lines in the index file, including superseded ones
+    };
+} // namespace Model
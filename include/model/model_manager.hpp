@@ -1,13 +1,24 @@
 #pragma once
 
 #include "model_persistence.hpp"
+#include "gguf_reader.hpp"
+#include "model_metadata_cache.hpp"
+#include "model_warmup.hpp"
+#include "model_residency.hpp"
+#include "model_quantizer.hpp"
+#include "blob_store.hpp"
 
 #include <string>
 #include <vector>
 #include <optional>
 #include <shared_mutex>
 #include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <atomic>
 #include <future>
+#include <functional>
+#include <thread>
 #include <curl/curl.h>
 
 namespace Model
@@ -16,12 +27,41 @@ namespace Model
     class ModelManager
     {
     public:
+        static constexpr const char *METADATA_CACHE_PATH = "models/.metadata.cache";
+        static constexpr const char *BLOB_STORE_PATH = "models/blobs";
+
         static ModelManager &getInstance()
         {
             static ModelManager instance(std::make_unique<FileModelPersistence>("models"));
             return instance;
         }
 
+        using DownloadFinishedCallback = std::function<void(const std::string &modelName, const std::string &variantType, bool success)>;
+
+        ~ModelManager()
+        {
+            m_stopping = true;
+            if (m_loadThread.joinable())
+            {
+                m_loadThread.join();
+            }
+
+            {
+                std::unique_lock<std::shared_mutex> lock(m_mutex);
+                if (m_quantizer)
+                {
+                    m_quantizer->cancel();
+                }
+            }
+            if (m_quantizationThread.joinable())
+            {
+                m_quantizationThread.join();
+            }
+
+            // Stop the download thread before the variants its callbacks write to go away
+            m_persistence.reset();
+        }
+
         ModelManager(const ModelManager &) = delete;
         ModelManager &operator=(const ModelManager &) = delete;
         ModelManager(ModelManager &&) = delete;
@@ -29,10 +69,18 @@ namespace Model
 
         void initialize(std::unique_ptr<IModelPersistence> persistence)
         {
-            std::unique_lock<std::shared_mutex> lock(m_mutex);
-            m_persistence = std::move(persistence);
-            m_currentModelName = std::nullopt;
-            m_currentModelIndex = 0;
+            // The previous load publishes under the lock, so it is waited for without it
+            if (m_loadThread.joinable())
+            {
+                m_loadThread.join();
+            }
+
+            {
+                std::unique_lock<std::shared_mutex> lock(m_mutex);
+                m_persistence = std::move(persistence);
+                m_currentModelName = std::nullopt;
+                m_currentModelIndex = 0;
+            }
             loadModelsAsync();
         }
 
@@ -46,6 +94,12 @@ namespace Model
                 return false; // Model not found
             }
 
+            // The previously selected variant's download no longer jumps the queue
+            if (ModelVariant *previous = getVariantLocked(m_currentModelIndex, m_currentVariantType))
+            {
+                m_persistence->setDownloadPriority(*previous, DOWNLOAD_PRIORITY_BACKGROUND);
+            }
+
             m_currentModelName = modelName;
             m_currentVariantType = variantType;
             m_currentModelIndex = it->second;
@@ -54,16 +108,32 @@ namespace Model
             ModelVariant *variant = getVariantLocked(m_currentModelIndex, m_currentVariantType);
             if (variant)
             {
-                if (!variant->isDownloaded && variant->downloadProgress == 0.0)
+                if (!variant->isDownloaded && !m_persistence->getDownloadState(*variant))
                 {
                     startDownloadAsyncLocked(m_currentModelIndex, m_currentVariantType);
                 }
+                else if (!variant->isDownloaded)
+                {
+                    // Already queued or paused: selecting it moves it to the front
+                    m_persistence->setDownloadPriority(*variant, DOWNLOAD_PRIORITY_CURRENT);
+                    m_persistence->resumeDownload(*variant);
+                }
                 else
                 {
                     // Update lastSelected
                     variant->lastSelected = static_cast<int>(std::time(nullptr));
                     m_persistence->saveModelData(m_models[m_currentModelIndex]);
                 }
+
+                if (variant->isDownloaded)
+                {
+                    loadModelFileLocked(*variant);
+                }
+                else
+                {
+                    // Nothing to warm up until the download finishes
+                    m_warmup.cancel();
+                }
             }
 
             return true;
@@ -81,8 +151,8 @@ namespace Model
             if (!variant)
                 return false;
 
-            // If already downloaded or currently downloading (progress > 0 but not finished), do nothing
-            if (variant->isDownloaded || variant->downloadProgress > 0.0)
+            // If already downloaded or currently queued, downloading or paused, do nothing
+            if (variant->isDownloaded || m_persistence->getDownloadState(*variant))
             {
                 return false;
             }
@@ -92,6 +162,49 @@ namespace Model
             return true;
         }
 
+        bool pauseDownload(size_t modelIndex, const std::string &variantType)
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            ModelVariant *variant = getVariantLocked(modelIndex, variantType);
+            return variant && m_persistence->pauseDownload(*variant);
+        }
+
+        bool resumeDownload(size_t modelIndex, const std::string &variantType)
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            ModelVariant *variant = getVariantLocked(modelIndex, variantType);
+            return variant && m_persistence->resumeDownload(*variant);
+        }
+
+        // Stops the download and discards what was downloaded so far
+        bool cancelDownload(size_t modelIndex, const std::string &variantType)
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            ModelVariant *variant = getVariantLocked(modelIndex, variantType);
+            return variant && m_persistence->cancelDownload(*variant);
+        }
+
+        // std::nullopt if the variant is not queued, downloading or paused
+        std::optional<DownloadState> getDownloadState(size_t modelIndex, const std::string &variantType) const
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            const ModelVariant *variant = getVariantLocked(modelIndex, variantType);
+            return variant ? m_persistence->getDownloadState(*variant) : std::nullopt;
+        }
+
+        // Deletes stored model files no variant refers to any more; returns the bytes freed
+        uint64_t collectModelGarbage()
+        {
+            return m_blobStore.collectGarbage();
+        }
+
+        // Called on the download thread whenever a variant download finishes, fails or is cancelled
+        void setDownloadFinishedCallback(DownloadFinishedCallback callback)
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            m_downloadFinishedCallback = std::move(callback);
+        }
+
         bool isModelDownloaded(size_t modelIndex, const std::string &variantType) const
         {
             std::shared_lock<std::shared_mutex> lock(m_mutex);
@@ -109,7 +222,176 @@ namespace Model
                 return 0.0;
 
             const ModelVariant *variant = getVariantLocked(modelIndex, variantType);
-            return variant ? variant->downloadProgress : 0.0;
+            return variant ? getVariantProgressLocked(*variant) : 0.0;
+        }
+
+        // Live progress record of a variant; hold on to it to poll progress without any lock
+        std::shared_ptr<const DownloadProgress> getDownloadProgress(size_t modelIndex, const std::string &variantType) const
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            const ModelVariant *variant = getVariantLocked(modelIndex, variantType);
+            return variant ? variant->progress : nullptr;
+        }
+
+        /**
+         * @brief Re-quantizes the model's downloaded full precision variant on this machine
+         *
+         * Runs in the background, one conversion at a time. The result is registered as a
+         * local variant ("4-bit Quantized" for Q4_K_M, "8-bit Quantized" for Q8_0) with a
+         * verified marker, so it is selected like a downloaded variant and a 4-bit
+         * download is no longer needed. Returns false if the full precision variant is not
+         * downloaded or a conversion is already running; `onComplete` then is not called.
+         */
+        bool quantizeModel(size_t modelIndex, QuantizationType type, std::function<void(bool success)> onComplete = nullptr)
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            const ModelVariant *source = getVariantLocked(modelIndex, "Full Precision");
+            if (!source || !source->isDownloaded || m_quantizer)
+                return false;
+            m_quantizingModelIndex = modelIndex;
+            m_quantizingVariantType = localVariantType(type);
+            m_variantErrors.erase({ modelIndex, m_quantizingVariantType });
+
+            // e.g. models/llama-3.2-1b-f16.gguf -> models/llama-3.2-1b-f16-Q4_K_M.gguf
+            const std::string sourcePath = source->path;
+            const std::filesystem::path sourceFile(sourcePath);
+            const std::string outputPath = (sourceFile.parent_path() /
+                (sourceFile.stem().string() + "-" + quantizationTypeName(type) + ".gguf")).string();
+
+            if (m_quantizationThread.joinable())
+            {
+                m_quantizationThread.join();
+            }
+
+            auto quantizer = std::make_shared<ModelQuantizer>();
+            m_quantizer = quantizer;
+            m_quantizationThread = std::thread([this, modelIndex, type, quantizer, onComplete, sourcePath, outputPath]() {
+                std::optional<QuantizationResult> result;
+                std::optional<std::string> error; // stays empty when cancelled
+                try
+                {
+                    result = quantizer->run(sourcePath, outputPath, type);
+                }
+                catch (const std::exception &e)
+                {
+                    error = e.what();
+                }
+
+                bool success = result && registerLocalVariant(modelIndex, type, outputPath, *result);
+                if (result && !success)
+                {
+                    error = "Cannot register " + outputPath;
+                }
+                {
+                    std::unique_lock<std::shared_mutex> lock(m_mutex);
+                    m_quantizer.reset();
+                    if (error)
+                    {
+                        m_variantErrors[{ modelIndex, localVariantType(type) }] = *error;
+                    }
+                }
+
+                if (onComplete)
+                {
+                    onComplete(success);
+                }
+            });
+            return true;
+        }
+
+        bool isQuantizing() const
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            return m_quantizer != nullptr;
+        }
+
+        // Why the last attempt to produce or load the variant failed; std::nullopt since it succeeded
+        std::optional<std::string> getVariantError(size_t modelIndex, const std::string &variantType) const
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            auto it = m_variantErrors.find({ modelIndex, variantType });
+            if (it == m_variantErrors.end())
+                return std::nullopt;
+            return it->second;
+        }
+
+        // Whether the variant's file, found without a verified marker, is still being hashed
+        bool isVerifying(size_t modelIndex, const std::string &variantType) const
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            const ModelVariant *variant = getVariantLocked(modelIndex, variantType);
+            return variant && m_verifying.count(variant->path) > 0;
+        }
+
+        // Whether the running conversion produces this variant
+        bool isQuantizing(size_t modelIndex, const std::string &variantType) const
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            return m_quantizer && m_quantizingModelIndex == modelIndex && m_quantizingVariantType == variantType;
+        }
+
+        // Variant type of the local variant a conversion to `type` is registered as
+        static const char *localVariantType(QuantizationType type)
+        {
+            return type == QuantizationType::Q8_0 ? "8-bit Quantized" : "4-bit Quantized";
+        }
+
+        // The conversion quantizeModel() produces a variant type with, if any
+        static std::optional<QuantizationType> quantizationTypeFor(const std::string &variantType)
+        {
+            for (QuantizationType type : { QuantizationType::Q4_K_M, QuantizationType::Q8_0 })
+            {
+                if (variantType == localVariantType(type))
+                    return type;
+            }
+            return std::nullopt;
+        }
+
+        /**
+         * @brief Variant types a model can be used in
+         *
+         * The catalog's two, then those only available locally: types already converted
+         * on this machine, and, once the full precision variant is downloaded, the ones
+         * quantizeModel() can still produce.
+         */
+        std::vector<std::string> getVariantTypes(size_t modelIndex) const
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            std::vector<std::string> types{ "4-bit Quantized", "Full Precision" };
+            if (modelIndex >= m_models.size())
+                return types;
+
+            const ModelData &model = m_models[modelIndex];
+            auto add = [&types](const std::string &type) {
+                if (std::find(types.begin(), types.end(), type) == types.end())
+                    types.push_back(type);
+            };
+            for (const auto &local : model.localVariants)
+            {
+                if (local.isDownloaded)
+                    add(local.type);
+            }
+            if (model.fullPrecision.isDownloaded)
+            {
+                add(localVariantType(QuantizationType::Q8_0));
+            }
+            return types;
+        }
+
+        // Progress (0.0 to 100.0) of the running conversion
+        double getQuantizationProgress() const
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            return m_quantizer ? m_quantizer->getProgress() : 0.0;
+        }
+
+        void cancelQuantization()
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            if (m_quantizer)
+            {
+                m_quantizer->cancel();
+            }
         }
 
         std::vector<ModelData> getModels() const
@@ -134,7 +416,49 @@ namespace Model
         {
             std::shared_lock<std::shared_mutex> lock(m_mutex);
             const ModelVariant *variant = getVariantLocked(m_currentModelIndex, m_currentVariantType);
-            return variant ? variant->downloadProgress : 0.0;
+            return variant ? getVariantProgressLocked(*variant) : 0.0;
+        }
+
+        // Progress (0.0 to 100.0) of streaming the current variant's weights into memory
+        double getCurrentVariantWarmupProgress() const
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            return m_warmup.getProgress();
+        }
+
+        bool isCurrentVariantWarm() const
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            return m_warmup.isComplete();
+        }
+
+        // Resident/evicted state and mapped bytes of every model loaded this session
+        std::vector<ModelResidencyInfo> getModelResidency() const
+        {
+            return m_residency.getResidency();
+        }
+
+        size_t getResidentModelBytes() const
+        {
+            return m_residency.getResidentBytes();
+        }
+
+        // RAM budget for keeping previously selected models mapped; the current model is always kept
+        void setModelMemoryBudget(size_t budgetBytes)
+        {
+            m_residency.setBudget(budgetBytes);
+        }
+
+        size_t getModelMemoryBudget() const
+        {
+            return m_residency.getBudget();
+        }
+
+        // Memory-mapped weights of the current variant, or nullptr if none is loaded
+        std::shared_ptr<const GGUFFile> getLoadedModel() const
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            return m_loadedModel;
         }
 
     private:
@@ -146,85 +470,296 @@ namespace Model
             loadModelsAsync();
         }
 
-        void loadModelsAsync() 
+        void loadModelsAsync()
         {
-            std::async(std::launch::async, [this]() {
-                auto models = m_persistence->loadAllModels().get();
+            m_loadThread = std::thread([this]() {
+                loadModels();
+                verifyUnmarkedFiles();
+            });
+        }
 
-                // After loading, check file existence if isDownloaded is true
-                for (auto& model : models) 
+        // Runs on m_loadThread; files without a valid marker are verified afterwards
+        void loadModels()
+        {
+            auto models = m_persistence->loadAllModels().get();
+
+            // Files downloaded before the blob store existed move into it here; this comes
+            // before the metadata lookup since storing may change the mtime
+            std::unordered_set<std::string> unverified;
+            auto check = [&](ModelVariant& variant) {
+                checkAndFixDownloadStatus(variant);
+                if (!variant.isDownloaded && hasUnmarkedFile(variant))
                 {
-                    checkAndFixDownloadStatus(model.fullPrecision);
-                    checkAndFixDownloadStatus(model.quantized4Bit);
+                    unverified.insert(variant.path);
                 }
+                storeVariantFile(variant);
+                loadVariantMetadata(variant);
+            };
 
-                std::unique_lock<std::shared_mutex> lock(m_mutex);
-                m_models = std::move(models);
-                m_modelNameToIndex.clear();
+            for (auto& model : models) 
+            {
+                check(model.fullPrecision);
+                check(model.quantized4Bit);
+
+                // A local variant cannot be downloaded again, so one whose file is gone is dropped
+                for (auto& local : model.localVariants)
+                {
+                    check(local);
+                }
+                model.localVariants.erase(std::remove_if(model.localVariants.begin(), model.localVariants.end(),
+                    [&](const ModelVariant& local) { return !local.isDownloaded && !unverified.count(local.path); }),
+                    model.localVariants.end());
+            }
+            m_metadataCache.save();
+            m_blobStore.collectGarbage();
 
-                for (size_t i = 0; i < m_models.size(); ++i) 
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            m_models = std::move(models);
+            m_modelNameToIndex.clear();
+            m_verifying = std::move(unverified);
+
+            for (size_t i = 0; i < m_models.size(); ++i) 
+            {
+                m_modelNameToIndex[m_models[i].name] = i;
+            }
+
+            selectLastUsedVariantLocked();
+        }
+
+        // Makes the downloaded variant selected most recently the current one
+        void selectLastUsedVariantLocked()
+        {
+            int maxLastSelected = -1;
+            size_t selectedModelIndex = 0;
+            std::string selectedVariantType;
+
+            for (size_t i = 0; i < m_models.size(); ++i)
+            {
+                const auto& model = m_models[i];
+                const ModelVariant* variants[] = { &model.quantized4Bit, &model.fullPrecision };
+
+                for (const ModelVariant* variant : variants)
                 {
-                    m_modelNameToIndex[m_models[i].name] = i;
+                    if (variant->isDownloaded && variant->lastSelected > maxLastSelected)
+                    {
+                        maxLastSelected = variant->lastSelected;
+                        selectedModelIndex = i;
+                        selectedVariantType = variant->type;
+                    }
                 }
+            }
+
+            if (maxLastSelected >= 0)
+            {
+                m_currentModelName = m_models[selectedModelIndex].name;
+                m_currentModelIndex = selectedModelIndex;
+                m_currentVariantType = selectedVariantType;
+            }
+            else
+            {
+                // If no model has been selected before, fallback to default behavior
+                m_currentModelName = std::nullopt;
+                m_currentVariantType.clear();
+                m_currentModelIndex = 0;
+            }
+        }
 
-                // Find the model variant with the highest lastSelected value
-                int maxLastSelected = -1;
-                size_t selectedModelIndex = 0;
-                std::string selectedVariantType;
+        /**
+         * @brief Hashes the files loadModels() found without a valid marker, one at a time
+         *
+         * Runs on m_loadThread after the catalog is published, so the UI is usable
+         * meanwhile; until its file is done a variant reports isVerifying() and cannot
+         * be downloaded over. Each result is published as soon as it is known.
+         */
+        void verifyUnmarkedFiles()
+        {
+            std::vector<std::string> paths;
+            {
+                std::shared_lock<std::shared_mutex> lock(m_mutex);
+                paths.assign(m_verifying.begin(), m_verifying.end());
+            }
 
-                for (size_t i = 0; i < m_models.size(); ++i)
+            for (const std::string& path : paths)
+            {
+                if (m_stopping)
+                    return;
+
+                std::optional<ModelVariant> variant;
                 {
-                    const auto& model = m_models[i];
-                    const ModelVariant* variants[] = { &model.quantized4Bit, &model.fullPrecision };
+                    std::shared_lock<std::shared_mutex> lock(m_mutex);
+                    if (const ModelVariant* found = findVariantByPathLocked(path))
+                    {
+                        variant = *found;
+                    }
+                }
 
-                    for (const ModelVariant* variant : variants)
+                bool verified = variant && verifyUnmarkedFile(*variant);
+                std::optional<ModelMetadata> metadata;
+                if (verified)
+                {
+                    storeFile(path, variant->sha256);
+                    metadata = m_metadataCache.getOrRead(path);
+                    m_metadataCache.save();
+                }
+
+                std::unique_lock<std::shared_mutex> lock(m_mutex);
+                m_verifying.erase(path);
+                for (auto& model : m_models)
+                {
+                    ModelVariant* variants[] = { &model.fullPrecision, &model.quantized4Bit };
+                    for (ModelVariant* target : variants)
                     {
-                        if (variant->isDownloaded && variant->lastSelected > maxLastSelected)
+                        if (verified && target->path == path)
                         {
-                            maxLastSelected = variant->lastSelected;
-                            selectedModelIndex = i;
-                            selectedVariantType = variant->type;
+                            target->isDownloaded = true;
+                            target->downloadProgress = 100.0;
+                            target->metadata = metadata;
                         }
                     }
+                    for (auto& local : model.localVariants)
+                    {
+                        if (verified && local.path == path)
+                        {
+                            local.isDownloaded = true;
+                            local.downloadProgress = 100.0;
+                            local.metadata = metadata;
+                        }
+                    }
+                    model.localVariants.erase(std::remove_if(model.localVariants.begin(), model.localVariants.end(),
+                        [&](const ModelVariant& local) { return !local.isDownloaded && !m_verifying.count(local.path); }),
+                        model.localVariants.end());
                 }
 
-                if (maxLastSelected >= 0)
+                if (verified && !m_currentModelName)
                 {
-                    m_currentModelName = m_models[selectedModelIndex].name;
-                    m_currentModelIndex = selectedModelIndex;
-                    m_currentVariantType = selectedVariantType;
+                    selectLastUsedVariantLocked();
                 }
-                else
+            }
+        }
+
+        const ModelVariant* findVariantByPathLocked(const std::string& path) const
+        {
+            for (const auto& model : m_models)
+            {
+                if (model.fullPrecision.path == path)
+                    return &model.fullPrecision;
+                if (model.quantized4Bit.path == path)
+                    return &model.quantized4Bit;
+                for (const auto& local : model.localVariants)
                 {
-                    // If no model has been selected before, fallback to default behavior
-                    m_currentModelName = std::nullopt;
-                    m_currentVariantType.clear();
-                    m_currentModelIndex = 0;
+                    if (local.path == path)
+                        return &local;
                 }
-            });
+            }
+            return nullptr;
         }
 
+        // Only checks the marker; files without one are hashed later by verifyUnmarkedFiles()
         void checkAndFixDownloadStatus(ModelVariant& variant) 
         {
-            if (variant.isDownloaded) 
+            // Trust a file only if its verified marker still matches it; a bare file may
+            // be a truncated or corrupted download
+            if (isVerifiedMarkerValid(variant))
             {
-                // Check if file exists
-                if (!std::filesystem::exists(variant.path)) 
+                variant.isDownloaded = true;
+                variant.downloadProgress = 100.0;
+                return;
+            }
+
+            variant.isDownloaded = false;
+            variant.downloadProgress = 0.0;
+        }
+
+        static bool hasUnmarkedFile(const ModelVariant& variant)
+        {
+            std::error_code ec;
+            return !variant.path.empty() && std::filesystem::is_regular_file(variant.path, ec);
+        }
+
+        /**
+         * @brief Verifies a model file without a valid marker once, writing its marker
+         *
+         * Files downloaded before markers existed have none, and neither does a file that
+         * was touched since. Hashing such a file once on m_loadThread is far cheaper than
+         * downloading it again. It must match the catalog size and digest
+         * where those are known. Without a digest it must at least parse as GGUF with
+         * all tensor data inside the file, which rules out a truncated download.
+         */
+        bool verifyUnmarkedFile(const ModelVariant& variant)
+        {
+            std::error_code ec;
+            if (variant.path.empty() || !std::filesystem::is_regular_file(variant.path, ec))
+                return false;
+            if (variant.size != 0 && std::filesystem::file_size(variant.path, ec) != variant.size)
+                return false;
+
+            if (variant.sha256.empty())
+            {
+                try
+                {
+                    GGUFFile file(variant.path);
+                }
+                catch (const std::exception &)
                 {
-                    // File doesn't exist, reset
-                    variant.isDownloaded = false;
-                    variant.downloadProgress = 0.0;
+                    return false;
                 }
+            }
 
-                return;
+            std::optional<std::string> digest = hashFile(variant.path, &m_stopping);
+            if (!digest || (!variant.sha256.empty() && *digest != variant.sha256))
+                return false;
+            return writeVerifiedMarker(variant.path, *digest);
+        }
+
+        // Maps the current variant's GGUF file; only the header and tensor table are read here
+        bool loadModelFileLocked(ModelVariant &variant)
+        {
+            const std::pair<size_t, std::string> key{ m_currentModelIndex, m_currentVariantType };
+            if (!m_loadedModel || m_loadedModel->path() != variant.path)
+            {
+                try
+                {
+                    // Instant if the variant is still resident from an earlier selection
+                    m_loadedModel = m_residency.acquire(variant.path, variant.lastSelected);
+
+                    // The header is already parsed, so refresh the cache entry for free
+                    variant.metadata = m_metadataCache.put(variant.path, *m_loadedModel);
+                    m_metadataCache.save();
+                }
+                catch (const std::exception &e)
+                {
+                    // e.g. a truncated or malformed file; selecting the variant again retries
+                    m_variantErrors[key] = e.what();
+                    m_warmup.cancel();
+                    m_loadedModel.reset();
+                    return false;
+                }
+                m_variantErrors.erase(key);
+
+                // Restarting also cancels the warm-up of the previously selected model
+                m_warmup.cancel();
             }
-            
-            // if variant is not downloaded, but file exists, set isDownloaded to true
-            if (std::filesystem::exists(variant.path)) 
+
+            // Fault the weights in now rather than during the first generation
+            if (!m_warmup.isRunning() && !m_warmup.isComplete())
             {
-                variant.isDownloaded = true;
-                variant.downloadProgress = 100.0;
+                m_warmup.start(m_loadedModel);
             }
+            return true;
+        }
+
+        // Cache hit on every launch after the first; only a changed file is re-parsed
+        void loadVariantMetadata(ModelVariant& variant)
+        {
+            if (!variant.isDownloaded)
+                return;
+
+            variant.metadata = m_metadataCache.getOrRead(variant.path);
+        }
+
+        double getVariantProgressLocked(const ModelVariant &variant) const
+        {
+            return variant.isDownloaded ? 100.0 : variant.progress->getPercent();
         }
 
         ModelVariant *getVariantLocked(size_t modelIndex, const std::string &variantType) const
@@ -232,15 +767,46 @@ namespace Model
             if (modelIndex >= m_models.size())
                 return nullptr;
 
-            const auto &model = m_models[modelIndex];
-            if (variantType == "Full Precision")
-            {
-                return const_cast<ModelVariant *>(&model.fullPrecision);
-            }
-            else
+            return const_cast<ModelVariant *>(m_models[modelIndex].getVariant(variantType));
+        }
+
+        // Called on the quantization thread once the converted file is in place
+        bool registerLocalVariant(size_t modelIndex, QuantizationType type, const std::string &path, const QuantizationResult &result)
+        {
+            if (!writeVerifiedMarker(path, result.sha256))
+                return false;
+
+            storeFile(path, result.sha256);
+
+            std::optional<ModelMetadata> metadata = m_metadataCache.getOrRead(path);
+            m_metadataCache.save();
+
+            ModelData saved;
             {
-                return const_cast<ModelVariant *>(&model.quantized4Bit);
+                std::unique_lock<std::shared_mutex> lock(m_mutex);
+                if (modelIndex >= m_models.size())
+                    return false;
+
+                const std::string variantType = localVariantType(type);
+                auto &locals = m_models[modelIndex].localVariants;
+                auto it = std::find_if(locals.begin(), locals.end(),
+                    [&](const ModelVariant &local) { return local.type == variantType; });
+                ModelVariant &local = it != locals.end() ? *it : locals.emplace_back();
+
+                local.type = variantType;
+                local.path = path;
+                local.downloadLink.clear();
+                local.isDownloaded = true;
+                local.downloadProgress = 100.0;
+                local.sha256 = result.sha256;
+                local.size = result.size;
+                local.metadata = metadata;
+
+                saved = m_models[modelIndex];
             }
+
+            m_persistence->saveModelData(saved).get();
+            return true;
         }
 
         void startDownloadAsyncLocked(size_t modelIndex, const std::string &variantType)
@@ -248,13 +814,141 @@ namespace Model
             if (modelIndex >= m_models.size())
                 return;
 
+            // Its file may still turn out to be complete
             ModelVariant* variant = getVariantLocked(modelIndex, variantType);
-            if (!variant)
+            if (!variant || m_verifying.count(variant->path))
                 return;
 
             ModelData* model = &m_models[modelIndex];
 
-            m_downloadFutures.emplace_back(m_persistence->downloadModelVariant(*model, *variant));
+            if (restoreFromBlobStoreLocked(*model, *variant))
+                return;
+
+            bool isCurrent = modelIndex == m_currentModelIndex && variantType == m_currentVariantType;
+            m_persistence->downloadModelVariant(*variant,
+                isCurrent ? DOWNLOAD_PRIORITY_CURRENT : DOWNLOAD_PRIORITY_BACKGROUND,
+                [this, modelIndex, variantType](bool success) {
+                    onDownloadFinished(modelIndex, variantType, success);
+                },
+                [this, modelIndex, variantType](const DownloadProgressSnapshot &snapshot) {
+                    onDownloadProgress(modelIndex, variantType, snapshot);
+                });
+        }
+
+        // A catalog entry pointing at content already on disk is linked instead of downloaded
+        bool restoreFromBlobStoreLocked(ModelData &model, ModelVariant &variant)
+        {
+            if (variant.sha256.empty() || !m_blobStore.contains(variant.sha256))
+                return false;
+
+            if (!m_blobStore.materialize(variant.sha256, variant.path) ||
+                !writeVerifiedMarker(variant.path, variant.sha256))
+            {
+                return false;
+            }
+
+            variant.isDownloaded = true;
+            variant.downloadProgress = 100.0;
+            variant.metadata = m_metadataCache.getOrRead(variant.path);
+            m_metadataCache.save();
+            m_persistence->saveModelData(model);
+            return true;
+        }
+
+        void storeVariantFile(ModelVariant &variant)
+        {
+            if (variant.isDownloaded)
+            {
+                storeFile(variant.path, variant.sha256);
+            }
+        }
+
+        // Replaces a verified file by a link into the blob store; on failure it is left as is
+        void storeFile(const std::string &path, const std::string &sha256)
+        {
+            std::string digest = sha256.empty() ? readVerifiedMarkerDigest(path).value_or("") : sha256;
+            if (m_blobStore.add(path, digest))
+            {
+                // A deduplicated or copied file has the blob's mtime, which the marker must match
+                writeVerifiedMarker(path, digest);
+            }
+        }
+
+        // Periodic, so the download thread rarely contends for the lock
+        void onDownloadProgress(size_t modelIndex, const std::string &variantType, const DownloadProgressSnapshot &snapshot)
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            ModelVariant *variant = getVariantLocked(modelIndex, variantType);
+            if (variant && !variant->isDownloaded)
+            {
+                variant->downloadProgress = snapshot.percent();
+            }
+        }
+
+        void onDownloadFinished(size_t modelIndex, const std::string &variantType, bool success)
+        {
+            // Nothing maps the new file yet, so it can still be moved into the blob store
+            if (success)
+            {
+                std::string path, sha256;
+                {
+                    std::shared_lock<std::shared_mutex> lock(m_mutex);
+                    if (const ModelVariant *variant = getVariantLocked(modelIndex, variantType))
+                    {
+                        path = variant->path;
+                        sha256 = variant->sha256;
+                    }
+                }
+                if (!path.empty())
+                {
+                    storeFile(path, sha256);
+                }
+            }
+
+            DownloadFinishedCallback callback;
+            std::string modelName;
+            std::optional<ModelData> saved;
+            {
+                std::unique_lock<std::shared_mutex> lock(m_mutex);
+                if (modelIndex >= m_models.size())
+                    return;
+
+                // A failed download keeps its .part file, so the next attempt resumes
+                ModelVariant *variant = getVariantLocked(modelIndex, variantType);
+                if (variant)
+                {
+                    variant->isDownloaded = success;
+                    variant->downloadProgress = success ? 100.0 : 0.0;
+                }
+
+                // Load the selected variant right away instead of on the next selection. It was
+                // selected now as far as the residency LRU goes; its stale lastSelected would
+                // make it the first model evicted.
+                if (success && variant && modelIndex == m_currentModelIndex && variantType == m_currentVariantType)
+                {
+                    variant->lastSelected = static_cast<int>(std::time(nullptr));
+                    loadModelFileLocked(*variant);
+                }
+
+                // Saved once the lock is released, from a copy the UI cannot race with
+                if (success && variant)
+                {
+                    saved = m_models[modelIndex];
+                }
+
+                callback = m_downloadFinishedCallback;
+                modelName = m_models[modelIndex].name;
+            }
+
+            if (saved)
+            {
+                m_persistence->saveModelData(*saved).get();
+            }
+
+            if (callback)
+            {
+                callback(modelName, variantType, success);
+            }
         }
 
         mutable std::shared_mutex m_mutex;
@@ -264,7 +958,20 @@ namespace Model
         std::optional<std::string> m_currentModelName;
         std::string m_currentVariantType;
         size_t m_currentModelIndex;
-        std::vector<std::future<void>> m_downloadFutures;
+        DownloadFinishedCallback m_downloadFinishedCallback;
+        std::shared_ptr<const GGUFFile> m_loadedModel;
+        ModelMetadataCache m_metadataCache{ METADATA_CACHE_PATH };
+        ModelWarmup m_warmup;
+        ModelResidencyManager m_residency;
+        BlobStore m_blobStore{ BLOB_STORE_PATH };
+        std::thread m_loadThread;
+        std::atomic<bool> m_stopping{ false };
+        std::unordered_set<std::string> m_verifying; // paths of files verifyUnmarkedFiles() has yet to check
+        std::map<std::pair<size_t, std::string>, std::string> m_variantErrors; // by model index and variant type
+        std::shared_ptr<ModelQuantizer> m_quantizer; // set while a conversion runs
+        size_t m_quantizingModelIndex = 0;
+        std::string m_quantizingVariantType;
+        std::thread m_quantizationThread;
     };
 
     inline void initializeModelManager()
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "model.hpp"
+#include "gguf_reader.hpp"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace Model
+{
+    /**
+     * @brief Persistent cache of GGUF header metadata
+     *
+     * Entries are keyed by (path, size, mtime, header hash) so that startup never has to
+     * re-parse multi-GB GGUF headers. A lookup costs one stat and a read of the first
+     * HEADER_HASH_BYTES of the file; any change to the file invalidates its entry.
+     */
+    class ModelMetadataCache
+    {
+    public:
+        static constexpr size_t HEADER_HASH_BYTES = 64 * 1024;
+
+        explicit ModelMetadataCache(const std::string& cachePath)
+            : m_cachePath(cachePath)
+        {
+            load();
+        }
+
+        // Returns cached metadata if the file is unchanged since it was cached
+        std::optional<ModelMetadata> get(const std::string& modelPath)
+        {
+            auto key = computeKey(modelPath);
+            if (!key)
+                return std::nullopt;
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_entries.find(modelPath);
+            if (it == m_entries.end() || !(it->second.key == *key))
+                return std::nullopt;
+
+            return it->second.metadata;
+        }
+
+        // Returns cached metadata, parsing the GGUF header only on a cache miss
+        std::optional<ModelMetadata> getOrRead(const std::string& modelPath)
+        {
+            if (auto cached = get(modelPath))
+                return cached;
+
+            try
+            {
+                GGUFFile file(modelPath);
+                return put(modelPath, file);
+            }
+            catch (const std::exception&)
+            {
+                // Not a readable GGUF file (yet), e.g. a partial download
+                return std::nullopt;
+            }
+        }
+
+        // Records metadata of an already opened file
+        ModelMetadata put(const std::string& modelPath, const GGUFFile& file)
+        {
+            ModelMetadata metadata = readMetadata(file);
+            auto key = computeKey(modelPath);
+            if (!key)
+                return metadata;
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_entries[modelPath] = Entry{ *key, metadata };
+            m_dirty = true;
+            return metadata;
+        }
+
+        void remove(const std::string& modelPath)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_entries.erase(modelPath) > 0)
+            {
+                m_dirty = true;
+            }
+        }
+
+        // Writes the cache back to disk if anything changed since the last save
+        bool save()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_dirty)
+                return true;
+
+            nlohmann::json j = nlohmann::json::object();
+            for (const auto& [path, entry] : m_entries)
+            {
+                j[path] = nlohmann::json{
+                    {"size", entry.key.size},
+                    {"mtime", entry.key.mtime},
+                    {"headerHash", entry.key.headerHash},
+                    {"metadata", entry.metadata} };
+            }
+
+            // Write to a temporary file first so a crash never leaves a torn cache
+            std::string tmpPath = m_cachePath + ".tmp";
+            {
+                std::ofstream file(tmpPath);
+                if (!file.is_open())
+                    return false;
+                file << j.dump();
+                if (!file)
+                    return false;
+            }
+
+            std::error_code ec;
+            std::filesystem::rename(tmpPath, m_cachePath, ec);
+            if (ec)
+                return false;
+
+            m_dirty = false;
+            return true;
+        }
+
+        static ModelMetadata readMetadata(const GGUFFile& file)
+        {
+            ModelMetadata metadata;
+            metadata.architecture = file.architecture();
+            metadata.quantization = ggufFileTypeName(static_cast<uint32_t>(file.getUInt("general.file_type", UINT32_MAX)));
+            metadata.contextLength = file.getArchUInt("context_length");
+            metadata.parameterCount = file.parameterCount();
+            metadata.tensorCount = file.tensors().size();
+            metadata.fileSize = file.fileSize();
+            metadata.tensorDataSize = file.tensorDataSize();
+            metadata.blockCount = file.getArchUInt("block_count");
+            metadata.embeddingLength = file.getArchUInt("embedding_length");
+            metadata.headCount = file.getArchUInt("attention.head_count");
+            metadata.headCountKv = file.getArchUInt("attention.head_count_kv", metadata.headCount);
+            return metadata;
+        }
+
+    private:
+        struct Key
+        {
+            uint64_t size = 0;
+            int64_t mtime = 0;
+            uint64_t headerHash = 0;
+
+            bool operator==(const Key& other) const
+            {
+                return size == other.size && mtime == other.mtime && headerHash == other.headerHash;
+            }
+        };
+
+        struct Entry
+        {
+            Key key;
+            ModelMetadata metadata;
+        };
+
+        static std::optional<Key> computeKey(const std::string& modelPath)
+        {
+            std::error_code ec;
+            Key key;
+            key.size = std::filesystem::file_size(modelPath, ec);
+            if (ec)
+                return std::nullopt;
+
+            auto mtime = std::filesystem::last_write_time(modelPath, ec);
+            if (ec)
+                return std::nullopt;
+            key.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+
+            std::ifstream file(modelPath, std::ios::binary);
+            if (!file.is_open())
+                return std::nullopt;
+
+            std::vector<char> buffer(static_cast<size_t>(std::min<uint64_t>(key.size, HEADER_HASH_BYTES)));
+            file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+
+            // FNV-1a
+            uint64_t hash = 1469598103934665603ULL;
+            for (size_t i = 0; i < static_cast<size_t>(file.gcount()); ++i)
+            {
+                hash ^= static_cast<uint8_t>(buffer[i]);
+                hash *= 1099511628211ULL;
+            }
+            key.headerHash = hash;
+
+            return key;
+        }
+
+        void load()
+        {
+            std::ifstream file(m_cachePath);
+            if (!file.is_open())
+                return;
+
+            try
+            {
+                nlohmann::json j;
+                file >> j;
+                for (const auto& [path, value] : j.items())
+                {
+                    Entry entry;
+                    value.at("size").get_to(entry.key.size);
+                    value.at("mtime").get_to(entry.key.mtime);
+                    value.at("headerHash").get_to(entry.key.headerHash);
+                    value.at("metadata").get_to(entry.metadata);
+                    m_entries[path] = std::move(entry);
+                }
+            }
+            catch (const std::exception&)
+            {
+                // A corrupt cache is simply rebuilt
+                m_entries.clear();
+                m_dirty = true;
+            }
+        }
+
+        const std::string m_cachePath;
+        std::unordered_map<std::string, Entry> m_entries;
+        bool m_dirty = false;
+        std::mutex m_mutex;
+    };
+} // namespace Model
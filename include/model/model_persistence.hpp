@@ -1,23 +1,155 @@
 #pragma once
 
 #include "model.hpp"
+#include "partial_download.hpp"
+#include "download_service.hpp"
+#include "model_catalog_index.hpp"
+#include "crypto/crypto.hpp"
 
 #include <string>
 #include <fstream>
 #include <filesystem>
 #include <vector>
 #include <future>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
 #include <curl/curl.h>
 
 namespace Model
 {
+    /**
+     * @brief Cheap proof that a downloaded file was verified
+     *
+     * Written next to the model as `<path>.verified` once its SHA-256 was checked while
+     * downloading. It records the digest together with the file's size and mtime, so a
+     * later startup can trust the file with a single stat instead of re-hashing it.
+     */
+    inline std::string getVerifiedMarkerPath(const std::string& modelPath)
+    {
+        return modelPath + ".verified";
+    }
+
+    inline bool writeVerifiedMarker(const std::string& modelPath, const std::string& sha256)
+    {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(modelPath, ec);
+        if (ec)
+            return false;
+        auto mtime = std::filesystem::last_write_time(modelPath, ec);
+        if (ec)
+            return false;
+
+        std::ofstream file(getVerifiedMarkerPath(modelPath));
+        if (!file.is_open())
+            return false;
+
+        nlohmann::json j{
+            {"sha256", sha256},
+            {"size", static_cast<uint64_t>(size)},
+            {"mtime", static_cast<int64_t>(mtime.time_since_epoch().count())} };
+        file << j.dump(4);
+        return static_cast<bool>(file);
+    }
+
+    // Digest the file was verified against; std::nullopt without a readable marker
+    inline std::optional<std::string> readVerifiedMarkerDigest(const std::string& modelPath)
+    {
+        std::ifstream file(getVerifiedMarkerPath(modelPath));
+        if (!file.is_open())
+            return std::nullopt;
+
+        try
+        {
+            nlohmann::json j;
+            file >> j;
+            return j.at("sha256").get<std::string>();
+        }
+        catch (const std::exception&)
+        {
+            return std::nullopt;
+        }
+    }
+
+    // SHA-256 of a whole file; std::nullopt if it cannot be read or `cancel` is set meanwhile
+    inline std::optional<std::string> hashFile(const std::string& path, const std::atomic<bool>* cancel = nullptr)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return std::nullopt;
+
+        Crypto::Sha256 hash;
+        std::vector<char> buffer(4 * 1024 * 1024);
+        while (file)
+        {
+            if (cancel && *cancel)
+                return std::nullopt;
+            file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            hash.update(buffer.data(), static_cast<size_t>(file.gcount()));
+        }
+        if (file.bad())
+            return std::nullopt;
+        return hash.finalHex();
+    }
+
+    inline bool isVerifiedMarkerValid(const ModelVariant& variant)
+    {
+        std::ifstream file(getVerifiedMarkerPath(variant.path));
+        if (!file.is_open())
+            return false;
+
+        try
+        {
+            nlohmann::json j;
+            file >> j;
+
+            std::error_code ec;
+            auto size = std::filesystem::file_size(variant.path, ec);
+            if (ec)
+                return false;
+            auto mtime = std::filesystem::last_write_time(variant.path, ec);
+            if (ec)
+                return false;
+
+            if (j.at("size").get<uint64_t>() != size ||
+                j.at("mtime").get<int64_t>() != static_cast<int64_t>(mtime.time_since_epoch().count()))
+            {
+                return false;
+            }
+
+            // The catalog digest may have been updated since the file was verified
+            return variant.sha256.empty() || j.at("sha256").get<std::string>() == variant.sha256;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+
+    // Download priorities; the variant the user has selected goes first
+    constexpr int DOWNLOAD_PRIORITY_BACKGROUND = 0;
+    constexpr int DOWNLOAD_PRIORITY_CURRENT = 1;
+
+    using DownloadCompleteCallback = std::function<void(bool success)>;
+    using DownloadProgressCallback = std::function<void(const DownloadProgressSnapshot& snapshot)>;
+
     class IModelPersistence
     {
     public:
         virtual ~IModelPersistence() = default;
         virtual std::future<std::vector<ModelData>> loadAllModels() = 0;
-        virtual std::future<void> downloadModelVariant(ModelData& modelData, ModelVariant& variant) = 0;
+        virtual std::future<void> downloadModelVariant(const ModelVariant& variant,
+            int priority, DownloadCompleteCallback onComplete, DownloadProgressCallback onProgress) = 0;
         virtual std::future<void> saveModelData(const ModelData& modelData) = 0;
+
+        virtual void setDownloadPriority(const ModelVariant& variant, int priority) = 0;
+        virtual bool pauseDownload(const ModelVariant& variant) = 0;
+        virtual bool resumeDownload(const ModelVariant& variant) = 0;
+        virtual bool cancelDownload(const ModelVariant& variant) = 0;
+        virtual std::optional<DownloadState> getDownloadState(const ModelVariant& variant) const = 0;
     };
 
     class FileModelPersistence : public IModelPersistence
@@ -25,6 +157,7 @@ namespace Model
     public:
         explicit FileModelPersistence(const std::string &basePath)
             : m_basePath(basePath)
+            , m_catalog(basePath)
         {
             if (!std::filesystem::exists(m_basePath))
             {
@@ -35,109 +168,178 @@ namespace Model
         std::future<std::vector<ModelData>> loadAllModels() override
         {
             return std::async(std::launch::async, [this]() -> std::vector<ModelData> {
-                std::vector<ModelData> models;
-                try 
-                {
-                    for (const auto& entry : std::filesystem::directory_iterator(m_basePath)) 
-                    {
-                        if (entry.path().extension() == ".json") 
-                        {
-                            std::ifstream file(entry.path());
-                            if (file.is_open()) 
-                            {
-                                nlohmann::json j;
-                                file >> j;
-                                models.push_back(j.get<ModelData>());
-                            }
-                        }
-                    }
-                } catch (...) 
-                {
-                    // Return whatever was read successfully.
-                }
-                return models; });
+                CatalogLoadResult result = m_catalog.load();
+
+                std::lock_guard<std::mutex> lock(m_catalogErrorsMutex);
+                m_catalogErrors = std::move(result.errors);
+                return std::move(result.models); });
+        }
+
+        // Catalog files that failed to parse during the last loadAllModels()
+        std::vector<CatalogError> getCatalogErrors() const
+        {
+            std::lock_guard<std::mutex> lock(m_catalogErrorsMutex);
+            return m_catalogErrors;
+        }
+
+        // Names of all catalog models, answered from the catalog index alone
+        std::vector<std::string> listModelNames()
+        {
+            return m_catalog.listModelNames();
         }
 
-        std::future<void> downloadModelVariant(ModelData& modelData, ModelVariant& variant) override
+        /**
+         * @brief Queues a variant download on the shared download service
+         *
+         * The file is fetched into `<path>.part` (see DownloadService for resuming and
+         * segmenting), then checked against the catalog size and SHA-256, or against
+         * those the server published where the catalog has none. Only a
+         * verified file is renamed into `variant.path`; a mismatching one is
+         * quarantined. `onComplete` runs on the download thread once the variant is
+         * downloaded, has failed or was cancelled; the returned future becomes ready
+         * right after it.
+         *
+         * Nothing here writes to `variant` or its model after this call returns: the
+         * owner of the catalog marks the variant downloaded and saves it from
+         * `onComplete`, under its own lock. Likewise live progress goes to
+         * `variant.progress` only, and `onProgress` receives a snapshot on the download
+         * thread every DownloadService::PROGRESS_INTERVAL for the owner to store in
+         * `downloadProgress`.
+         */
+        std::future<void> downloadModelVariant(const ModelVariant& variant,
+            int priority, DownloadCompleteCallback onComplete, DownloadProgressCallback onProgress) override
         {
-            return std::async(std::launch::async, [&variant, &modelData, this]() {
-                CURL *curl = curl_easy_init();
-                if (curl)
+            auto promise = std::make_shared<std::promise<void>>();
+            std::future<void> future = promise->get_future();
+
+            DownloadRequest request;
+            request.id = variant.path;
+            request.url = variant.downloadLink;
+            request.partPath = getPartPath(variant.path);
+            request.priority = priority;
+            request.progress = variant.progress;
+            request.onProgress = std::move(onProgress);
+            request.onComplete = [path = variant.path, size = variant.size, sha256 = variant.sha256,
+                progress = variant.progress, promise, onComplete](const DownloadResult& result) {
+                bool success = result.state == DownloadState::COMPLETED &&
+                    finishDownload(path, size, sha256, result);
+                if (result.state == DownloadState::COMPLETED && !success)
                 {
-                    std::ofstream file(variant.path,  std::ios::binary);
-                    if (!file.is_open())
-                    {
-                        curl_easy_cleanup(curl);
-                        return;
-                    }
-
-                    curl_easy_setopt(curl, CURLOPT_URL, variant.downloadLink.c_str());
-                    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
-                    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &file);
-                    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
-                    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &variant);
-                    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-                    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-
-                    CURLcode res = curl_easy_perform(curl);
-                    if (res != CURLE_OK)
-                    {
-                        // Handle error
-                    }
-                    else
-                    {
-                        variant.isDownloaded = true;
-                        variant.downloadProgress = 100.0;
-
-                        // Save the model data
-                        saveModelData(modelData).get();
-                    }
-
-                    curl_easy_cleanup(curl);
-                    file.close();
+                    progress->setState(DownloadState::FAILED);
                 }
-            });
+
+                if (onComplete)
+                {
+                    onComplete(success);
+                }
+                promise->set_value();
+            };
+
+            m_downloads.enqueue(std::move(request));
+            return future;
         }
 
         std::future<void> saveModelData(const ModelData& modelData) override
         {
+            // One appended index entry rather than a rewrite of the model's catalog file
             return std::async(std::launch::async, [this, modelData]() {
-                std::string modelDataFilename = modelData.name;
-                std::replace(modelDataFilename.begin(), modelDataFilename.end(), ' ', '-');
-                std::transform(modelDataFilename.begin(), modelDataFilename.end(), modelDataFilename.begin(), ::tolower);
-                std::ofstream file(m_basePath + "/" + modelDataFilename + ".json");
-                if (file.is_open())
-                {
-                    nlohmann::json j = modelData;
-                    file << j.dump(4);
-                    file.close();
-                }
+                m_catalog.update(modelData);
             });
         }
 
-        static size_t write_data(void* ptr, size_t size, size_t nmemb, void* userdata)
+        void setDownloadPriority(const ModelVariant& variant, int priority) override
         {
-            std::ofstream* stream = static_cast<std::ofstream*>(userdata);
-            size_t written = 0;
-            if (stream->is_open())
+            m_downloads.setPriority(variant.path, priority);
+        }
+
+        bool pauseDownload(const ModelVariant& variant) override
+        {
+            return m_downloads.pause(variant.path);
+        }
+
+        bool resumeDownload(const ModelVariant& variant) override
+        {
+            return m_downloads.resume(variant.path);
+        }
+
+        // Also deletes the partial download
+        bool cancelDownload(const ModelVariant& variant) override
+        {
+            return m_downloads.cancel(variant.path);
+        }
+
+        std::optional<DownloadState> getDownloadState(const ModelVariant& variant) const override
+        {
+            return m_downloads.getState(variant.path);
+        }
+
+        // Number of variants downloading at once; further ones wait in the queue
+        void setMaxConcurrentDownloads(int downloads)
+        {
+            m_downloads.setMaxActive(downloads);
+        }
+
+        // Number of parallel connections for large downloads; 1 disables segmenting
+        void setMaxConnections(int connections)
+        {
+            m_downloads.setMaxConnections(connections);
+        }
+
+        // Keeps downloaded data out of the page cache (O_DIRECT) where the filesystem allows
+        void setDirectIO(bool enabled)
+        {
+            m_downloads.setDirectIO(enabled);
+        }
+
+    private:
+        // Verifies the finished .part file against the expected size and digest and moves it into place
+        static bool finishDownload(const std::string& path, uint64_t size, const std::string& sha256,
+            const DownloadResult& result)
+        {
+            const std::string partPath = getPartPath(path);
+            const uint64_t expectedSize = size != 0 ? size : result.publishedSize;
+            const std::string& expectedSha256 = !sha256.empty() ? sha256 : result.publishedSha256;
+
+            // The digest was computed while downloading, so verifying costs no extra read
+            bool sizeMatches = expectedSize == 0 || result.size == expectedSize;
+            bool digestMatches = expectedSha256.empty() || result.sha256 == expectedSha256;
+            if (!sizeMatches || !digestMatches)
             {
-                stream->write(static_cast<const char*>(ptr), size * nmemb);
-                written = size * nmemb;
+                quarantineFile(partPath);
+                removePartialDownload(partPath);
+                return false;
             }
-            return written;
+
+            // Atomic replace, so the model path is either absent or complete
+            std::error_code ec;
+            std::filesystem::rename(partPath, path, ec);
+            if (ec)
+                return false;
+            removePartialDownload(partPath);
+
+            writeVerifiedMarker(path, result.sha256);
+            return true;
         }
 
-        static int progress_callback(void* ptr, curl_off_t total, curl_off_t now, curl_off_t, curl_off_t)
+        // Moves a file that failed verification out of the way so it is never loaded
+        static void quarantineFile(const std::string& path)
         {
-            ModelVariant* variant = static_cast<ModelVariant*>(ptr);
-            if (total > 0)
+            std::error_code ec;
+            std::filesystem::rename(path, path + ".quarantine", ec);
+            if (ec)
             {
-                variant->downloadProgress = static_cast<double>(now) / static_cast<double>(total) * 100.0;
+                std::filesystem::remove(path, ec);
             }
-            return 0;
+            std::filesystem::remove(getVerifiedMarkerPath(path), ec);
         }
 
-    private:
         std::string m_basePath;
+        ModelCatalogIndex m_catalog;
+
+        mutable std::mutex m_catalogErrorsMutex;
+        std::vector<CatalogError> m_catalogErrors;
+
+        // Last, so its thread stops before anything its callbacks use is destroyed
+        DownloadService m_downloads;
     };
-} // namespace Model
\ No newline at end of file
+} // namespace Model
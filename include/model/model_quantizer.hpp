@@ -0,0 +1,366 @@
+#pragma once
+
+#include "gguf_reader.hpp"
+#include "gguf_writer.hpp"
+#include "ggml_quants.hpp"
+#include "download_file.hpp"
+#include "crypto/crypto.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+
+namespace Model
+{
+    enum class QuantizationType
+    {
+        Q8_0,
+        Q4_K_M
+    };
+
+    inline const char* quantizationTypeName(QuantizationType type)
+    {
+        return type == QuantizationType::Q8_0 ? "Q8_0" : "Q4_K_M";
+    }
+
+    struct QuantizationResult
+    {
+        std::string sha256;
+        uint64_t size = 0;
+    };
+
+    /**
+     * @brief Converts an f16/bf16/f32 GGUF model into a Q8_0 or Q4_K_M GGUF file
+     *
+     * Tensor types follow llama.cpp's choices for the same file type: Q4_K_M keeps
+     * `output.weight` and, in about a third of the layers, `attn_v` and `ffn_down` at
+     * Q6_K, and uses Q4_K everywhere else. Norms and other 1-D tensors stay as they are.
+     *
+     * The output layout is computed up front, so the work is split into chunks of at
+     * most CHUNK_BYTES of source rows that any thread can quantize and write at their
+     * final offset. Each thread only holds one chunk, which bounds memory at roughly
+     * threads x 2 x CHUNK_BYTES no matter how large the model is; the source is read
+     * through the mapping. The file is written to `<output>.part` and renamed once
+     * complete.
+     */
+    class ModelQuantizer
+    {
+    public:
+        static constexpr size_t CHUNK_BYTES = 4 * 1024 * 1024;
+
+        ModelQuantizer() = default;
+
+        ModelQuantizer(const ModelQuantizer&) = delete;
+        ModelQuantizer& operator=(const ModelQuantizer&) = delete;
+
+        /**
+         * @brief Quantizes `sourcePath` into `outputPath`, blocking until done
+         *
+         * Returns std::nullopt if cancel() was called; throws std::runtime_error if the
+         * source cannot be read or the output cannot be written.
+         */
+        std::optional<QuantizationResult> run(const std::string& sourcePath, const std::string& outputPath,
+            QuantizationType type, unsigned int threadCount = 0)
+        {
+            m_doneBytes = 0;
+            m_totalBytes = 0;
+
+            GGUFFile source(sourcePath);
+            GGUFWriter writer(source.alignment());
+            writer.copyMetadata(source);
+            writer.setUInt32("general.file_type", type == QuantizationType::Q8_0 ? 7 : 15);
+            writer.setUInt32("general.quantization_version", 2);
+
+            const int layerCount = static_cast<int>(source.getArchUInt("block_count"));
+            const bool tiedOutput = source.findTensor("output.weight") == nullptr;
+            for (const auto& tensor : source.tensors())
+            {
+                writer.addTensor(tensor.name, chooseType(tensor, type, layerCount, tiedOutput), tensor.nDims, tensor.ne);
+                m_totalBytes += tensor.nbytes;
+            }
+
+            const std::vector<uint8_t> header = writer.serializeHeader();
+            const std::string partPath = outputPath + ".part";
+
+            DownloadFile output;
+            if (!output.open(partPath, true) ||
+                !output.preallocate(writer.fileSize(header.size())) ||
+                !output.writeAt(0, header.data(), header.size()))
+            {
+                removeFile(partPath);
+                throw std::runtime_error("Cannot write " + partPath);
+            }
+
+            std::vector<WorkItem> items = splitWork(source);
+            m_nextItem = 0;
+            m_stopping = false;
+            m_error.clear();
+
+            if (threadCount == 0)
+            {
+                threadCount = std::max(1u, std::thread::hardware_concurrency());
+            }
+            threadCount = static_cast<unsigned int>(std::min<size_t>(threadCount, std::max<size_t>(1, items.size())));
+
+            std::vector<std::thread> workers;
+            for (unsigned int i = 0; i < threadCount; ++i)
+            {
+                workers.emplace_back([&]() {
+                    try
+                    {
+                        quantizeChunks(source, writer, header.size(), items, output);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        fail(e.what());
+                    }
+                });
+            }
+            for (auto& worker : workers)
+            {
+                worker.join();
+            }
+
+            if (m_cancelled || !m_error.empty() || !output.sync())
+            {
+                output.close();
+                removeFile(partPath);
+                if (m_cancelled)
+                    return std::nullopt;
+                throw std::runtime_error(m_error.empty() ? "Cannot write " + partPath : m_error);
+            }
+
+            QuantizationResult result;
+            result.size = writer.fileSize(header.size());
+            result.sha256 = hashFile(output, result.size);
+            output.close();
+
+            std::error_code ec;
+            std::filesystem::rename(partPath, outputPath, ec);
+            if (ec)
+            {
+                removeFile(partPath);
+                throw std::runtime_error("Cannot rename " + partPath + ": " + ec.message());
+            }
+            return result;
+        }
+
+        // Makes run() stop within one chunk per thread and return std::nullopt; also applies
+        // to a run() that has not started yet, so use one instance per conversion
+        void cancel()
+        {
+            m_cancelled = true;
+        }
+
+        // 0.0 to 100.0
+        double getProgress() const
+        {
+            uint64_t total = m_totalBytes.load(std::memory_order_relaxed);
+            if (total == 0)
+                return 0.0;
+            return static_cast<double>(m_doneBytes.load(std::memory_order_relaxed)) / static_cast<double>(total) * 100.0;
+        }
+
+        // Output type of one tensor; public so callers can preview the mix
+        static GGMLType chooseType(const GGUFTensorView& tensor, QuantizationType type, int layerCount, bool tiedOutput)
+        {
+            const bool quantizable = tensor.type == GGMLType::F32 || tensor.type == GGMLType::F16 || tensor.type == GGMLType::BF16;
+            const std::string_view name = tensor.name;
+            const std::string_view suffix = "weight";
+            const bool isWeight = name.size() >= suffix.size() && name.substr(name.size() - suffix.size()) == suffix;
+            if (!quantizable || tensor.nDims < 2 || !isWeight)
+                return tensor.type;
+
+            GGMLType target = GGMLType::Q8_0;
+            if (type == QuantizationType::Q4_K_M)
+            {
+                target = GGMLType::Q4_K;
+                if (name == "output.weight" || (tiedOutput && name == "token_embd.weight"))
+                {
+                    target = GGMLType::Q6_K;
+                }
+                else if ((name.find("attn_v.weight") != std::string_view::npos ||
+                          name.find("ffn_down") != std::string_view::npos) &&
+                         useMoreBits(layerIndex(name), layerCount))
+                {
+                    target = GGMLType::Q6_K;
+                }
+            }
+
+            // K-quants need whole 256-element rows; fall back like llama.cpp does
+            if (ggmlRowSize(target, tensor.ne[0]) == 0)
+            {
+                target = GGMLType::Q8_0;
+            }
+            return ggmlRowSize(target, tensor.ne[0]) != 0 ? target : tensor.type;
+        }
+
+    private:
+        struct WorkItem
+        {
+            size_t tensor;
+            int64_t firstRow;
+            int64_t rowCount;
+        };
+
+        // llama.cpp's layer pattern for the extra bits: first and last eighth, then every third
+        static bool useMoreBits(int layer, int layerCount)
+        {
+            return layer < layerCount / 8 || layer >= 7 * layerCount / 8 || (layer - layerCount / 8) % 3 == 2;
+        }
+
+        // "blk.12.attn_v.weight" -> 12, or -1 for tensors outside a block
+        static int layerIndex(std::string_view name)
+        {
+            if (name.substr(0, 4) != "blk.")
+                return -1;
+            int layer = 0;
+            for (size_t i = 4; i < name.size() && name[i] >= '0' && name[i] <= '9'; ++i)
+            {
+                layer = layer * 10 + (name[i] - '0');
+            }
+            return layer;
+        }
+
+        static std::vector<WorkItem> splitWork(const GGUFFile& source)
+        {
+            std::vector<WorkItem> items;
+            const auto& tensors = source.tensors();
+            for (size_t t = 0; t < tensors.size(); ++t)
+            {
+                const int64_t rows = tensors[t].nRows();
+                const size_t rowSize = std::max<size_t>(1, tensors[t].rowSize());
+                const int64_t rowsPerItem = std::max<int64_t>(1, static_cast<int64_t>(CHUNK_BYTES / rowSize));
+                for (int64_t row = 0; row < rows; row += rowsPerItem)
+                {
+                    items.push_back({ t, row, std::min(rowsPerItem, rows - row) });
+                }
+            }
+            return items;
+        }
+
+        void quantizeChunks(const GGUFFile& source, const GGUFWriter& writer, size_t dataStart,
+            const std::vector<WorkItem>& items, DownloadFile& output)
+        {
+            std::vector<float> row;
+            std::vector<uint8_t> buffer;
+
+            while (!m_cancelled && !m_stopping)
+            {
+                size_t index = m_nextItem.fetch_add(1);
+                if (index >= items.size())
+                    return;
+
+                const WorkItem& item = items[index];
+                const GGUFTensorView& in = source.tensors()[item.tensor];
+                const GGUFWriter::TensorInfo& out = writer.tensors()[item.tensor];
+                const size_t inRowSize = in.rowSize();
+                const size_t outRowSize = ggmlRowSize(out.type, out.ne[0]);
+                const uint8_t* src = static_cast<const uint8_t*>(in.data) + item.firstRow * inRowSize;
+                const uint64_t offset = dataStart + out.offset + static_cast<uint64_t>(item.firstRow) * outRowSize;
+                const size_t inBytes = static_cast<size_t>(item.rowCount) * inRowSize;
+
+                bool ok;
+                if (out.type == in.type)
+                {
+                    ok = output.writeAt(offset, src, inBytes);
+                }
+                else
+                {
+                    row.resize(static_cast<size_t>(in.ne[0]));
+                    buffer.resize(static_cast<size_t>(item.rowCount) * outRowSize);
+                    for (int64_t r = 0; r < item.rowCount; ++r)
+                    {
+                        toFloat(in.type, src + r * inRowSize, row.data(), in.ne[0]);
+                        quantizeRow(out.type, row.data(), buffer.data() + r * outRowSize, in.ne[0]);
+                    }
+                    ok = output.writeAt(offset, buffer.data(), buffer.size());
+                }
+
+                if (!ok)
+                {
+                    fail("Failed to write tensor " + out.name);
+                    return;
+                }
+                m_doneBytes += inBytes;
+            }
+        }
+
+        // Stops the other workers; run() reports the first error
+        void fail(const std::string& error)
+        {
+            std::lock_guard<std::mutex> lock(m_errorMutex);
+            if (m_error.empty())
+            {
+                m_error = error;
+            }
+            m_stopping = true;
+        }
+
+        static void toFloat(GGMLType type, const uint8_t* src, float* dst, int64_t n)
+        {
+            if (type == GGMLType::F32)
+            {
+                std::memcpy(dst, src, static_cast<size_t>(n) * sizeof(float));
+                return;
+            }
+
+            for (int64_t i = 0; i < n; ++i)
+            {
+                uint16_t h;
+                std::memcpy(&h, src + i * 2, sizeof(h));
+                dst[i] = type == GGMLType::F16 ? fp16ToFp32(h) : bf16ToFp32(h);
+            }
+        }
+
+        static void quantizeRow(GGMLType type, const float* src, uint8_t* dst, int64_t n)
+        {
+            switch (type)
+            {
+            case GGMLType::Q8_0: quantizeRowQ8_0(src, reinterpret_cast<BlockQ8_0*>(dst), n); break;
+            case GGMLType::Q4_K: quantizeRowQ4_K(src, reinterpret_cast<BlockQ4_K*>(dst), n); break;
+            case GGMLType::Q6_K: quantizeRowQ6_K(src, reinterpret_cast<BlockQ6_K*>(dst), n); break;
+            default:
+                throw std::runtime_error(std::string("Cannot quantize to ") + ggmlTypeName(type));
+            }
+        }
+
+        static std::string hashFile(const DownloadFile& file, uint64_t size)
+        {
+            Crypto::Sha256 hash;
+            std::vector<char> buffer(CHUNK_BYTES);
+            for (uint64_t offset = 0; offset < size;)
+            {
+                size_t chunk = static_cast<size_t>(std::min<uint64_t>(buffer.size(), size - offset));
+                if (!file.readAt(offset, buffer.data(), chunk))
+                {
+                    throw std::runtime_error("Cannot read back the quantized model");
+                }
+                hash.update(buffer.data(), chunk);
+                offset += chunk;
+            }
+            return hash.finalHex();
+        }
+
+        static void removeFile(const std::string& path)
+        {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+        }
+
+        std::atomic<bool> m_cancelled{ false };
+        std::atomic<bool> m_stopping{ false }; // set by the first failing worker
+        std::atomic<uint64_t> m_doneBytes{ 0 };
+        std::atomic<uint64_t> m_totalBytes{ 0 };
+        std::atomic<size_t> m_nextItem{ 0 };
+        std::mutex m_errorMutex;
+        std::string m_error;
+    };
+} // namespace Model
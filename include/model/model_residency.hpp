@@ -0,0 +1,222 @@
+#pragma once
+
+#include "gguf_reader.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+
+namespace Model
+{
+    enum class ResidencyState
+    {
+        RESIDENT,
+        EVICTED
+    };
+
+    struct ModelResidencyInfo
+    {
+        std::string path;
+        ResidencyState state;
+        size_t bytes;     // size of the tensor data that is (or was) mapped
+        int lastSelected; // same clock as ModelVariant::lastSelected
+        bool pinned;
+    };
+
+    /**
+     * @brief Keeps several models mapped at once within a RAM budget
+     *
+     * Models stay mapped after the user switches away so that switching back is
+     * instant. When mapping another model would exceed the budget, unpinned models are
+     * evicted in least-recently-selected order. The model being acquired is pinned, so
+     * a model larger than the whole budget is still loaded on its own rather than
+     * failing.
+     */
+    class ModelResidencyManager
+    {
+    public:
+        explicit ModelResidencyManager(size_t budgetBytes = defaultBudget())
+            : m_budgetBytes(budgetBytes) {}
+
+        // Half of physical memory, leaving room for the KV cache, UI and other processes
+        static size_t defaultBudget()
+        {
+#ifdef _WIN32
+            MEMORYSTATUSEX status;
+            status.dwLength = sizeof(status);
+            if (GlobalMemoryStatusEx(&status))
+            {
+                return static_cast<size_t>(status.ullTotalPhys / 2);
+            }
+#else
+            long pages = sysconf(_SC_PHYS_PAGES);
+            long pageSize = sysconf(_SC_PAGESIZE);
+            if (pages > 0 && pageSize > 0)
+            {
+                return static_cast<size_t>(pages) * static_cast<size_t>(pageSize) / 2;
+            }
+#endif
+            return static_cast<size_t>(4) * 1024 * 1024 * 1024;
+        }
+
+        /**
+         * @brief Returns the mapped model at `path`, mapping it if needed
+         *
+         * The returned model becomes the only pinned one. Throws std::runtime_error if
+         * the file cannot be mapped.
+         */
+        std::shared_ptr<const GGUFFile> acquire(const std::string& path, int lastSelected)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            for (auto& [entryPath, entry] : m_entries)
+            {
+                entry.pinned = false;
+            }
+
+            Entry& entry = m_entries[path];
+            entry.lastSelected = lastSelected;
+            entry.pinned = true;
+
+            if (!entry.model)
+            {
+                std::shared_ptr<const GGUFFile> model;
+                try
+                {
+                    model = std::make_shared<const GGUFFile>(path);
+                }
+                catch (...)
+                {
+                    m_entries.erase(path);
+                    throw;
+                }
+                entry.bytes = model->tensorDataSize();
+
+                // Make room before the new model's pages start faulting in
+                evictLocked(entry.bytes);
+                entry.model = std::move(model);
+            }
+
+            return entry.model;
+        }
+
+        // Returns the model if it is still resident, without changing LRU order
+        std::shared_ptr<const GGUFFile> find(const std::string& path) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_entries.find(path);
+            return it != m_entries.end() ? it->second.model : nullptr;
+        }
+
+        void evict(const std::string& path)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_entries.find(path);
+            if (it != m_entries.end())
+            {
+                it->second.model.reset();
+                it->second.pinned = false;
+            }
+        }
+
+        void setBudget(size_t budgetBytes)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_budgetBytes = budgetBytes;
+            evictLocked(0);
+        }
+
+        size_t getBudget() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_budgetBytes;
+        }
+
+        size_t getResidentBytes() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return residentBytesLocked();
+        }
+
+        std::vector<ModelResidencyInfo> getResidency() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<ModelResidencyInfo> info;
+            info.reserve(m_entries.size());
+            for (const auto& [path, entry] : m_entries)
+            {
+                info.push_back({
+                    path,
+                    entry.model ? ResidencyState::RESIDENT : ResidencyState::EVICTED,
+                    entry.bytes,
+                    entry.lastSelected,
+                    entry.pinned });
+            }
+
+            // Most recently selected first
+            std::sort(info.begin(), info.end(),
+                [](const ModelResidencyInfo& a, const ModelResidencyInfo& b)
+                { return a.lastSelected > b.lastSelected; });
+            return info;
+        }
+
+    private:
+        struct Entry
+        {
+            std::shared_ptr<const GGUFFile> model;
+            size_t bytes = 0;
+            int lastSelected = 0;
+            bool pinned = false;
+        };
+
+        size_t residentBytesLocked() const
+        {
+            size_t total = 0;
+            for (const auto& [path, entry] : m_entries)
+            {
+                if (entry.model)
+                    total += entry.bytes;
+            }
+            return total;
+        }
+
+        // Evicts least recently selected unpinned models until `incomingBytes` fits
+        void evictLocked(size_t incomingBytes)
+        {
+            size_t resident = residentBytesLocked();
+            while (resident + incomingBytes > m_budgetBytes)
+            {
+                Entry* victim = nullptr;
+                for (auto& [path, entry] : m_entries)
+                {
+                    if (entry.model && !entry.pinned &&
+                        (!victim || entry.lastSelected < victim->lastSelected))
+                    {
+                        victim = &entry;
+                    }
+                }
+
+                if (!victim)
+                    break;
+
+                // Unmapping lets the OS reclaim the pages; a running inference still
+                // holding the shared_ptr keeps its mapping alive until it finishes
+                victim->model.reset();
+                resident -= victim->bytes;
+            }
+        }
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, Entry> m_entries;
+        size_t m_budgetBytes;
+    };
+} // namespace Model
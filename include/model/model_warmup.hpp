@@ -0,0 +1,177 @@
+#pragma once
+
+#include "gguf_reader.hpp"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+namespace Model
+{
+    /**
+     * @brief Streams a mapped model's weights into the page cache in the background
+     *
+     * Without this the first generation after selecting a model pays a page fault for
+     * every weight page. The whole tensor data range is first hinted to the kernel
+     * (madvise(WILLNEED)/readahead, PrefetchVirtualMemory on Windows), then several
+     * threads touch one byte per page in parallel to force the reads. Starting a new
+     * warm-up or calling cancel() stops the current one within one chunk.
+     */
+    class ModelWarmup
+    {
+    public:
+        static constexpr size_t CHUNK_SIZE = 4 * 1024 * 1024;
+        static constexpr size_t PAGE_STRIDE = 4096;
+
+        ModelWarmup() = default;
+
+        ~ModelWarmup()
+        {
+            cancel();
+        }
+
+        ModelWarmup(const ModelWarmup&) = delete;
+        ModelWarmup& operator=(const ModelWarmup&) = delete;
+
+        void start(std::shared_ptr<const GGUFFile> model, unsigned int threadCount = 0)
+        {
+            cancel();
+
+            m_model = std::move(model);
+            if (!m_model || m_model->tensorDataSize() == 0)
+            {
+                m_totalBytes = 0;
+                m_doneBytes = 0;
+                return;
+            }
+
+            if (threadCount == 0)
+            {
+                threadCount = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+            }
+
+            m_cancelled = false;
+            m_nextChunk = 0;
+            m_doneBytes = 0;
+            m_totalBytes = m_model->tensorDataSize();
+            m_activeWorkers = threadCount;
+
+            adviseWillNeed();
+
+            m_workers.reserve(threadCount);
+            for (unsigned int i = 0; i < threadCount; ++i)
+            {
+                m_workers.emplace_back([this]() { touchPages(); });
+            }
+        }
+
+        // Stops the running warm-up; pages already read stay in the page cache
+        void cancel()
+        {
+            m_cancelled = true;
+            for (auto& worker : m_workers)
+            {
+                if (worker.joinable())
+                    worker.join();
+            }
+            m_workers.clear();
+            m_model.reset();
+            m_totalBytes = 0;
+            m_doneBytes = 0;
+        }
+
+        bool isRunning() const
+        {
+            return m_activeWorkers.load(std::memory_order_acquire) > 0;
+        }
+
+        bool isComplete() const
+        {
+            size_t total = m_totalBytes.load(std::memory_order_relaxed);
+            return total > 0 && m_doneBytes.load(std::memory_order_acquire) >= total;
+        }
+
+        // 0.0 to 100.0, matching ModelVariant::downloadProgress
+        double getProgress() const
+        {
+            size_t total = m_totalBytes.load(std::memory_order_relaxed);
+            if (total == 0)
+                return 0.0;
+            return static_cast<double>(m_doneBytes.load(std::memory_order_relaxed)) / static_cast<double>(total) * 100.0;
+        }
+
+    private:
+        const uint8_t* dataBegin() const
+        {
+            return m_model->mapping().data() + m_model->dataOffset();
+        }
+
+        void adviseWillNeed()
+        {
+            const uint8_t* begin = dataBegin();
+#ifdef _WIN32
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+            WIN32_MEMORY_RANGE_ENTRY range;
+            range.VirtualAddress = const_cast<uint8_t*>(begin);
+            range.NumberOfBytes = m_totalBytes;
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+            (void)begin;
+#endif
+#else
+            // madvise needs a page aligned start address
+            const long pageSize = sysconf(_SC_PAGESIZE);
+            const uintptr_t alignedBegin = reinterpret_cast<uintptr_t>(begin) & ~static_cast<uintptr_t>(pageSize - 1);
+            const size_t length = m_totalBytes + (reinterpret_cast<uintptr_t>(begin) - alignedBegin);
+            madvise(reinterpret_cast<void*>(alignedBegin), length, MADV_WILLNEED);
+#ifdef POSIX_FADV_WILLNEED
+            posix_fadvise(m_model->mapping().fd(), static_cast<off_t>(m_model->dataOffset()),
+                static_cast<off_t>(m_totalBytes), POSIX_FADV_WILLNEED);
+#endif
+#endif
+        }
+
+        void touchPages()
+        {
+            const uint8_t* begin = dataBegin();
+            const size_t total = m_totalBytes;
+            const size_t chunkCount = (total + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            uint8_t sink = 0;
+
+            while (!m_cancelled.load(std::memory_order_relaxed))
+            {
+                size_t chunk = m_nextChunk.fetch_add(1, std::memory_order_relaxed);
+                if (chunk >= chunkCount)
+                    break;
+
+                size_t start = chunk * CHUNK_SIZE;
+                size_t end = std::min(start + CHUNK_SIZE, total);
+                for (size_t offset = start; offset < end; offset += PAGE_STRIDE)
+                {
+                    sink ^= *static_cast<const volatile uint8_t*>(begin + offset);
+                }
+
+                m_doneBytes.fetch_add(end - start, std::memory_order_release);
+            }
+
+            m_sink.fetch_xor(sink, std::memory_order_relaxed);
+            m_activeWorkers.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        std::shared_ptr<const GGUFFile> m_model;
+        std::vector<std::thread> m_workers;
+        std::atomic<bool> m_cancelled{ false };
+        std::atomic<size_t> m_nextChunk{ 0 };
+        std::atomic<size_t> m_doneBytes{ 0 };
+        std::atomic<unsigned int> m_activeWorkers{ 0 };
+        std::atomic<uint8_t> m_sink{ 0 };
+        std::atomic<size_t> m_totalBytes{ 0 };
+    };
+} // namespace Model
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <json.hpp>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <optional>
+#include <filesystem>
+#include <cstdint>
+#include <cctype>
+
+namespace Model
+{
+    // A byte range [start, end) of a segmented download and how much of it is on disk
+    struct DownloadSegment
+    {
+        uint64_t start = 0;
+        uint64_t end = 0;
+        uint64_t done = 0;
+
+        uint64_t length() const { return end - start; }
+        bool isComplete() const { return done >= length(); }
+    };
+
+    /**
+     * @brief Resume state persisted next to a `.part` file
+     *
+     * `segments` is empty for a single-stream download, whose progress is simply the
+     * size of the .part file. A segmented download preallocates the whole file, so it
+     * must record per-segment progress instead.
+     */
+    struct PartialDownloadInfo
+    {
+        std::string url;
+        std::string etag;
+        std::string lastModified;
+        uint64_t totalSize = 0;
+        std::vector<DownloadSegment> segments;
+    };
+
+    inline std::string getPartPath(const std::string& path)
+    {
+        return path + ".part";
+    }
+
+    // Not ".json": everything with that extension in the models folder is a catalog entry
+    inline std::string getPartMetaPath(const std::string& partPath)
+    {
+        return partPath + ".meta";
+    }
+
+    inline std::optional<PartialDownloadInfo> loadPartialDownloadInfo(const std::string& partPath)
+    {
+        std::ifstream file(getPartMetaPath(partPath));
+        if (!file.is_open())
+            return std::nullopt;
+
+        try
+        {
+            nlohmann::json j;
+            file >> j;
+            PartialDownloadInfo info;
+            j.at("url").get_to(info.url);
+            j.at("etag").get_to(info.etag);
+            j.at("lastModified").get_to(info.lastModified);
+            j.at("totalSize").get_to(info.totalSize);
+            if (j.contains("segments"))
+            {
+                for (const auto& segment : j.at("segments"))
+                {
+                    info.segments.push_back({
+                        segment.at(0).get<uint64_t>(),
+                        segment.at(1).get<uint64_t>(),
+                        segment.at(2).get<uint64_t>() });
+                }
+            }
+            return info;
+        }
+        catch (const std::exception&)
+        {
+            return std::nullopt;
+        }
+    }
+
+    inline bool savePartialDownloadInfo(const std::string& partPath, const PartialDownloadInfo& info)
+    {
+        nlohmann::json j{
+            {"url", info.url},
+            {"etag", info.etag},
+            {"lastModified", info.lastModified},
+            {"totalSize", info.totalSize} };
+
+        if (!info.segments.empty())
+        {
+            nlohmann::json segments = nlohmann::json::array();
+            for (const auto& segment : info.segments)
+            {
+                segments.push_back({ segment.start, segment.end, segment.done });
+            }
+            j["segments"] = std::move(segments);
+        }
+
+        // Replace atomically; the record is rewritten while the download is running
+        std::string metaPath = getPartMetaPath(partPath);
+        std::string tmpPath = metaPath + ".tmp";
+        {
+            std::ofstream file(tmpPath);
+            if (!file.is_open())
+                return false;
+            file << j.dump(4);
+            if (!file)
+                return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmpPath, metaPath, ec);
+        return !ec;
+    }
+
+    // Value of header `name` (lower case) if `line` is that header, matched case-insensitively
+    inline std::optional<std::string> httpHeaderValue(const std::string& line, const std::string& name)
+    {
+        if (line.size() <= name.size() || line[name.size()] != ':')
+            return std::nullopt;
+
+        for (size_t i = 0; i < name.size(); ++i)
+        {
+            if (std::tolower(static_cast<unsigned char>(line[i])) != name[i])
+                return std::nullopt;
+        }
+
+        size_t begin = line.find_first_not_of(" \t", name.size() + 1);
+        size_t end = line.find_last_not_of(" \t\r\n");
+        if (begin == std::string::npos || end < begin)
+            return std::string();
+        return line.substr(begin, end - begin + 1);
+    }
+
+    /**
+     * @brief SHA-256 in an X-Linked-Etag header, or an empty string
+     *
+     * Hugging Face sends this header, the LFS object's SHA-256, on the redirect to the
+     * storage host. Any value that is not a plain 64-digit hex digest is ignored.
+     */
+    inline std::string sha256FromLinkedETag(std::string value)
+    {
+        if (value.rfind("W/", 0) == 0)
+        {
+            value.erase(0, 2);
+        }
+        if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        {
+            value = value.substr(1, value.size() - 2);
+        }
+
+        if (value.size() != 64)
+            return std::string();
+        for (char& c : value)
+        {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            if (!std::isxdigit(static_cast<unsigned char>(c)))
+                return std::string();
+        }
+        return value;
+    }
+
+    inline void removePartialDownload(const std::string& partPath)
+    {
+        std::error_code ec;
+        std::filesystem::remove(partPath, ec);
+        std::filesystem::remove(getPartMetaPath(partPath), ec);
+    }
+} // namespace Model
@@ -5,6 +5,7 @@
 #include "ui/widgets.hpp"
 #include "chat/chat_manager.hpp"
 #include "model/model_manager.hpp"
+#include "model/preset_manager.hpp"
 
 inline void pushIDAndColors(const Chat::Message msg, int index)
 {
@@ -235,6 +236,24 @@ inline void renderRenameChatDialog(bool &showRenameChatDialog)
     ModalWindow::render(modalConfig);
 }
 
+// One line of error text above a model card's button; the full message shows on hover
+inline void renderModelCardError(const std::string &error, float width, float lineHeight)
+{
+    ImGui::SetCursorPosY(ImGui::GetCursorPosY() - lineHeight - 6);
+
+    ImVec2 start = ImGui::GetCursorScreenPos();
+    ImGui::PushClipRect(start, ImVec2(start.x + width, start.y + lineHeight), true);
+    ImGui::PushStyleColor(ImGuiCol_Text, RGBAToImVec4(224, 108, 117, 255));
+    ImGui::TextUnformatted(error.c_str());
+    ImGui::PopStyleColor();
+    ImGui::PopClipRect();
+
+    if (ImGui::IsItemHovered())
+    {
+        ImGui::SetTooltip("%s", error.c_str());
+    }
+}
+
 inline void renderModelManager(bool &openModal)
 {
     ImVec2 windowSize = ImGui::GetWindowSize();
@@ -325,59 +344,71 @@ inline void renderModelManager(bool &openModal)
                 // Get the height of the model name label
                 float modelNameLabelHeight = ImGui::GetTextLineHeightWithSpacing();
 
+                // Render capabilities from the cached GGUF metadata, if the variant is on disk
+                // nullptr for a local type that has not been converted yet
+                const Model::ModelVariant *cardVariant = models[i].getVariant(modelVariants[i]);
+                float modelDetailsLabelHeight = 0.0f;
+                if (cardVariant && cardVariant->metadata.has_value())
+                {
+                    const Model::ModelMetadata &metadata = cardVariant->metadata.value();
+                    char details[128];
+                    std::snprintf(details, sizeof(details), "%s | %.1fB params | %lluk ctx | ~%.1f GB",
+                                  metadata.quantization.c_str(),
+                                  static_cast<double>(metadata.parameterCount) / 1e9,
+                                  static_cast<unsigned long long>(metadata.contextLength / 1024),
+                                  static_cast<double>(metadata.estimateMemoryBytes(4096)) / (1024.0 * 1024.0 * 1024.0));
+
+                    LabelConfig modelDetailsLabel;
+                    modelDetailsLabel.id = "##modelDetails" + std::to_string(i);
+                    modelDetailsLabel.label = details;
+                    modelDetailsLabel.size = ImVec2(0, 0);
+                    modelDetailsLabel.fontType = FontsManager::REGULAR;
+                    modelDetailsLabel.fontSize = FontsManager::SM;
+                    modelDetailsLabel.alignment = Alignment::LEFT;
+                    Label::render(modelDetailsLabel);
+
+                    modelDetailsLabelHeight = ImGui::GetTextLineHeightWithSpacing();
+                }
+
                 // Calculate the total height of the labels
-                float totalLabelHeight = authorLabelHeight + modelNameLabelHeight;
+                float totalLabelHeight = authorLabelHeight + modelNameLabelHeight + modelDetailsLabelHeight;
 
                 // add left padding
                 ImGui::SetCursorPosX(ImGui::GetCursorPosX() + 4.0f);
 
-                // TODO: Check button rect size is bigger when no icon is present
-                //       make sure to adjust the size of the button accordingly                
-                ButtonConfig use4bitButton;
-                use4bitButton.id = "##use4bit" + std::to_string(i);
-                if (modelVariants[i] == "4-bit Quantized")
+                // Variant picker; lists locally quantized types next to the catalog's
+                std::vector<std::string> variantTypes = Model::ModelManager::getInstance().getVariantTypes(i);
+                std::vector<const char *> variantNames;
+                int selectedVariant = -1;
+                for (size_t v = 0; v < variantTypes.size(); v++)
                 {
-                    use4bitButton.icon = ICON_CI_CHECK;
+                    variantNames.push_back(variantTypes[v].c_str());
+                    if (variantTypes[v] == modelVariants[i])
+                    {
+                        selectedVariant = static_cast<int>(v);
+                    }
                 }
-                else
+                if (selectedVariant < 0)
                 {
-                    // TODO's workarounds for the button size issue
-                    use4bitButton.icon = ICON_CI_CLOSE;
-                    use4bitButton.textColor = RGBAToImVec4(34, 34, 34, 255);
+                    // e.g. a local type whose source was deleted since it was picked
+                    selectedVariant = 0;
+                    modelVariants[i] = variantTypes[0];
+                    cardVariant = models[i].getVariant(modelVariants[i]);
                 }
-                use4bitButton.fontSize = FontsManager::SM;
-                use4bitButton.size = ImVec2(24, 0);
-                use4bitButton.backgroundColor = RGBAToImVec4(34, 34, 34, 255);
-                use4bitButton.onClick = [i, models]()
+                if (ComboBox::render(("##variant" + std::to_string(i)).c_str(),
+                                     variantNames.data(),
+                                     static_cast<int>(variantNames.size()),
+                                     selectedVariant,
+                                     cardWidth - 22,
+                                     24.0F))
                 {
-                    if (modelVariants[i] == "4-bit Quantized")
-                    {
-                        modelVariants[i] = "Full Precision";
-                    }
-                    else
-                    {
-                        modelVariants[i] = "4-bit Quantized";
-                    }
-                };
-                Button::render(use4bitButton);
+                    modelVariants[i] = variantTypes[selectedVariant];
+                    cardVariant = models[i].getVariant(modelVariants[i]);
+                }
 
-                // Get the height of the quantization checkbox button
+                // Get the height of the variant picker
                 float quantizationHeight = ImGui::GetTextLineHeightWithSpacing();
 
-                ImGui::SameLine(0.0f, 4.0f);
-
-                // Render labels
-                LabelConfig quantizationLabel;
-                quantizationLabel.id = "##quantization" + std::to_string(i);
-                quantizationLabel.label = "Use 4-bit quantization";
-                quantizationLabel.size = ImVec2(0, 0);
-                quantizationLabel.fontType = FontsManager::REGULAR;
-                quantizationLabel.fontSize = FontsManager::SM;
-                quantizationLabel.alignment = Alignment::LEFT;
-                float labelOffsetY = (use4bitButton.size.y - ImGui::GetTextLineHeight()) / 4.0f + 2.0f;
-                ImGui::SetCursorPosY(ImGui::GetCursorPosY() + labelOffsetY);
-                Label::render(quantizationLabel);
-
                 // Render select button at the bottom of the card
                 ImGui::SetCursorPosY(ImGui::GetCursorPosY() + (cardHeight - totalLabelHeight - quantizationHeight * 3 - 10));
 
@@ -388,7 +419,64 @@ inline void renderModelManager(bool &openModal)
                 ButtonConfig selectButton;
                 selectButton.size = ImVec2(cardWidth - 18, 0);
 
-                if (!isDownloaded)
+                // A downloaded full precision variant is converted here instead of downloading
+                // a quantized one, unless that download was already started
+                std::optional<Model::QuantizationType> quantization = Model::ModelManager::quantizationTypeFor(modelVariants[i]);
+                Model::DownloadProgressSnapshot progress = cardVariant ? cardVariant->progress->snapshot() : Model::DownloadProgressSnapshot();
+                bool canQuantize = quantization && models[i].fullPrecision.isDownloaded && !progress.state;
+
+                if (!isDownloaded && Model::ModelManager::getInstance().isVerifying(i, modelVariants[i]))
+                {
+                    // A file from before verified markers existed is being hashed once
+                    selectButton.id = "##verifying" + std::to_string(i);
+                    selectButton.label = "Verifying";
+                    selectButton.icon = ICON_CI_SYNC;
+                    selectButton.backgroundColor = RGBAToImVec4(34, 34, 34, 255);
+                    selectButton.state = ButtonState::DISABLED;
+                }
+                else if (!isDownloaded && canQuantize)
+                {
+                    selectButton.id = "##quantize" + std::to_string(i);
+                    selectButton.label = "Quantize";
+                    selectButton.backgroundColor = RGBAToImVec4(26, 95, 180, 255);
+                    selectButton.hoverColor = RGBAToImVec4(53, 132, 228, 255);
+                    selectButton.activeColor = RGBAToImVec4(26, 95, 180, 255);
+                    selectButton.icon = ICON_CI_PACKAGE;
+                    selectButton.borderSize = 1.0F;
+
+                    Model::QuantizationType type = *quantization;
+                    selectButton.onClick = [i, type]()
+                    {
+                        Model::ModelManager::getInstance().quantizeModel(i, type);
+                    };
+
+                    if (Model::ModelManager::getInstance().isQuantizing(i, modelVariants[i]))
+                    {
+                        selectButton.label = "Quantizing";
+                        selectButton.state = ButtonState::DISABLED;
+
+                        ImGui::SetCursorPosY(ImGui::GetCursorPosY() - quantizationHeight - 6);
+                        ImGui::ProgressBar(
+                            static_cast<float>(Model::ModelManager::getInstance().getQuantizationProgress() / 100.0),
+                            ImVec2(cardWidth - 18, 0));
+                    }
+                    else
+                    {
+                        if (auto error = Model::ModelManager::getInstance().getVariantError(i, modelVariants[i]))
+                        {
+                            selectButton.label = "Retry";
+                            selectButton.icon = ICON_CI_REFRESH;
+                            renderModelCardError("Quantization failed: " + *error, cardWidth - 18, quantizationHeight);
+                        }
+
+                        // One conversion at a time
+                        if (Model::ModelManager::getInstance().isQuantizing())
+                        {
+                            selectButton.state = ButtonState::DISABLED;
+                        }
+                    }
+                }
+                else if (!isDownloaded && cardVariant)
                 {
                     selectButton.id = "##download" + std::to_string(i);
                     selectButton.label = "Download";
@@ -403,21 +491,48 @@ inline void renderModelManager(bool &openModal)
                         Model::ModelManager::getInstance().downloadModel(i, modelVariants[i]);
                     };
 
-                    if (Model::ModelManager::getInstance().getModelDownloadProgress(i, modelVariants[i]) > 0.0)
+                    // Read straight from the live progress record, without locking the model manager
+                    if (progress.state == Model::DownloadState::FAILED || progress.state == Model::DownloadState::CANCELLED)
                     {
-                        selectButton.label = "Downloading";
-                        selectButton.icon = ICON_CI_CLOUD_DOWNLOAD;
-                        selectButton.state = ButtonState::DISABLED;
+                        // No longer queued, so downloading again starts a new attempt; after a
+                        // failure it resumes from the .part file, after a cancel from scratch
+                        selectButton.label = "Retry";
+                        selectButton.icon = ICON_CI_REFRESH;
+                    }
+                    else if (progress.isInProgress())
+                    {
+                        if (progress.state == Model::DownloadState::PAUSED)
+                        {
+                            selectButton.label = "Resume";
+                            selectButton.icon = ICON_CI_DEBUG_CONTINUE;
+                            selectButton.onClick = [i]()
+                            {
+                                Model::ModelManager::getInstance().resumeDownload(i, modelVariants[i]);
+                            };
+                        }
+                        else
+                        {
+                            selectButton.label = progress.state == Model::DownloadState::QUEUED ? "Queued" : "Downloading";
+                            selectButton.state = ButtonState::DISABLED;
+                        }
 
                         ImGui::SetCursorPosY(ImGui::GetCursorPosY() - quantizationHeight - 6);
 
-                        // Add a progress bar
+                        // Add a progress bar with the smoothed rate and time left
+                        char overlay[64] = "";
+                        if (progress.smoothedBytesPerSecond > 0.0 && progress.etaSeconds >= 0.0)
+                        {
+                            int eta = static_cast<int>(progress.etaSeconds);
+                            std::snprintf(overlay, sizeof(overlay), "%.1f MB/s - %d:%02d left",
+                                          progress.smoothedBytesPerSecond / (1024.0 * 1024.0), eta / 60, eta % 60);
+                        }
                         ImGui::ProgressBar(
-                            Model::ModelManager::getInstance().getModelDownloadProgress(i, modelVariants[i]) / 100.0,
-                            ImVec2(cardWidth - 18, 0));
+                            static_cast<float>(progress.percent() / 100.0),
+                            ImVec2(cardWidth - 18, 0),
+                            overlay[0] != '\0' ? overlay : nullptr);
                     }
                 }
-                else
+                else if (isDownloaded)
                 {
                     selectButton.id = "##select" + std::to_string(i);
                     selectButton.label = isSelected ? "selected" : "select";
@@ -437,6 +552,15 @@ inline void renderModelManager(bool &openModal)
                             modelVariants[i]
                         );
                     };
+
+                    // The file is on disk but could not be opened; selecting it again retries
+                    if (auto error = Model::ModelManager::getInstance().getVariantError(i, modelVariants[i]))
+                    {
+                        selectButton.label = "Retry";
+                        selectButton.icon = ICON_CI_REFRESH;
+                        selectButton.state = ButtonState::NORMAL;
+                        renderModelCardError("Cannot load model: " + *error, cardWidth - 18, quantizationHeight);
+                    }
                 }
 
                 Button::render(selectButton);
@@ -488,6 +612,21 @@ inline void renderChatFeatureButtons(const float startX = 0, const float startY
 
     buttons.push_back(openModelManager);
 
+    // Stops the reply being generated; the part generated so far is kept
+    if (Chat::ChatManager::getInstance().isGenerating())
+    {
+        ButtonConfig stopGeneration;
+        stopGeneration.id = "##stopGenerationButton";
+        stopGeneration.label = "Stop";
+        stopGeneration.icon = ICON_CI_DEBUG_STOP;
+        stopGeneration.size = ImVec2(80, 0);
+        stopGeneration.alignment = Alignment::LEFT;
+        stopGeneration.onClick = []()
+        { Chat::ChatManager::getInstance().stopGeneration(); };
+
+        buttons.push_back(stopGeneration);
+    }
+
     // Render the button using renderGroup
     Button::renderGroup(buttons, startX, startY);
 
@@ -526,15 +665,15 @@ inline void renderInputField(const float inputHeight, const float inputWidth)
             chatManager.addMessageToCurrentChat(userMessage);
         }
 
-        // Handle assistant response
-        // TODO: Implement assistant response through callback
+        // Handle assistant response; it is streamed into the chat as it is generated
         {
-            Chat::Message assistantMessage;
-            assistantMessage.id = static_cast<int>(currentChat.value().messages.size()) + 2;
-            assistantMessage.role = "assistant";
-            assistantMessage.content = "Hello! I am an assistant. How can I help you today?";
+            Model::ModelPreset preset;
+            if (auto currentPreset = Model::PresetManager::getInstance().getCurrentPreset())
+            {
+                preset = currentPreset->get();
+            }
 
-            chatManager.addMessageToCurrentChat(assistantMessage);
+            chatManager.generateResponse(Model::ModelManager::getInstance().getLoadedModel(), preset);
         }
     };
 
@@ -547,7 +686,11 @@ inline void renderInputField(const float inputHeight, const float inputWidth)
     {
         inputConfig.placeholderText = "Type a message and press Enter to send (Ctrl+Enter or Shift+Enter for new line)";
         inputConfig.flags = ImGuiInputTextFlags_EnterReturnsTrue | ImGuiInputTextFlags_CtrlEnterForNewLine | ImGuiInputTextFlags_ShiftEnterForNewLine;
-        inputConfig.processInput = processInput;
+        // While a reply is generated Enter does not submit, so what is typed stays in the field
+        if (!Chat::ChatManager::getInstance().isGenerating())
+        {
+            inputConfig.processInput = processInput;
+        }
     }
 
     // Set background color and create child window